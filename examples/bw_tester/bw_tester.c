@@ -73,7 +73,7 @@ int main(int argc, char **argv)
   uint64_t num_writes, obj_nlb, strp_nobjs, strp_nbytes, wrt_nbytes, num_strp_objs;
   bool verify;
   struct fla_open_opts open_opts = {0};
-  struct xnvme_opts x_opts = xnvme_opts_default();
+  struct fla_io_profile io_profile = {.backend = "io_uring_cmd"};
 
   if (argc != 10) {
     printf("Usage:%s\n", USAGE);
@@ -95,8 +95,7 @@ int main(int argc, char **argv)
 
   open_opts.dev_uri = dev;
   open_opts.md_dev_uri = md_dev;
-  open_opts.opts = &x_opts;
-  open_opts.opts->async = "io_uring_cmd";
+  open_opts.io_profile = &io_profile;
   ret = fla_open(&open_opts, &fs);
   if (ret) {
     printf("Error on open\n");
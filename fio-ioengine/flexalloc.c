@@ -250,8 +250,9 @@ static void fio_flexalloc_cleanup(struct thread_data *td)
  * opened the FS use its FS handle instead of acquiring a new one. Otherwise
  * just call the library routine.
  *
- * FS open and pool creation are protected by a mutex even if they target
- * different devices.
+ * FS open and the lookup of a shared handle are protected by a mutex even if
+ * they target different devices. The handle itself is opened thread safe, so
+ * jobs sharing it need no further locking.
  */
 static int fio_flexalloc_open_direct(const char *dev_uri, const char *md_dev_uri,
     int thread_number, struct flexalloc **fs)
@@ -290,6 +291,8 @@ static int fio_flexalloc_open_direct(const char *dev_uri, const char *md_dev_uri
 
 	struct fla_open_opts open_opts = {0};
 	open_opts.dev_uri = dev_uri;
+	/* the handle is shared by all jobs on the device */
+	open_opts.flags = FLA_OPEN_THREAD_SAFE;
 	if(md_dev_uri)
 		open_opts.md_dev_uri = md_dev_uri;
 	return fla_open(&open_opts, fs);
@@ -10,6 +10,7 @@
 #ifndef __FLEXALLOC_H_
 #define __FLEXALLOC_H_
 #include <stdint.h>
+#include <pthread.h>
 #include <libxnvme.h>
 #include "flexalloc_shared.h"
 #include "flexalloc_freelist.h"
@@ -35,6 +36,8 @@ struct fla_slab_flist_cache
   struct flexalloc *_fs;
   /// Head of cache array, entry at offset n corresponds to slab with id n
   struct fla_slab_flist_cache_elem *_head;
+  /// Slabs whose cache entry may be dirty, one bit per slab id
+  uint64_t *_dirty;
 };
 
 
@@ -64,6 +67,8 @@ struct fla_geo
   struct fla_geo_pool_sgmt pool_sgmt;
   /// blocks needed for slab segment
   struct fla_geo_slab_sgmt slab_sgmt;
+  /// blocks of the metadata journal, 0 without a journal
+  uint32_t jnl_nlb;
 };
 
 struct fla_pools
@@ -78,6 +83,14 @@ struct fla_pools
   struct fla_pool_entry *entries;
   /// array of pool_entry functions in memeory
   struct fla_pool_entry_fnc *entrie_funcs;
+  /// array of pool slab and object counts in memory, nobjs is left unset
+  struct fla_pool_usage *usage;
+  /// array of pool occupancy bins in memory
+  struct fla_pool_bins *bins;
+  /// array of slab occupancy bin links in memory, indexed by slab ID
+  struct fla_slab_bin_link *slab_bins;
+  /// array of pool empty slab watermarks in memory
+  struct fla_pool_wmark *wmarks;
 
 };
 
@@ -109,6 +122,25 @@ struct fla_dp
   struct fla_dp_fncs fncs;
 };
 
+/// locks of a handle opened with FLA_OPEN_THREAD_SAFE
+///
+/// A pool lock covers the pool entry, its slab lists, the freelists of its
+/// slabs and its object cache. The fs lock covers the free slab list and the
+/// pool freelist and hash table. Pool locks are taken before the fs lock, and
+/// several pool locks in index order.
+struct fla_locks
+{
+  pthread_mutex_t fs;
+  /// lock-free object calls between the slab count and the freelist change
+  uint32_t nobjs_pending;
+  /// callers of fla_lock_all() waiting for nobjs_pending to drop to zero
+  uint32_t nquiesce;
+  /// number of pool locks
+  uint32_t npools;
+  /// one lock per pool entry
+  pthread_mutex_t pools[];
+};
+
 /// flexalloc handle
 struct flexalloc
 {
@@ -118,6 +150,8 @@ struct flexalloc
   ///
   /// NOTE: allocated as an IO buffer.
   void *fs_buffer;
+  /// logical blocks of fs_buffer changed since the last flush, one bit per block
+  uint64_t *md_dirty;
 
   struct fla_slab_flist_cache slab_cache;
 
@@ -131,6 +165,21 @@ struct flexalloc
 
   struct fla_fns fns;
 
+  /// asynchronous queues shared by all I/O paths of this handle
+  struct fla_xne_queue_pool *qpool;
+  /// queue for asynchronous object I/O, leased from qpool on first use
+  struct fla_xne_queue *io_queue;
+  /// size class pool for fla_buf_alloc and the internal I/O buffers
+  struct fla_bufpool *bufpool;
+  /// object ID cache of each pool, see flexalloc_objcache.h
+  struct fla_obj_cache **obj_caches;
+  /// NULL unless the handle was opened with FLA_OPEN_THREAD_SAFE
+  struct fla_locks *locks;
+  /// metadata journal, NULL unless formatted with one, see flexalloc_journal.h
+  struct fla_jnl *jnl;
+  /// background checkpointer and shadow of fs_buffer, see flexalloc_ckpt.h
+  struct fla_ckpt *ckpt;
+
   /// pointer for the application to associate additional data
   void *user_data;
 };
@@ -37,6 +37,15 @@ ntz(uint32_t x)
   return n - (x & 1);
 }
 
+uint32_t
+ntz64(uint64_t x)
+{
+  if ((uint32_t)x)
+    return ntz((uint32_t)x);
+
+  return 32u + ntz((uint32_t)(x >> 32));
+}
+
 uint32_t
 count_set_bits(uint32_t val)
 {
@@ -17,6 +17,16 @@
 uint32_t
 ntz(uint32_t x);
 
+/**
+ * Count number of trailing zero bits of a 8B/64b value.
+ *
+ * Examples:
+ * - ntz64(0) == 64
+ * - ntz64(1ull << 40) == 40
+ */
+uint32_t
+ntz64(uint64_t x);
+
 /**
  * Count number of set bits.
  *
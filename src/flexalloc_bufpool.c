@@ -0,0 +1,285 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flexalloc_bufpool.h"
+#include "flexalloc_util.h"
+#include "flexalloc_xnvme_env.h"
+
+#define FLA_BUFPOOL_CLASS_NBYTES(sclass) ((size_t)1 << (FLA_BUFPOOL_MIN_SHIFT + (sclass)))
+
+/*
+ * Free buffers held by the calling thread. The cache belongs to at most one
+ * pool at a time; it is only claimed by another pool once it is empty, so a
+ * thread alternating between pools takes the locked path for the second one.
+ * A pool terminated while other threads cache its buffers leaves their caches
+ * stale. Their contents point into freed chunks and are dropped unread once
+ * the pool is found gone.
+ */
+struct fla_bufpool_tcache
+{
+  uint64_t pool_id;
+  /// fla_bufpool_nterms when pool_id was last known to be live
+  uint64_t nterms;
+  uint32_t nbufs;
+  void *free[FLA_BUFPOOL_NCLASSES];
+  uint32_t nfree[FLA_BUFPOOL_NCLASSES];
+};
+
+static _Thread_local struct fla_bufpool_tcache fla_bufpool_tcache;
+static uint64_t fla_bufpool_last_id;
+
+// Pools not yet terminated, and the number of pools terminated so far
+static pthread_mutex_t fla_bufpool_live_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fla_bufpool *fla_bufpool_live;
+static uint64_t fla_bufpool_nterms;
+
+// Free buffers are linked through their first bytes
+static inline void *
+fla_bufpool_next(void *buf)
+{
+  return *(void **)buf;
+}
+
+static inline void
+fla_bufpool_push(void **head, void *buf)
+{
+  *(void **)buf = *head;
+  *head = buf;
+}
+
+static inline void *
+fla_bufpool_pop(void **head)
+{
+  void *buf = *head;
+  if (buf)
+    *head = fla_bufpool_next(buf);
+  return buf;
+}
+
+static int
+fla_bufpool_sclass(size_t nbytes)
+{
+  for (int sclass = 0; sclass < FLA_BUFPOOL_NCLASSES; ++sclass)
+  {
+    if (nbytes <= FLA_BUFPOOL_CLASS_NBYTES(sclass))
+      return sclass;
+  }
+
+  return -1;
+}
+
+static bool
+fla_bufpool_is_live(uint64_t pool_id)
+{
+  struct fla_bufpool *pool;
+
+  pthread_mutex_lock(&fla_bufpool_live_lock);
+  for (pool = fla_bufpool_live; pool && pool->id != pool_id; pool = pool->next)
+    ;
+  pthread_mutex_unlock(&fla_bufpool_live_lock);
+
+  return pool != NULL;
+}
+
+static struct fla_bufpool_tcache *
+fla_bufpool_tcache_get(struct fla_bufpool *pool)
+{
+  struct fla_bufpool_tcache *tcache = &fla_bufpool_tcache;
+  uint64_t nterms;
+
+  if (tcache->pool_id == pool->id)
+    return tcache;
+
+  // A non-empty cache of another pool is left alone while that pool is in use
+  if (tcache->nbufs)
+  {
+    nterms = __atomic_load_n(&fla_bufpool_nterms, __ATOMIC_ACQUIRE);
+    if (tcache->nterms == nterms)
+      return NULL;
+
+    if (fla_bufpool_is_live(tcache->pool_id))
+    {
+      tcache->nterms = nterms;
+      return NULL;
+    }
+  }
+
+  memset(tcache, 0, sizeof(*tcache));
+  tcache->pool_id = pool->id;
+  tcache->nterms = __atomic_load_n(&fla_bufpool_nterms, __ATOMIC_ACQUIRE);
+  return tcache;
+}
+
+/*
+ * Split a new chunk into buffers of sclass and put them on the shared free
+ * list. Called with the pool lock held.
+ */
+static int
+fla_bufpool_chunk_add(struct fla_bufpool *pool, uint32_t sclass)
+{
+  struct fla_bufpool_chunk *chunk;
+  size_t buf_nbytes = FLA_BUFPOOL_CLASS_NBYTES(sclass);
+
+  if (pool->nchunks == FLA_BUFPOOL_MAX_CHUNKS)
+    return -ENOMEM;
+
+  chunk = &pool->chunks[pool->nchunks];
+  chunk->base = fla_xne_alloc_buf(pool->dev, FLA_BUFPOOL_CHUNK_NBYTES);
+  if (FLA_ERR(!chunk->base, "fla_xne_alloc_buf()"))
+    return -ENOMEM;
+  chunk->sclass = sclass;
+
+  for (size_t off = FLA_BUFPOOL_CHUNK_NBYTES; off >= buf_nbytes; off -= buf_nbytes)
+    fla_bufpool_push(&pool->free[sclass], chunk->base + off - buf_nbytes);
+
+  // Lookups in fla_bufpool_free read the chunks without the lock
+  __atomic_store_n(&pool->nchunks, pool->nchunks + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static struct fla_bufpool_chunk const *
+fla_bufpool_chunk_find(struct fla_bufpool *pool, void const *buf)
+{
+  uint32_t nchunks = __atomic_load_n(&pool->nchunks, __ATOMIC_ACQUIRE);
+  char const *addr = buf;
+
+  for (uint32_t i = 0; i < nchunks; ++i)
+  {
+    if (pool->chunks[i].base <= addr && addr < pool->chunks[i].base + FLA_BUFPOOL_CHUNK_NBYTES)
+      return &pool->chunks[i];
+  }
+
+  return NULL;
+}
+
+int
+fla_bufpool_init(struct xnvme_dev *dev, struct fla_bufpool **pool)
+{
+  int err;
+
+  *pool = calloc(1, sizeof(struct fla_bufpool));
+  if ((err = FLA_ERR_ERRNO(!*pool, "calloc()")))
+    return err;
+
+  err = pthread_mutex_init(&(*pool)->lock, NULL);
+  if (FLA_ERR(err, "pthread_mutex_init()"))
+  {
+    free(*pool);
+    *pool = NULL;
+    return err;
+  }
+
+  (*pool)->dev = dev;
+  (*pool)->id = __atomic_add_fetch(&fla_bufpool_last_id, 1, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&fla_bufpool_live_lock);
+  (*pool)->next = fla_bufpool_live;
+  fla_bufpool_live = *pool;
+  pthread_mutex_unlock(&fla_bufpool_live_lock);
+  return 0;
+}
+
+void
+fla_bufpool_term(struct fla_bufpool *pool)
+{
+  struct fla_bufpool **link;
+
+  if (!pool)
+    return;
+
+  // Caches of other threads find the pool gone before its chunks are freed
+  pthread_mutex_lock(&fla_bufpool_live_lock);
+  for (link = &fla_bufpool_live; *link != pool; link = &(*link)->next)
+    ;
+  *link = pool->next;
+  __atomic_add_fetch(&fla_bufpool_nterms, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&fla_bufpool_live_lock);
+
+  if (fla_bufpool_tcache.pool_id == pool->id)
+    memset(&fla_bufpool_tcache, 0, sizeof(fla_bufpool_tcache));
+
+  for (uint32_t i = 0; i < pool->nchunks; ++i)
+    fla_xne_free_buf(pool->dev, pool->chunks[i].base);
+
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+void *
+fla_bufpool_alloc(struct fla_bufpool *pool, size_t nbytes)
+{
+  int sclass = fla_bufpool_sclass(nbytes);
+  void *buf;
+  struct fla_bufpool_tcache *tcache;
+
+  if (sclass < 0)
+    return fla_xne_alloc_buf(pool->dev, nbytes);
+
+  tcache = fla_bufpool_tcache_get(pool);
+  if (tcache && (buf = fla_bufpool_pop(&tcache->free[sclass])))
+  {
+    tcache->nfree[sclass]--;
+    tcache->nbufs--;
+    return buf;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  if (!pool->free[sclass])
+    fla_bufpool_chunk_add(pool, sclass);
+
+  buf = fla_bufpool_pop(&pool->free[sclass]);
+
+  // Refill half of the thread cache while holding the lock anyway
+  while (buf && tcache && tcache->nfree[sclass] < FLA_BUFPOOL_TCACHE_MAX / 2 && pool->free[sclass])
+  {
+    fla_bufpool_push(&tcache->free[sclass], fla_bufpool_pop(&pool->free[sclass]));
+    tcache->nfree[sclass]++;
+    tcache->nbufs++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (!buf)
+    return fla_xne_alloc_buf(pool->dev, nbytes);
+
+  return buf;
+}
+
+void
+fla_bufpool_free(struct fla_bufpool *pool, void *buf)
+{
+  uint32_t sclass;
+  struct fla_bufpool_chunk const *chunk;
+  struct fla_bufpool_tcache *tcache;
+
+  if (!buf)
+    return;
+
+  chunk = fla_bufpool_chunk_find(pool, buf);
+  if (!chunk)
+  {
+    fla_xne_free_buf(pool->dev, buf);
+    return;
+  }
+
+  sclass = chunk->sclass;
+  tcache = fla_bufpool_tcache_get(pool);
+  if (tcache && tcache->nfree[sclass] < FLA_BUFPOOL_TCACHE_MAX)
+  {
+    fla_bufpool_push(&tcache->free[sclass], buf);
+    tcache->nfree[sclass]++;
+    tcache->nbufs++;
+    return;
+  }
+
+  // Cache is full, hand half of it back together with buf
+  pthread_mutex_lock(&pool->lock);
+  fla_bufpool_push(&pool->free[sclass], buf);
+  while (tcache && tcache->nfree[sclass] > FLA_BUFPOOL_TCACHE_MAX / 2)
+  {
+    fla_bufpool_push(&pool->free[sclass], fla_bufpool_pop(&tcache->free[sclass]));
+    tcache->nfree[sclass]--;
+    tcache->nbufs--;
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,98 @@
+/**
+ * Size class pool of DMA-able I/O buffers
+ *
+ * Buffers are carved out of large chunks allocated with the xnvme allocator and
+ * kept on per size class free lists. Every thread keeps a small cache of free
+ * buffers in front of the shared lists so that most allocations and frees do
+ * not take the pool lock.
+ *
+ * @file flexalloc_bufpool.h
+ */
+#ifndef __FLEXALLOC_BUFPOOL_H_
+#define __FLEXALLOC_BUFPOOL_H_
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <libxnvme.h>
+
+/// log2 of the smallest size class in bytes
+#define FLA_BUFPOOL_MIN_SHIFT 12
+/// Number of size classes, each twice the size of the previous one
+#define FLA_BUFPOOL_NCLASSES 8
+/// Bytes allocated from the device at a time, split into buffers of one class
+#define FLA_BUFPOOL_CHUNK_NBYTES (4U << 20)
+/// Max number of chunks a pool allocates, later requests go to the xnvme allocator
+#define FLA_BUFPOOL_MAX_CHUNKS 64
+/// Max number of free buffers per size class kept by each thread
+#define FLA_BUFPOOL_TCACHE_MAX 32
+
+struct fla_bufpool_chunk
+{
+  /// First byte of the chunk
+  char *base;
+  /// Size class of all the buffers in the chunk
+  uint32_t sclass;
+};
+
+struct fla_bufpool
+{
+  /// xnvme device the buffers are allocated for
+  struct xnvme_dev *dev;
+  /// Unique identifier, lets threads tell which pool their cache belongs to
+  uint64_t id;
+  /// Protects free and the chunk allocation
+  pthread_mutex_t lock;
+  /// Free buffers of each size class not held by any thread
+  void *free[FLA_BUFPOOL_NCLASSES];
+  /// Chunks allocated so far, entries below nchunks are never modified
+  struct fla_bufpool_chunk chunks[FLA_BUFPOOL_MAX_CHUNKS];
+  /// Number of valid entries in chunks
+  uint32_t nchunks;
+  /// Next pool not yet terminated
+  struct fla_bufpool *next;
+};
+
+/**
+ * @brief Create an empty buffer pool
+ *
+ * @param dev xnvme device the buffers are allocated for
+ * @param pool Allocated pool on success
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_bufpool_init(struct xnvme_dev *dev, struct fla_bufpool **pool);
+
+/**
+ * @brief Release all chunks and free the pool
+ *
+ * Every buffer handed out by the pool is invalid afterwards. Free buffers of
+ * the pool cached by other threads are dropped unread by those threads.
+ *
+ * @param pool pool to free, NULL is ignored
+ */
+void
+fla_bufpool_term(struct fla_bufpool *pool);
+
+/**
+ * @brief Allocate a buffer of at least nbytes
+ *
+ * Requests larger than the largest size class, or made once the pool has
+ * allocated FLA_BUFPOOL_MAX_CHUNKS chunks, are passed on to the xnvme allocator.
+ *
+ * @param pool pool to allocate from
+ * @param nbytes Number of bytes to allocate
+ * @return Buffer on success. NULL on error.
+ */
+void *
+fla_bufpool_alloc(struct fla_bufpool *pool, size_t nbytes);
+
+/**
+ * @brief Return a buffer allocated with fla_bufpool_alloc
+ *
+ * @param pool pool the buffer was allocated from
+ * @param buf Buffer to free
+ */
+void
+fla_bufpool_free(struct fla_bufpool *pool, void *buf);
+
+#endif // __FLEXALLOC_BUFPOOL_H_
@@ -0,0 +1,312 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flexalloc_ckpt.h"
+#include "flexalloc.h"
+#include "flexalloc_journal.h"
+#include "flexalloc_mm.h"
+#include "flexalloc_xnvme_env.h"
+#include "flexalloc_util.h"
+
+static void
+fla_ckpt_deadline(struct timespec *ts, uint32_t ms)
+{
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+  if (ts->tv_nsec >= 1000000000L)
+  {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+static bool
+fla_ckpt_ts_passed(struct timespec const *ts)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec > ts->tv_sec || (now.tv_sec == ts->tv_sec && now.tv_nsec >= ts->tv_nsec);
+}
+
+/*
+ * Dirty metadata blocks and slab freelists, the freelists counted as a block
+ * each. Read without locks, an estimate is good enough here.
+ */
+static uint64_t
+fla_ckpt_dirty_nbytes(struct flexalloc const *fs)
+{
+  uint32_t nwords = FLA_CEIL_DIV(fla_geo_nblocks(&fs->geo), 64);
+  uint64_t nblocks = 0;
+
+  for (uint32_t i = 0; i < nwords; ++i)
+    nblocks += __builtin_popcountll(__atomic_load_n(&fs->md_dirty[i], __ATOMIC_RELAXED));
+
+  nwords = FLA_CEIL_DIV(fs->geo.nslabs, 64);
+  for (uint32_t i = 0; i < nwords; ++i)
+    nblocks += __builtin_popcountll(__atomic_load_n(&fs->slab_cache._dirty[i], __ATOMIC_RELAXED));
+
+  return nblocks * fs->geo.lb_nbytes;
+}
+
+/*
+ * Sleep until asked to flush. With an interval or a threshold wake up every
+ * FLA_CKPT_POLL_MS at most, or every interval if shorter, to check them.
+ */
+static void *
+fla_ckpt_thread(void *arg)
+{
+  struct fla_ckpt *ckpt = arg;
+  struct timespec due, wake;
+  uint32_t period = FLA_CKPT_POLL_MS;
+  uint64_t ndirty;
+  int err;
+
+  if (ckpt->interval_ms)
+    period = fla_min(period, ckpt->interval_ms);
+
+  pthread_mutex_lock(&ckpt->lock);
+  fla_ckpt_deadline(&due, ckpt->interval_ms);
+  while (!ckpt->stop)
+  {
+    if (!ckpt->req)
+    {
+      if (!ckpt->interval_ms && !ckpt->dirty_nbytes)
+      {
+        pthread_cond_wait(&ckpt->wake, &ckpt->lock);
+        continue;
+      }
+
+      fla_ckpt_deadline(&wake, period);
+      err = pthread_cond_timedwait(&ckpt->wake, &ckpt->lock, &wake);
+      if (err != ETIMEDOUT)
+        continue;
+
+      ndirty = fla_ckpt_dirty_nbytes(ckpt->fs);
+      if (ckpt->interval_ms && fla_ckpt_ts_passed(&due))
+      {
+        fla_ckpt_deadline(&due, ckpt->interval_ms);
+        ckpt->req = ndirty > 0;
+      }
+      if (ckpt->dirty_nbytes && ndirty >= ckpt->dirty_nbytes)
+        ckpt->req = true;
+      continue;
+    }
+
+    ckpt->req = false;
+    ckpt->nstarted++;
+    pthread_mutex_unlock(&ckpt->lock);
+    err = fla_flush(ckpt->fs);
+    fla_jnl_ckpt_end(ckpt->fs);
+    pthread_mutex_lock(&ckpt->lock);
+
+    FLA_ERR(err, "fla_flush()");
+    ckpt->err = err;
+    ckpt->nended++;
+    fla_ckpt_deadline(&due, ckpt->interval_ms);
+    pthread_cond_broadcast(&ckpt->done);
+  }
+  pthread_mutex_unlock(&ckpt->lock);
+
+  return NULL;
+}
+
+int
+fla_ckpt_open(struct flexalloc *fs, struct fla_open_opts const *opts)
+{
+  struct xnvme_dev *md_dev = fs->dev.md_dev ? fs->dev.md_dev : fs->dev.dev;
+  bool timed = opts->ckpt_interval_ms || opts->ckpt_dirty_nbytes;
+  struct fla_ckpt *ckpt;
+  int err;
+
+  if (FLA_ERR(timed && !fs->locks, "background checkpoints need FLA_OPEN_THREAD_SAFE"))
+    return -EINVAL;
+
+  if (!fs->locks || (!fs->jnl && !timed))
+    return 0;
+
+  ckpt = calloc(1, sizeof(struct fla_ckpt));
+  if (FLA_ERR(!ckpt, "calloc()"))
+    return -ENOMEM;
+
+  ckpt->fs = fs;
+  ckpt->interval_ms = opts->ckpt_interval_ms;
+  ckpt->dirty_nbytes = opts->ckpt_dirty_nbytes;
+
+  ckpt->shadow = fla_xne_alloc_buf(md_dev, fla_geo_nbytes(&fs->geo));
+  if (FLA_ERR(!ckpt->shadow, "fla_xne_alloc_buf()"))
+  {
+    err = -ENOMEM;
+    goto free_ckpt;
+  }
+
+  err = pthread_mutex_init(&ckpt->flush, NULL);
+  if (FLA_ERR(err, "pthread_mutex_init()"))
+    goto free_shadow;
+
+  err = pthread_mutex_init(&ckpt->lock, NULL);
+  if (FLA_ERR(err, "pthread_mutex_init()"))
+    goto destroy_flush;
+
+  err = pthread_cond_init(&ckpt->wake, NULL);
+  if (FLA_ERR(err, "pthread_cond_init()"))
+    goto destroy_lock;
+
+  err = pthread_cond_init(&ckpt->done, NULL);
+  if (FLA_ERR(err, "pthread_cond_init()"))
+    goto destroy_wake;
+
+  err = pthread_cond_init(&ckpt->written, NULL);
+  if (FLA_ERR(err, "pthread_cond_init()"))
+    goto destroy_done;
+
+  // with an md device the freelists are not written into the slabs
+  if (!fs->dev.md_dev)
+  {
+    ckpt->slabs_writing = calloc(FLA_CEIL_DIV(fs->geo.nslabs, 64), sizeof(uint64_t));
+    if (FLA_ERR(!ckpt->slabs_writing, "calloc()"))
+    {
+      err = -ENOMEM;
+      goto destroy_written;
+    }
+  }
+
+  // the thread flushes through the handle, which must find the shadow
+  fs->ckpt = ckpt;
+  err = pthread_create(&ckpt->thread, NULL, fla_ckpt_thread, ckpt);
+  if (FLA_ERR(err, "pthread_create()"))
+    goto free_slabs_writing;
+
+  return 0;
+
+free_slabs_writing:
+  fs->ckpt = NULL;
+  free(ckpt->slabs_writing);
+destroy_written:
+  pthread_cond_destroy(&ckpt->written);
+destroy_done:
+  pthread_cond_destroy(&ckpt->done);
+destroy_wake:
+  pthread_cond_destroy(&ckpt->wake);
+destroy_lock:
+  pthread_mutex_destroy(&ckpt->lock);
+destroy_flush:
+  pthread_mutex_destroy(&ckpt->flush);
+free_shadow:
+  fla_xne_free_buf(md_dev, ckpt->shadow);
+free_ckpt:
+  free(ckpt);
+  return err;
+}
+
+void
+fla_ckpt_close(struct flexalloc *fs)
+{
+  struct xnvme_dev *md_dev = fs->dev.md_dev ? fs->dev.md_dev : fs->dev.dev;
+  struct fla_ckpt *ckpt = fs->ckpt;
+
+  if (!ckpt)
+    return;
+
+  pthread_mutex_lock(&ckpt->lock);
+  ckpt->stop = true;
+  pthread_cond_signal(&ckpt->wake);
+  pthread_cond_broadcast(&ckpt->done);
+  pthread_mutex_unlock(&ckpt->lock);
+  pthread_join(ckpt->thread, NULL);
+
+  free(ckpt->slabs_writing);
+  pthread_cond_destroy(&ckpt->written);
+  pthread_cond_destroy(&ckpt->done);
+  pthread_cond_destroy(&ckpt->wake);
+  pthread_mutex_destroy(&ckpt->lock);
+  pthread_mutex_destroy(&ckpt->flush);
+  fla_xne_free_buf(md_dev, ckpt->shadow);
+  free(ckpt);
+  fs->ckpt = NULL;
+}
+
+void
+fla_ckpt_request(struct flexalloc const *fs)
+{
+  struct fla_ckpt *ckpt = fs->ckpt;
+
+  if (!ckpt)
+    return;
+
+  pthread_mutex_lock(&ckpt->lock);
+  ckpt->req = true;
+  pthread_cond_signal(&ckpt->wake);
+  pthread_mutex_unlock(&ckpt->lock);
+}
+
+int
+fla_ckpt_wait(struct flexalloc const *fs)
+{
+  struct fla_ckpt *ckpt = fs->ckpt;
+  uint64_t target;
+  int err;
+
+  pthread_mutex_lock(&ckpt->lock);
+
+  // a flush started already may have taken its copy before the changes of the caller
+  target = ckpt->nstarted + 1;
+  ckpt->req = true;
+  pthread_cond_signal(&ckpt->wake);
+  while (ckpt->nended < target && !ckpt->stop)
+    pthread_cond_wait(&ckpt->done, &ckpt->lock);
+  err = ckpt->err;
+
+  pthread_mutex_unlock(&ckpt->lock);
+  return err;
+}
+
+void
+fla_ckpt_slabs_writing(struct flexalloc const *fs, struct fla_slab_cache_snap const *snap)
+{
+  struct fla_ckpt *ckpt = fs->ckpt;
+  uint32_t slab_id;
+
+  if (!ckpt || !ckpt->slabs_writing || !snap->nios)
+    return;
+
+  pthread_mutex_lock(&ckpt->lock);
+  for (uint32_t i = 0; i < snap->nios; i++)
+  {
+    slab_id = snap->ios[i].slab_id;
+    ckpt->slabs_writing[slab_id / 64] |= 1ULL << (slab_id % 64);
+  }
+  pthread_mutex_unlock(&ckpt->lock);
+}
+
+void
+fla_ckpt_slabs_written(struct flexalloc const *fs)
+{
+  struct fla_ckpt *ckpt = fs->ckpt;
+
+  if (!ckpt || !ckpt->slabs_writing)
+    return;
+
+  // flushes are serialized, the slabs kept are those of this one
+  pthread_mutex_lock(&ckpt->lock);
+  memset(ckpt->slabs_writing, 0, FLA_CEIL_DIV(fs->geo.nslabs, 64) * sizeof(uint64_t));
+  pthread_cond_broadcast(&ckpt->written);
+  pthread_mutex_unlock(&ckpt->lock);
+}
+
+void
+fla_ckpt_slab_wait(struct flexalloc const *fs, uint32_t slab_id)
+{
+  struct fla_ckpt *ckpt = fs->ckpt;
+
+  if (!ckpt || !ckpt->slabs_writing)
+    return;
+
+  // the flush writing the copy takes no lock of the handle
+  pthread_mutex_lock(&ckpt->lock);
+  while (ckpt->slabs_writing[slab_id / 64] & (1ULL << (slab_id % 64)))
+    pthread_cond_wait(&ckpt->written, &ckpt->lock);
+  pthread_mutex_unlock(&ckpt->lock);
+}
@@ -0,0 +1,149 @@
+/**
+ * flexalloc background checkpointer
+ *
+ * Thread safe handles with a journal, or opened with a checkpoint interval or
+ * dirty threshold, keep a shadow of the metadata buffer. A flush then copies
+ * the dirty metadata blocks and slab freelists while holding every lock, and
+ * writes the copies once the locks are dropped, so allocations go on while
+ * the metadata is written.
+ *
+ * Without an md device the freelist of a slab sits in the slab itself. A
+ * slab whose freelist copy is being written is not handed out again until
+ * the write is done, which would otherwise land on the data of its next
+ * owner. Releasing the slab in the meantime is fine.
+ *
+ * Flushes are serialized and numbered by the copy they take. A flush finding
+ * that a copy taken after it was called is on disk already returns at once,
+ * so callers of fla_sync() only wait for the flush in flight and one more.
+ *
+ * A thread flushes when asked to by the journal, every interval and when the
+ * dirty metadata grows past the threshold.
+ *
+ * @file flexalloc_ckpt.h
+ */
+#ifndef __FLEXALLOC_CKPT_H_
+#define __FLEXALLOC_CKPT_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "flexalloc.h"
+#include "flexalloc_slabcache.h"
+
+/// Interval in milliseconds at which the dirty threshold is checked
+#define FLA_CKPT_POLL_MS 100
+
+struct fla_ckpt
+{
+  struct flexalloc *fs;
+  /// copy of the dirty metadata blocks being written, the size of fs_buffer
+  void *shadow;
+  /// held by a flush from taking its copy until its writes are done
+  pthread_mutex_t flush;
+  /// copies taken, advanced with every lock of the handle held
+  uint64_t nsnaps;
+  /// number of the last copy written
+  uint64_t nwritten;
+  /// flush at least this often, 0 for no interval
+  uint32_t interval_ms;
+  /// flush once this much metadata is dirty, 0 for no threshold
+  uint64_t dirty_nbytes;
+  /// protects the fields below
+  pthread_mutex_t lock;
+  /// signalled to wake the thread
+  pthread_cond_t wake;
+  /// signalled when the thread ends a flush
+  pthread_cond_t done;
+  /// a flush was asked for and not yet started
+  bool req;
+  bool stop;
+  /// flushes started and ended by the thread
+  uint64_t nstarted;
+  uint64_t nended;
+  /// result of the last flush of the thread
+  int err;
+  /// slabs whose freelist is being written from a copy, NULL with an md device
+  uint64_t *slabs_writing;
+  /// signalled once the freelists of a copy are written
+  pthread_cond_t written;
+  pthread_t thread;
+};
+
+/**
+ * @brief Set up the shadow buffer and start the checkpoint thread
+ *
+ * Done on thread safe handles with a journal, or when the open options set a
+ * checkpoint interval or dirty threshold. Called once the journal is replayed.
+ *
+ * @param fs flexalloc system handle, open
+ * @param opts open options
+ * @return zero on success. -EINVAL if the options ask for a checkpointer on a
+ * handle which is not thread safe, other non zero values on error.
+ */
+int
+fla_ckpt_open(struct flexalloc *fs, struct fla_open_opts const *opts);
+
+/**
+ * @brief Stop the checkpoint thread and free the shadow buffer
+ *
+ * Waits for the flush in flight, if any.
+ *
+ * @param fs flexalloc system handle
+ */
+void
+fla_ckpt_close(struct flexalloc *fs);
+
+/**
+ * @brief Ask the checkpoint thread to flush, without waiting
+ *
+ * Does nothing without a checkpointer.
+ *
+ * @param fs flexalloc system handle
+ */
+void
+fla_ckpt_request(struct flexalloc const *fs);
+
+/**
+ * @brief Have the checkpoint thread flush and wait for it
+ *
+ * Waits for a flush started after the call. Concurrent callers share it.
+ *
+ * @param fs flexalloc system handle with a checkpointer
+ * @return result of the flush
+ */
+int
+fla_ckpt_wait(struct flexalloc const *fs);
+
+/**
+ * @brief Keep the slabs of a freelist copy from reuse until it is written
+ *
+ * Called by a flush with every lock of the handle held, once it took the
+ * copy. Does nothing without a checkpointer or with an md device.
+ *
+ * @param fs flexalloc system handle
+ * @param snap freelists taken by the flush
+ */
+void
+fla_ckpt_slabs_writing(struct flexalloc const *fs, struct fla_slab_cache_snap const *snap);
+
+/**
+ * @brief Release the slabs kept by fla_ckpt_slabs_writing()
+ *
+ * Called by the flush once the freelists are written, or failed to be.
+ *
+ * @param fs flexalloc system handle
+ */
+void
+fla_ckpt_slabs_written(struct flexalloc const *fs);
+
+/**
+ * @brief Wait until the freelist of a slab is not being written from a copy
+ *
+ * Called before a free slab is handed out to a pool, with the fs lock held.
+ *
+ * @param fs flexalloc system handle
+ * @param slab_id slab about to be acquired
+ */
+void
+fla_ckpt_slab_wait(struct flexalloc const *fs, uint32_t slab_id);
+
+#endif // __FLEXALLOC_CKPT_H_
@@ -46,6 +46,16 @@ msg_handler(struct fla_daemon *d, int client_fd, struct fla_msg const * const re
     if (FLA_ERR(fla_daemon_object_destroy_rsp(d, client_fd, recv, send), "fla_daemon_object_destroy()"))
       return -1;
     break;
+  case FLA_MSG_CMD_OBJECT_CREATE_N:
+    if (FLA_ERR(fla_daemon_object_create_n_rsp(d, client_fd, recv, send),
+                "fla_daemon_object_create_n()"))
+      return -1;
+    break;
+  case FLA_MSG_CMD_OBJECT_DESTROY_N:
+    if (FLA_ERR(fla_daemon_object_destroy_n_rsp(d, client_fd, recv, send),
+                "fla_daemon_object_destroy_n()"))
+      return -1;
+    break;
   case FLA_MSG_CMD_POOL_OPEN:
     if (FLA_ERR(fla_daemon_pool_open_rsp(d, client_fd, recv, send), "fla_daemon_pool_open()"))
       return -1;
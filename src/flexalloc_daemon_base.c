@@ -15,6 +15,7 @@
 #include "src/flexalloc_mm.h"
 #include "src/flexalloc_shared.h"
 #include "src/flexalloc_xnvme_env.h"
+#include "src/flexalloc_bufpool.h"
 #include <inttypes.h>
 
 #define BUF_SIZE 1024 * 10
@@ -548,16 +549,36 @@ fla_daemon_fs_init_rq(struct fla_daemon_client *client, int sock_fd)
     goto free_pool_entry_array;
   client->flexalloc->dev.dev = dev;
 
+  err = fla_xne_queue_pool_init(dev, FLA_XNE_QUEUE_DEPTH, &client->flexalloc->qpool);
+  if (FLA_ERR(err, "fla_xne_queue_pool_init()"))
+    goto close_dev;
+
+  err = fla_bufpool_init(dev, &client->flexalloc->bufpool);
+  if (FLA_ERR(err, "fla_bufpool_init()"))
+    goto term_qpool;
+
   if(md_dev_uri_len > 0)
   {
     err = fla_xne_dev_open(client->flexalloc->dev.md_dev_uri, NULL, &md_dev);
     if (FLA_ERR(err, "fla_xne_dev_open() - failed to open device"))
-      goto free_pool_entry_array;
+      goto term_bufpool;
     client->flexalloc->dev.md_dev = md_dev;
   }
 
   return 0;
 
+term_bufpool:
+  fla_bufpool_term(client->flexalloc->bufpool);
+  client->flexalloc->bufpool = NULL;
+
+term_qpool:
+  fla_xne_queue_pool_term(client->flexalloc->qpool);
+  client->flexalloc->qpool = NULL;
+
+close_dev:
+  fla_xne_dev_close(dev);
+  client->flexalloc->dev.dev = NULL;
+
 free_pool_entry_array:
   free(client->flexalloc->pools.entries);
   client->flexalloc->pools.entries = NULL;
@@ -636,6 +657,14 @@ fla_daemon_close_rq(struct flexalloc *fs)
   close(client->sock_fd);
   client->sock_fd = 0;
 
+  if (fs->io_queue)
+    fla_xne_queue_release(fs->qpool, fs->io_queue);
+  fs->io_queue = NULL;
+  fla_xne_queue_pool_term(fs->qpool);
+  fs->qpool = NULL;
+  fla_bufpool_term(fs->bufpool);
+  fs->bufpool = NULL;
+
   fla_xne_dev_close(fs->dev.dev);
   fs->dev.dev = NULL;
 
@@ -1097,6 +1126,137 @@ exit:
   return err;
 }
 
+int
+fla_daemon_object_create_n_rq(struct flexalloc *fs, struct fla_pool *pool,
+                              struct fla_object *objects, uint32_t nobjects)
+{
+  int err = 0, ret;
+  struct fla_daemon_client *client = fla_get_client(fs);
+  uint32_t n = 0, batch;
+
+  for (; n < nobjects; n += batch)
+  {
+    batch = fla_min(nobjects - n, FLA_MSG_OBJS_MAX);
+
+    memcpy(client->send.data, pool, sizeof(struct fla_pool));
+    memcpy(client->send.data + sizeof(struct fla_pool), &batch, sizeof(uint32_t));
+    client->send.hdr->len = sizeof(struct fla_pool) + sizeof(uint32_t);
+    client->send.hdr->cmd = FLA_MSG_CMD_OBJECT_CREATE_N;
+
+    err = fla_send_recv(client);
+    if (FLA_ERR(err, "fla_send_recv()"))
+      goto release;
+
+    // did operation succeed ?
+    err = *((int *)client->recv.data);
+    if (FLA_ERR(err, "object_create_n()"))
+      goto release;
+
+    memcpy(objects + n, client->recv.data + sizeof(int), batch * sizeof(struct fla_object));
+  }
+
+  return 0;
+
+release:
+  // the batches created so far
+  if (n)
+  {
+    ret = fla_daemon_object_destroy_n_rq(fs, pool, objects, n);
+    FLA_ERR(ret, "fla_daemon_object_destroy_n_rq()");
+  }
+  return err;
+}
+
+int
+fla_daemon_object_create_n_rsp(struct fla_daemon *daemon, int client_fd,
+                               struct fla_msg const * const recv,
+                               struct fla_msg const * const send)
+{
+  int err;
+  struct fla_pool *pool = (struct fla_pool *)recv->data;
+  uint32_t nobjects = *((uint32_t *)(recv->data + sizeof(struct fla_pool)));
+  struct fla_object *objects = (struct fla_object *)(send->data + sizeof(int));
+
+  if (FLA_ERR(nobjects > FLA_MSG_OBJS_MAX, "too many objects in one message"))
+    err = -EINVAL;
+  else
+    err = daemon->flexalloc->fns.object_create_n(daemon->flexalloc, pool, objects, nobjects);
+  *((int *)send->data) = err;
+
+  if (FLA_ERR(err, "object_create_n()"))
+    send->hdr->len = sizeof(int);
+  else
+    send->hdr->len = sizeof(int) + nobjects * sizeof(struct fla_object);
+
+  if (FLA_ERR(err = fla_sock_send_msg(client_fd, send), "fla_sock_send_msg()"))
+    goto exit;
+
+exit:
+  return err;
+}
+
+int
+fla_daemon_object_destroy_n_rq(struct flexalloc *fs, struct fla_pool *pool,
+                               struct fla_object *objects, uint32_t nobjects)
+{
+  int err = 0, ret;
+  struct fla_daemon_client *client = fla_get_client(fs);
+  char *data = client->send.data;
+  uint32_t batch;
+
+  for (uint32_t n = 0; n < nobjects; n += batch)
+  {
+    batch = fla_min(nobjects - n, FLA_MSG_OBJS_MAX);
+
+    memcpy(data, pool, sizeof(struct fla_pool));
+    memcpy(data + sizeof(struct fla_pool), &batch, sizeof(uint32_t));
+    memcpy(data + sizeof(struct fla_pool) + sizeof(uint32_t), objects + n,
+           batch * sizeof(struct fla_object));
+    client->send.hdr->len = sizeof(struct fla_pool) + sizeof(uint32_t)
+                            + batch * sizeof(struct fla_object);
+    client->send.hdr->cmd = FLA_MSG_CMD_OBJECT_DESTROY_N;
+
+    ret = fla_send_recv(client);
+    if (FLA_ERR(ret, "fla_send_recv()"))
+      return ret;
+
+    // did the operation succeed ? keep going with the next batch if not
+    ret = *((int *)client->recv.data);
+    if (FLA_ERR(ret, "object_destroy_n()"))
+      err = ret;
+  }
+
+  return err;
+}
+
+int
+fla_daemon_object_destroy_n_rsp(struct fla_daemon *daemon, int client_fd,
+                                struct fla_msg const * const recv,
+                                struct fla_msg const * const send)
+{
+  int err;
+  struct fla_pool *pool = (struct fla_pool *)recv->data;
+  uint32_t nobjects = *((uint32_t *)(recv->data + sizeof(struct fla_pool)));
+  struct fla_object *objects =
+    (struct fla_object *)(recv->data + sizeof(struct fla_pool) + sizeof(uint32_t));
+
+  if (FLA_ERR(nobjects > FLA_MSG_OBJS_MAX, "too many objects in one message"))
+    err = -EINVAL;
+  else
+    err = daemon->flexalloc->fns.object_destroy_n(daemon->flexalloc, pool, objects, nobjects);
+  if (FLA_ERR(err, "object_destroy_n()"))
+  {} // nothing to do
+
+  *((int *)send->data) = err;
+  send->hdr->len = sizeof(err);
+
+  if (FLA_ERR((err = fla_sock_send_msg(client_fd, send)), "fla_sock_send_msg()"))
+    goto exit;
+
+exit:
+  return err;
+}
+
 int
 fla_daemon_pool_set_root_object_rq(struct flexalloc const * const fs,
                                    struct fla_pool const * pool,
@@ -1219,6 +1379,8 @@ struct fla_fns client_fns =
   .object_open = &fla_daemon_object_open_rq,
   .object_create = &fla_daemon_object_create_rq,
   .object_destroy = &fla_daemon_object_destroy_rq,
+  .object_create_n = &fla_daemon_object_create_n_rq,
+  .object_destroy_n = &fla_daemon_object_destroy_n_rq,
   .pool_set_root_object = &fla_daemon_pool_set_root_object_rq,
   .pool_get_root_object = &fla_daemon_pool_get_root_object_rq,
 };
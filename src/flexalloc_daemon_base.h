@@ -50,6 +50,8 @@ struct fla_msg
 #define FLA_MSG_CMD_OBJECT_CREATE 10
 #define FLA_MSG_CMD_OBJECT_DESTROY 11
 #define FLA_MSG_CMD_SYNC_NO_RSPS 12
+#define FLA_MSG_CMD_OBJECT_CREATE_N 13
+#define FLA_MSG_CMD_OBJECT_DESTROY_N 14
 
 #define FLA_MSG_CMD_INIT_INFO 30
 
@@ -80,6 +82,9 @@ struct fla_daemon
 #define FLA_MSG_DATA_MAX 2048
 // message buffer size - protocol mandates all messages fit within a buffer this size
 #define FLA_MSG_BUFSIZ (sizeof(struct fla_msg_header) + FLA_MSG_DATA_MAX)
+// maximum number of objects created or destroyed by one message, larger batches take several
+#define FLA_MSG_OBJS_MAX \
+  ((FLA_MSG_DATA_MAX - sizeof(struct fla_pool) - sizeof(uint32_t)) / sizeof(struct fla_object))
 
 /// get pointer to the message header struct
 #define FLA_MSG_HDR(x) ((struct fla_msg_header *)*(&x))
@@ -281,6 +286,24 @@ fla_daemon_object_destroy_rsp(struct fla_daemon *daemon, int client_fd,
                               struct fla_msg const * const recv,
                               struct fla_msg const * const send);
 
+int
+fla_daemon_object_create_n_rq(struct flexalloc *fs, struct fla_pool *pool,
+                              struct fla_object *objects, uint32_t nobjects);
+
+int
+fla_daemon_object_create_n_rsp(struct fla_daemon *daemon, int client_fd,
+                               struct fla_msg const * const recv,
+                               struct fla_msg const * const send);
+
+int
+fla_daemon_object_destroy_n_rq(struct flexalloc *fs, struct fla_pool *pool,
+                               struct fla_object *objects, uint32_t nobjects);
+
+int
+fla_daemon_object_destroy_n_rsp(struct fla_daemon *daemon, int client_fd,
+                                struct fla_msg const * const recv,
+                                struct fla_msg const * const send);
+
 int
 fla_daemon_pool_set_root_object_rq(struct flexalloc const * const fs,
                                    struct fla_pool const * pool,
@@ -4,7 +4,6 @@
 #include "flexalloc_xnvme_env.h"
 #include "flexalloc_freelist.h"
 #include <stdint.h>
-#include <stdarg.h>
 
 int
 fla_fdp_get_placement_identifier(uint32_t *pid, struct fla_dp_fdp *fdp)
@@ -60,28 +59,13 @@ fla_fdp_onwrite_prep_ctx(struct fla_xne_io *xne_io, struct xnvme_cmd_ctx *ctx)
   return 0;
 }
 
-static int
-fla_fdp_get_id(const uint32_t ndx, va_list ag)
-{
-  uint32_t *pid = va_arg(ag, uint32_t*);
-  uint32_t *fla_id = va_arg(ag, uint32_t*);
-  struct fla_dp_fdp * fdp = va_arg(ag, struct fla_dp_fdp*);
-
-  if(*fla_id == (fdp->pids + ndx)->fla_id)
-  {
-    *pid = (fdp->pids + ndx)->pid;
-    return 1;
-  }
-
-  return 0;
-}
-
 static int
 fla_fdp_cached_prep_ctx(struct fla_xne_io *xne_io, struct xnvme_cmd_ctx *ctx)
 {
   struct fla_dp_fdp* fdp = xne_io->fla_dp->fla_dp_fdp;
   struct fla_dp_fdp_pid_to_id *pid_to_id;
-  uint32_t fla_id, pid, found = 0;
+  struct fla_flist_iter it;
+  uint32_t fla_id, ndx;
   int ret;
 
   switch (xne_io->io_type)
@@ -111,29 +95,39 @@ fla_fdp_cached_prep_ctx(struct fla_xne_io *xne_io, struct xnvme_cmd_ctx *ctx)
     }
   }
 
-  ret = fla_flist_search_wfunc(fdp->free_pids, FLA_FLIST_SEARCH_EXEC_FIRST,
-                               &found, fla_fdp_get_id, &pid, &fla_id, fdp);
-  if (FLA_ERR(ret, "fla_flist_search_wfunc()"))
-    return ret;
+  pthread_mutex_lock(&fdp->lock);
 
-  if (found == 1)
-    ctx->cmd.nvm.cdw13.dspec = pid;
+  // look the id up among the cached placement ids
+  fla_flist_iter_init(&it, fdp->free_pids, true);
+  while (fla_flist_iter_next(&it, &ndx))
+  {
+    pid_to_id = fdp->pids + ndx;
+    if (pid_to_id->fla_id == fla_id)
+      goto set_pid;
+  }
 
-  else if (found == 0)
+  ret = fla_flist_entries_alloc(fdp->free_pids, 1);
+  if (FLA_ERR(ret < 0, "fla_fdp_cached_prep_ctx()"))
   {
-    ret = fla_flist_entries_alloc(fdp->free_pids, 1);
-    if (FLA_ERR(ret < 0, "fla_fdp_cached_prep_ctx()"))
-      return -ENOSPC;
+    ret = -ENOSPC;
+    goto unlock;
+  }
 
-    pid_to_id = fdp->pids + ret;
-    pid_to_id->fla_id = fla_id;
+  pid_to_id = fdp->pids + ret;
+  pid_to_id->fla_id = fla_id;
 
-    ret = fla_fdp_get_pid_n(xne_io->dev, &pid_to_id->pid, 1);
-    if (FLA_ERR(ret, "fla_fdp_get_pid_n()"))
-      return ret;
-  }
+  ret = fla_fdp_get_pid_n(xne_io->dev, &pid_to_id->pid, 1);
+  if (FLA_ERR(ret, "fla_fdp_get_pid_n()"))
+    goto unlock;
+
+set_pid:
+  ctx->cmd.nvm.cdw13.dspec = pid_to_id->pid;
   ctx->cmd.nvm.dtype = 2;
-  return 0;
+  ret = 0;
+
+unlock:
+  pthread_mutex_unlock(&fdp->lock);
+  return ret;
 }
 
 int
@@ -222,6 +216,13 @@ fla_dp_fdp_init(struct flexalloc *fs, uint64_t flags)
     return -ENOMEM;
 
   fs->fla_dp.fla_dp_fdp->ctx_set = FLA_DP_FDP_ON_WRITE;
+  if ((err = FLA_ERR(pthread_mutex_init(&fs->fla_dp.fla_dp_fdp->lock, NULL),
+                     "pthread_mutex_init()")))
+  {
+    free(fs->fla_dp.fla_dp_fdp);
+    return err;
+  }
+
   fs->fla_dp.fncs.init_dp = fla_dp_fdp_init;
   fs->fla_dp.fncs.fini_dp = fla_dp_fdp_fini;
 
@@ -239,6 +240,7 @@ fla_dp_fdp_init(struct flexalloc *fs, uint64_t flags)
 int
 fla_dp_fdp_fini(struct flexalloc *fs)
 {
+  pthread_mutex_destroy(&fs->fla_dp.fla_dp_fdp->lock);
   free(fs->fla_dp.fla_dp_fdp);
   return 0;
 }
@@ -1,6 +1,7 @@
 #ifndef __FLEXALLOC_FDP_H
 #define __FLEXALLOC_FDP_H
 #include <stdint.h>
+#include <pthread.h>
 #include "flexalloc_freelist.h"
 #include "flexalloc_shared.h"
 #include "flexalloc_xnvme_env.h"
@@ -25,6 +26,8 @@ struct fla_dp_fdp
   struct fla_dp_fdp_pid_to_id *pids;
   freelist_t free_pids;
   uint32_t md_pid;
+  /// serializes lookups and updates of the cached placement ids
+  pthread_mutex_t lock;
 };
 
 int fla_dp_fdp_init(struct flexalloc *fs, const uint64_t flags);
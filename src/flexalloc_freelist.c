@@ -1,8 +1,10 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <stdbool.h>
+#include <string.h>
 #include "flexalloc_freelist.h"
-#include "flexalloc_bits.h"
+#include "flexalloc_freelist_kern.h"
 #include "flexalloc_util.h"
 
 size_t
@@ -12,32 +14,102 @@ fla_flist_size(uint32_t len)
   return sizeof(uint32_t) * (1 + FLA_FREELIST_U32_ELEMS(len));
 }
 
+/*
+ * The summary has one bit per freelist word and the top level one bit per
+ * summary word. Each top level word thereby covers 64 * 64 freelist words.
+ */
+#define FLA_FLIST_SUMMARY_BITS 64
+
+static freelist_t
+fla_flist_handle_alloc(uint32_t len, size_t data_nbytes)
+{
+  uint32_t nwords = FLA_FREELIST_U32_ELEMS(len);
+  uint32_t nsummary = FLA_CEIL_DIV(nwords, FLA_FLIST_SUMMARY_BITS);
+  uint32_t ntop = FLA_CEIL_DIV(nsummary, FLA_FLIST_SUMMARY_BITS);
+  freelist_t flist;
+
+  flist = malloc(sizeof(struct fla_flist) + sizeof(uint64_t) * (nsummary + ntop)
+                 + data_nbytes);
+  if (FLA_ERR(!flist, "malloc()"))
+    return NULL;
+
+  flist->summary = (uint64_t *)(flist + 1);
+  flist->top = flist->summary + nsummary;
+  flist->words = data_nbytes ? (uint32_t *)(flist->top + ntop) : NULL;
+  flist->nwords = nwords;
+  flist->nsummary = nsummary;
+  flist->ntop = ntop;
+
+  return flist;
+}
+
+static void
+fla_flist_summary_build(freelist_t flist)
+{
+  uint32_t const *words = flist->words + 1;
+
+  memset(flist->summary, 0, sizeof(uint64_t) * (flist->nsummary + flist->ntop));
+  flist->nfree = fla_flist_kern_popcount(words, flist->nwords);
+
+  // visit only the words with free entries
+  for (uint32_t w = fla_flist_kern_find(words, 0, flist->nwords, 0); w < flist->nwords;
+       w = fla_flist_kern_find(words, w + 1, flist->nwords, 0))
+  {
+    flist->summary[w / FLA_FLIST_SUMMARY_BITS] |= 1ull << (w % FLA_FLIST_SUMMARY_BITS);
+  }
+
+  for (uint32_t s = 0; s < flist->nsummary; s++)
+  {
+    if (flist->summary[s])
+      flist->top[s / FLA_FLIST_SUMMARY_BITS] |= 1ull << (s % FLA_FLIST_SUMMARY_BITS);
+  }
+}
+
+// freelist word `w` just ran out of free entries
+static void
+fla_flist_summary_clear(freelist_t flist, uint32_t w)
+{
+  uint32_t s = w / FLA_FLIST_SUMMARY_BITS;
+
+  flist->summary[s] &= ~(1ull << (w % FLA_FLIST_SUMMARY_BITS));
+  if (!flist->summary[s])
+    flist->top[s / FLA_FLIST_SUMMARY_BITS] &= ~(1ull << (s % FLA_FLIST_SUMMARY_BITS));
+}
+
+// freelist word `w` has at least one free entry
+static void
+fla_flist_summary_set(freelist_t flist, uint32_t w)
+{
+  uint32_t s = w / FLA_FLIST_SUMMARY_BITS;
+
+  flist->summary[s] |= 1ull << (w % FLA_FLIST_SUMMARY_BITS);
+  flist->top[s / FLA_FLIST_SUMMARY_BITS] |= 1ull << (s % FLA_FLIST_SUMMARY_BITS);
+}
+
 uint32_t
 fla_flist_len(freelist_t flist)
 {
-  return *flist;
+  return *flist->words;
 }
 
 uint32_t
 fla_flist_num_reserved(freelist_t flist)
 {
-  uint32_t *ptr = flist + 1;
-  uint32_t *end = flist + fla_flist_size(*flist) / sizeof(uint32_t);
-  uint32_t free_entries = 0;
+  return *flist->words - fla_flist_num_free(flist);
+}
 
-  for (; ptr != end; ptr++)
-  {
-    free_entries += count_set_bits(*ptr);
-  }
-  return *flist - free_entries;
+uint32_t
+fla_flist_num_free(freelist_t flist)
+{
+  return __atomic_load_n(&flist->nfree, __ATOMIC_RELAXED);
 }
 
 void
 fla_flist_reset(freelist_t flist)
 {
-  uint32_t *len = flist;
-  uint32_t elems = FLA_FREELIST_U32_ELEMS(*flist);
-  uint32_t *elem = flist + 1;
+  uint32_t *len = flist->words;
+  uint32_t elems = flist->nwords;
+  uint32_t *elem = flist->words + 1;
   uint32_t *elem_last = elem + elems - 1;
   uint32_t unused_spots;
 
@@ -55,25 +127,33 @@ fla_flist_reset(freelist_t flist)
   }
   unused_spots = elems * sizeof(uint32_t) * 8 - *len;
   *elem = (~0u) >> unused_spots;
+
+  fla_flist_summary_build(flist);
 }
 
-void
-fla_flist_init(freelist_t flist, uint32_t len)
+int
+fla_flist_init(void *data, uint32_t len, freelist_t *flist)
 {
-  flist[0] = len;
-  fla_flist_reset(flist);
+  *flist = fla_flist_handle_alloc(len, 0);
+  if (!(*flist))
+    return -ENOMEM;
+
+  (*flist)->words = data;
+  (*flist)->words[0] = len;
+  fla_flist_reset(*flist);
+
+  return 0;
 }
 
 int
 fla_flist_new(uint32_t len, freelist_t *flist)
 {
-  *flist = malloc(fla_flist_size(len));
-  if (FLA_ERR(!(*flist), "malloc()"))
-  {
+  *flist = fla_flist_handle_alloc(len, fla_flist_size(len));
+  if (!(*flist))
     return -ENOMEM;
-  }
 
-  fla_flist_init(*flist, len);
+  (*flist)->words[0] = len;
+  fla_flist_reset(*flist);
 
   return 0;
 }
@@ -81,141 +161,347 @@ fla_flist_new(uint32_t len, freelist_t *flist)
 void
 fla_flist_free(freelist_t flist)
 {
+  // the summary, and for fla_flist_new() the freelist, share the handle allocation
   free(flist);
 }
 
-freelist_t
-fla_flist_load(void *data)
+int
+fla_flist_load(void *data, freelist_t *flist)
 {
-  return (freelist_t)data;
+  *flist = fla_flist_handle_alloc(*(uint32_t *)data, 0);
+  if (!(*flist))
+    return -ENOMEM;
+
+  (*flist)->words = data;
+  fla_flist_summary_build(*flist);
+
+  return 0;
+}
+
+void *
+fla_flist_data(freelist_t flist)
+{
+  return flist->words;
+}
+
+/*
+ * Index of the first word at or after `from` with a free entry, nwords if none.
+ * The summary is read with relaxed atomic loads as the atomic variants below
+ * update it concurrently, the result is then only a hint.
+ */
+static uint32_t
+fla_flist_next_free_word(freelist_t flist, uint32_t from)
+{
+  uint32_t s = from / FLA_FLIST_SUMMARY_BITS, t;
+  uint64_t bits;
+
+  if (from >= flist->nwords)
+    return flist->nwords;
+
+  bits = __atomic_load_n(&flist->summary[s], __ATOMIC_RELAXED)
+         & (~0ull << (from % FLA_FLIST_SUMMARY_BITS));
+  if (bits)
+    return s * FLA_FLIST_SUMMARY_BITS + fla_flist_ctz64(bits);
+
+  for (s++; s < flist->nsummary; s = (t + 1) * FLA_FLIST_SUMMARY_BITS)
+  {
+    t = s / FLA_FLIST_SUMMARY_BITS;
+    bits = __atomic_load_n(&flist->top[t], __ATOMIC_RELAXED)
+           & (~0ull << (s % FLA_FLIST_SUMMARY_BITS));
+    if (bits)
+    {
+      s = t * FLA_FLIST_SUMMARY_BITS + fla_flist_ctz64(bits);
+      bits = __atomic_load_n(&flist->summary[s], __ATOMIC_RELAXED);
+      if (bits)
+        return s * FLA_FLIST_SUMMARY_BITS + fla_flist_ctz64(bits);
+
+      // emptied since the top level was read
+      return fla_flist_next_free_word(flist, (s + 1) * FLA_FLIST_SUMMARY_BITS);
+    }
+  }
+
+  return flist->nwords;
 }
 
 // find and take a spot in the freelist, returning its index
-int
-fla_flist_entry_alloc(freelist_t flist, uint32_t elems)
+static int
+fla_flist_entry_alloc(freelist_t flist)
 {
   uint32_t *elem;
-  uint32_t wndx = 0;
+  uint32_t w, wndx = 0;
+
+  w = fla_flist_next_free_word(flist, 0);
+  // fully booked
+  if (w == flist->nwords)
+    return -1;
+
+  elem = &flist->words[1 + w];
+
+  // isolate rightmost 1-bit, store in `wndx` that we may calculate the entry's
+  // index, then set it in the freelist.
+  wndx = *elem & (- *elem);
+  *elem &= ~wndx;
+  if (*elem == 0)
+    fla_flist_summary_clear(flist, w);
+  flist->nfree--;
+
+  return w * sizeof(uint32_t) * 8 + fla_flist_ctz(wndx);
+}
 
-  for (uint32_t i = 0; i < elems; i++)
+/*
+ * Reserve (take) or free the entries [ndx, ndx + num) one word at a time,
+ * masking the partial words at either end.
+ */
+static void
+fla_flist_range_set(freelist_t flist, uint32_t ndx, uint32_t num, bool take)
+{
+  uint32_t w = ndx / 32, w_last = (ndx + num - 1) / 32;
+  uint32_t mask, *elem;
+
+  for (; w <= w_last; w++)
   {
-    elem = &flist[1 + i];
-    // fully booked
-    if (*elem == 0)
-      continue;
-
-    // isolate rightmost 1-bit, store in `wndx` that we may calculate the entry's
-    // index, then set it in the freelist.
-    wndx = *elem & (- *elem);
-    *elem &= ~wndx;
-    return i * sizeof(uint32_t) * 8 + ntz(wndx);
+    mask = ~0u;
+    if (w == ndx / 32)
+      mask &= ~0u << (ndx % 32);
+    if (w == w_last)
+      mask &= ~0u >> (31 - (ndx + num - 1) % 32);
+
+    elem = &flist->words[1 + w];
+    if (take)
+    {
+      flist->nfree -= __builtin_popcount(*elem & mask);
+      *elem &= ~mask;
+      if (*elem == 0)
+        fla_flist_summary_clear(flist, w);
+    }
+    else
+    {
+      flist->nfree += __builtin_popcount(~*elem & mask);
+      *elem |= mask;
+      fla_flist_summary_set(flist, w);
+    }
   }
-  return -1;
 }
 
-int
-fla_flist_entries_alloc(freelist_t flist, unsigned int num)
+// bit `i` of the result is set when bits i..i+num-1 of `val` are all set
+static uint32_t
+fla_flist_run_starts(uint32_t val, uint32_t num)
 {
-  uint32_t elems = FLA_FREELIST_U32_ELEMS(*flist);
-  uint32_t alloc_count;
-  int alloc_ret;
+  uint32_t shift;
 
-  alloc_ret = fla_flist_entry_alloc(flist, elems);
+  for (uint32_t len = 1; len < num && val; len += shift)
+  {
+    shift = fla_min(len, num - len);
+    val &= val >> shift;
+  }
 
-  if (num == 1)
-    return alloc_ret;
+  return val;
+}
 
-  for(alloc_count = 1; alloc_count != num; ++alloc_count)
+int
+fla_flist_run_alloc(freelist_t flist, uint32_t num)
+{
+  uint32_t w, val, starts, nlead;
+  uint32_t run_start = 0, run_len = 0, run_end_w = UINT32_MAX;
+
+  if (num == 0 || num > *flist->words)
+    return -1;
+
+  /*
+   * Visit the words with free entries in order. A run is carried over from
+   * the high bits of one word into the low bits of the next for as long as
+   * the words are adjacent.
+   */
+  for (w = fla_flist_next_free_word(flist, 0); w < flist->nwords;
+       w = fla_flist_next_free_word(flist, w + 1))
   {
-    if(fla_flist_entry_alloc(flist, elems) == -1)
-      return -1;
+    val = flist->words[1 + w];
+
+    if (run_len && run_end_w + 1 == w)
+    {
+      nlead = val == ~0u ? 32 : fla_flist_ctz(~val);
+      if (run_len + nlead >= num)
+        goto take;
+
+      if (val == ~0u)
+      {
+        run_len += 32;
+        run_end_w = w;
+        continue;
+      }
+    }
+
+    if (num <= 32)
+    {
+      starts = fla_flist_run_starts(val, num);
+      if (starts)
+      {
+        run_start = w * 32 + fla_flist_ctz(starts);
+        goto take;
+      }
+    }
+
+    // start a new run from the free entries at the top of the word
+    run_len = val == ~0u ? 32 : (uint32_t)__builtin_clz(~val);
+    run_start = w * 32 + 32 - run_len;
+    run_end_w = w;
   }
 
-  return alloc_ret;
+  return -1;
+
+take:
+  fla_flist_range_set(flist, run_start, num, true);
+  return run_start;
+}
+
+int
+fla_flist_entries_alloc(freelist_t flist, unsigned int num)
+{
+  if (num == 1)
+    return fla_flist_entry_alloc(flist);
+
+  return fla_flist_run_alloc(flist, num);
 }
 
 // release a taken element from freelist
 int
 fla_flist_entry_free(freelist_t flist, uint32_t ndx)
 {
-  uint32_t *elem = flist + 1;
-  if (ndx > *flist)
+  uint32_t w = ndx / (sizeof(uint32_t) * CHAR_BIT);
+  uint32_t bit = 1u << (ndx % (sizeof(uint32_t) * CHAR_BIT));
+
+  if (ndx >= *flist->words)
     return -1;
 
-  while (ndx >= sizeof(uint32_t) * CHAR_BIT)
-  {
-    elem++;
-    ndx -= sizeof(uint32_t) * CHAR_BIT;
-  }
-  *elem |= 1 << ndx;
+  // freeing a free entry is allowed, only count the ones taken
+  if (!(flist->words[1 + w] & bit))
+    flist->nfree++;
+
+  flist->words[1 + w] |= bit;
+  fla_flist_summary_set(flist, w);
   return 0;
 }
 
 int
-fla_flist_entries_free(freelist_t flist, uint32_t ndx, unsigned int num)
+fla_flist_run_free(freelist_t flist, uint32_t ndx, uint32_t num)
 {
-  for(uint32_t i = 0 ; i < num ; ++i)
-  {
-    if(fla_flist_entry_free(flist, ndx+i))
-      return -1;
-  }
+  if ((uint64_t)ndx + num > *flist->words)
+    return -1;
+
+  if (num)
+    fla_flist_range_set(flist, ndx, num, false);
+
   return 0;
 }
 
 int
-fla_flist_search_wfunc(freelist_t flist, uint64_t flags, uint32_t *found,
-                       int(*f)(const uint32_t, va_list), ...)
+fla_flist_run_take(freelist_t flist, uint32_t ndx, uint32_t num)
 {
-  uint32_t elem_cpy, wndx = 0, ret;
-  uint32_t u32_elems = FLA_FREELIST_U32_ELEMS(*flist);
-  uint32_t len = *flist;
-  va_list ap;
+  if ((uint64_t)ndx + num > *flist->words)
+    return -1;
+
+  if (num)
+    fla_flist_range_set(flist, ndx, num, true);
+
+  return 0;
+}
 
-  if ((flags & FLA_FLIST_SEARCH_EXEC_FIRST) == 0)
-    return -EINVAL;
+int
+fla_flist_entries_free(freelist_t flist, uint32_t ndx, unsigned int num)
+{
+  return fla_flist_run_free(flist, ndx, num);
+}
 
-  *found = 0;
+/*
+ * The atomic variants keep the summary levels in line with the words without
+ * a lock. A bit is set by whoever makes the level below non-zero and cleared
+ * by whoever makes it zero. The clearing side checks the level below again
+ * afterwards and sets the bit back if a free raced with it, so a summary bit
+ * is never left clear for a word with free entries.
+ */
 
-  for (uint32_t u32_elem = 0 ; u32_elem < u32_elems; u32_elem++)
+static void
+fla_flist_summary_set_atomic(freelist_t flist, uint32_t w)
+{
+  uint32_t s = w / FLA_FLIST_SUMMARY_BITS;
+  uint64_t bit = 1ull << (w % FLA_FLIST_SUMMARY_BITS);
+
+  if (!__atomic_fetch_or(&flist->summary[s], bit, __ATOMIC_SEQ_CST))
+    __atomic_fetch_or(&flist->top[s / FLA_FLIST_SUMMARY_BITS],
+                      1ull << (s % FLA_FLIST_SUMMARY_BITS), __ATOMIC_SEQ_CST);
+}
+
+static void
+fla_flist_summary_clear_atomic(freelist_t flist, uint32_t w)
+{
+  uint32_t s = w / FLA_FLIST_SUMMARY_BITS;
+  uint64_t bit = 1ull << (w % FLA_FLIST_SUMMARY_BITS);
+  uint64_t top_bit = 1ull << (s % FLA_FLIST_SUMMARY_BITS);
+  uint64_t *top = &flist->top[s / FLA_FLIST_SUMMARY_BITS];
+
+  if (!__atomic_and_fetch(&flist->summary[s], ~bit, __ATOMIC_SEQ_CST))
   {
-    elem_cpy = flist[1 + u32_elem];
-
-    /*
-     * There is a special case when we reach the end element where all the
-     * unused bits are NOT 1s but 0s. Here we need to set the unused 0s to ones
-     * so our stopping condition is valid.
-     */
-    if (u32_elem + 1 == u32_elems)
-    {
-      uint32_t used_spots = len % 32;
-      elem_cpy = elem_cpy | (~0 << used_spots);
-    }
+    __atomic_fetch_and(top, ~top_bit, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&flist->summary[s], __ATOMIC_SEQ_CST))
+      __atomic_fetch_or(top, top_bit, __ATOMIC_SEQ_CST);
+  }
+
+  if (__atomic_load_n(&flist->words[1 + w], __ATOMIC_SEQ_CST))
+    fla_flist_summary_set_atomic(flist, w);
+}
 
-    // All free
-    if (elem_cpy == 0xFFFFFFFF)
-      continue;
+int
+fla_flist_entry_alloc_atomic(freelist_t flist)
+{
+  uint32_t *elem, val, w;
 
-    /* For all the zero bits: isolate and exec f on the index. */
-    for (uint8_t j = 0; j < 32 && elem_cpy != 0xFFFFFFFF; ++j)
+  do
+  {
+    for (w = fla_flist_next_free_word(flist, 0); w < flist->nwords;
+         w = fla_flist_next_free_word(flist, w + 1))
     {
-      wndx = ~elem_cpy & (elem_cpy + 1);
+      elem = &flist->words[1 + w];
+      val = __atomic_load_n(elem, __ATOMIC_RELAXED);
 
-      va_start(ap, f);
-      ret = f(u32_elem * sizeof(uint32_t) * 8 + ntz(wndx), ap);
-      va_end(ap);
+      // take the rightmost free entry, unless another thread empties the word first
+      while (val && !__atomic_compare_exchange_n(elem, &val, val & (val - 1), true,
+             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        ;
 
-      switch (ret)
-      {
-      case 1:
-        *found += ret;
-      //fall through
-      case 0:
-        elem_cpy |= wndx;
+      if (!val)
         continue;
-      default:
-        return ret;
-      }
+
+      if (!(val & (val - 1)))
+        fla_flist_summary_clear_atomic(flist, w);
+      __atomic_fetch_sub(&flist->nfree, 1, __ATOMIC_SEQ_CST);
+
+      return w * sizeof(uint32_t) * 8 + fla_flist_ctz(val);
     }
+    // entries freed behind the scan are still counted, look again
   }
+  while (__atomic_load_n(&flist->nfree, __ATOMIC_SEQ_CST));
+
+  return -1;
+}
+
+int
+fla_flist_entry_free_atomic(freelist_t flist, uint32_t ndx)
+{
+  uint32_t w = ndx / (sizeof(uint32_t) * CHAR_BIT);
+  uint32_t bit = 1u << (ndx % (sizeof(uint32_t) * CHAR_BIT));
+  uint32_t old;
+
+  if (ndx >= *flist->words)
+    return -1;
+
+  old = __atomic_fetch_or(&flist->words[1 + w], bit, __ATOMIC_SEQ_CST);
+  if (old & bit)
+    return 0;
+
+  __atomic_fetch_add(&flist->nfree, 1, __ATOMIC_SEQ_CST);
+  // a word which had free entries already is, or is about to be, in the summary
+  if (!old)
+    fla_flist_summary_set_atomic(flist, w);
+
   return 0;
 }
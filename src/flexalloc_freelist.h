@@ -3,9 +3,37 @@
 
 #include <stdint.h>
 #include <stddef.h>
-#include <stdarg.h>
+#include <stdbool.h>
+#include "flexalloc_freelist_kern.h"
 
-typedef uint32_t * freelist_t;
+/// In-memory freelist handle
+///
+/// The freelist proper is the buffer at `words`, laid out as it is stored on
+/// media: the length of the list followed by one bit per entry, where 1 means
+/// free. The summary levels are kept in memory only and are rebuilt whenever a
+/// freelist is initialized or loaded, so allocation jumps straight to a word
+/// with free entries instead of scanning from the start of the list.
+/// The number of free entries is kept alongside and updated by every
+/// allocation and free.
+struct fla_flist
+{
+  /// freelist as stored on media, see fla_flist_size()
+  uint32_t *words;
+  /// bit `w` is set when freelist word `w` has a free entry
+  uint64_t *summary;
+  /// bit `s` is set when summary word `s` is non-zero
+  uint64_t *top;
+  /// number of freelist words following the length
+  uint32_t nwords;
+  /// number of summary words
+  uint32_t nsummary;
+  /// number of top level words
+  uint32_t ntop;
+  /// number of free entries
+  uint32_t nfree;
+};
+
+typedef struct fla_flist * freelist_t;
 
 #define FLA_FREELIST_U32_ELEMS(b) FLA_CEIL_DIV(b, sizeof(uint32_t) * 8)
 
@@ -35,7 +63,9 @@ fla_flist_len(freelist_t flist);
  *
  * Return number of entries already reserved by the freelist.
  * Number of free entries can be determined by subtracting this value from
- * fla_flist_len().
+ * fla_flist_len(), or with fla_flist_num_free().
+ *
+ * NOTE: the count is maintained by the fla_flist_* functions, this is O(1).
  *
  * @param flist freelist handle
  * @return number of entries already reserved.
@@ -43,6 +73,15 @@ fla_flist_len(freelist_t flist);
 uint32_t
 fla_flist_num_reserved(freelist_t flist);
 
+/**
+ * Return number of free entries in freelist.
+ *
+ * @param flist freelist handle
+ * @return number of entries which can still be reserved.
+ */
+uint32_t
+fla_flist_num_free(freelist_t flist);
+
 /**
  * Reset freelist, setting all `len` entries to free.
  *
@@ -54,7 +93,7 @@ void
 fla_flist_reset(freelist_t flist);
 
 /**
- * Initialize the freelist.
+ * Initialize a freelist in a caller provided buffer.
  *
  * Use this routine routine in case you allocate a buffer by other means
  * (use fla_flist_size() to determine the required size) and wish to initialize
@@ -62,12 +101,18 @@ fla_flist_reset(freelist_t flist);
  * Note: if you wish to re-use an existing freelist, calling fla_flist_reset()
  * will suffice.
  *
- * @param flist freelist handle
+ * NOTE: the buffer is still owned by you. Release the handle with
+ * fla_flist_free(), which leaves the buffer alone.
+ *
+ * @param data buffer of at least fla_flist_size(len) bytes
  * @param len length of the freelist. This should be the same length as provided
  * when using fla_flist_size() to calculate the required buffer size.
+ * @param flist pointer to a freelist handle
+ * @return On success, 0 is returned and flist points to an initialized freelist.
+ * Otherwise, non-zero is returned and flist is uninitialized.
  */
-void
-fla_flist_init(freelist_t flist, uint32_t len);
+int
+fla_flist_init(void *data, uint32_t len, freelist_t *flist);
 
 /**
  * Create a new freelist.
@@ -87,11 +132,12 @@ int
 fla_flist_new(uint32_t len, freelist_t *flist);
 
 /**
- * Free buffer backing the freelist.
+ * Release a freelist handle.
  *
- * NOTE: *only* use this if freelist is allocated using fla_flist_new().
+ * Frees the handle and its summary. The buffer backing the freelist is only
+ * freed if the freelist was created by fla_flist_new().
  *
- * @param flist freelist handle
+ * @param flist freelist handle, may be NULL
  */
 void
 fla_flist_free(freelist_t flist);
@@ -104,21 +150,36 @@ fla_flist_free(freelist_t flist);
  * some point it was initialized with fla_freelist_init() and since then
  * only operated on using the fla_flist_* functions.
  *
- * NOTE: no additional allocations are made and that the memory is still
- * owned by you, do *not* use fla_flist_free() on the freelist handle!
+ * The summary is rebuilt from the buffer contents.
+ *
+ * NOTE: the memory at data is still owned by you, fla_flist_free() on the
+ * freelist handle releases the handle only.
  *
  * @param data a buffer with data laid out by the freelist routines.
- * @return a freelist handle
+ * @param flist pointer to a freelist handle
+ * @return On success, 0 is returned and flist points to the loaded freelist.
+ * Otherwise, non-zero is returned and flist is uninitialized.
  * */
-freelist_t
-fla_flist_load(void *data);
+int
+fla_flist_load(void *data, freelist_t *flist);
 
 /**
- * Allocate an entry from the freelist (if possible).
+ * Return the buffer backing the freelist.
  *
- * Allocates an entry from the freelist, if possible, and returns its
- * index. An allocation may fail only if the freelist is full, in which
- * case -1 is returned.
+ * This is the memory to persist, fla_flist_size() bytes laid out as on media.
+ *
+ * @param flist freelist handle
+ * @return buffer backing the freelist
+ */
+void *
+fla_flist_data(freelist_t flist);
+
+/**
+ * Allocate entries from the freelist (if possible).
+ *
+ * Allocates `num` consecutive entries from the freelist, if possible, and
+ * returns the index of the first. An allocation fails if the freelist has no
+ * run of `num` free entries, in which case -1 is returned.
  *
  * @param flist freelist handle
  * @param unsigned int num of entries to allocate
@@ -129,6 +190,53 @@ fla_flist_load(void *data);
 int
 fla_flist_entries_alloc(freelist_t flist, unsigned int num);
 
+/**
+ * Allocate a run of consecutive entries from the freelist.
+ *
+ * Reserves the lowest run of `num` consecutive free entries. Runs may span
+ * several freelist words.
+ *
+ * @param flist freelist handle
+ * @param num number of consecutive entries to allocate, must be non-zero
+ * @return On success, the index of the first entry of the run. On error,
+ * -1, in which case no allocation was made.
+ */
+int
+fla_flist_run_alloc(freelist_t flist, uint32_t num);
+
+/**
+ * Free a run of consecutive entries.
+ *
+ * Frees entries `ndx` through `ndx + num - 1`, whole words at a time.
+ *
+ * NOTE: the free is idempotent, freeing already free entries is fine.
+ *
+ * @param flist freelist handle
+ * @param ndx index of the first entry to free
+ * @param num number of entries to free
+ * @return On success, 0 is returned. If the run does not fit within the
+ * freelist -1 is returned and nothing is freed.
+ */
+int
+fla_flist_run_free(freelist_t flist, uint32_t ndx, uint32_t num);
+
+/**
+ * Reserve a given run of consecutive entries.
+ *
+ * Takes entries `ndx` through `ndx + num - 1`, as when replaying an
+ * allocation whose position is already known.
+ *
+ * NOTE: the reservation is idempotent, taking already reserved entries is fine.
+ *
+ * @param flist freelist handle
+ * @param ndx index of the first entry to reserve
+ * @param num number of entries to reserve
+ * @return On success, 0 is returned. If the run does not fit within the
+ * freelist -1 is returned and nothing is reserved.
+ */
+int
+fla_flist_run_take(freelist_t flist, uint32_t ndx, uint32_t num);
+
 /**
  * Free an entry from the freelist.
  *
@@ -147,28 +255,132 @@ fla_flist_entries_alloc(freelist_t flist, unsigned int num);
 int
 fla_flist_entry_free(freelist_t flist, uint32_t ndx);
 
-
+/**
+ * Free `num` entries starting at `ndx`, see fla_flist_run_free().
+ */
 int
 fla_flist_entries_free(freelist_t flist, uint32_t ndx, unsigned int num);
 
 /**
- * Search all the used element by executing a function.
+ * Allocate one entry, safe against concurrent atomic calls.
+ *
+ * Takes the lowest free entry of the first word found with a compare and
+ * swap on the word. Several threads may call this and
+ * fla_flist_entry_free_atomic() on the same freelist at once. Other
+ * modifying calls must not run concurrently with them.
  *
+ * While the freelist counts free entries which the scan missed, because
+ * they were freed behind it, the scan starts over. A caller which made sure
+ * an entry is free for it therefore never fails.
  *
  * @param flist freelist handle
- * @param flags modifies how the function is executed.
- *        When FLA_FLIST_SEARCH_EXEC_FIRST is set returns on first find
- * @param found is the number of times f returned 1
- * @param f The function that will be executed. Must Return < 0
- *        on error, must return 0 when an element was not "found",
- *        must return 1 when an element was "found".
- * @param ... These are the variadic arguments that will be
- *        forwarded to the f function.
- * @return <0 if there is an error. 0 otherwise.
+ * @return On success, the index of the entry. -1 if no entry is free.
  */
 int
-fla_flist_search_wfunc(freelist_t flist, uint64_t flags, uint32_t *found,
-                       int(*f)(const uint32_t, va_list), ...);
-#define FLA_FLIST_SEARCH_EXEC_FIRST 1 << 0
+fla_flist_entry_alloc_atomic(freelist_t flist);
+
+/**
+ * Free an entry, safe against concurrent atomic calls.
+ *
+ * See fla_flist_entry_alloc_atomic(). Like fla_flist_entry_free() the free is
+ * idempotent.
+ *
+ * @param flist freelist handle
+ * @param ndx index within the freelist of the element to free
+ * @return On success, 0 is returned. On error, -1 is returned.
+ */
+int
+fla_flist_entry_free_atomic(freelist_t flist, uint32_t ndx);
+
+/// Freelist iterator
+///
+/// Walks the reserved or the free entries of a freelist in index order
+/// without allocating or calling out. The iterator takes a copy of one word
+/// at a time, changes to the word being walked are not seen.
+struct fla_flist_iter
+{
+  /// freelist words following the length
+  uint32_t const *words;
+  /// number of freelist words
+  uint32_t nwords;
+  /// valid bits of the last word
+  uint32_t last_mask;
+  /// index of the word being walked
+  uint32_t w;
+  /// entries of word `w` still to visit
+  uint32_t bits;
+  /// ~0 to visit reserved entries, 0 to visit free entries
+  uint32_t flip;
+};
+
+/**
+ * Initialize an iterator over the freelist.
+ *
+ * @param it iterator to initialize
+ * @param flist freelist handle
+ * @param reserved visit the reserved entries if true, the free entries otherwise
+ */
+static inline void
+fla_flist_iter_init(struct fla_flist_iter *it, freelist_t flist, bool reserved)
+{
+  uint32_t len = *flist->words;
+
+  it->words = flist->words + 1;
+  it->nwords = flist->nwords;
+  it->last_mask = len % 32 ? ~0u >> (32 - len % 32) : ~0u;
+  it->w = 0;
+  it->flip = reserved ? ~0u : 0;
+  it->bits = it->nwords ? it->words[0] ^ it->flip : 0;
+  if (it->nwords == 1)
+    it->bits &= it->last_mask;
+}
+
+/**
+ * Advance the iterator to the next entry.
+ *
+ * @param it iterator, see fla_flist_iter_init()
+ * @param ndx set to the index of the entry on success
+ * @return true if an entry was found, false once the freelist is exhausted.
+ */
+static inline bool
+fla_flist_iter_next(struct fla_flist_iter *it, uint32_t *ndx)
+{
+  while (!it->bits)
+  {
+    if (++it->w >= it->nwords)
+    {
+      it->w = it->nwords;
+      return false;
+    }
+
+    it->bits = it->words[it->w] ^ it->flip;
+    if (it->w + 1 == it->nwords)
+      it->bits &= it->last_mask;
+  }
+
+  *ndx = it->w * 32 + fla_flist_ctz(it->bits);
+  it->bits &= it->bits - 1;
+  return true;
+}
+
+/**
+ * Fill `ndxs` with the indices of up to `max` next entries.
+ *
+ * @param it iterator, see fla_flist_iter_init()
+ * @param ndxs array of at least `max` elements
+ * @param max number of indices to return at most
+ * @return number of indices written, less than `max` once the freelist is
+ * exhausted.
+ */
+static inline uint32_t
+fla_flist_iter_batch(struct fla_flist_iter *it, uint32_t *ndxs, uint32_t max)
+{
+  uint32_t n = 0;
+
+  while (n < max && fla_flist_iter_next(it, ndxs + n))
+    n++;
+
+  return n;
+}
 
 #endif // __FLEXALLOC_FREELIST_H_
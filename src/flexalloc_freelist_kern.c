@@ -0,0 +1,234 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include "flexalloc_freelist_kern.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FLA_FLIST_KERN_X86
+#include <immintrin.h>
+#endif
+
+struct fla_flist_kern
+{
+  enum fla_flist_kern_isa isa;
+  uint64_t (*popcount)(uint32_t const *words, uint32_t nwords);
+  uint32_t (*find)(uint32_t const *words, uint32_t from, uint32_t nwords, uint32_t skip);
+};
+
+// freelist words follow the 32-bit length, 64-bit loads are unaligned
+static inline uint64_t
+fla_flist_load64(uint32_t const *words)
+{
+  uint64_t val;
+
+  memcpy(&val, words, sizeof(val));
+  return val;
+}
+
+static uint64_t
+fla_flist_popcount_scalar(uint32_t const *words, uint32_t nwords)
+{
+  uint64_t nset = 0;
+  uint32_t i = 0;
+
+  for (; i + 2 <= nwords; i += 2)
+    nset += __builtin_popcountll(fla_flist_load64(words + i));
+
+  if (i < nwords)
+    nset += __builtin_popcount(words[i]);
+
+  return nset;
+}
+
+static uint32_t
+fla_flist_find_scalar(uint32_t const *words, uint32_t from, uint32_t nwords, uint32_t skip)
+{
+  uint64_t skip64 = ((uint64_t)skip << 32) | skip;
+  uint32_t i = from;
+
+  for (; i + 2 <= nwords; i += 2)
+  {
+    if (fla_flist_load64(words + i) != skip64)
+      return words[i] != skip ? i : i + 1;
+  }
+
+  if (i < nwords && words[i] != skip)
+    return i;
+
+  return nwords;
+}
+
+#ifdef FLA_FLIST_KERN_X86
+/*
+ * Popcount by nibble lookup, summing the byte counts into 64-bit lanes with
+ * the sum of absolute differences against zero.
+ */
+__attribute__((target("avx2")))
+static uint64_t
+fla_flist_popcount_avx2(uint32_t const *words, uint32_t nwords)
+{
+  __m256i const lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  __m256i const nibble = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  __m256i val, lo, hi;
+  uint32_t i = 0;
+
+  for (; i + 8 <= nwords; i += 8)
+  {
+    val = _mm256_loadu_si256((__m256i const *)(words + i));
+    lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(val, nibble));
+    hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(val, 4), nibble));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi),
+                           _mm256_setzero_si256()));
+  }
+
+  return (uint64_t)_mm256_extract_epi64(acc, 0) + (uint64_t)_mm256_extract_epi64(acc, 1)
+         + (uint64_t)_mm256_extract_epi64(acc, 2) + (uint64_t)_mm256_extract_epi64(acc, 3)
+         + fla_flist_popcount_scalar(words + i, nwords - i);
+}
+
+__attribute__((target("avx2")))
+static uint32_t
+fla_flist_find_avx2(uint32_t const *words, uint32_t from, uint32_t nwords, uint32_t skip)
+{
+  __m256i const skipv = _mm256_set1_epi32(skip);
+  __m256i val;
+  uint32_t i = from, eq;
+
+  for (; i + 8 <= nwords; i += 8)
+  {
+    val = _mm256_loadu_si256((__m256i const *)(words + i));
+    eq = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(val, skipv)));
+    if (eq != 0xff)
+      return i + fla_flist_ctz(~eq & 0xff);
+  }
+
+  return fla_flist_find_scalar(words, i, nwords, skip);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t
+fla_flist_popcount_avx512(uint32_t const *words, uint32_t nwords)
+{
+  __m512i acc = _mm512_setzero_si512();
+  uint32_t i = 0;
+
+  for (; i + 16 <= nwords; i += 16)
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512(words + i)));
+
+  return (uint64_t)_mm512_reduce_add_epi64(acc)
+         + fla_flist_popcount_scalar(words + i, nwords - i);
+}
+
+__attribute__((target("avx512f")))
+static uint32_t
+fla_flist_find_avx512(uint32_t const *words, uint32_t from, uint32_t nwords, uint32_t skip)
+{
+  __m512i const skipv = _mm512_set1_epi32(skip);
+  __mmask16 ne;
+  uint32_t i = from;
+
+  for (; i + 16 <= nwords; i += 16)
+  {
+    ne = _mm512_cmpneq_epi32_mask(_mm512_loadu_si512(words + i), skipv);
+    if (ne)
+      return i + fla_flist_ctz(ne);
+  }
+
+  return fla_flist_find_scalar(words, i, nwords, skip);
+}
+#endif // FLA_FLIST_KERN_X86
+
+static struct fla_flist_kern const fla_flist_kerns[] =
+{
+  [FLA_FLIST_KERN_SCALAR] = {
+    .isa = FLA_FLIST_KERN_SCALAR,
+    .popcount = fla_flist_popcount_scalar,
+    .find = fla_flist_find_scalar,
+  },
+#ifdef FLA_FLIST_KERN_X86
+  [FLA_FLIST_KERN_AVX2] = {
+    .isa = FLA_FLIST_KERN_AVX2,
+    .popcount = fla_flist_popcount_avx2,
+    .find = fla_flist_find_avx2,
+  },
+  [FLA_FLIST_KERN_AVX512] = {
+    .isa = FLA_FLIST_KERN_AVX512,
+    .popcount = fla_flist_popcount_avx512,
+    .find = fla_flist_find_avx512,
+  },
+#endif // FLA_FLIST_KERN_X86
+};
+
+static struct fla_flist_kern const *fla_flist_kern_cur;
+
+static bool
+fla_flist_kern_supported(enum fla_flist_kern_isa isa)
+{
+  switch (isa)
+  {
+  case FLA_FLIST_KERN_SCALAR:
+    return true;
+#ifdef FLA_FLIST_KERN_X86
+  case FLA_FLIST_KERN_AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+  case FLA_FLIST_KERN_AVX512:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq");
+#endif // FLA_FLIST_KERN_X86
+  default:
+    return false;
+  }
+}
+
+static struct fla_flist_kern const *
+fla_flist_kern_get(void)
+{
+  struct fla_flist_kern const *kern = __atomic_load_n(&fla_flist_kern_cur, __ATOMIC_ACQUIRE);
+
+  if (kern)
+    return kern;
+
+  // racing callers pick the same implementation, the last store wins
+  kern = &fla_flist_kerns[FLA_FLIST_KERN_SCALAR];
+  if (fla_flist_kern_supported(FLA_FLIST_KERN_AVX512))
+    kern = &fla_flist_kerns[FLA_FLIST_KERN_AVX512];
+  else if (fla_flist_kern_supported(FLA_FLIST_KERN_AVX2))
+    kern = &fla_flist_kerns[FLA_FLIST_KERN_AVX2];
+
+  __atomic_store_n(&fla_flist_kern_cur, kern, __ATOMIC_RELEASE);
+  return kern;
+}
+
+uint64_t
+fla_flist_kern_popcount(uint32_t const *words, uint32_t nwords)
+{
+  return fla_flist_kern_get()->popcount(words, nwords);
+}
+
+uint32_t
+fla_flist_kern_find(uint32_t const *words, uint32_t from, uint32_t nwords, uint32_t skip)
+{
+  if (from >= nwords)
+    return nwords;
+
+  return fla_flist_kern_get()->find(words, from, nwords, skip);
+}
+
+int
+fla_flist_kern_select(enum fla_flist_kern_isa isa)
+{
+  if (!fla_flist_kern_supported(isa))
+    return -ENOTSUP;
+
+  __atomic_store_n(&fla_flist_kern_cur, &fla_flist_kerns[isa], __ATOMIC_RELEASE);
+  return 0;
+}
+
+enum fla_flist_kern_isa
+fla_flist_kern_isa(void)
+{
+  return fla_flist_kern_get()->isa;
+}
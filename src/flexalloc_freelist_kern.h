@@ -0,0 +1,85 @@
+#ifndef __FLEXALLOC_FREELIST_KERN_H_
+#define __FLEXALLOC_FREELIST_KERN_H_
+
+/*
+ * Freelist kernels
+ *
+ * Word level primitives the freelist is built on. The freelist is stored as
+ * 32-bit words, the kernels read it 64 bits at a time with compiler builtins
+ * and, on x86-64, with AVX2 or AVX-512 when the CPU supports them. The
+ * implementation is chosen at runtime on first use.
+ */
+
+#include <stdint.h>
+
+/// Instruction set a kernel implementation is built for
+enum fla_flist_kern_isa
+{
+  FLA_FLIST_KERN_SCALAR = 0,
+  FLA_FLIST_KERN_AVX2,
+  FLA_FLIST_KERN_AVX512,
+};
+
+/**
+ * Index of the lowest set bit of a non-zero 32-bit value.
+ */
+static inline uint32_t
+fla_flist_ctz(uint32_t x)
+{
+  return __builtin_ctz(x);
+}
+
+/**
+ * Index of the lowest set bit of a non-zero 64-bit value.
+ */
+static inline uint32_t
+fla_flist_ctz64(uint64_t x)
+{
+  return __builtin_ctzll(x);
+}
+
+/**
+ * Count the set bits of `nwords` freelist words.
+ *
+ * @param words first word to count
+ * @param nwords number of words to count
+ * @return number of set bits
+ */
+uint64_t
+fla_flist_kern_popcount(uint32_t const *words, uint32_t nwords);
+
+/**
+ * Find the first word which differs from `skip`.
+ *
+ * Skips over fully booked words with skip == 0 and over fully free words
+ * with skip == UINT32_MAX.
+ *
+ * @param words freelist words
+ * @param from index of the first word to look at
+ * @param nwords number of words in `words`
+ * @param skip value of the words to skip over
+ * @return index of the first word at or after `from` differing from `skip`,
+ * `nwords` if there is none.
+ */
+uint32_t
+fla_flist_kern_find(uint32_t const *words, uint32_t from, uint32_t nwords, uint32_t skip);
+
+/**
+ * Select the kernel implementation.
+ *
+ * The best implementation the CPU supports is selected on first use, this
+ * overrides the choice. Meant for benchmarks and tests.
+ *
+ * @param isa instruction set to use
+ * @return 0 on success, -ENOTSUP if the CPU or build does not support isa.
+ */
+int
+fla_flist_kern_select(enum fla_flist_kern_isa isa);
+
+/**
+ * Return the instruction set of the kernels in use.
+ */
+enum fla_flist_kern_isa
+fla_flist_kern_isa(void);
+
+#endif // __FLEXALLOC_FREELIST_KERN_H_
@@ -49,6 +49,7 @@ print_super(struct fla_super *super)
   fprintf(stdout, "npools: %"PRIu32"\n", super->npools);
   fprintf(stdout, "md_nlb: %"PRIu32"\n", super->md_nlb);
   fprintf(stdout, "fmt_version: %"PRIu8"\n", super->fmt_version);
+  fprintf(stdout, "jnl_nlb: %"PRIu32"\n", super->jnl_nlb);
 }
 
 int
@@ -195,6 +196,22 @@ validate_pool_entries(struct flexalloc *fs)
   return err;
 }
 
+void
+report_usage(struct flexalloc *fs)
+{
+  struct fla_usage usage;
+
+  fprintf(stdout, "== Utilization...\n");
+  if (fla_usage(fs, &usage))
+    return;
+
+  fprintf(stdout, "   * Pools: %"PRIu32" of %"PRIu32" in use\n", usage.npools_used, usage.npools);
+  fprintf(stdout, "   * Slabs: %"PRIu32" of %"PRIu32" in use\n",
+          usage.nslabs - usage.nslabs_free, usage.nslabs);
+  fprintf(stdout, "   * Objects: %"PRIu64" in use, %"PRIu64" logical blocks\n",
+          usage.nobjs_used, usage.nlb_used);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -247,6 +264,7 @@ main(int argc, char **argv)
   validate_md_ptr_offsets(fs);
   validate_pool_num_entries(fs);
   validate_pool_entries(fs);
+  report_usage(fs);
 
   fla_close_noflush(fs);
 
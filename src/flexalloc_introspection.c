@@ -13,7 +13,7 @@ __flist_bit_reserved(freelist_t flist, uint32_t ndx)
 {
   /* check if bit at offset `ndx` of freelist is reserved */
   uint32_t *start;
-  for (start = flist + 1; ndx > 32; ndx -= 32, start++)
+  for (start = flist->words + 1; ndx > 32; ndx -= 32, start++)
     continue;
 
   /* remember, 1->free, 0->reserved */
@@ -67,13 +67,13 @@ mdr_ptr_check_super_offset(struct flexalloc *fs)
 int
 md_ptr_check_super_size(struct flexalloc *fs)
 {
-  return (PTR_OFFSETOF(fs->super, fs->pools.freelist)
+  return (PTR_OFFSETOF(fs->super, fla_flist_data(fs->pools.freelist))
           != fs->geo.md_nlb * fs->geo.lb_nbytes);
 }
 int
 md_ptr_check_pool_freelist_size(struct flexalloc *fs)
 {
-  return (PTR_OFFSETOF(fs->pools.freelist, fs->pools.htbl_hdr_buffer)
+  return (PTR_OFFSETOF(fla_flist_data(fs->pools.freelist), fs->pools.htbl_hdr_buffer)
           != fs->geo.pool_sgmt.freelist_nlb * fs->geo.lb_nbytes);
 }
 
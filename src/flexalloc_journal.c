@@ -0,0 +1,820 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flexalloc_journal.h"
+#include "flexalloc.h"
+#include "flexalloc_ckpt.h"
+#include "flexalloc_mm.h"
+#include "flexalloc_pool.h"
+#include "flexalloc_slabcache.h"
+#include "flexalloc_xnvme_env.h"
+#include "flexalloc_util.h"
+
+#define FLA_JNL_MAGIC 0x4c4e4a414c46ULL // 'FLAJNL'
+
+/// first block of the journal, written by mkfs and by every checkpoint
+struct fla_jnl_super
+{
+  uint64_t magic;
+  /// set by mkfs, commits of an earlier format carry another id
+  uint64_t id;
+  /// blocks of the journal including this one
+  uint32_t nlb;
+  /// block of the first commit not covered by the last checkpoint
+  uint32_t start;
+  /// sequence number of the commit at start
+  uint64_t seq;
+};
+
+/// first bytes of a commit, followed by its records and padded to whole blocks
+struct fla_jnl_commit
+{
+  uint64_t magic;
+  uint64_t id;
+  /// commits are numbered from 0 since the format, replay stops at a gap
+  uint64_t seq;
+  /// FNV-1a of the commit, computed with this field set to 0
+  uint64_t csum;
+  /// blocks of the commit
+  uint32_t nlb;
+  /// bytes of records following the header
+  uint32_t nbytes;
+};
+
+/// in memory state of the journal
+struct fla_jnl
+{
+  struct flexalloc *fs;
+  /// device holding the journal
+  struct xnvme_dev *dev;
+  /// first block of the journal, its super
+  uint64_t slba;
+  /// blocks of the journal including the super
+  uint32_t nlb;
+  uint32_t lb_nbytes;
+  uint64_t id;
+  /// next block to write a commit to
+  uint32_t pos;
+  /// blocks from the start set by the last checkpoint up to pos, including
+  /// those skipped when wrapping around
+  uint32_t used;
+  /// sequence number of the next commit
+  uint64_t seq;
+  /// records logged and not yet taken by a commit
+  char *recs;
+  size_t recs_nbytes;
+  size_t recs_cap;
+  /// times records were taken by a commit
+  uint64_t ntaken;
+  /// records logged since the journal was opened
+  uint64_t nlogged;
+  /// records known to be on disk, in the journal or in place
+  uint64_t ndurable;
+  /// I/O buffer spanning the whole journal
+  void *io_buf;
+  /// one block to write the super from, commits go on during a checkpoint
+  void *super_buf;
+  /// a commit is being written from io_buf
+  bool writing;
+  /// set when records were lost from the journal, cleared by a checkpoint
+  int err;
+  /// times err was set
+  uint64_t nerrs;
+  /// a checkpoint was asked of the checkpoint thread and has not ended yet
+  bool ckpt_req;
+  pthread_mutex_t lock;
+  /// signalled when a commit or a checkpoint is done
+  pthread_cond_t done;
+};
+
+static uint64_t
+fla_jnl_csum(void const *buf, size_t nbytes)
+{
+  unsigned char const *p = buf;
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < nbytes; ++i)
+  {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
+}
+
+static int
+fla_jnl_io(struct flexalloc *fs, struct xnvme_dev *dev, void *buf, uint64_t slba, uint32_t nlb,
+           bool write)
+{
+  int err;
+  struct xnvme_lba_range range;
+
+  range = fla_xne_lba_range_from_slba_naddrs(dev, slba, nlb);
+  if ((err = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
+    return err;
+
+  struct fla_xne_io xne_io = {.io_type = write ? FLA_IO_MD_WRITE : FLA_IO_MD_READ, .dev = dev,
+                              .buf = buf, .lba_range = &range, .fla_dp = &fs->fla_dp,
+                              .qpool = dev == fs->dev.dev ? fs->qpool : NULL};
+  if (write)
+    err = fla_xne_sync_seq_w_xneio(&xne_io);
+  else
+    err = fla_xne_sync_seq_r_xneio(&xne_io);
+  FLA_ERR(err, "fla_xne_sync_seq_w/r_xneio()");
+
+  return err;
+}
+
+int
+fla_jnl_format(struct flexalloc *fs, struct xnvme_dev *md_dev)
+{
+  struct fla_geo const *geo = &fs->geo;
+  struct fla_jnl_super *super;
+  struct timespec now;
+  void *buf;
+  int err;
+
+  if (!geo->jnl_nlb)
+    return 0;
+
+  // commits of an earlier format at the same place carry another id
+  buf = fla_xne_alloc_buf(md_dev, 2 * geo->lb_nbytes);
+  if (FLA_ERR(!buf, "fla_xne_alloc_buf()"))
+    return -ENOMEM;
+
+  memset(buf, 0, 2 * geo->lb_nbytes);
+  clock_gettime(CLOCK_REALTIME, &now);
+  super = buf;
+  super->magic = FLA_JNL_MAGIC;
+  super->id = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+  super->nlb = geo->jnl_nlb;
+  super->start = 1;
+  super->seq = 0;
+
+  err = fla_jnl_io(fs, md_dev, buf, fla_geo_jnl_lb_off(geo), 2, true);
+  FLA_ERR(err, "fla_jnl_io()");
+
+  fla_xne_free_buf(md_dev, buf);
+  return err;
+}
+
+static int
+fla_jnl_super_write(struct fla_jnl *jnl, uint32_t start, uint64_t seq)
+{
+  struct fla_jnl_super *super = jnl->super_buf;
+
+  memset(jnl->super_buf, 0, jnl->lb_nbytes);
+  super->magic = FLA_JNL_MAGIC;
+  super->id = jnl->id;
+  super->nlb = jnl->nlb;
+  super->start = start;
+  super->seq = seq;
+
+  return fla_jnl_io(jnl->fs, jnl->dev, jnl->super_buf, jnl->slba, 1, true);
+}
+
+static int
+fla_jnl_apply_objs(struct fla_jnl *jnl, struct fla_jnl_rec const *rec, char const *data)
+{
+  struct flexalloc *fs = jnl->fs;
+  struct fla_pool_entry *pool_entry;
+  struct fla_object obj;
+  uint32_t nentries;
+  int err;
+
+  if (FLA_ERR(rec->pool_ndx >= fs->geo.npools || rec->nbytes % sizeof(obj), "invalid record"))
+    return -EINVAL;
+
+  pool_entry = &fs->pools.entries[rec->pool_ndx];
+  nentries = fs->pools.entrie_funcs[rec->pool_ndx].fla_pool_num_fla_objs(pool_entry);
+
+  for (uint32_t off = 0; off < rec->nbytes; off += sizeof(obj))
+  {
+    memcpy(&obj, data + off, sizeof(obj));
+    if (FLA_ERR(obj.slab_id >= fs->geo.nslabs, "invalid object in record"))
+      return -EINVAL;
+
+    err = fla_slab_cache_elem_load(&fs->slab_cache, obj.slab_id, pool_entry->slab_nobj);
+    if (err == FLA_SLAB_CACHE_INVALID_STATE)
+      err = 0; //Ignore as it was already loaded.
+    else if (FLA_ERR(err, "fla_slab_cache_elem_load()"))
+      return err;
+
+    err = fla_slab_cache_obj_restore(&fs->slab_cache, &obj, nentries,
+                                     rec->type == FLA_JNL_OBJ_CREATE);
+    if (FLA_ERR(err, "fla_slab_cache_obj_restore()"))
+      return err;
+  }
+
+  return 0;
+}
+
+static int
+fla_jnl_apply(struct fla_jnl *jnl, struct fla_jnl_rec const *rec, char const *data,
+              uint32_t *owners)
+{
+  struct flexalloc *fs = jnl->fs;
+  struct fla_pool_entry entry;
+  uint64_t root;
+  int err;
+
+  switch (rec->type)
+  {
+  case FLA_JNL_OBJ_CREATE:
+  case FLA_JNL_OBJ_DESTROY:
+    return fla_jnl_apply_objs(jnl, rec, data);
+
+  case FLA_JNL_SLAB_ACQUIRE:
+    if (FLA_ERR(rec->pool_ndx >= fs->geo.npools || rec->slab_id >= fs->geo.nslabs,
+                "invalid record"))
+      return -EINVAL;
+
+    owners[rec->slab_id] = rec->pool_ndx;
+    fla_slab_cache_elem_drop(&fs->slab_cache, rec->slab_id);
+    err = fla_slab_cache_elem_init(&fs->slab_cache, rec->slab_id,
+                                   fs->pools.entries[rec->pool_ndx].slab_nobj);
+    FLA_ERR(err, "fla_slab_cache_elem_init()");
+    return err;
+
+  case FLA_JNL_SLAB_RELEASE:
+    if (FLA_ERR(rec->slab_id >= fs->geo.nslabs, "invalid record"))
+      return -EINVAL;
+
+    owners[rec->slab_id] = FLA_SLAB_POOL_NONE;
+    fla_slab_cache_elem_drop(&fs->slab_cache, rec->slab_id);
+    return 0;
+
+  case FLA_JNL_POOL_CREATE:
+  case FLA_JNL_POOL_DESTROY:
+    if (FLA_ERR(rec->pool_ndx >= fs->geo.npools || rec->nbytes != sizeof(entry),
+                "invalid record"))
+      return -EINVAL;
+
+    memcpy(&entry, data, sizeof(entry));
+    if (rec->type == FLA_JNL_POOL_CREATE)
+      return fla_pool_entry_restore(fs, rec->pool_ndx, &entry);
+    return fla_pool_entry_drop(fs, rec->pool_ndx, &entry);
+
+  case FLA_JNL_POOL_ROOT:
+    if (FLA_ERR(rec->pool_ndx >= fs->geo.npools || rec->nbytes != sizeof(root),
+                "invalid record"))
+      return -EINVAL;
+
+    memcpy(&root, data, sizeof(root));
+    fs->pools.entries[rec->pool_ndx].root_obj_hndl = root;
+    fla_md_mark_dirty(fs, &fs->pools.entries[rec->pool_ndx].root_obj_hndl, sizeof(root));
+    return 0;
+  }
+
+  FLA_ERR_PRINTF("unknown journal record type %"PRIu16, rec->type);
+  return -EINVAL;
+}
+
+static int
+fla_jnl_apply_commit(struct fla_jnl *jnl, struct fla_jnl_commit const *commit,
+                     uint32_t *owners)
+{
+  char const *recs = (char const *)(commit + 1);
+  struct fla_jnl_rec rec;
+  int err;
+
+  for (uint32_t off = 0; off < commit->nbytes; off += sizeof(rec) + rec.nbytes)
+  {
+    if (FLA_ERR(commit->nbytes - off < sizeof(rec), "truncated record"))
+      return -EINVAL;
+
+    memcpy(&rec, recs + off, sizeof(rec));
+    if (FLA_ERR(rec.nbytes > commit->nbytes - off - sizeof(rec), "truncated record"))
+      return -EINVAL;
+
+    err = fla_jnl_apply(jnl, &rec, recs + off + sizeof(rec), owners);
+    if (FLA_ERR(err, "fla_jnl_apply()"))
+      return err;
+  }
+
+  return 0;
+}
+
+/*
+ * The commit expected at pos, or NULL if the block holds none, one of another
+ * format, out of sequence or torn.
+ */
+static struct fla_jnl_commit *
+fla_jnl_commit_at(struct fla_jnl *jnl, uint32_t pos)
+{
+  struct fla_jnl_commit *commit;
+  uint64_t csum;
+
+  if (pos >= jnl->nlb)
+    return NULL;
+
+  commit = (struct fla_jnl_commit *)((char *)jnl->io_buf + (size_t)pos * jnl->lb_nbytes);
+  if (commit->magic != FLA_JNL_MAGIC || commit->id != jnl->id || commit->seq != jnl->seq
+      || !commit->nlb || commit->nlb > jnl->nlb - pos
+      || commit->nbytes > (size_t)commit->nlb * jnl->lb_nbytes - sizeof(*commit))
+    return NULL;
+
+  csum = commit->csum;
+  commit->csum = 0;
+  if (fla_jnl_csum(commit, sizeof(*commit) + commit->nbytes) != csum)
+    return NULL;
+
+  return commit;
+}
+
+/*
+ * Apply the commits from the start given by the super in order, up to the
+ * first one missing. A commit which did not fit at the end of the journal
+ * was written to the block after the super.
+ */
+static int
+fla_jnl_replay(struct fla_jnl *jnl, bool *replayed)
+{
+  struct flexalloc *fs = jnl->fs;
+  struct fla_jnl_super *super = jnl->io_buf;
+  struct fla_jnl_commit *commit;
+  uint32_t *owners = NULL;
+  int err;
+
+  *replayed = false;
+
+  err = fla_jnl_io(fs, jnl->dev, jnl->io_buf, jnl->slba, jnl->nlb, false);
+  if (FLA_ERR(err, "fla_jnl_io()"))
+    return err;
+
+  if (FLA_ERR(super->magic != FLA_JNL_MAGIC || super->nlb != jnl->nlb
+              || !super->start || super->start > jnl->nlb, "invalid journal super"))
+    return -EINVAL;
+
+  jnl->id = super->id;
+  jnl->pos = super->start;
+  jnl->seq = super->seq;
+  jnl->used = 0;
+
+  while (jnl->used < jnl->nlb - 1)
+  {
+    commit = fla_jnl_commit_at(jnl, jnl->pos);
+    if (!commit && jnl->pos != 1)
+    {
+      commit = fla_jnl_commit_at(jnl, 1);
+      if (commit)
+      {
+        jnl->used += jnl->nlb - jnl->pos;
+        jnl->pos = 1;
+      }
+    }
+    if (!commit)
+      break;
+
+    if (!owners)
+    {
+      owners = malloc(fs->geo.nslabs * sizeof(uint32_t));
+      if (FLA_ERR(!owners, "malloc()"))
+        return -ENOMEM;
+
+      for (uint32_t slab_id = 0; slab_id < fs->geo.nslabs; ++slab_id)
+        owners[slab_id] = fs->slabs.headers[slab_id].pool;
+    }
+
+    err = fla_jnl_apply_commit(jnl, commit, owners);
+    if (FLA_ERR(err, "fla_jnl_apply_commit()"))
+      goto exit;
+
+    jnl->pos += commit->nlb;
+    jnl->used += commit->nlb;
+    jnl->seq++;
+  }
+
+  if (!owners)
+    return 0;
+
+  err = fla_slabs_rebuild(fs, owners);
+  if (FLA_ERR(err, "fla_slabs_rebuild()"))
+    goto exit;
+
+  // slab headers and lists may be torn on disk, write all of the metadata out
+  fla_md_mark_dirty(fs, fs->fs_buffer, (size_t)fla_geo_nblocks(&fs->geo) * fs->geo.lb_nbytes);
+  *replayed = true;
+
+exit:
+  free(owners);
+  return err;
+}
+
+/*
+ * Checkpoint and wait for it, called and returning with the journal lock
+ * held. Handles with a checkpointer leave it to its thread, so that callers
+ * running out of journal at once share one checkpoint.
+ */
+static void
+fla_jnl_ckpt_wait(struct fla_jnl *jnl)
+{
+  int err;
+
+  pthread_mutex_unlock(&jnl->lock);
+  if (jnl->fs->ckpt)
+    err = fla_ckpt_wait(jnl->fs);
+  else
+    err = fla_flush(jnl->fs);
+  pthread_mutex_lock(&jnl->lock);
+
+  if (FLA_ERR(err, "fla_flush()"))
+  {
+    jnl->err = err;
+    jnl->nerrs++;
+  }
+}
+
+static int
+fla_jnl_init(struct flexalloc *fs, struct fla_jnl **jnl_out)
+{
+  struct fla_jnl *jnl;
+  int err;
+
+  jnl = calloc(1, sizeof(struct fla_jnl));
+  if (FLA_ERR(!jnl, "calloc()"))
+    return -ENOMEM;
+
+  jnl->fs = fs;
+  jnl->dev = fs->dev.md_dev ? fs->dev.md_dev : fs->dev.dev;
+  jnl->slba = fla_geo_jnl_lb_off(&fs->geo);
+  jnl->nlb = fs->geo.jnl_nlb;
+  jnl->lb_nbytes = fs->geo.lb_nbytes;
+
+  jnl->io_buf = fla_xne_alloc_buf(jnl->dev, (size_t)jnl->nlb * jnl->lb_nbytes);
+  if (FLA_ERR(!jnl->io_buf, "fla_xne_alloc_buf()"))
+  {
+    err = -ENOMEM;
+    goto free_jnl;
+  }
+
+  jnl->super_buf = fla_xne_alloc_buf(jnl->dev, jnl->lb_nbytes);
+  if (FLA_ERR(!jnl->super_buf, "fla_xne_alloc_buf()"))
+  {
+    err = -ENOMEM;
+    goto free_buf;
+  }
+
+  err = pthread_mutex_init(&jnl->lock, NULL);
+  if (FLA_ERR(err, "pthread_mutex_init()"))
+    goto free_super_buf;
+
+  err = pthread_cond_init(&jnl->done, NULL);
+  if (FLA_ERR(err, "pthread_cond_init()"))
+    goto destroy_lock;
+
+  *jnl_out = jnl;
+  return 0;
+
+destroy_lock:
+  pthread_mutex_destroy(&jnl->lock);
+free_super_buf:
+  fla_xne_free_buf(jnl->dev, jnl->super_buf);
+free_buf:
+  fla_xne_free_buf(jnl->dev, jnl->io_buf);
+free_jnl:
+  free(jnl);
+  return err;
+}
+
+int
+fla_jnl_open(struct flexalloc *fs)
+{
+  struct fla_jnl *jnl = NULL;
+  bool replayed;
+  int err;
+
+  if (!fs->geo.jnl_nlb)
+    return 0;
+
+  err = fla_jnl_init(fs, &jnl);
+  if (FLA_ERR(err, "fla_jnl_init()"))
+    return err;
+
+  // freed by fla_jnl_close() on error, as the flush below checkpoints through fs->jnl
+  fs->jnl = jnl;
+
+  err = fla_jnl_replay(jnl, &replayed);
+  if (FLA_ERR(err, "fla_jnl_replay()"))
+    return err;
+
+  if (replayed)
+  {
+    err = fla_flush(fs);
+    if (FLA_ERR(err, "fla_flush()"))
+      return err;
+  }
+
+  return 0;
+}
+
+void
+fla_jnl_close(struct flexalloc *fs)
+{
+  struct fla_jnl *jnl = fs->jnl;
+
+  if (!jnl)
+    return;
+
+  pthread_cond_destroy(&jnl->done);
+  pthread_mutex_destroy(&jnl->lock);
+  fla_xne_free_buf(jnl->dev, jnl->super_buf);
+  fla_xne_free_buf(jnl->dev, jnl->io_buf);
+  free(jnl->recs);
+  free(jnl);
+  fs->jnl = NULL;
+}
+
+void
+fla_jnl_log(struct flexalloc const *fs, enum fla_jnl_rec_type type, uint32_t pool_ndx,
+            uint32_t slab_id, void const *data, uint32_t nbytes)
+{
+  struct fla_jnl *jnl = fs->jnl;
+  struct fla_jnl_rec rec = {.type = type, .pool_ndx = pool_ndx, .slab_id = slab_id,
+                            .nbytes = nbytes};
+  size_t need, cap;
+  char *recs;
+
+  if (!jnl)
+    return;
+
+  pthread_mutex_lock(&jnl->lock);
+
+  need = jnl->recs_nbytes + sizeof(rec) + nbytes;
+  if (need > jnl->recs_cap)
+  {
+    cap = fla_max(need, 2 * jnl->recs_cap);
+    recs = realloc(jnl->recs, cap);
+    if (FLA_ERR(!recs, "realloc()"))
+    {
+      // the change is in memory only, the next commit asks for a checkpoint
+      jnl->err = -ENOMEM;
+      jnl->nerrs++;
+      goto unlock;
+    }
+    jnl->recs = recs;
+    jnl->recs_cap = cap;
+  }
+
+  memcpy(jnl->recs + jnl->recs_nbytes, &rec, sizeof(rec));
+  if (nbytes)
+    memcpy(jnl->recs + jnl->recs_nbytes + sizeof(rec), data, nbytes);
+  jnl->recs_nbytes = need;
+  jnl->nlogged++;
+
+unlock:
+  pthread_mutex_unlock(&jnl->lock);
+}
+
+/*
+ * Blocks of a commit of nbytes of records, and where it goes. A commit which
+ * does not fit at the end of the journal goes to the block after the super,
+ * skipping the blocks up to the end.
+ */
+static uint32_t
+fla_jnl_place(struct fla_jnl const *jnl, size_t nbytes, uint32_t *pos, uint32_t *skip)
+{
+  uint32_t nlb = FLA_CEIL_DIV(sizeof(struct fla_jnl_commit) + nbytes, jnl->lb_nbytes);
+
+  *pos = jnl->pos;
+  *skip = 0;
+  if (*pos + nlb > jnl->nlb)
+  {
+    *skip = jnl->nlb - *pos;
+    *pos = 1;
+  }
+
+  return nlb;
+}
+
+/*
+ * Write the first nbytes of the records as a commit placed by fla_jnl_place().
+ * Called with the lock held and no commit in flight, drops the lock for the
+ * write. Records of a failed write are lost until the next checkpoint.
+ */
+static int
+fla_jnl_write_recs(struct fla_jnl *jnl, size_t nbytes, uint32_t nlb, uint32_t pos,
+                   uint32_t skip)
+{
+  struct fla_jnl_commit *commit = jnl->io_buf;
+  int err;
+
+  memset(commit, 0, (size_t)nlb * jnl->lb_nbytes);
+  commit->magic = FLA_JNL_MAGIC;
+  commit->id = jnl->id;
+  commit->seq = jnl->seq;
+  commit->nlb = nlb;
+  commit->nbytes = nbytes;
+  memcpy(commit + 1, jnl->recs, nbytes);
+  commit->csum = fla_jnl_csum(commit, sizeof(*commit) + commit->nbytes);
+
+  memmove(jnl->recs, jnl->recs + nbytes, jnl->recs_nbytes - nbytes);
+  jnl->recs_nbytes -= nbytes;
+  jnl->ntaken++;
+  jnl->writing = true;
+  pthread_mutex_unlock(&jnl->lock);
+
+  err = fla_jnl_io(jnl->fs, jnl->dev, jnl->io_buf, jnl->slba + pos, nlb, true);
+
+  pthread_mutex_lock(&jnl->lock);
+  jnl->writing = false;
+  if (FLA_ERR(err, "fla_jnl_io()"))
+  {
+    jnl->err = err;
+    jnl->nerrs++;
+  }
+  else
+  {
+    jnl->pos = pos + nlb;
+    jnl->used += skip + nlb;
+    jnl->seq++;
+  }
+  pthread_cond_broadcast(&jnl->done);
+
+  return err;
+}
+
+/*
+ * The first caller finding no commit in flight writes the records of every
+ * caller so far, the others wait for it and find their records on disk.
+ * Commits follow each other around the journal, from the start set by the
+ * last checkpoint, and never wrap within a commit. They leave the last
+ * FLA_JNL_RSV_PCT of the journal to the commit of a checkpoint.
+ */
+int
+fla_jnl_commit(struct flexalloc const *fs)
+{
+  struct fla_jnl *jnl = fs->jnl;
+  uint64_t target, batch;
+  uint32_t nlb, pos, skip, rsv;
+  bool waited = false, ckpt;
+  int err = 0;
+
+  if (!jnl)
+    return 0;
+
+  rsv = (uint64_t)(jnl->nlb - 1) * FLA_JNL_RSV_PCT / 100;
+
+  pthread_mutex_lock(&jnl->lock);
+  target = jnl->nlogged;
+
+  while (jnl->ndurable < target)
+  {
+    if (jnl->writing)
+    {
+      pthread_cond_wait(&jnl->done, &jnl->lock);
+      continue;
+    }
+
+    nlb = fla_jnl_place(jnl, jnl->recs_nbytes, &pos, &skip);
+
+    // records were lost or do not fit, only a checkpoint gets them to disk
+    if (jnl->err || (uint64_t)jnl->used + skip + nlb + rsv > jnl->nlb - 1)
+    {
+      if (waited)
+      {
+        err = jnl->err ? jnl->err : -ENOSPC;
+        break;
+      }
+      fla_jnl_ckpt_wait(jnl);
+      waited = true;
+      continue;
+    }
+
+    batch = jnl->nlogged;
+    if (!fla_jnl_write_recs(jnl, jnl->recs_nbytes, nlb, pos, skip))
+      jnl->ndurable = fla_max(jnl->ndurable, batch);
+  }
+
+  // start a checkpoint ahead of the journal filling up
+  ckpt = fs->ckpt && !jnl->ckpt_req
+         && jnl->used > (uint64_t)(jnl->nlb - 1) * FLA_JNL_CKPT_PCT / 100;
+  if (ckpt)
+    jnl->ckpt_req = true;
+
+  pthread_mutex_unlock(&jnl->lock);
+
+  if (ckpt)
+    fla_ckpt_request(fs);
+  return err;
+}
+
+void
+fla_jnl_ckpt_begin(struct flexalloc const *fs, struct fla_jnl_mark *mark)
+{
+  struct fla_jnl *jnl = fs->jnl;
+
+  if (!jnl)
+    return;
+
+  // a commit in flight holds records of before the mark, replaying it again is fine
+  pthread_mutex_lock(&jnl->lock);
+  mark->pos = jnl->pos;
+  mark->seq = jnl->seq;
+  mark->used = jnl->used;
+  mark->nlogged = jnl->nlogged;
+  mark->ntaken = jnl->ntaken;
+  mark->nerrs = jnl->nerrs;
+  mark->recs_nbytes = jnl->recs_nbytes;
+  pthread_mutex_unlock(&jnl->lock);
+}
+
+void
+fla_jnl_ckpt_commit(struct flexalloc const *fs, struct fla_jnl_mark *mark)
+{
+  struct fla_jnl *jnl = fs->jnl;
+  uint32_t nlb, pos, skip;
+
+  if (!jnl)
+    return;
+
+  pthread_mutex_lock(&jnl->lock);
+
+  // a commit in flight holds records of before the mark, or takes them all
+  while (jnl->writing)
+    pthread_cond_wait(&jnl->done, &jnl->lock);
+
+  if (jnl->ntaken != mark->ntaken || !mark->recs_nbytes || jnl->err)
+    goto unlock;
+
+  nlb = fla_jnl_place(jnl, mark->recs_nbytes, &pos, &skip);
+  if ((uint64_t)jnl->used + skip + nlb > jnl->nlb - 1)
+  {
+    FLA_ERR_PRINTF("journal full, %zu bytes of records are only written in place\n",
+                   mark->recs_nbytes);
+    goto unlock;
+  }
+
+  if (fla_jnl_write_recs(jnl, mark->recs_nbytes, nlb, pos, skip))
+    goto unlock;
+
+  // the commit only holds records of before the mark, the checkpoint covers it
+  jnl->ndurable = fla_max(jnl->ndurable, mark->nlogged);
+  mark->pos = jnl->pos;
+  mark->seq = jnl->seq;
+  mark->used = jnl->used;
+  mark->ntaken = jnl->ntaken;
+  mark->recs_nbytes = 0;
+
+unlock:
+  pthread_mutex_unlock(&jnl->lock);
+}
+
+int
+fla_jnl_checkpoint(struct flexalloc const *fs, struct fla_jnl_mark const *mark)
+{
+  struct fla_jnl *jnl = fs->jnl;
+  int err = 0;
+
+  if (!jnl)
+    return 0;
+
+  // commits before the mark are no longer replayed once the super is written
+  if (mark->used)
+  {
+    err = fla_jnl_super_write(jnl, mark->pos, mark->seq);
+    FLA_ERR(err, "fla_jnl_super_write()");
+  }
+
+  pthread_mutex_lock(&jnl->lock);
+  if (err)
+  {
+    jnl->err = err;
+    jnl->nerrs++;
+    goto unlock;
+  }
+
+  jnl->used -= mark->used;
+
+  // records the journal had no room for before the metadata are in place now
+  if (jnl->ntaken == mark->ntaken && mark->recs_nbytes)
+  {
+    memmove(jnl->recs, jnl->recs + mark->recs_nbytes, jnl->recs_nbytes - mark->recs_nbytes);
+    jnl->recs_nbytes -= mark->recs_nbytes;
+  }
+  jnl->ndurable = fla_max(jnl->ndurable, mark->nlogged);
+
+  // records lost after the mark are not covered
+  if (jnl->nerrs == mark->nerrs)
+    jnl->err = 0;
+
+unlock:
+  pthread_cond_broadcast(&jnl->done);
+  pthread_mutex_unlock(&jnl->lock);
+  return err;
+}
+
+void
+fla_jnl_ckpt_end(struct flexalloc const *fs)
+{
+  struct fla_jnl *jnl = fs->jnl;
+
+  if (!jnl)
+    return;
+
+  pthread_mutex_lock(&jnl->lock);
+  jnl->ckpt_req = false;
+  pthread_mutex_unlock(&jnl->lock);
+}
@@ -0,0 +1,198 @@
+/**
+ * flexalloc metadata journal
+ *
+ * Changes to the metadata are logged as records while the locks of the
+ * operation are held, and written to a reserved region of the metadata device
+ * before the operation returns. Writes of concurrent operations are grouped,
+ * one caller writes the records of all the others waiting. The metadata
+ * itself is only written by a checkpoint, that is a flush. It first commits
+ * the records of its copy still in memory, so that replay redoes a metadata
+ * write torn by a crash, and then moves the start of the journal past the
+ * commits it covers. Commits go on while a checkpoint is written, the journal
+ * is used as a ring.
+ *
+ * Records describe the state reached rather than the steps taken, so
+ * replaying them over metadata which already holds some of them is fine.
+ * After replay the slab lists and counts are laid out again from the owner of
+ * each slab and the slab freelists.
+ *
+ * The journal is optional, its size is set when formatting.
+ *
+ * @file flexalloc_journal.h
+ */
+#ifndef __FLEXALLOC_JOURNAL_H_
+#define __FLEXALLOC_JOURNAL_H_
+#include <stdint.h>
+#include "flexalloc.h"
+
+/// Type of a journal record
+enum fla_jnl_rec_type
+{
+  /// Objects taken, followed by their struct fla_object
+  FLA_JNL_OBJ_CREATE = 1,
+  /// Objects given back, followed by their struct fla_object
+  FLA_JNL_OBJ_DESTROY,
+  /// Slab taken from the free slab list by a pool
+  FLA_JNL_SLAB_ACQUIRE,
+  /// Slab given back to the free slab list
+  FLA_JNL_SLAB_RELEASE,
+  /// Pool entry set up, followed by the struct fla_pool_entry
+  FLA_JNL_POOL_CREATE,
+  /// Pool entry released, followed by the struct fla_pool_entry
+  FLA_JNL_POOL_DESTROY,
+  /// Pool root object set or cleared, followed by the root object handle
+  FLA_JNL_POOL_ROOT,
+};
+
+/// Header of a journal record, followed by nbytes of data
+struct fla_jnl_rec
+{
+  uint16_t type;
+  uint16_t rsvd;
+  /// pool the record applies to
+  uint32_t pool_ndx;
+  /// slab of a slab record
+  uint32_t slab_id;
+  /// bytes of data following the header
+  uint32_t nbytes;
+};
+
+/// Share of the journal in use, in percent, above which a checkpoint is started
+#define FLA_JNL_CKPT_PCT 75
+/// Share of the journal, in percent, kept for the commit of a checkpoint
+#define FLA_JNL_RSV_PCT 10
+
+/// Position of the journal when a checkpoint took its copy of the metadata
+struct fla_jnl_mark
+{
+  /// block and sequence number of the next commit
+  uint32_t pos;
+  uint64_t seq;
+  /// blocks in use up to pos
+  uint32_t used;
+  uint64_t nlogged;
+  uint64_t ntaken;
+  uint64_t nerrs;
+  /// bytes of records not yet taken by a commit
+  size_t recs_nbytes;
+};
+
+/**
+ * @brief Write an empty journal
+ *
+ * Does nothing if the geometry has no journal.
+ *
+ * @param fs flexalloc system handle being formatted
+ * @param md_dev device holding the metadata
+ * @return zero on success. non zero otherwise.
+ */
+int
+fla_jnl_format(struct flexalloc *fs, struct xnvme_dev *md_dev);
+
+/**
+ * @brief Open the journal and replay it
+ *
+ * Applies the records written since the last checkpoint and flushes the
+ * result. Does nothing without a journal.
+ *
+ * @param fs flexalloc system handle, open
+ * @return zero on success. non zero otherwise.
+ */
+int
+fla_jnl_open(struct flexalloc *fs);
+
+/**
+ * @brief Free the journal
+ *
+ * Records not yet written are lost, see fla_close_noflush().
+ *
+ * @param fs flexalloc system handle
+ */
+void
+fla_jnl_close(struct flexalloc *fs);
+
+/**
+ * @brief Add a record to the journal
+ *
+ * Called with the locks covering the change held, so records are in the
+ * order of the changes. The record is only kept in memory, see
+ * fla_jnl_commit(). Does nothing without a journal.
+ *
+ * @param fs flexalloc system handle
+ * @param type record type
+ * @param pool_ndx pool the record applies to
+ * @param slab_id slab of a slab record
+ * @param data record data, may be NULL if nbytes is zero
+ * @param nbytes bytes of data
+ */
+void
+fla_jnl_log(struct flexalloc const *fs, enum fla_jnl_rec_type type, uint32_t pool_ndx,
+            uint32_t slab_id, void const *data, uint32_t nbytes);
+
+/**
+ * @brief Wait until every record logged so far is on disk
+ *
+ * Writes the records of all callers waiting at once. Called with no lock held,
+ * as a full journal waits for a checkpoint. Does nothing without a journal.
+ *
+ * @param fs flexalloc system handle
+ * @return zero on success. non zero otherwise, in which case the records stay
+ * in memory until the next successful checkpoint.
+ */
+int
+fla_jnl_commit(struct flexalloc const *fs);
+
+/**
+ * @brief Mark the position covered by a checkpoint
+ *
+ * Called by fla_flush() with every lock held, as it takes the dirty metadata.
+ * Does nothing without a journal.
+ *
+ * @param fs flexalloc system handle
+ * @param mark set to the current position
+ */
+void
+fla_jnl_ckpt_begin(struct flexalloc const *fs, struct fla_jnl_mark *mark);
+
+/**
+ * @brief Commit the records covered by a checkpoint
+ *
+ * Called by fla_flush() after fla_jnl_ckpt_begin() and before writing any
+ * metadata. Waits for the commit in flight and writes the records logged
+ * before the mark and not yet taken by a commit, then moves the mark past
+ * them. Records the journal has no room for, even in the share kept for
+ * checkpoints, are only written in place. Does nothing without a journal.
+ *
+ * @param fs flexalloc system handle
+ * @param mark position taken by fla_jnl_ckpt_begin()
+ */
+void
+fla_jnl_ckpt_commit(struct flexalloc const *fs, struct fla_jnl_mark *mark);
+
+/**
+ * @brief Drop the commits covered by a checkpoint
+ *
+ * Called by fla_flush() once the metadata taken with the mark is on disk,
+ * possibly without holding the locks. Commits made since the mark are kept.
+ * Does nothing without a journal.
+ *
+ * @param fs flexalloc system handle
+ * @param mark position taken by fla_jnl_ckpt_begin()
+ * @return zero on success. non zero otherwise.
+ */
+int
+fla_jnl_checkpoint(struct flexalloc const *fs, struct fla_jnl_mark const *mark);
+
+/**
+ * @brief Let commits ask the checkpoint thread for a checkpoint again
+ *
+ * Called by the checkpoint thread when a flush ends, whether it succeeded or
+ * not, so that a failed flush does not keep commits from asking for another.
+ * Does nothing without a journal.
+ *
+ * @param fs flexalloc system handle
+ */
+void
+fla_jnl_ckpt_end(struct flexalloc const *fs);
+
+#endif // __FLEXALLOC_JOURNAL_H_
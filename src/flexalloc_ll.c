@@ -24,11 +24,14 @@ fla_hdll_prepend(struct flexalloc * fs, struct fla_slab_header * slab, uint32_t
       goto exit;
     }
     head_slab->prev = slab_id;
+    fla_md_mark_dirty(fs, head_slab, sizeof(struct fla_slab_header));
   }
 
   slab->next = *head;
   slab->prev = FLA_LINKED_LIST_NULL;
   *head = slab_id;
+  fla_md_mark_dirty(fs, slab, sizeof(struct fla_slab_header));
+  fla_md_mark_dirty(fs, head, sizeof(uint32_t));
 
 exit:
   return err;
@@ -44,6 +47,7 @@ fla_hdll_remove(struct flexalloc * fs, struct fla_slab_header * slab, uint32_t *
   if(slab->prev == FLA_LINKED_LIST_NULL)
   {
     *head = slab->next;
+    fla_md_mark_dirty(fs, head, sizeof(uint32_t));
   }
   else
   {
@@ -53,6 +57,7 @@ fla_hdll_remove(struct flexalloc * fs, struct fla_slab_header * slab, uint32_t *
       goto exit;
     }
     temp_slab->next = slab->next;
+    fla_md_mark_dirty(fs, temp_slab, sizeof(struct fla_slab_header));
   }
 
   if(slab->next != FLA_LINKED_LIST_NULL)
@@ -63,6 +68,7 @@ fla_hdll_remove(struct flexalloc * fs, struct fla_slab_header * slab, uint32_t *
       goto exit;
     }
     temp_slab->prev = slab->prev;
+    fla_md_mark_dirty(fs, temp_slab, sizeof(struct fla_slab_header));
   }
 
 exit:
@@ -85,6 +91,7 @@ fla_hdll_remove_all(struct flexalloc *fs, uint32_t *head,
     }
 
     *head = curr_slab->next;
+    fla_md_mark_dirty(fs, head, sizeof(uint32_t));
 
     err = execute_on_release(fs, curr_slab);
     if(FLA_ERR(err, "execute_on_release()"))
@@ -135,7 +142,10 @@ fla_edll_remove_head(struct flexalloc * fs, uint32_t * head, uint32_t * tail,
 
     *head =  (*a_slab)->next;
     new_head->prev = FLA_LINKED_LIST_NULL;
+    fla_md_mark_dirty(fs, new_head, sizeof(struct fla_slab_header));
   }
+  fla_md_mark_dirty(fs, head, sizeof(uint32_t));
+  fla_md_mark_dirty(fs, tail, sizeof(uint32_t));
 
 exit:
   return err;
@@ -173,7 +183,11 @@ fla_edll_add_tail(struct flexalloc *fs, uint32_t * head, uint32_t * tail,
     tail_slab->next = r_slab_id;
     r_slab->prev = *tail;
     *tail = r_slab_id;
+    fla_md_mark_dirty(fs, tail_slab, sizeof(struct fla_slab_header));
   }
+  fla_md_mark_dirty(fs, r_slab, sizeof(struct fla_slab_header));
+  fla_md_mark_dirty(fs, head, sizeof(uint32_t));
+  fla_md_mark_dirty(fs, tail, sizeof(uint32_t));
 
 exit:
   return err;
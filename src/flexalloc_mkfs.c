@@ -31,6 +31,11 @@ static struct cli_option options[] =
     .description = "number of pools",
     .arg_ex = "NUM"
   },
+  {
+    .base = {"journal-nlb", required_argument, NULL, 'j'},
+    .description = "size of the metadata journal in logical blocks, 0 for none",
+    .arg_ex = "NUM"
+  },
   {
     .base = {"help", no_argument, NULL, 'h'},
     .description = "display this help",
@@ -76,7 +81,7 @@ fla_mkfs_parse_args(int argc, char ** argv, struct fla_mkfs_p * p)
     memcpy(long_options+i, &options[i].base, sizeof(struct option));
   }
 
-  while ((c = getopt_long(argc, argv, "vhs:p:m:", long_options, &opt_idx)) != -1)
+  while ((c = getopt_long(argc, argv, "vhs:p:j:m:", long_options, &opt_idx)) != -1)
   {
     switch (c)
     {
@@ -105,6 +110,15 @@ fla_mkfs_parse_args(int argc, char ** argv, struct fla_mkfs_p * p)
       }
       p->npools = (int)arg_long;
       break;
+    case 'j':
+      arg_long = strtol(optarg, &arg_end, 0);
+      if ((arg_end == optarg) || (arg_long > INT_MAX) || (arg_long < 0) || (arg_long == 1))
+      {
+        fprintf(stderr, "journal-nlb: invalid argument, '%s'\n", optarg);
+        err = -1;
+      }
+      p->jnl_nlb = (int)arg_long;
+      break;
     case 'm':
       p->open_opts.md_dev_uri = optarg;
       break;
@@ -181,6 +195,7 @@ main(int argc, char ** argv)
   fprintf(stderr, "Opts:\n");
   fprintf(stderr, "  dev_uri: %s\n", mkfs_params.open_opts.dev_uri);
   fprintf(stderr, "  slab_nlb: %"PRIu32"\n", mkfs_params.slab_nlb);
+  fprintf(stderr, "  jnl_nlb: %"PRIu32"\n", mkfs_params.jnl_nlb);
   fprintf(stderr, "  verbose: %"PRIu8"\n", mkfs_params.verbose);
   if (mkfs_params.open_opts.md_dev_uri)
     fprintf(stderr, "  md_dev_uri: %s\n", mkfs_params.open_opts.md_dev_uri);
@@ -6,14 +6,21 @@
 #include <libxnvmec.h>
 #include <stdint.h>
 #include <limits.h>
+#include <sched.h>
 #include <string.h>
 #include "flexalloc.h"
+#include "libflexalloc.h"
 #include "flexalloc_util.h"
 #include "flexalloc_dp.h"
+#include "flexalloc_dp_fdp.h"
 #include "flexalloc_hash.h"
 #include "flexalloc_freelist.h"
 #include "flexalloc_slabcache.h"
 #include "flexalloc_xnvme_env.h"
+#include "flexalloc_bufpool.h"
+#include "flexalloc_objcache.h"
+#include "flexalloc_journal.h"
+#include "flexalloc_ckpt.h"
 #include "flexalloc_mm.h"
 #include "flexalloc_util.h"
 #include "flexalloc_ll.h"
@@ -160,6 +167,7 @@ fla_geo_from_super(struct xnvme_dev *dev, struct fla_super *super,
   geo->npools = super->npools;
   geo->nslabs = super->nslabs;
   geo->md_nlb = super->md_nlb;
+  geo->jnl_nlb = super->jnl_nlb;
   fla_geo_pool_sgmt_calc(geo->npools, geo->lb_nbytes, &geo->pool_sgmt);
   fla_geo_slab_sgmt_calc(geo->nslabs, geo->lb_nbytes, &geo->slab_sgmt);
 }
@@ -195,9 +203,31 @@ fla_geo_init(const struct xnvme_dev *dev, uint32_t npools, uint32_t slab_nlb,
   geo->md_nlb = FLA_CEIL_DIV(sizeof(struct fla_super), lb_nbytes);
 }
 
+/*
+ * The journal is taken off the blocks left for metadata, check it leaves
+ * room for md_nlb blocks of other metadata and at least one slab before the
+ * blocks left are computed.
+ */
+static int
+fla_mkfs_geo_jnl_check(const struct xnvme_dev *md_dev, struct fla_geo const *geo,
+                       struct fla_geo const *md_geo, uint64_t md_nlb)
+{
+  uint64_t need_nlb = md_nlb + geo->jnl_nlb;
+
+  // a slab takes one header block on the md device, and its blocks otherwise
+  need_nlb += md_dev ? 1 : geo->slab_nlb;
+
+  if (FLA_ERR(need_nlb > (md_dev ? md_geo->nlb : geo->nlb),
+              "journal too large - no space left for any slabs"))
+    return -1;
+
+  return 0;
+}
+
 int
 fla_mkfs_geo_calc(const struct xnvme_dev *dev, const struct xnvme_dev *md_dev,
-                  uint32_t npools, uint32_t slab_nlb, struct fla_geo *geo)
+                  uint32_t npools, uint32_t slab_nlb, uint32_t jnl_nlb,
+                  struct fla_geo *geo)
 {
   /*
    * Calculate geometry of disk format given the SLAB size (in number of logical blocks)
@@ -212,23 +242,29 @@ fla_mkfs_geo_calc(const struct xnvme_dev *dev, const struct xnvme_dev *md_dev,
   int err;
   uint32_t nslabs_approx;
   uint32_t lb_nbytes = fla_xne_dev_lba_nbytes(dev);
-  struct fla_geo md_geo;
+  struct fla_geo md_geo = {0};
 
   fla_geo_init(dev, npools, slab_nlb, lb_nbytes, geo);
   fla_geo_init(dev, npools, slab_nlb, lb_nbytes, &md_geo);
+  geo->jnl_nlb = jnl_nlb;
 
   err = fla_cs_geo_check(dev, geo);
   if (FLA_ERR(err, "fla_cs_geo_check()"))
     return err;
 
+  err = fla_mkfs_geo_jnl_check(md_dev, geo, &md_geo, geo->md_nlb);
+  if (FLA_ERR(err, "fla_mkfs_geo_jnl_check()"))
+    return err;
+
   // estimate how many slabs we can get before knowing the overhead of the pool metadata
   if (!md_dev)
   {
-    nslabs_approx = fla_nelems_max(geo->nlb - geo->md_nlb, slab_nlb, fla_slab_sgmt_calc_v, lb_nbytes);
+    nslabs_approx = fla_nelems_max(geo->nlb - geo->md_nlb - jnl_nlb, slab_nlb, fla_slab_sgmt_calc_v,
+                                   lb_nbytes);
   }
   else
   {
-    nslabs_approx = fla_nslabs_max_mddev(geo->nlb, slab_nlb, lb_nbytes, md_geo.nlb);
+    nslabs_approx = fla_nslabs_max_mddev(geo->nlb, slab_nlb, lb_nbytes, md_geo.nlb - jnl_nlb);
   }
 
   if (FLA_ERR(!nslabs_approx, "slab size too large - not enough space to allocate any slabs"))
@@ -249,11 +285,16 @@ fla_mkfs_geo_calc(const struct xnvme_dev *dev, const struct xnvme_dev *md_dev,
   // calculate number of blocks required to support the pool entries
   fla_geo_pool_sgmt_calc(geo->npools, lb_nbytes, &geo->pool_sgmt);
 
+  err = fla_mkfs_geo_jnl_check(md_dev, geo, &md_geo,
+                               geo->md_nlb + fla_geo_pool_sgmt_nblocks(&geo->pool_sgmt));
+  if (FLA_ERR(err, "fla_mkfs_geo_jnl_check()"))
+    return err;
+
   // calculate maximum number of slabs we can support given the logical blocks remaining
   if (!md_dev)
   {
     geo->nslabs = fla_nelems_max(
-                    geo->nlb - geo->md_nlb - fla_geo_pool_sgmt_nblocks(&geo->pool_sgmt),
+                    geo->nlb - geo->md_nlb - fla_geo_pool_sgmt_nblocks(&geo->pool_sgmt) - jnl_nlb,
                     slab_nlb,
                     fla_slab_sgmt_calc_v, lb_nbytes);
   }
@@ -261,7 +302,7 @@ fla_mkfs_geo_calc(const struct xnvme_dev *dev, const struct xnvme_dev *md_dev,
   {
     geo->nslabs = fla_nslabs_max_mddev(geo->nlb, slab_nlb, lb_nbytes,
                                        md_geo.nlb - geo->md_nlb -
-                                       fla_geo_pool_sgmt_nblocks(&geo->pool_sgmt));
+                                       fla_geo_pool_sgmt_nblocks(&geo->pool_sgmt) - jnl_nlb);
   }
 
   if (FLA_ERR(!geo->nslabs, "slab size too large, not enough space to allocate any slabs"))
@@ -310,12 +351,19 @@ fla_geo_slab_sgmt_lb_off(struct fla_geo const *geo)
          + fla_geo_pool_sgmt_nblocks(&geo->pool_sgmt);
 }
 
+/// calculate disk offset, in logical blocks, of the start of the metadata journal
 uint64_t
-fla_geo_slabs_lb_off(struct fla_geo const *geo)
+fla_geo_jnl_lb_off(struct fla_geo const *geo)
 {
   return fla_geo_slab_sgmt_lb_off(geo) + fla_geo_slab_sgmt_nblocks(&geo->slab_sgmt);
 }
 
+uint64_t
+fla_geo_slabs_lb_off(struct fla_geo const *geo)
+{
+  return fla_geo_jnl_lb_off(geo) + geo->jnl_nlb;
+}
+
 uint64_t
 fla_geo_slab_lb_off(struct flexalloc const *fs, uint32_t slab_id)
 {
@@ -379,6 +427,9 @@ fla_mkfs_slab_sgmt_init(struct flexalloc *fs, struct fla_geo *geo)
     curr_slab->prev = curr_slab_id - 1;
   }
 
+  for(uint32_t curr_slab_id = 0 ; curr_slab_id < geo->nslabs ; ++curr_slab_id)
+    fs->slabs.headers[curr_slab_id].pool = FLA_SLAB_POOL_NONE;
+
 }
 
 void
@@ -390,6 +441,46 @@ fla_mkfs_super_init(struct flexalloc *fs, struct fla_geo *geo)
   fs->super->npools = geo->npools;
   fs->super->slab_nlb = geo->slab_nlb;
   fs->super->nslabs = geo->nslabs;
+  fs->super->jnl_nlb = geo->jnl_nlb;
+}
+
+/// dirty runs of metadata blocks at most this far apart are written as one
+#define FLA_MD_FLUSH_MERGE_NLB 8
+
+static int
+fla_md_dirty_init(struct flexalloc *fs)
+{
+  fs->md_dirty = calloc(FLA_CEIL_DIV(fla_geo_nblocks(&fs->geo), 64), sizeof(uint64_t));
+  if (FLA_ERR(!fs->md_dirty, "calloc()"))
+    return -ENOMEM;
+
+  return 0;
+}
+
+static void
+fla_md_dirty_fini(struct flexalloc *fs)
+{
+  free(fs->md_dirty);
+  fs->md_dirty = NULL;
+}
+
+void
+fla_md_mark_dirty(struct flexalloc const *fs, void const *ptr, size_t nbytes)
+{
+  uint64_t off, nblocks = fla_geo_nblocks(&fs->geo);
+  uint32_t slb, elb;
+
+  if (!fs->md_dirty || !nbytes || (char const *)ptr < (char const *)fs->fs_buffer)
+    return;
+
+  off = (char const *)ptr - (char const *)fs->fs_buffer;
+  if (off >= nblocks * fs->geo.lb_nbytes)
+    return;
+
+  slb = off / fs->geo.lb_nbytes;
+  elb = fla_min((off + nbytes - 1) / fs->geo.lb_nbytes, nblocks - 1);
+  for (uint32_t lb = slb; lb <= elb; ++lb)
+    __atomic_fetch_or(&fs->md_dirty[lb / 64], 1ULL << (lb % 64), __ATOMIC_RELAXED);
 }
 
 int
@@ -417,6 +508,10 @@ fla_init(struct fla_geo *geo, struct xnvme_dev *dev, struct xnvme_dev *md_dev, v
   // super block is at the head of the buffer
   fs->super = fla_md_buf;
 
+  err = fla_md_dirty_init(fs);
+  if (FLA_ERR(err, "fla_md_dirty_init()"))
+    return err;
+
   /*
    * Pool segment
    */
@@ -436,6 +531,10 @@ fla_init(struct fla_geo *geo, struct xnvme_dev *dev, struct xnvme_dev *md_dev, v
   fs->slabs.fslab_num = (uint32_t*)((unsigned char*)fs->slabs.headers +
                                     (geo->slab_sgmt.slab_sgmt_nlb * geo->lb_nbytes) - (sizeof(uint32_t)*3));
 
+  err = fla_pool_usage_init(fs);
+  if (FLA_ERR(err, "fla_pool_usage_init()"))
+    return err;
+
   err = fla_init_dp(fs);
   if (err)
     return err;
@@ -482,7 +581,30 @@ fla_mkfs(struct fla_mkfs_p *p)
     }
   }
 
-  err = fla_mkfs_geo_calc(dev, md_dev, p->npools, p->slab_nlb, &geo);
+  if ((err = FLA_ERR(p->jnl_nlb == 1, "The journal needs a header and at least one log block")))
+    goto exit;
+
+  if ((err = FLA_ERR(p->jnl_nlb && !md_dev && fla_xne_dev_type(dev) == XNVME_GEO_ZONED,
+                     "The journal of a zoned device must be on an md device")))
+    goto exit;
+
+  /*
+   * Replay loads the freelists of the logged slabs, which an md device only
+   * supports for freelists of one block. The smallest object takes a block,
+   * or a zone on zoned devices.
+   */
+  if (p->jnl_nlb && md_dev)
+  {
+    uint64_t obj_nlb_min = fla_xne_dev_type(dev) == XNVME_GEO_ZONED
+                           ? fla_xne_dev_znd_sect(dev) : 1;
+
+    if ((err = FLA_ERR(FLA_CEIL_DIV(fla_flist_size(p->slab_nlb / obj_nlb_min),
+                                    fla_xne_dev_lba_nbytes(dev)) > 1,
+                       "A journal on an md device needs one block freelists, lower slab_nlb")))
+      goto exit;
+  }
+
+  err = fla_mkfs_geo_calc(dev, md_dev, p->npools, p->slab_nlb, p->jnl_nlb, &geo);
   if(FLA_ERR(err, "fla_mkfs_geo_calc()"))
     goto exit;
 
@@ -511,7 +633,9 @@ fla_mkfs(struct fla_mkfs_p *p)
     goto free_md;
 
   // initialize pool
-  fla_mkfs_pool_sgmt_init(fs, &geo);
+  err = fla_mkfs_pool_sgmt_init(fs, &geo);
+  if (FLA_ERR(err, "fla_mkfs_pool_sgmt_init()"))
+    goto free_md;
 
   // initialize slab
   fla_mkfs_slab_sgmt_init(fs, &geo);
@@ -534,8 +658,12 @@ fla_mkfs(struct fla_mkfs_p *p)
   if (FLA_ERR(err, "fla_xne_sync_seq_w_xneio()"))
     goto free_md;
 
+  err = fla_jnl_format(fs, md_dev);
+  FLA_ERR(err, "fla_jnl_format()");
 
 free_md:
+  fla_pool_fini(fs);
+  fla_md_dirty_fini(fs);
   fla_xne_free_buf(md_dev, fla_md_buf);
 
 free_fs:
@@ -607,49 +735,367 @@ fla_fs_free(struct flexalloc *fs)
     free(fs);
 }
 
+static int
+fla_md_write(struct flexalloc *fs, struct xnvme_dev *md_dev, void *buf, uint32_t slb, uint32_t nlb)
+{
+  int err;
+  struct xnvme_lba_range range;
+
+  range = fla_xne_lba_range_from_slba_naddrs(md_dev, FLA_SUPER_SLBA + slb, nlb);
+  if ((err = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
+    return err;
+
+  struct fla_xne_io xne_io = {.dev = md_dev, .buf = (char *)buf + (uint64_t)slb * fs->geo.lb_nbytes,
+                              .lba_range = &range, .fla_dp = &fs->fla_dp,
+                              .qpool = md_dev == fs->dev.dev ? fs->qpool : NULL};
+  err = fla_xne_sync_seq_w_xneio(&xne_io);
+  FLA_ERR(err, "fla_xne_sync_seq_w_xneio()");
+
+  return err;
+}
+
+static inline bool
+fla_md_dirty_test(uint64_t const *dirty, uint32_t lb)
+{
+  return dirty[lb / 64] & (1ULL << (lb % 64));
+}
+
+/*
+ * Find the next run of dirty blocks from lb on. Runs of dirty blocks close to
+ * each other go out as one write, rewriting a few clean blocks is cheaper
+ * than issuing another command.
+ */
+static bool
+fla_md_dirty_next_run(uint64_t const *dirty, uint32_t nblocks, uint32_t *lb, uint32_t *slb,
+                      uint32_t *nlb)
+{
+  uint32_t elb;
+
+  while (*lb < nblocks)
+  {
+    if (!(dirty[*lb / 64] >> (*lb % 64)))
+    {
+      *lb = (*lb / 64 + 1) * 64;
+      continue;
+    }
+
+    if (!fla_md_dirty_test(dirty, *lb))
+    {
+      (*lb)++;
+      continue;
+    }
+
+    // extend the run over dirty blocks and small clean gaps
+    *slb = elb = *lb;
+    for ((*lb)++; *lb < nblocks && *lb - elb <= FLA_MD_FLUSH_MERGE_NLB; ++(*lb))
+    {
+      if (fla_md_dirty_test(dirty, *lb))
+        elb = *lb;
+    }
+    *lb = elb + 1;
+    *nlb = elb - *slb + 1;
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * Take the dirty bits of the metadata buffer. With a shadow buffer the runs
+ * to write are copied to it, clean gaps included, as the buffer may change
+ * once the locks are dropped.
+ */
+static int
+fla_md_take_dirty(struct flexalloc *fs, void *shadow, uint64_t **dirty)
+{
+  uint32_t nblocks = fla_geo_nblocks(&fs->geo), nwords = FLA_CEIL_DIV(nblocks, 64);
+  uint32_t slb, nlb, lb = 0;
+  size_t off;
+
+  *dirty = malloc(nwords * sizeof(uint64_t));
+  if (FLA_ERR(!*dirty, "malloc()"))
+    return -ENOMEM;
+
+  for (uint32_t i = 0; i < nwords; ++i)
+    (*dirty)[i] = __atomic_exchange_n(&fs->md_dirty[i], 0, __ATOMIC_RELAXED);
+
+  if (!shadow)
+    return 0;
+
+  while (fla_md_dirty_next_run(*dirty, nblocks, &lb, &slb, &nlb))
+  {
+    off = (size_t)slb * fs->geo.lb_nbytes;
+    memcpy((char *)shadow + off, (char *)fs->fs_buffer + off, (size_t)nlb * fs->geo.lb_nbytes);
+  }
+
+  return 0;
+}
+
+static void
+fla_md_restore_dirty(struct flexalloc *fs, uint64_t const *dirty)
+{
+  uint32_t nwords = FLA_CEIL_DIV(fla_geo_nblocks(&fs->geo), 64);
+
+  for (uint32_t i = 0; i < nwords; ++i)
+    __atomic_fetch_or(&fs->md_dirty[i], dirty[i], __ATOMIC_RELAXED);
+}
+
+/*
+ * Write the blocks taken by fla_md_take_dirty() from buf, either the metadata
+ * buffer or its shadow.
+ */
+static int
+fla_md_write_dirty(struct flexalloc *fs, struct xnvme_dev *md_dev, void *buf,
+                   uint64_t const *dirty)
+{
+  uint32_t nblocks = fla_geo_nblocks(&fs->geo);
+  uint32_t slb, nlb, lb = 0;
+  int err = 0;
+
+  while (fla_md_dirty_next_run(dirty, nblocks, &lb, &slb, &nlb))
+  {
+    err = fla_md_write(fs, md_dev, buf, slb, nlb);
+    if (FLA_ERR(err, "fla_md_write()"))
+      break;
+  }
+
+  // written blocks were clean again, keep the rest for the next flush
+  if (err)
+    fla_md_restore_dirty(fs, dirty);
+
+  return err;
+}
+
+/*
+ * Handles with a checkpointer take copies of the dirty metadata with every
+ * lock held and write them once the locks are dropped, see flexalloc_ckpt.h.
+ * Other handles write in place with the locks held.
+ */
 int
 fla_flush(struct flexalloc *fs)
 {
   int err = 0;
-  struct xnvme_dev *md_dev = fs->dev.md_dev;
+  struct xnvme_dev *md_dev;
+  struct fla_ckpt *ckpt;
+  struct fla_slab_cache_snap slab_snap;
+  struct fla_jnl_mark mark;
+  uint64_t *dirty, nsnaps = 0;
+  bool locked;
+  void *buf;
 
   if (!fs || !(fs->state & FLA_STATE_OPEN))
     return 0;
 
-  if (!md_dev)
-    md_dev = fs->dev.dev;
+  md_dev = fs->dev.md_dev ? fs->dev.md_dev : fs->dev.dev;
+  ckpt = fs->ckpt;
+  buf = ckpt ? ckpt->shadow : fs->fs_buffer;
 
-  err = fla_slab_cache_flush(&fs->slab_cache);
-  if (FLA_ERR(err, "fla_slab_cache_flush() - failed to flush one or more slab freelists"))
-    goto exit;
+  if (ckpt)
+  {
+    nsnaps = __atomic_load_n(&ckpt->nsnaps, __ATOMIC_ACQUIRE);
+    pthread_mutex_lock(&ckpt->flush);
+
+    // a copy taken since the call holds every change made before it
+    if (ckpt->nwritten > nsnaps)
+      goto unlock_flush;
+  }
+
+  fla_lock_all(fs);
+  locked = true;
+
+  // cached object IDs must not be persisted as allocated
+  err = fla_obj_cache_drain_all(fs);
+  if (FLA_ERR(err, "fla_obj_cache_drain_all()"))
+    goto unlock_all;
 
   // We have to copy over the pool hash table's metadata before flushing
-  fs->pools.htbl_hdr_buffer->len = fs->pools.htbl.len;
+  if (fs->pools.htbl_hdr_buffer->len != fs->pools.htbl.len)
+  {
+    fs->pools.htbl_hdr_buffer->len = fs->pools.htbl.len;
+    fla_md_mark_dirty(fs, fs->pools.htbl_hdr_buffer, sizeof(struct fla_pool_htbl_header));
+  }
 
-  struct xnvme_lba_range range;
-  range = fla_xne_lba_range_from_slba_naddrs(md_dev, FLA_SUPER_SLBA, fla_geo_nblocks(&fs->geo));
-  if ((err = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
-    goto exit;
+  err = fla_md_take_dirty(fs, ckpt ? buf : NULL, &dirty);
+  if (FLA_ERR(err, "fla_md_take_dirty()"))
+    goto unlock_all;
 
-  struct fla_xne_io xne_io = {.dev = md_dev, .buf = fs->fs_buffer, .lba_range = &range, .fla_dp = &fs->fla_dp};
-  err = fla_xne_sync_seq_w_xneio(&xne_io);
-  if(FLA_ERR(err, "fla_xne_sync_seq_w_xneio()"))
-    goto exit;
+  err = fla_slab_cache_snapshot(&fs->slab_cache, ckpt != NULL, &slab_snap);
+  if (FLA_ERR(err, "fla_slab_cache_snapshot()"))
+  {
+    fla_md_restore_dirty(fs, dirty);
+    goto free_dirty;
+  }
+  fla_ckpt_slabs_writing(fs, &slab_snap);
 
-exit:
+  fla_jnl_ckpt_begin(fs, &mark);
+
+  if (ckpt)
+  {
+    nsnaps = ckpt->nsnaps + 1;
+    __atomic_store_n(&ckpt->nsnaps, nsnaps, __ATOMIC_RELEASE);
+    fla_unlock_all(fs);
+    locked = false;
+  }
+
+  // write ahead, replay redoes the changes of a metadata write torn by a crash
+  fla_jnl_ckpt_commit(fs, &mark);
+
+  err = fla_slab_cache_snap_write(&fs->slab_cache, &slab_snap);
+  fla_ckpt_slabs_written(fs);
+  if (FLA_ERR(err, "fla_slab_cache_snap_write() - failed to flush one or more slab freelists"))
+  {
+    fla_md_restore_dirty(fs, dirty);
+    goto free_dirty;
+  }
+
+  err = fla_md_write_dirty(fs, md_dev, buf, dirty);
+  if (FLA_ERR(err, "fla_md_write_dirty()"))
+    goto free_dirty;
+
+  // everything logged up to the mark is in place
+  err = fla_jnl_checkpoint(fs, &mark);
+  if (FLA_ERR(err, "fla_jnl_checkpoint()"))
+    goto free_dirty;
+
+  if (ckpt)
+    ckpt->nwritten = nsnaps;
+
+free_dirty:
+  free(dirty);
+unlock_all:
+  if (locked)
+    fla_unlock_all(fs);
+unlock_flush:
+  if (ckpt)
+    pthread_mutex_unlock(&ckpt->flush);
+  return err;
+}
+
+static int
+fla_locks_init(struct flexalloc *fs)
+{
+  int err;
+  uint32_t npools = 0;
+  struct fla_locks *locks;
+
+  locks = malloc(sizeof(struct fla_locks) + fs->geo.npools * sizeof(pthread_mutex_t));
+  if (FLA_ERR(!locks, "malloc()"))
+    return -ENOMEM;
+
+  err = pthread_mutex_init(&locks->fs, NULL);
+  if (FLA_ERR(err, "pthread_mutex_init()"))
+    goto free_locks;
+
+  for (; npools < fs->geo.npools; npools++)
+  {
+    err = pthread_mutex_init(&locks->pools[npools], NULL);
+    if (FLA_ERR(err, "pthread_mutex_init()"))
+      goto destroy_locks;
+  }
+
+  locks->npools = npools;
+  locks->nobjs_pending = 0;
+  locks->nquiesce = 0;
+  fs->locks = locks;
+  return 0;
+
+destroy_locks:
+  while (npools--)
+    pthread_mutex_destroy(&locks->pools[npools]);
+  pthread_mutex_destroy(&locks->fs);
+free_locks:
+  free(locks);
   return err;
 }
 
+static void
+fla_locks_fini(struct flexalloc *fs)
+{
+  struct fla_locks *locks = fs->locks;
+
+  if (!locks)
+    return;
+
+  for (uint32_t i = 0; i < locks->npools; i++)
+    pthread_mutex_destroy(&locks->pools[i]);
+  pthread_mutex_destroy(&locks->fs);
+
+  free(locks);
+  fs->locks = NULL;
+}
+
+static void
+fla_lock_all_locks(struct flexalloc const *fs)
+{
+  for (uint32_t i = 0; i < fs->locks->npools; i++)
+    pthread_mutex_lock(&fs->locks->pools[i]);
+  pthread_mutex_lock(&fs->locks->fs);
+}
+
+static void
+fla_unlock_all_locks(struct flexalloc const *fs)
+{
+  pthread_mutex_unlock(&fs->locks->fs);
+  for (uint32_t i = fs->locks->npools; i > 0; i--)
+    pthread_mutex_unlock(&fs->locks->pools[i - 1]);
+}
+
+/*
+ * New lock-free object calls back off to the locked path while nquiesce is
+ * set, see fla_objs_pending_get(). The calls in flight may need a pool lock
+ * to finish, so the locks are dropped again until all of them are done.
+ */
+void
+fla_lock_all(struct flexalloc const *fs)
+{
+  if (!fs->locks)
+    return;
+
+  __atomic_add_fetch(&fs->locks->nquiesce, 1, __ATOMIC_SEQ_CST);
+  for (;;)
+  {
+    fla_lock_all_locks(fs);
+    if (!__atomic_load_n(&fs->locks->nobjs_pending, __ATOMIC_SEQ_CST))
+      break;
+    fla_unlock_all_locks(fs);
+    sched_yield();
+  }
+}
+
+void
+fla_unlock_all(struct flexalloc const *fs)
+{
+  if (!fs->locks)
+    return;
+
+  __atomic_sub_fetch(&fs->locks->nquiesce, 1, __ATOMIC_SEQ_CST);
+  fla_unlock_all_locks(fs);
+}
+
 void
 fla_close_noflush(struct flexalloc *fs)
 {
   if (!fs || !(fs->state & FLA_STATE_OPEN))
     return;
 
+  // stops the checkpoint thread, which flushes through this handle
+  fla_ckpt_close(fs);
+  fla_jnl_close(fs);
   fs->state &= ~FLA_STATE_OPEN;
+  if (fs->io_queue)
+    fla_xne_queue_release(fs->qpool, fs->io_queue);
+  fs->io_queue = NULL;
+  fla_xne_queue_pool_term(fs->qpool);
+  fs->qpool = NULL;
   fs->fla_cs.fncs.fini_cs(fs, 0);
   fs->fla_dp.fncs.fini_dp(fs);
+  fla_obj_cache_fini(fs);
   fla_slab_cache_free(&fs->slab_cache);
+  fla_pool_fini(fs);
+  fla_md_dirty_fini(fs);
+  fla_locks_fini(fs);
+  fla_bufpool_term(fs->bufpool);
+  fs->bufpool = NULL;
   xnvme_dev_close(fs->dev.dev);
   free(fs->super);
   if (fs->dev.md_dev != fs->dev.dev)
@@ -683,6 +1129,10 @@ exit:
 int
 fla_base_sync(struct flexalloc *fs)
 {
+  // once logged a change survives a crash, it is put in place by a checkpoint
+  if (fs->jnl)
+    return fla_jnl_commit(fs);
+
   return fla_flush(fs);
 }
 
@@ -703,6 +1153,7 @@ fla_print_geo(struct flexalloc *fs)
   fprintf(stderr, "|  slab segment:\n");
   fprintf(stderr, "|    * slabs: %"PRIu32"\n", geo->nslabs);
   fprintf(stderr, "|    * slab total blocks: %"PRIu32"\n", geo->slab_sgmt.slab_sgmt_nlb);
+  fprintf(stderr, "|  journal blocks: %"PRIu32"\n", geo->jnl_nlb);
   fprintf(stderr, "\n");
 }
 
@@ -747,19 +1198,27 @@ int
 fla_pool_next_available_slab(struct flexalloc * fs, struct fla_pool_entry * pool_entry,
                              struct fla_slab_header ** slab)
 {
-  int err, ret;
+  int err = 0, ret;
+  uint32_t slab_id;
 
   if(pool_entry->partial_slabs == FLA_LINKED_LIST_NULL)
   {
     if(pool_entry->empty_slabs == FLA_LINKED_LIST_NULL)
     {
       // ACQUIRE A NEW ONE
+      fla_fs_lock(fs);
       err = fla_acquire_slab(fs, pool_entry->obj_nlb, slab);
+      fla_fs_unlock(fs);
       if(FLA_ERR(err, "fla_acquire_slab()"))
       {
         goto exit;
       }
 
+      (*slab)->pool = pool_entry - fs->pools.entries;
+      fla_md_mark_dirty(fs, *slab, sizeof(struct fla_slab_header));
+      fs->pools.usage[(*slab)->pool].nslabs++;
+      fla_jnl_log(fs, FLA_JNL_SLAB_ACQUIRE, (*slab)->pool, *slab - fs->slabs.headers, NULL, 0);
+
       // Add to empty
       err = fla_hdll_prepend(fs, *slab, &pool_entry->empty_slabs);
       if(FLA_ERR(err, "fla_hdll_prepend()"))
@@ -769,7 +1228,9 @@ fla_pool_next_available_slab(struct flexalloc * fs, struct fla_pool_entry * pool
 
       goto exit;
 release_slab:
+      fla_fs_lock(fs);
       ret = fla_release_slab(fs, *slab);
+      fla_fs_unlock(fs);
       if(FLA_ERR(ret, "fla_release_slab()"))
       {
         goto exit;
@@ -787,8 +1248,12 @@ release_slab:
   }
   else
   {
-    // TAKE FROM PARTIAL
-    *slab = fla_slab_header_ptr(pool_entry->partial_slabs, fs);
+    // TAKE THE FULLEST PARTIAL, so the emptier ones get a chance to drain
+    slab_id = fla_pool_bins_fullest(fs, pool_entry - fs->pools.entries);
+    if(slab_id == FLA_LINKED_LIST_NULL)
+      slab_id = pool_entry->partial_slabs;
+
+    *slab = fla_slab_header_ptr(slab_id, fs);
     if((err = -FLA_ERR(!slab, "fla_slab_header_ptr()")))
     {
       goto exit;
@@ -804,7 +1269,7 @@ fla_slab_next_available_obj(struct flexalloc * fs, struct fla_slab_header * slab
                             struct fla_object * obj, uint32_t num_objs)
 {
   int err = 0;
-  uint32_t slab_id;
+  uint32_t slab_id, nobjs;
   struct fla_pool_entry const * pool_entry;
 
   err = fla_slab_id(slab, fs, &slab_id);
@@ -816,7 +1281,9 @@ fla_slab_next_available_obj(struct flexalloc * fs, struct fla_slab_header * slab
     return err;
 
   pool_entry = &fs->pools.entries[slab->pool];
-  slab->refcount += (fs->pools.entrie_funcs + slab->pool)->fla_pool_num_fla_objs(pool_entry);
+  nobjs = (fs->pools.entrie_funcs + slab->pool)->fla_pool_num_fla_objs(pool_entry);
+  slab->refcount += nobjs;
+  fs->pools.usage[slab->pool].nobjs_used += nobjs;
 
   return err;
 }
@@ -834,6 +1301,111 @@ fla_pool_best_slab_list(struct fla_slab_header const *slab,
          : &pool_entry->partial_slabs;
 }
 
+/*
+ * Move the slab from the pool slab list it was on before its refcount changed
+ * to the one matching its refcount now, and update its occupancy bin.
+ */
+static int
+fla_slab_list_update(struct flexalloc *fs, struct fla_slab_header *slab, uint32_t *from_head)
+{
+  int err;
+  uint32_t * to_head, slab_id;
+
+  err = fla_slab_id(slab, fs, &slab_id);
+  if(FLA_ERR(err, "fla_slab_id()"))
+    return err;
+
+  fla_md_mark_dirty(fs, slab, sizeof(struct fla_slab_header));
+
+  to_head = fla_pool_best_slab_list(slab, &fs->pools);
+  if(from_head != to_head)
+  {
+    err = fla_hdll_remove(fs, slab, from_head);
+    if(FLA_ERR(err, "fla_hdll_remove()"))
+      return err;
+
+    err = fla_hdll_prepend(fs, slab, to_head);
+    if(FLA_ERR(err, "fla_hdll_prepend()"))
+      return err;
+  }
+
+  fla_pool_bins_update(fs, slab_id, to_head);
+  return 0;
+}
+
+int
+fla_slabs_rebuild(struct flexalloc *fs, uint32_t const *owners)
+{
+  int err = 0;
+  bool *in_use;
+  uint32_t ndx, owner;
+  struct fla_flist_iter it;
+  struct fla_slab_header * slab;
+  struct fla_pool_entry * pool_entry;
+
+  in_use = calloc(fs->geo.npools, sizeof(bool));
+  if(FLA_ERR(!in_use, "calloc()"))
+    return -ENOMEM;
+
+  fla_flist_iter_init(&it, fs->pools.freelist, true);
+  while(fla_flist_iter_next(&it, &ndx))
+    in_use[ndx] = true;
+
+  for(ndx = 0; ndx < fs->geo.npools; ++ndx)
+  {
+    pool_entry = &fs->pools.entries[ndx];
+    pool_entry->empty_slabs = FLA_LINKED_LIST_NULL;
+    pool_entry->full_slabs = FLA_LINKED_LIST_NULL;
+    pool_entry->partial_slabs = FLA_LINKED_LIST_NULL;
+    fla_md_mark_dirty(fs, pool_entry, sizeof(struct fla_pool_entry));
+  }
+
+  *fs->slabs.fslab_head = FLA_LINKED_LIST_NULL;
+  *fs->slabs.fslab_tail = FLA_LINKED_LIST_NULL;
+  *fs->slabs.fslab_num = 0;
+  fla_md_mark_dirty(fs, fs->slabs.fslab_num, 3 * sizeof(uint32_t));
+
+  // in ascending order, as mkfs lays out the free slab list
+  for(uint32_t slab_id = 0; slab_id < fs->geo.nslabs; ++slab_id)
+  {
+    slab = fs->slabs.headers + slab_id;
+    owner = owners[slab_id];
+    slab->refcount = 0;
+
+    if(owner >= fs->geo.npools || !in_use[owner])
+    {
+      fla_slab_cache_elem_drop(&fs->slab_cache, slab_id);
+      slab->pool = FLA_SLAB_POOL_NONE;
+      err = fla_edll_add_tail(fs, fs->slabs.fslab_head, fs->slabs.fslab_tail, slab);
+      if(FLA_ERR(err, "fla_edll_add_tail()"))
+        goto exit;
+
+      (*fs->slabs.fslab_num)++;
+      continue;
+    }
+
+    pool_entry = &fs->pools.entries[owner];
+    err = fla_slab_cache_elem_load(&fs->slab_cache, slab_id, pool_entry->slab_nobj);
+    if(err == FLA_SLAB_CACHE_INVALID_STATE)
+      err = 0; //Ignore as it was already loaded.
+    else if(FLA_ERR(err, "fla_slab_cache_elem_load()"))
+      goto exit;
+
+    slab->pool = owner;
+    slab->refcount = fla_flist_num_reserved(fs->slab_cache._head[slab_id].freelist);
+    err = fla_hdll_prepend(fs, slab, fla_pool_best_slab_list(slab, &fs->pools));
+    if(FLA_ERR(err, "fla_hdll_prepend()"))
+      goto exit;
+  }
+
+  err = fla_pool_usage_init(fs);
+  FLA_ERR(err, "fla_pool_usage_init()");
+
+exit:
+  free(in_use);
+  return err;
+}
+
 int
 fla_base_object_open(struct flexalloc * fs, struct fla_pool * pool_handle,
                      struct fla_object * obj)
@@ -842,23 +1414,53 @@ fla_base_object_open(struct flexalloc * fs, struct fla_pool * pool_handle,
   struct fla_slab_header * slab;
   struct fla_pool_entry const * pool_entry;
 
+  if((err = FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx),
+                    "invalid pool id, out of range")))
+    goto exit;
+
   slab = fla_slab_header_ptr(obj->slab_id, fs);
   if((err = FLA_ERR(!slab, "fla_slab_header_ptr()")))
     goto exit;
 
+  fla_pool_lock(fs, pool_handle->ndx);
+
   pool_entry = &fs->pools.entries[pool_handle->ndx];
   err = fla_slab_cache_elem_load(&fs->slab_cache, obj->slab_id, pool_entry->slab_nobj);
   if(err == FLA_SLAB_CACHE_INVALID_STATE)
     err = 0; //Ignore as it was already loaded.
   else if(FLA_ERR(err, "fla_slab_cache_elem_load()"))
-    goto exit;
+    goto unlock;
 
   //FIXME : make sure that the object is taken in the free list.
 
+unlock:
+  fla_pool_unlock(fs, pool_handle->ndx);
 exit:
   return err;
 }
 
+/*
+ * Enter the lock-free object path, which leaves the slab count and the slab
+ * freelist apart until fla_objs_pending_put(). Fails while fla_lock_all()
+ * waits for the calls in flight, the caller then takes the locked path.
+ */
+static bool
+fla_objs_pending_get(struct flexalloc const *fs)
+{
+  __atomic_add_fetch(&fs->locks->nobjs_pending, 1, __ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&fs->locks->nquiesce, __ATOMIC_SEQ_CST))
+    return true;
+
+  __atomic_sub_fetch(&fs->locks->nobjs_pending, 1, __ATOMIC_SEQ_CST);
+  return false;
+}
+
+static void
+fla_objs_pending_put(struct flexalloc const *fs)
+{
+  __atomic_sub_fetch(&fs->locks->nobjs_pending, 1, __ATOMIC_SEQ_CST);
+}
+
 int
 fla_base_object_create(struct flexalloc * fs, struct fla_pool * pool_handle,
                        struct fla_object * obj)
@@ -866,12 +1468,27 @@ fla_base_object_create(struct flexalloc * fs, struct fla_pool * pool_handle,
   int err;
   struct fla_slab_header * slab;
   struct fla_pool_entry * pool_entry;
-  uint32_t * from_head, * to_head, slab_id;
+  uint32_t * from_head, slab_id = 0;
   struct fla_pool_entry_fnc const * pool_entry_fnc;
+  bool counted = false;
 
-  pool_entry = &fs->pools.entries[pool_handle->ndx];
-  err = fla_pool_next_available_slab(fs, pool_entry, &slab);
-  if(FLA_ERR(err, "fla_pool_next_available_slab()"))
+  if((err = FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx),
+                    "invalid pool id, out of range")))
+    return err;
+
+  fla_pool_lock(fs, pool_handle->ndx);
+
+  err = fla_obj_cache_get(fs, pool_handle, obj);
+  if(err != FLA_OBJ_CACHE_BYPASS)
+  {
+    if(!FLA_ERR(err, "fla_obj_cache_get()"))
+      fla_jnl_log(fs, FLA_JNL_OBJ_CREATE, pool_handle->ndx, 0, obj, sizeof(*obj));
+    goto exit;
+  }
+
+  pool_entry = &fs->pools.entries[pool_handle->ndx];
+  err = fla_pool_next_available_slab(fs, pool_entry, &slab);
+  if(FLA_ERR(err, "fla_pool_next_available_slab()"))
   {
     goto exit;
   }
@@ -896,31 +1513,60 @@ fla_base_object_create(struct flexalloc * fs, struct fla_pool * pool_handle,
   pool_entry_fnc = fs->pools.entrie_funcs + slab->pool;
   uint32_t num_fla_objs = pool_entry_fnc->fla_pool_num_fla_objs(pool_entry);
 
-  err = fla_slab_next_available_obj(fs, slab, obj, num_fla_objs);
-  if(FLA_ERR(err, "fla_slab_next_available_obj()"))
+  // a journaled entry has to be taken before the record leaves the pool lock
+  if(fs->locks && !fs->jnl && num_fla_objs == 1 && fla_objs_pending_get(fs))
   {
-    goto exit;
+    // Only count the object here, the entry is taken once the lock is dropped
+    slab->refcount++;
+    fs->pools.usage[slab->pool].nobjs_used++;
+    counted = true;
   }
-
-  to_head = fla_pool_best_slab_list(slab, &fs->pools);
-
-  if(from_head != to_head)
+  else
   {
-    // TODO: Add an assert to make sure that to_head != than from_head
-    err = fla_hdll_remove(fs, slab, from_head);
-    if(FLA_ERR(err, "fla_hdll_remove()"))
+    err = fla_slab_next_available_obj(fs, slab, obj, num_fla_objs);
+    if(FLA_ERR(err, "fla_slab_next_available_obj()"))
     {
       goto exit;
     }
+    fla_jnl_log(fs, FLA_JNL_OBJ_CREATE, pool_handle->ndx, 0, obj, sizeof(*obj));
+  }
 
-    err = fla_hdll_prepend(fs, slab, to_head);
-    if(FLA_ERR(err, "fla_hdll_prepend()"))
+  err = fla_slab_list_update(fs, slab, from_head);
+  if(FLA_ERR(err, "fla_slab_list_update()"))
+  {
+    // no entry was taken for a counted object, it must not stay counted
+    if(counted)
     {
-      goto exit;
+      slab->refcount--;
+      fs->pools.usage[slab->pool].nobjs_used--;
+      fla_objs_pending_put(fs);
     }
+    goto exit;
   }
 
 exit:
+  fla_pool_unlock(fs, pool_handle->ndx);
+
+  if(!err && !counted)
+    err = fla_jnl_commit(fs);
+  if(err || !counted)
+    return err;
+
+  /*
+   * The slab counts one more object than its freelist holds, so a free entry
+   * is there for us. Threads creating objects in the same slab only contend
+   * on the freelist words from here.
+   */
+  err = fla_slab_cache_obj_alloc(&fs->slab_cache, slab_id, obj, 1);
+  if(FLA_ERR(err, "fla_slab_cache_obj_alloc()"))
+  {
+    fla_pool_lock(fs, pool_handle->ndx);
+    if(!fla_slab_refcount_sub(fs, slab, 1))
+      fs->pools.usage[slab->pool].nobjs_used--;
+    fla_pool_unlock(fs, pool_handle->ndx);
+  }
+  fla_objs_pending_put(fs);
+
   return err;
 }
 
@@ -940,48 +1586,334 @@ fla_object_soffset(struct flexalloc const * fs, struct fla_object const * obj,
 }
 
 int
-fla_base_object_destroy(struct flexalloc *fs, struct fla_pool * pool_handle,
-                        struct fla_object * obj)
+fla_slab_objs_reserve(struct flexalloc *fs, struct fla_pool const * pool_handle,
+                      struct fla_object *objs, uint32_t max, uint32_t *nobjs)
 {
-  int err = 0;
+  int err;
   struct fla_slab_header * slab;
   struct fla_pool_entry * pool_entry;
-  uint32_t * from_head, * to_head;
-  struct fla_pool_entry_fnc const * pool_entry_fnc;
+  uint32_t * from_head, slab_id, n = 0;
 
-  err = fs->fla_cs.fncs.object_destroy(fs, pool_handle, obj);
-  if (FLA_ERR(err, "object_destroy()"))
+  pool_entry = &fs->pools.entries[pool_handle->ndx];
+  err = fla_pool_next_available_slab(fs, pool_entry, &slab);
+  if(FLA_ERR(err, "fla_pool_next_available_slab()"))
     goto exit;
 
-  slab = fla_slab_header_ptr(obj->slab_id, fs);
-  if((err = FLA_ERR(!slab, "fla_slab_header_ptr()")))
+  err = fla_slab_id(slab, fs, &slab_id);
+  if(FLA_ERR(err, "fla_slab_id()"))
+    goto exit;
+
+  err = fla_slab_cache_elem_load(&fs->slab_cache, slab_id, pool_entry->slab_nobj);
+  if(err == FLA_SLAB_CACHE_INVALID_STATE)
+    err = 0; //Ignore as it was already loaded.
+  else if(FLA_ERR(err, "fla_slab_cache_elem_load()"))
     goto exit;
 
-  pool_entry = &fs->pools.entries[pool_handle->ndx];
   from_head = fla_pool_best_slab_list(slab, &fs->pools);
 
-  pool_entry_fnc = fs->pools.entrie_funcs + slab->pool;
-  uint32_t num_fla_objs = pool_entry_fnc->fla_pool_num_fla_objs(pool_entry);
+  // the next available slab is never full
+  max = fla_min(max, pool_entry->slab_nobj - slab->refcount);
+  for(; n < max; ++n)
+  {
+    err = fla_slab_cache_obj_alloc(&fs->slab_cache, slab_id, &objs[n], 1);
+    if(FLA_ERR(err, "fla_slab_cache_obj_alloc()"))
+      break;
+  }
+
+  if(!n)
+    goto exit;
+
+  slab->refcount += n;
+
+  err = fla_slab_list_update(fs, slab, from_head);
+  FLA_ERR(err, "fla_slab_list_update()");
+
+exit:
+  *nobjs = n;
+  return err;
+}
+
+int
+fla_slab_obj_release(struct flexalloc *fs, struct fla_object * obj, uint32_t num_fla_objs)
+{
+  int err;
+  struct fla_slab_header * slab;
+
+  slab = fla_slab_header_ptr(obj->slab_id, fs);
+  if((err = FLA_ERR(!slab, "fla_slab_header_ptr()")))
+    goto exit;
 
   err = fla_slab_cache_obj_free(&fs->slab_cache, obj, num_fla_objs);
   if(FLA_ERR(err, "fla_slab_cache_obj_free()"))
     goto exit;
 
+  err = fla_slab_refcount_sub(fs, slab, num_fla_objs);
+  FLA_ERR(err, "fla_slab_refcount_sub()");
+
+exit:
+  return err;
+}
+
+int
+fla_slab_refcount_sub(struct flexalloc *fs, struct fla_slab_header * slab, uint32_t num_fla_objs)
+{
+  int err;
+  uint32_t * from_head;
+
+  from_head = fla_pool_best_slab_list(slab, &fs->pools);
   slab->refcount -= num_fla_objs;
-  to_head = fla_pool_best_slab_list(slab, &fs->pools);
 
-  err = fla_hdll_remove(fs, slab, from_head);
-  if(FLA_ERR(err, "fla_hdll_remove()"))
+  // a slab staying on its list keeps its place, only its bin may change
+  err = fla_slab_list_update(fs, slab, from_head);
+  FLA_ERR(err, "fla_slab_list_update()");
+
+  return err;
+}
+
+int
+fla_base_object_destroy(struct flexalloc *fs, struct fla_pool * pool_handle,
+                        struct fla_object * obj)
+{
+  int err = 0;
+  struct fla_pool_entry * pool_entry;
+  struct fla_pool_entry_fnc const * pool_entry_fnc;
+  struct fla_slab_header * slab;
+  uint32_t num_fla_objs;
+  bool freed = false;
+
+  if((err = FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx),
+                    "invalid pool id, out of range")))
     goto exit;
 
-  err = fla_hdll_prepend(fs, slab, to_head);
-  if(FLA_ERR(err, "fla_hdll_prepend()"))
+  err = fs->fla_cs.fncs.object_destroy(fs, pool_handle, obj);
+  if (FLA_ERR(err, "object_destroy()"))
     goto exit;
 
+  pool_entry = &fs->pools.entries[pool_handle->ndx];
+  pool_entry_fnc = fs->pools.entrie_funcs + pool_handle->ndx;
+  num_fla_objs = pool_entry_fnc->fla_pool_num_fla_objs(pool_entry);
+
+  // Free the entry before the slab count drops, see fla_base_object_create()
+  if(fs->locks && !fs->jnl && num_fla_objs == 1 && fla_objs_pending_get(fs))
+  {
+    err = fla_slab_cache_obj_free(&fs->slab_cache, obj, 1);
+    if(FLA_ERR(err, "fla_slab_cache_obj_free()"))
+    {
+      fla_objs_pending_put(fs);
+      goto exit;
+    }
+    freed = true;
+  }
+
+  fla_pool_lock(fs, pool_handle->ndx);
+
+  if(freed)
+  {
+    slab = fla_slab_header_ptr(obj->slab_id, fs);
+    if((err = FLA_ERR(!slab, "fla_slab_header_ptr()")))
+    {
+      fla_objs_pending_put(fs);
+      goto unlock;
+    }
+
+    err = fla_slab_refcount_sub(fs, slab, 1);
+    if(!FLA_ERR(err, "fla_slab_refcount_sub()"))
+      fs->pools.usage[pool_handle->ndx].nobjs_used--;
+    fla_objs_pending_put(fs);
+    goto unlock;
+  }
+
+  // logged before the entry can be handed out again from the object cache
+  fla_jnl_log(fs, FLA_JNL_OBJ_DESTROY, pool_handle->ndx, 0, obj, sizeof(*obj));
+
+  err = fla_obj_cache_put(fs, pool_handle, obj);
+  if(err != FLA_OBJ_CACHE_BYPASS)
+  {
+    FLA_ERR(err, "fla_obj_cache_put()");
+    goto unlock;
+  }
+
+  err = fla_slab_obj_release(fs, obj, num_fla_objs);
+  if(FLA_ERR(err, "fla_slab_obj_release()"))
+    goto unlock;
+
+  fs->pools.usage[pool_handle->ndx].nobjs_used -= num_fla_objs;
+
+unlock:
+  if(!err)
+  {
+    err = fla_pool_wmark_check(fs, pool_handle->ndx);
+    FLA_ERR(err, "fla_pool_wmark_check()");
+  }
+  fla_pool_unlock(fs, pool_handle->ndx);
+
+  if(!err)
+    err = fla_jnl_commit(fs);
 exit:
   return err;
 }
 
+int
+fla_base_object_destroy_n(struct flexalloc *fs, struct fla_pool * pool_handle,
+                          struct fla_object * objs, uint32_t nobjs)
+{
+  int err = 0, ret;
+  struct fla_pool_entry * pool_entry;
+  struct fla_pool_entry_fnc const * pool_entry_fnc;
+  struct fla_slab_header * slab;
+  struct fla_object * done;
+  uint32_t i, j, nfreed, ndone = 0;
+
+  if((err = FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx),
+                    "invalid pool id, out of range")))
+    return err;
+
+  pool_entry = &fs->pools.entries[pool_handle->ndx];
+  pool_entry_fnc = fs->pools.entrie_funcs + pool_handle->ndx;
+
+  if(pool_entry_fnc->fla_pool_num_fla_objs(pool_entry) != 1)
+  {
+    for(i = 0; i < nobjs; ++i)
+    {
+      ret = fla_base_object_destroy(fs, pool_handle, &objs[i]);
+      if(FLA_ERR(ret, "fla_base_object_destroy()"))
+        err = ret;
+    }
+    return err;
+  }
+
+  if(!nobjs)
+    return 0;
+
+  done = malloc(nobjs * sizeof(*done));
+  if((err = FLA_ERR_ERRNO(!done, "malloc()")))
+    return err;
+
+  // objects the commit scheme failed to destroy stay allocated, the rest are freed
+  for(i = 0; i < nobjs; ++i)
+  {
+    ret = fs->fla_cs.fncs.object_destroy(fs, pool_handle, &objs[i]);
+    if(FLA_ERR(ret, "object_destroy()"))
+      err = ret;
+    else
+      done[ndone++] = objs[i];
+  }
+  if(!ndone)
+    goto free_done;
+
+  fla_pool_lock(fs, pool_handle->ndx);
+
+  fla_jnl_log(fs, FLA_JNL_OBJ_DESTROY, pool_handle->ndx, 0, done,
+              ndone * sizeof(*done));
+
+  // objects of the same slab next to each other move the slab once
+  for(i = 0; i < ndone; i = j)
+  {
+    nfreed = 0;
+    for(j = i; j < ndone && done[j].slab_id == done[i].slab_id; ++j)
+    {
+      ret = fla_slab_cache_obj_free(&fs->slab_cache, &done[j], 1);
+      if(FLA_ERR(ret, "fla_slab_cache_obj_free()"))
+        err = ret;
+      else
+        nfreed++;
+    }
+
+    if(!nfreed)
+      continue;
+
+    slab = fla_slab_header_ptr(done[i].slab_id, fs);
+    if((ret = FLA_ERR(!slab, "fla_slab_header_ptr()")))
+    {
+      err = ret;
+      continue;
+    }
+
+    ret = fla_slab_refcount_sub(fs, slab, nfreed);
+    if(FLA_ERR(ret, "fla_slab_refcount_sub()"))
+      err = ret;
+
+    fs->pools.usage[pool_handle->ndx].nobjs_used -= nfreed;
+  }
+
+  ret = fla_pool_wmark_check(fs, pool_handle->ndx);
+  if(FLA_ERR(ret, "fla_pool_wmark_check()"))
+    err = ret;
+
+  fla_pool_unlock(fs, pool_handle->ndx);
+
+  ret = fla_jnl_commit(fs);
+  if(FLA_ERR(ret, "fla_jnl_commit()"))
+    err = ret;
+
+free_done:
+  free(done);
+  return err;
+}
+
+int
+fla_base_object_create_n(struct flexalloc *fs, struct fla_pool * pool_handle,
+                         struct fla_object * objs, uint32_t nobjs)
+{
+  int err = 0, ret;
+  struct fla_pool_entry * pool_entry;
+  struct fla_pool_entry_fnc const * pool_entry_fnc;
+  uint32_t n = 0, nreserved;
+
+  if((err = FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx),
+                    "invalid pool id, out of range")))
+    return err;
+
+  pool_entry = &fs->pools.entries[pool_handle->ndx];
+  pool_entry_fnc = fs->pools.entrie_funcs + pool_handle->ndx;
+
+  // striped objects span several slab entries, take them one at a time
+  if(pool_entry_fnc->fla_pool_num_fla_objs(pool_entry) != 1)
+  {
+    for(; n < nobjs; ++n)
+    {
+      err = fla_base_object_create(fs, pool_handle, &objs[n]);
+      if(FLA_ERR(err, "fla_base_object_create()"))
+        break;
+    }
+
+    if(err)
+    {
+      ret = fla_base_object_destroy_n(fs, pool_handle, objs, n);
+      FLA_ERR(ret, "fla_base_object_destroy_n()");
+    }
+    return err;
+  }
+
+  fla_pool_lock(fs, pool_handle->ndx);
+
+  // take as many entries as the next available slab has left, one slab at a time
+  while(n < nobjs)
+  {
+    err = fla_slab_objs_reserve(fs, pool_handle, objs + n, nobjs - n, &nreserved);
+    n += nreserved;
+    if(FLA_ERR(err, "fla_slab_objs_reserve()"))
+      goto release;
+  }
+
+  fs->pools.usage[pool_handle->ndx].nobjs_used += nobjs;
+  fla_jnl_log(fs, FLA_JNL_OBJ_CREATE, pool_handle->ndx, 0, objs,
+              nobjs * sizeof(*objs));
+  fla_pool_unlock(fs, pool_handle->ndx);
+
+  return fla_jnl_commit(fs);
+
+release:
+  for(uint32_t i = 0; i < n; ++i)
+  {
+    ret = fla_slab_obj_release(fs, &objs[i], 1);
+    FLA_ERR(ret, "fla_slab_obj_release()");
+  }
+
+  fla_pool_unlock(fs, pool_handle->ndx);
+  return err;
+}
+
 int
 fla_slab_range_check_id(const struct flexalloc * fs, const uint32_t s_id)
 {
@@ -1028,6 +1960,9 @@ fla_acquire_slab(struct flexalloc *fs, const uint32_t obj_nlb,
     goto exit;
   }
 
+  // the freelist of a slab released during a flush may still be written into it
+  fla_ckpt_slab_wait(fs, *fs->slabs.fslab_head);
+
   err = fla_edll_remove_head(fs, fs->slabs.fslab_head, fs->slabs.fslab_tail, a_slab);
   if(FLA_ERR(err, "fla_edll_remove_head()"))
   {
@@ -1041,6 +1976,7 @@ fla_acquire_slab(struct flexalloc *fs, const uint32_t obj_nlb,
   }
 
   (*fs->slabs.fslab_num)--;
+  fla_md_mark_dirty(fs, fs->slabs.fslab_num, sizeof(uint32_t));
 
 exit:
   return err;
@@ -1050,7 +1986,7 @@ int
 fla_release_slab(struct flexalloc *fs, struct fla_slab_header * r_slab)
 {
   int err = 0;
-  uint32_t slab_id;
+  uint32_t slab_id, pool_ndx = r_slab->pool;
 
   if(FLA_ERR(r_slab->refcount, "fla_release_slab()"))
   {
@@ -1067,14 +2003,20 @@ fla_release_slab(struct flexalloc *fs, struct fla_slab_header * r_slab)
   }
 
   fla_slab_cache_elem_drop(&fs->slab_cache, slab_id);
+  fla_pool_bins_update(fs, slab_id, NULL);
 
+  r_slab->pool = FLA_SLAB_POOL_NONE;
   err = fla_edll_add_tail(fs, fs->slabs.fslab_head, fs->slabs.fslab_tail, r_slab);
   if(FLA_ERR(err, "fla_edll_add_tail()"))
   {
+    r_slab->pool = pool_ndx;
     goto exit;
   }
 
   (*fs->slabs.fslab_num)++;
+  fla_md_mark_dirty(fs, fs->slabs.fslab_num, sizeof(uint32_t));
+  fs->pools.usage[pool_ndx].nslabs--;
+  fla_jnl_log(fs, FLA_JNL_SLAB_RELEASE, pool_ndx, slab_id, NULL, 0);
 
 exit:
   return err;
@@ -1093,6 +2035,7 @@ fla_format_slab(struct flexalloc *fs, struct fla_slab_header * slab, uint32_t ob
   slab->next = FLA_LINKED_LIST_NULL;
   slab->prev = FLA_LINKED_LIST_NULL;
   slab->refcount = 0;
+  fla_md_mark_dirty(fs, slab, sizeof(struct fla_slab_header));
 
   // FIXME: Do we need the pool ID here?
   slab->pool = 0;
@@ -1146,8 +2089,9 @@ fla_object_read(const struct flexalloc * fs, struct fla_pool const * pool_handle
   if((err = FLA_ERR(obj_eoffset < r_eoffset, "Read outside of an object")))
     goto exit;
 
-  struct fla_xne_io xne_io;
+  struct fla_xne_io xne_io = {0};
   xne_io.fla_dp = &fs->fla_dp;
+  xne_io.qpool = fs->qpool;
   if (!(pool_entry->flags && FLA_POOL_ENTRY_STRP))
   {
     struct xnvme_lba_range range;
@@ -1167,6 +2111,7 @@ fla_object_read(const struct flexalloc * fs, struct fla_pool const * pool_handle
     xne_io.prep_ctx = fs->fla_dp.fncs.prep_dp_ctx;
     sp.strp_nobjs = strp_ops->strp_nobjs;
     sp.strp_chunk_nbytes = strp_ops->strp_nbytes;
+    sp.strp_depth = FLEXALLOC_XNVME_STRP_DEPTH;
     xne_io.io_type = FLA_IO_DATA_READ;
     xne_io.obj_handle = obj;
     xne_io.pool_handle = pool_handle;
@@ -1218,6 +2163,7 @@ fla_object_write(struct flexalloc * fs, struct fla_pool const * pool_handle,
   xne_io.obj_handle = obj;
   xne_io.pool_handle = pool_handle;
   xne_io.fla_dp = &fs->fla_dp;
+  xne_io.qpool = fs->qpool;
   if (!(pool_entry->flags && FLA_POOL_ENTRY_STRP))
   {
     struct xnvme_lba_range lba_range;
@@ -1234,6 +2180,7 @@ fla_object_write(struct flexalloc * fs, struct fla_pool const * pool_handle,
     struct fla_strp_params sp;
     sp.strp_nobjs = strp_ops->strp_nobjs;
     sp.strp_chunk_nbytes = strp_ops->strp_nbytes;
+    sp.strp_depth = FLEXALLOC_XNVME_STRP_DEPTH;
     sp.faobj_nlbs = pool_entry->obj_nlb;
     sp.xfer_snbytes = w_offset;
     sp.xfer_nbytes = w_len;
@@ -1252,80 +2199,647 @@ exit:
   return err;
 }
 
+/*
+ * Striped pools take no batched I/O, their descriptors go one at a time through
+ * the striped object path instead.
+ */
+static int
+fla_object_unaligned_io(struct flexalloc * fs, struct fla_object_io_desc * descs,
+                        uint32_t ndescs)
+{
+  int err = 0;
+  struct fla_object_io_desc *desc;
+
+  if (!ndescs || !(fs->pools.entries[descs[0].pool->ndx].flags & FLA_POOL_ENTRY_STRP))
+    return fla_object_io_batch(fs, descs, ndescs);
+
+  for (uint32_t i = 0; i < ndescs && !err; ++i)
+  {
+    desc = &descs[i];
+    err = desc->dir == FLA_OBJECT_IO_WRITE
+          ? fla_object_write(fs, desc->pool, desc->object, desc->buf, desc->offset, desc->len)
+          : fla_object_read(fs, desc->pool, desc->object, desc->buf, desc->offset, desc->len);
+    FLA_ERR(err, "fla_object_write() or fla_object_read()");
+  }
+
+  return err;
+}
+
+/*
+ * Partial head and tail blocks are read back concurrently, patched with the
+ * caller's bytes and written together with the aligned interior. The interior
+ * is written straight from w_buf when it sits at a block aligned address, as
+ * direct I/O requires; otherwise the whole range goes through the bounce
+ * buffer and out as one write.
+ */
 int
 fla_object_unaligned_write(struct flexalloc * fs, struct fla_pool const * pool_handle,
                            struct fla_object const * obj, void const * w_buf, size_t obj_offset,
                            size_t len)
 {
   int err = 0;
-  void * bounce_buf, * buf;
-  size_t bounce_buf_size,  aligned_sb, aligned_eb, orig_sb, orig_eb;
+  uint32_t ndescs = 0, lb_nbytes = fs->dev.lb_nbytes;
+  size_t aligned_so, aligned_eo, mid_so, mid_eo, tail_boff, eo = obj_offset + len;
+  char * bounce_buf;
+  char const * mid_buf;
+  bool head, tail, direct;
+  struct fla_object_io_desc descs[3];
+
+  if (!len)
+    goto exit;
 
-  orig_sb = (fla_object_slba(fs, obj, pool_handle) * fs->dev.lb_nbytes) + obj_offset;
-  orig_eb = orig_sb + len;
-  aligned_sb = (orig_sb / fs->dev.lb_nbytes) * fs->dev.lb_nbytes;
-  aligned_eb = FLA_CEIL_DIV(orig_eb, fs->dev.lb_nbytes) * fs->dev.lb_nbytes;
-  bounce_buf_size = aligned_eb - aligned_sb;
+  aligned_so = (obj_offset / lb_nbytes) * lb_nbytes;
+  aligned_eo = FLA_CEIL_DIV(eo, lb_nbytes) * lb_nbytes;
+  head = aligned_so < obj_offset;
+  tail = eo < aligned_eo;
 
-  bounce_buf = fla_xne_alloc_buf(fs->dev.dev, bounce_buf_size);
-  if(FLA_ERR(!bounce_buf, "fla_buf_alloc()"))
-  {
-    err = -ENOENT;
+  // A range within one block only needs the head read back
+  if (head && tail && aligned_eo - aligned_so == lb_nbytes)
+    tail = false;
+
+  mid_so = head ? aligned_so + lb_nbytes : obj_offset;
+  mid_eo = tail ? aligned_eo - lb_nbytes : eo;
+  if (mid_eo < mid_so)
+    mid_eo = mid_so;
+
+  mid_buf = (char const *)w_buf + (mid_so - obj_offset);
+  direct = mid_so < mid_eo && !((uintptr_t)mid_buf % lb_nbytes);
+
+  tail_boff = direct ? lb_nbytes : aligned_eo - aligned_so - lb_nbytes;
+  bounce_buf = fla_bufpool_alloc(fs->bufpool,
+                                 direct ? 2 * lb_nbytes : aligned_eo - aligned_so);
+  if((err = FLA_ERR(!bounce_buf, "fla_bufpool_alloc()")))
     goto exit;
+
+  struct fla_object_io_desc desc =
+  {
+    .pool = pool_handle, .object = obj, .len = lb_nbytes, .dir = FLA_OBJECT_IO_READ
+  };
+
+  if (head)
+  {
+    desc.offset = aligned_so;
+    desc.buf = bounce_buf;
+    descs[ndescs++] = desc;
   }
 
-  struct xnvme_lba_range range;
+  if (tail)
+  {
+    desc.offset = aligned_eo - lb_nbytes;
+    desc.buf = bounce_buf + tail_boff;
+    descs[ndescs++] = desc;
+  }
+
+  err = fla_object_unaligned_io(fs, descs, ndescs);
+  if(FLA_ERR(err, "fla_object_unaligned_io() - read edges"))
+    goto put_bounce_buf;
 
-  if(aligned_sb < orig_sb)
+  desc.dir = FLA_OBJECT_IO_WRITE;
+  ndescs = 0;
+  if (direct)
   {
-    range = fla_xne_lba_range_from_offset_nbytes(fs->dev.dev, aligned_sb, fs->dev.lb_nbytes);
-    if((err = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
-      goto exit;
-    struct fla_xne_io xne_io = {.dev = fs->dev.dev, .buf = bounce_buf, .lba_range = &range, .fla_dp = &fs->fla_dp};
-    err = fla_xne_sync_seq_r_xneio(&xne_io);
-    if(FLA_ERR(err, "fla_xne_sync_seq_r_xneio()"))
-      goto free_bounce_buf;
+    if (head)
+      memcpy(bounce_buf + (obj_offset - aligned_so), w_buf, mid_so - obj_offset);
+    if (tail)
+      memcpy(bounce_buf + tail_boff, (char const *)w_buf + (mid_eo - obj_offset), eo - mid_eo);
+
+    if (head)
+    {
+      desc.offset = aligned_so;
+      desc.buf = bounce_buf;
+      descs[ndescs++] = desc;
+    }
+
+    desc.offset = mid_so;
+    desc.len = mid_eo - mid_so;
+    desc.buf = (void *)mid_buf;
+    descs[ndescs++] = desc;
+
+    if (tail)
+    {
+      desc.offset = aligned_eo - lb_nbytes;
+      desc.len = lb_nbytes;
+      desc.buf = bounce_buf + tail_boff;
+      descs[ndescs++] = desc;
+    }
+  }
+  else
+  {
+    memcpy(bounce_buf + (obj_offset - aligned_so), w_buf, len);
+
+    desc.offset = aligned_so;
+    desc.len = aligned_eo - aligned_so;
+    desc.buf = bounce_buf;
+    descs[ndescs++] = desc;
   }
 
-  if(aligned_eb > orig_eb)
+  err = fla_object_unaligned_io(fs, descs, ndescs);
+  if(FLA_ERR(err, "fla_object_unaligned_io() - write"))
+    goto put_bounce_buf;
+
+put_bounce_buf:
+  fla_bufpool_free(fs->bufpool, bounce_buf);
+
+exit:
+  return err;
+}
+
+/*
+ * Bounds checks shared by the object I/O calls that take more than one buffer
+ * or transfer. Sets the device byte offset where the I/O starts.
+ */
+static int
+fla_object_io_check(struct flexalloc const * fs, struct fla_pool const * pool_handle,
+                    struct fla_object const * obj, size_t offset, size_t len,
+                    uint64_t * soffset)
+{
+  int err;
+  uint64_t obj_eoffset, slab_eoffset;
+
+  obj_eoffset = fla_object_eoffset(fs, obj, pool_handle);
+  *soffset = fla_object_soffset(fs, obj, pool_handle) + offset;
+
+  slab_eoffset = (fla_geo_slab_lb_off(fs, obj->slab_id) + fs->geo.slab_nlb) * fs->geo.lb_nbytes;
+  if((err = FLA_ERR(slab_eoffset < obj_eoffset, "I/O outside a slab")))
+    return err;
+
+  return FLA_ERR(obj_eoffset < *soffset + len, "I/O outside of an object");
+}
+
+static int
+fla_object_iov_xfer(struct flexalloc const * fs, struct fla_pool const * pool_handle,
+                    struct fla_object const * obj, struct iovec const * iov, int iovcnt,
+                    size_t offset, bool write)
+{
+  int err;
+  size_t len = 0;
+  uint64_t soffset;
+  struct fla_pool_entry *pool_entry = &fs->pools.entries[pool_handle->ndx];
+  struct fla_xne_io xne_io = {0};
+
+  if((err = FLA_ERR(iovcnt < 0, "Negative iovec count (%d)", iovcnt)))
+    goto exit;
+
+  for (int i = 0; i < iovcnt; ++i)
+    len += iov[i].iov_len;
+
+  err = fla_object_io_check(fs, pool_handle, obj, offset, len, &soffset);
+  if(FLA_ERR(err, "fla_object_io_check()"))
+    goto exit;
+
+  xne_io.io_type = write ? FLA_IO_DATA_WRITE : FLA_IO_DATA_READ;
+  xne_io.dev = fs->dev.dev;
+  xne_io.obj_handle = obj;
+  xne_io.pool_handle = pool_handle;
+  xne_io.fla_dp = &fs->fla_dp;
+  xne_io.qpool = fs->qpool;
+  if (!(pool_entry->flags & FLA_POOL_ENTRY_STRP))
   {
-    range = fla_xne_lba_range_from_offset_nbytes(fs->dev.dev, aligned_eb - fs->dev.lb_nbytes,
-            fs->dev.lb_nbytes);
-    if((err = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
+    struct xnvme_lba_range lba_range;
+    lba_range = fla_xne_lba_range_from_offset_nbytes(xne_io.dev, soffset, len);
+    if((err = FLA_ERR(lba_range.attr.is_valid != 1, "fla_xne_lba_range_from_offset_nbytes()")))
       goto exit;
-    buf = bounce_buf + bounce_buf_size - fs->dev.lb_nbytes;
-    struct fla_xne_io xne_io = {.dev = fs->dev.dev, .buf = buf, .lba_range = &range, .fla_dp = &fs->fla_dp};
 
-    err = fla_xne_sync_seq_r_xneio(&xne_io);
-    if(FLA_ERR(err, "fla_xne_sync_seq_r_xneio()"))
-      goto free_bounce_buf;
+    if (write)
+      xne_io.prep_ctx = fs->fla_dp.fncs.prep_dp_ctx;
+    xne_io.lba_range = &lba_range;
+
+    err = fla_xne_sync_seqv_xneio(&xne_io, iov, iovcnt);
+    if(FLA_ERR(err, "fla_xne_sync_seqv_xneio()"))
+      goto exit;
   }
+  else
+  {
+    // Every element is a striped transfer of its own, continuing where the last one ended
+    struct fla_pool_strp *strp_ops = (struct fla_pool_strp*)&pool_entry->usable;
+    struct fla_strp_params sp;
+    xne_io.prep_ctx = fs->fla_dp.fncs.prep_dp_ctx;
+    sp.strp_nobjs = strp_ops->strp_nobjs;
+    sp.strp_chunk_nbytes = strp_ops->strp_nbytes;
+    sp.strp_depth = FLEXALLOC_XNVME_STRP_DEPTH;
+    sp.faobj_nlbs = pool_entry->obj_nlb;
+    sp.strp_obj_tnbytes = (uint64_t)strp_ops->strp_nobjs * pool_entry->obj_nlb * fs->geo.lb_nbytes;
+    sp.strp_obj_start_nbytes = soffset - offset;
+    sp.dev_lba_nbytes = fs->geo.lb_nbytes;
+    sp.write = write;
+    xne_io.strp_params = &sp;
 
-  buf = bounce_buf + (orig_sb - aligned_sb);
-  memcpy(buf, w_buf, len);
+    sp.xfer_snbytes = offset;
+    for (int i = 0; i < iovcnt; sp.xfer_snbytes += iov[i].iov_len, ++i)
+    {
+      if (!iov[i].iov_len)
+        continue;
 
+      sp.xfer_nbytes = iov[i].iov_len;
+      xne_io.buf = iov[i].iov_base;
+      err = fla_xne_async_strp_seq_xneio(&xne_io);
+      if(FLA_ERR(err, "fla_xne_async_strp_seq_xneio()"))
+        goto exit;
+    }
+  }
+
+exit:
+  return err;
+}
+
+int
+fla_object_readv(struct flexalloc const * fs, struct fla_pool const * pool_handle,
+                 struct fla_object const * obj, struct iovec const * iov, int iovcnt,
+                 size_t r_offset)
+{
+  return fla_object_iov_xfer(fs, pool_handle, obj, iov, iovcnt, r_offset, false);
+}
+
+int
+fla_object_writev(struct flexalloc * fs, struct fla_pool const * pool_handle,
+                  struct fla_object const * obj, struct iovec const * iov, int iovcnt,
+                  size_t w_offset)
+{
+  return fla_object_iov_xfer(fs, pool_handle, obj, iov, iovcnt, w_offset, true);
+}
+
+static int
+fla_object_io_queue(struct flexalloc * fs, struct fla_xne_queue ** q)
+{
+  int err = 0;
+
+  if (!fs->io_queue)
+  {
+    err = fla_xne_queue_lease(fs->qpool, fs->qpool->depth, &fs->io_queue);
+    if (FLA_ERR(err, "fla_xne_queue_lease()"))
+      return err;
+  }
+
+  *q = fs->io_queue;
+  return err;
+}
+
+static int
+fla_object_async_xneio(struct flexalloc * fs, struct fla_pool const * pool_handle,
+                       struct fla_object const * obj, void * buf, size_t offset, size_t len,
+                       enum fla_xne_io_type io_type, fla_object_io_cb cb, void * cb_arg)
+{
+  int err;
+  uint64_t soffset;
+  struct fla_pool_entry *pool_entry = &fs->pools.entries[pool_handle->ndx];
+  struct fla_xne_queue *q = NULL;
   struct xnvme_lba_range lba_range;
   struct fla_xne_io xne_io;
-  xne_io.io_type = FLA_IO_DATA_WRITE;
+
+  err = fla_object_io_check(fs, pool_handle, obj, offset, len, &soffset);
+  if(FLA_ERR(err, "fla_object_io_check()"))
+    goto exit;
+
+  if((err = FLA_ERR(pool_entry->flags & FLA_POOL_ENTRY_STRP,
+                    "Asynchronous I/O is not supported on striped pools")))
+    goto exit;
+
+  err = fla_object_io_queue(fs, &q);
+  if(FLA_ERR(err, "fla_object_io_queue()"))
+    goto exit;
+
+  lba_range = fla_xne_lba_range_from_offset_nbytes(fs->dev.dev, soffset, len);
+  if((err = FLA_ERR(lba_range.attr.is_valid != 1, "fla_xne_lba_range_from_offset_nbytes()")))
+    goto exit;
+
+  xne_io.io_type = io_type;
   xne_io.dev = fs->dev.dev;
-  xne_io.buf = bounce_buf;
+  xne_io.buf = buf;
+  xne_io.lba_range = &lba_range;
   xne_io.prep_ctx = fs->fla_dp.fncs.prep_dp_ctx;
   xne_io.obj_handle = obj;
   xne_io.pool_handle = pool_handle;
   xne_io.fla_dp = &fs->fla_dp;
+  xne_io.qpool = fs->qpool;
 
-  lba_range = fla_xne_lba_range_from_offset_nbytes(xne_io.dev, aligned_sb, bounce_buf_size);
-  if(( err = FLA_ERR(lba_range.attr.is_valid != 1, "fla_xne_lba_range_from_offset_nbytes()")))
-    goto free_bounce_buf;
+  err = fla_xne_async_seq_xneio(q, &xne_io, cb, cb_arg);
+  if(FLA_ERR(err, "fla_xne_async_seq_xneio()"))
+    goto exit;
 
-  xne_io.lba_range = &lba_range;
+exit:
+  return err;
+}
 
-  err = fla_xne_sync_seq_w_xneio(&xne_io);
-  if(FLA_ERR(err, "fla_xne_sync_seq_w_xneio()"))
-    goto free_bounce_buf;
+int
+fla_object_read_async(struct flexalloc * fs, struct fla_pool const * pool_handle,
+                      struct fla_object const * obj, void * buf, size_t r_offset, size_t r_len,
+                      fla_object_io_cb cb, void *cb_arg)
+{
+  return fla_object_async_xneio(fs, pool_handle, obj, buf, r_offset, r_len,
+                                FLA_IO_DATA_READ, cb, cb_arg);
+}
+
+int
+fla_object_write_async(struct flexalloc * fs, struct fla_pool const * pool_handle,
+                       struct fla_object const * obj, void const * buf, size_t w_offset,
+                       size_t w_len, fla_object_io_cb cb, void *cb_arg)
+{
+  return fla_object_async_xneio(fs, pool_handle, obj, (void *)buf, w_offset, w_len,
+                                FLA_IO_DATA_WRITE, cb, cb_arg);
+}
+
+int
+fla_object_io_poll(struct flexalloc * fs, uint32_t max)
+{
+  if (!fs->io_queue)
+    return 0;
+
+  return fla_xne_queue_poke(fs->io_queue, max);
+}
+
+int
+fla_object_io_drain(struct flexalloc * fs)
+{
+  if (!fs->io_queue)
+    return 0;
+
+  return fla_xne_queue_drain(fs->io_queue);
+}
+
+/// Device position of one batch descriptor
+struct fla_object_io_pos
+{
+  /// Byte offset of the descriptor on the device
+  uint64_t soffset;
+  /// Index of the descriptor in the batch
+  uint32_t ndx;
+};
+
+/// Descriptors of one batch that go out as a single device transfer
+struct fla_object_io_run
+{
+  struct fla_object_io_desc * descs;
+  /// Descriptors of the run, in device order
+  struct fla_object_io_pos * pos;
+  uint32_t ndescs;
+};
+
+static void
+fla_object_io_run_cb(int err, void * cb_arg)
+{
+  struct fla_object_io_run * run = cb_arg;
+
+  for (uint32_t i = 0; i < run->ndescs; ++i)
+    run->descs[run->pos[i].ndx].status = err;
+}
+
+static int
+fla_object_io_pos_cmp(void const * a, void const * b)
+{
+  uint64_t sa = ((struct fla_object_io_pos const *)a)->soffset;
+  uint64_t sb = ((struct fla_object_io_pos const *)b)->soffset;
+
+  return (sa > sb) - (sa < sb);
+}
+
+/*
+ * Descriptor b can be sent in the same command as a when it continues a both on
+ * the device and in memory, and the data placement context of a applies to it.
+ * Zoned objects map to zones and a command must not cross into the next one,
+ * placement per object derives the context from the object of the command.
+ */
+static bool
+fla_object_io_desc_merge(struct fla_object_io_desc const * a, uint64_t a_soffset,
+                         struct fla_object_io_desc const * b, uint64_t b_soffset,
+                         bool per_object)
+{
+  return a->dir == b->dir
+         && a->pool->ndx == b->pool->ndx
+         && a->object->slab_id == b->object->slab_id
+         && (!per_object || a->object->entry_ndx == b->object->entry_ndx)
+         && a_soffset + a->len == b_soffset
+         && (char *)a->buf + a->len == (char *)b->buf;
+}
+
+int
+fla_object_io_batch(struct flexalloc * fs, struct fla_object_io_desc * descs, uint32_t ndescs)
+{
+  int err = 0, ret;
+  bool write, per_object, zoned = fla_xne_dev_type(fs->dev.dev) == XNVME_GEO_ZONED;
+  uint32_t nvalid = 0, nruns = 0;
+  uint64_t soffset, eoffset;
+  struct fla_object_io_pos *pos = NULL, *last;
+  struct fla_object_io_run *runs = NULL, *run = NULL;
+  struct fla_object_io_desc *first;
+  struct fla_pool_entry *pool_entry;
+  struct fla_xne_queue *q;
+  struct xnvme_lba_range lba_range;
+  struct fla_xne_io xne_io;
+
+  if (!ndescs)
+    goto exit;
+
+  pos = malloc(ndescs * sizeof(struct fla_object_io_pos));
+  runs = malloc(ndescs * sizeof(struct fla_object_io_run));
+  if((err = FLA_ERR_ERRNO(!pos || !runs, "malloc()")))
+    goto free_arrays;
+
+  // Rejected descriptors keep their error and are left out of the batch
+  for (uint32_t i = 0; i < ndescs; ++i)
+  {
+    pool_entry = &fs->pools.entries[descs[i].pool->ndx];
+    descs[i].status = fla_object_io_check(fs, descs[i].pool, descs[i].object,
+                                          descs[i].offset, descs[i].len, &soffset);
+    if (!descs[i].status)
+      descs[i].status = FLA_ERR(pool_entry->flags & FLA_POOL_ENTRY_STRP,
+                                "Batched I/O is not supported on striped pools");
+    if (descs[i].status)
+      continue;
+
+    pos[nvalid].soffset = soffset;
+    pos[nvalid++].ndx = i;
+  }
+
+  qsort(pos, nvalid, sizeof(struct fla_object_io_pos), fla_object_io_pos_cmp);
+
+  per_object = zoned || (fs->fla_dp.dp_type == FLA_DP_FDP
+                         && fs->fla_dp.fla_dp_fdp->ctx_set == FLA_DP_FDP_ON_OBJECT);
+
+  for (uint32_t i = 0; i < nvalid; ++i)
+  {
+    if (run)
+    {
+      last = &run->pos[run->ndescs - 1];
+      if (fla_object_io_desc_merge(&descs[last->ndx], last->soffset,
+                                   &descs[pos[i].ndx], pos[i].soffset, per_object))
+      {
+        run->ndescs++;
+        continue;
+      }
+    }
+
+    run = &runs[nruns++];
+    run->descs = descs;
+    run->pos = &pos[i];
+    run->ndescs = 1;
+  }
+
+  err = fla_xne_queue_lease(fs->qpool, fs->qpool->depth, &q);
+  if(FLA_ERR(err, "fla_xne_queue_lease()"))
+    goto free_arrays;
+
+  for (uint32_t i = 0; i < nruns; ++i)
+  {
+    run = &runs[i];
+    first = &descs[run->pos[0].ndx];
+    last = &run->pos[run->ndescs - 1];
+    write = first->dir == FLA_OBJECT_IO_WRITE;
+    eoffset = last->soffset + descs[last->ndx].len;
+
+    // Zone writes must arrive in write pointer order
+    if (write && zoned)
+    {
+      ret = fla_xne_queue_drain(q);
+      if((err = FLA_ERR(ret < 0, "fla_xne_queue_drain()")))
+        goto release_queue;
+    }
+
+    lba_range = fla_xne_lba_range_from_offset_nbytes(fs->dev.dev, run->pos[0].soffset,
+                eoffset - run->pos[0].soffset);
+    ret = FLA_ERR(lba_range.attr.is_valid != 1, "fla_xne_lba_range_from_offset_nbytes()");
+    if (!ret)
+    {
+      memset(&xne_io, 0, sizeof(xne_io));
+      xne_io.io_type = write ? FLA_IO_DATA_WRITE : FLA_IO_DATA_READ;
+      xne_io.dev = fs->dev.dev;
+      xne_io.buf = first->buf;
+      xne_io.lba_range = &lba_range;
+      xne_io.prep_ctx = write ? fs->fla_dp.fncs.prep_dp_ctx : NULL;
+      xne_io.obj_handle = first->object;
+      xne_io.pool_handle = first->pool;
+      xne_io.fla_dp = &fs->fla_dp;
+      xne_io.qpool = fs->qpool;
+
+      ret = fla_xne_async_seq_xneio(q, &xne_io, fla_object_io_run_cb, run);
+      FLA_ERR(ret, "fla_xne_async_seq_xneio()");
+    }
+
+    // Submission errors are reported through the statuses of the run
+    if (ret)
+      fla_object_io_run_cb(ret, run);
+  }
 
-free_bounce_buf:
-  free(bounce_buf);
+  ret = fla_xne_queue_drain(q);
+  if(FLA_ERR(ret < 0, "fla_xne_queue_drain()"))
+    err = ret;
+
+release_queue:
+  fla_xne_queue_release(fs->qpool, q);
+
+  for (uint32_t i = 0; i < ndescs && !err; ++i)
+    err = descs[i].status;
+
+free_arrays:
+  free(runs);
+  free(pos);
+
+exit:
+  return err;
+}
+
+/*
+ * Partial head and tail blocks are read into the bounce buffer together with
+ * the aligned interior. The interior is read straight into r_buf when it sits
+ * at a block aligned address, as direct I/O requires; otherwise the whole range
+ * is read into the bounce buffer as one read.
+ */
+int
+fla_object_unaligned_read(struct flexalloc * fs, struct fla_pool const * pool_handle,
+                          struct fla_object const * obj, void * r_buf, size_t obj_offset,
+                          size_t len)
+{
+  int err = 0;
+  uint32_t ndescs = 0, lb_nbytes = fs->dev.lb_nbytes;
+  size_t aligned_so, aligned_eo, mid_so, mid_eo, eo = obj_offset + len;
+  char * bounce_buf = NULL, * mid_buf;
+  bool head, tail, direct;
+  struct fla_object_io_desc descs[3];
+
+  if (!len)
+    goto exit;
+
+  aligned_so = (obj_offset / lb_nbytes) * lb_nbytes;
+  aligned_eo = FLA_CEIL_DIV(eo, lb_nbytes) * lb_nbytes;
+  head = aligned_so < obj_offset;
+  tail = eo < aligned_eo;
+
+  // A range within one block only needs the head bounce
+  if (head && tail && aligned_eo - aligned_so == lb_nbytes)
+    tail = false;
+
+  mid_so = head ? aligned_so + lb_nbytes : obj_offset;
+  mid_eo = tail ? aligned_eo - lb_nbytes : eo;
+  if (mid_eo < mid_so)
+    mid_eo = mid_so;
+
+  mid_buf = (char *)r_buf + (mid_so - obj_offset);
+  direct = !((uintptr_t)mid_buf % lb_nbytes);
+
+  if (head || tail || !direct)
+  {
+    bounce_buf = fla_bufpool_alloc(fs->bufpool,
+                                 direct ? 2 * lb_nbytes : aligned_eo - aligned_so);
+    if((err = FLA_ERR(!bounce_buf, "fla_bufpool_alloc()")))
+      goto exit;
+  }
+
+  struct fla_object_io_desc desc =
+  {
+    .pool = pool_handle, .object = obj, .len = lb_nbytes, .dir = FLA_OBJECT_IO_READ
+  };
+
+  if (direct)
+  {
+    if (head)
+    {
+      desc.offset = aligned_so;
+      desc.buf = bounce_buf;
+      descs[ndescs++] = desc;
+    }
+
+    if (mid_so < mid_eo)
+    {
+      desc.offset = mid_so;
+      desc.len = mid_eo - mid_so;
+      desc.buf = mid_buf;
+      descs[ndescs++] = desc;
+      desc.len = lb_nbytes;
+    }
+
+    if (tail)
+    {
+      desc.offset = aligned_eo - lb_nbytes;
+      desc.buf = bounce_buf + lb_nbytes;
+      descs[ndescs++] = desc;
+    }
+  }
+  else
+  {
+    desc.offset = aligned_so;
+    desc.len = aligned_eo - aligned_so;
+    desc.buf = bounce_buf;
+    descs[ndescs++] = desc;
+  }
+
+  err = fla_object_unaligned_io(fs, descs, ndescs);
+  if(FLA_ERR(err, "fla_object_unaligned_io()"))
+    goto put_bounce_buf;
+
+  if (!direct)
+  {
+    memcpy(r_buf, bounce_buf + (obj_offset - aligned_so), len);
+    goto put_bounce_buf;
+  }
+
+  if (head)
+    memcpy(r_buf, bounce_buf + (obj_offset - aligned_so),
+           fla_min(aligned_so + lb_nbytes, eo) - obj_offset);
+
+  if (tail)
+    memcpy((char *)r_buf + (mid_eo - obj_offset), bounce_buf + lb_nbytes, eo - mid_eo);
+
+put_bounce_buf:
+  fla_bufpool_free(fs->bufpool, bounce_buf);
 
 exit:
   return err;
@@ -1348,6 +2862,8 @@ struct fla_fns base_fns =
   .object_open = &fla_base_object_open,
   .object_create = &fla_base_object_create,
   .object_destroy = &fla_base_object_destroy,
+  .object_create_n = &fla_base_object_create_n,
+  .object_destroy_n = &fla_base_object_destroy_n,
   .pool_set_root_object = &fla_base_pool_set_root_object,
   .pool_get_root_object = &fla_base_pool_get_root_object,
 };
@@ -1375,8 +2891,8 @@ fla_open(struct fla_open_opts *opts, struct flexalloc **fs)
     goto exit;
   }
 
-  err = fla_xne_dev_open(opts->dev_uri, opts->opts, &dev);
-  if (FLA_ERR(err, "fla_xne_dev_open()"))
+  err = fla_xne_dev_open_profile(opts->dev_uri, opts->opts, opts->io_profile, &dev);
+  if (FLA_ERR(err, "fla_xne_dev_open_profile()"))
     goto free_fs;
 
   if (opts->md_dev_uri)
@@ -1392,9 +2908,19 @@ fla_open(struct fla_open_opts *opts, struct flexalloc **fs)
   if(FLA_ERR(err, "fla_dev_sanity_check()"))
     goto xnvme_dev_close;
 
+  err = fla_xne_queue_pool_init(dev, opts->io_profile && opts->io_profile->qdepth
+                                ? opts->io_profile->qdepth : FLA_XNE_QUEUE_DEPTH,
+                                &(*fs)->qpool);
+  if (FLA_ERR(err, "fla_xne_queue_pool_init()"))
+    goto xnvme_dev_close;
+
+  err = fla_bufpool_init(dev, &(*fs)->bufpool);
+  if (FLA_ERR(err, "fla_bufpool_init()"))
+    goto term_qpool;
+
   err = fla_super_read(md_dev, fla_xne_dev_lba_nbytes(dev), &super);
   if (FLA_ERR(err, "fla_super_read"))
-    goto xnvme_dev_close;
+    goto term_bufpool;
 
   // read disk geometry
   fla_geo_from_super(dev, super, &geo);
@@ -1414,7 +2940,8 @@ fla_open(struct fla_open_opts *opts, struct flexalloc **fs)
   range = fla_xne_lba_range_from_offset_nbytes(md_dev, 0, fla_md_buf_len);
   if((err = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
     goto exit;
-  struct fla_xne_io xne_io = {.dev = md_dev, .buf = fla_md_buf, .lba_range = &range, .fla_dp = &(*fs)->fla_dp};
+  struct fla_xne_io xne_io = {.dev = md_dev, .buf = fla_md_buf, .lba_range = &range, .fla_dp = &(*fs)->fla_dp,
+                              .qpool = md_dev == dev ? (*fs)->qpool : NULL};
 
   err = fla_xne_sync_seq_r_xneio(&xne_io);
   if (FLA_ERR(err, "fla_xne_sync_seq_r_nbyte_nbytess()"))
@@ -1432,13 +2959,24 @@ fla_open(struct fla_open_opts *opts, struct flexalloc **fs)
   if (FLA_ERR(err, "fla_slab_cache_init()"))
     goto free_md;
 
+  err = fla_obj_cache_init(*fs);
+  if (FLA_ERR(err, "fla_obj_cache_init()"))
+    goto free_slab_cache;
+
+  if (opts->flags & FLA_OPEN_THREAD_SAFE)
+  {
+    err = fla_locks_init(*fs);
+    if (FLA_ERR(err, "fla_locks_init()"))
+      goto free_obj_cache;
+  }
+
   free(super);
 
   (*fs)->dev.dev_uri = fla_strdup(opts->dev_uri);
   if ((*fs)->dev.dev_uri == NULL)
   {
     err = -ENOMEM;
-    goto free_md;
+    goto free_locks;
   }
 
   if(md_dev != dev)
@@ -1454,14 +2992,40 @@ fla_open(struct fla_open_opts *opts, struct flexalloc **fs)
   (*fs)->state |= FLA_STATE_OPEN;
   (*fs)->fns = base_fns;
 
+  // replays the changes logged since the last checkpoint, flushing the handle
+  err = fla_jnl_open(*fs);
+  if (FLA_ERR(err, "fla_jnl_open()"))
+    goto close;
+
+  err = fla_ckpt_open(*fs, opts);
+  if (FLA_ERR(err, "fla_ckpt_open()"))
+    goto close;
+
   return 0;
 
+close:
+  fla_close_noflush(*fs);
+  *fs = NULL;
+  return err;
+
 free_dev_uri:
   free((*fs)->dev.dev_uri);
+free_locks:
+  fla_locks_fini(*fs);
+free_obj_cache:
+  fla_obj_cache_fini(*fs);
+free_slab_cache:
+  fla_slab_cache_free(&(*fs)->slab_cache);
 free_md:
+  fla_pool_fini(*fs);
+  fla_md_dirty_fini(*fs);
   fla_xne_free_buf(md_dev, fla_md_buf);
 free_super:
   fla_xne_free_buf(md_dev, super);
+term_bufpool:
+  fla_bufpool_term((*fs)->bufpool);
+term_qpool:
+  fla_xne_queue_pool_term((*fs)->qpool);
 xnvme_dev_close:
   if (dev != md_dev)
     xnvme_dev_close(dev);
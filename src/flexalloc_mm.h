@@ -23,6 +23,9 @@
 
 #define FLA_ROOT_OBJ_NONE UINT64_MAX
 
+/// pool of a slab on the free slab list
+#define FLA_SLAB_POOL_NONE UINT32_MAX
+
 #define FLA_MDTS_MIN_NBYTES 512
 
 /// mkfs file system initialization parameters
@@ -34,6 +37,8 @@ struct fla_mkfs_p
   uint32_t slab_nlb;
   /// number of pools to support
   uint32_t npools;
+  /// size of the metadata journal, in LBA's, 0 for no journal
+  uint32_t jnl_nlb;
   /// whether to be verbose during initialization
   uint8_t verbose;
 };
@@ -88,6 +93,9 @@ struct fla_super
 
   /// flexalloc disk format version - permits backward compatibility
   uint8_t fmt_version;
+
+  /// Blocks reserved for the metadata journal, 0 without a journal
+  uint32_t jnl_nlb;
 };
 
 /// calculate disk offset, in logical blocks, of the start of the slab identified by slab_id
@@ -105,9 +113,20 @@ fla_geo_slab_lb_off(struct flexalloc const *fs, uint32_t slab_id);
 uint64_t
 fla_geo_slab_sgmt_lb_off(struct fla_geo const *geo);
 
+uint64_t
+fla_geo_jnl_lb_off(struct fla_geo const *geo);
+
 uint64_t
 fla_geo_slabs_lb_off(struct fla_geo const *geo);
 
+/// blocks of metadata held in the metadata buffer, fs_buffer
+uint32_t
+fla_geo_nblocks(const struct fla_geo *geo);
+
+/// bytes of the metadata buffer, fs_buffer
+uint64_t
+fla_geo_nbytes(struct fla_geo *geo);
+
 /**
  * Create new flexalloc system on disk
  * @param p parameters supplied (and inferred) from mkfs program
@@ -121,7 +140,9 @@ fla_mkfs(struct fla_mkfs_p *p);
  * Flush flexalloc metadata to disk.
  *
  * Flush writes flexalloc metadata to disk, persisting any affecting pools and slabs
- * themselves.
+ * themselves. Only the logical blocks marked with fla_md_mark_dirty() since
+ * the last flush are written. Handles with a checkpointer only hold the
+ * locks while copying those blocks, see flexalloc_ckpt.h.
  * NOTE: sync is NOT necessary to persist object writes.
  *
  * @return On success 0.
@@ -129,6 +150,35 @@ fla_mkfs(struct fla_mkfs_p *p);
 int
 fla_flush(struct flexalloc *fs);
 
+/**
+ * @brief Mark a range of the metadata buffer as changed
+ *
+ * The logical blocks of fs_buffer covering the range are written out by the
+ * next flush. Ranges outside of fs_buffer are ignored. Safe to call
+ * concurrently on handles opened with FLA_OPEN_THREAD_SAFE.
+ *
+ * @param fs flexalloc system handle
+ * @param ptr start of the changed range
+ * @param nbytes length of the changed range in bytes
+ */
+void
+fla_md_mark_dirty(struct flexalloc const *fs, void const *ptr, size_t nbytes);
+
+/**
+ * @brief Lay out the slab lists again from the owner of each slab
+ *
+ * Puts every slab not owned by a pool in use on the free slab list and every
+ * other slab on the list of its pool matching the fill level of its freelist,
+ * then recounts the pool usage. Used once the journal is replayed, when the
+ * lists on disk may predate the replayed changes.
+ *
+ * @param fs flexalloc system handle
+ * @param owners pool of each slab, FLA_SLAB_POOL_NONE for free slabs
+ * @return zero on success. non zero otherwise.
+ */
+int
+fla_slabs_rebuild(struct flexalloc *fs, uint32_t const *owners);
+
 /**
  * Close flexalloc system *without* writing changes to disk.
  *
@@ -172,6 +222,53 @@ fla_acquire_slab(struct flexalloc *fs, const uint32_t obj_nlb,
 int
 fla_release_slab(struct flexalloc *fs, struct fla_slab_header * slab_header);
 
+/**
+ * @brief Reserve a batch of objects from one slab of the pool
+ *
+ * Reserves up to `max` single objects from the next available slab of the
+ * pool, moving the slab between the pool slab lists once for the batch.
+ * The objects are not counted in the pool usage.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_handle pool to reserve the objects from
+ * @param objs array of at least `max` objects, set to the reserved objects
+ * @param max number of objects to reserve at most
+ * @param nobjs set to the number of objects reserved
+ * @return zero on success, in which case at least one object was reserved.
+ * non zero otherwise.
+ */
+int
+fla_slab_objs_reserve(struct flexalloc *fs, struct fla_pool const * pool_handle,
+                      struct fla_object *objs, uint32_t max, uint32_t *nobjs);
+
+/**
+ * @brief Return an object to the freelist of its slab
+ *
+ * Frees the object entries and moves the slab to the pool slab list matching
+ * its new fill level. The pool usage is left alone.
+ *
+ * @param fs flexalloc system handle
+ * @param obj object to release
+ * @param num_fla_objs number of slab entries the object spans
+ * @return zero on success. non zero otherwise.
+ */
+int
+fla_slab_obj_release(struct flexalloc *fs, struct fla_object * obj, uint32_t num_fla_objs);
+
+/**
+ * @brief Drop objects from the slab count
+ *
+ * Moves the slab to the pool slab list matching its new fill level. The slab
+ * freelist and the pool usage are left alone.
+ *
+ * @param fs flexalloc system handle
+ * @param slab slab header
+ * @param num_fla_objs number of slab entries to drop
+ * @return zero on success. non zero otherwise.
+ */
+int
+fla_slab_refcount_sub(struct flexalloc *fs, struct fla_slab_header * slab, uint32_t num_fla_objs);
+
 /**
  * @brief Slab header pointer from slab ID
  *
@@ -221,5 +318,59 @@ fla_object_slba(struct flexalloc const * fs, struct fla_object const * obj,
 int
 fla_open_common(char const *dev_uri, struct flexalloc *fs);
 
+/*
+ * Locking of handles opened with FLA_OPEN_THREAD_SAFE, see struct fla_locks.
+ * All of these are no-ops on other handles.
+ */
+
+static inline void
+fla_fs_lock(struct flexalloc const *fs)
+{
+  if (fs->locks)
+    pthread_mutex_lock(&fs->locks->fs);
+}
+
+static inline void
+fla_fs_unlock(struct flexalloc const *fs)
+{
+  if (fs->locks)
+    pthread_mutex_unlock(&fs->locks->fs);
+}
+
+static inline void
+fla_pool_lock(struct flexalloc const *fs, uint32_t pool_ndx)
+{
+  if (fs->locks && pool_ndx < fs->locks->npools)
+    pthread_mutex_lock(&fs->locks->pools[pool_ndx]);
+}
+
+static inline void
+fla_pool_unlock(struct flexalloc const *fs, uint32_t pool_ndx)
+{
+  if (fs->locks && pool_ndx < fs->locks->npools)
+    pthread_mutex_unlock(&fs->locks->pools[pool_ndx]);
+}
+
+/**
+ * @brief Take every lock of the handle
+ *
+ * Locks all pools in index order followed by the fs lock, for operations
+ * touching the metadata of the whole handle such as a flush. Returns once no
+ * lock-free object call is between changing a slab count and the slab
+ * freelist, so the two agree until the locks are released.
+ *
+ * @param fs flexalloc system handle
+ */
+void
+fla_lock_all(struct flexalloc const *fs);
+
+/**
+ * @brief Release the locks taken by fla_lock_all()
+ *
+ * @param fs flexalloc system handle
+ */
+void
+fla_unlock_all(struct flexalloc const *fs);
+
 #endif // __FLEXALLOC_MM_H_
 
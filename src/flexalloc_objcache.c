@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flexalloc_objcache.h"
+#include "flexalloc.h"
+#include "flexalloc_mm.h"
+#include "flexalloc_pool.h"
+#include "flexalloc_util.h"
+
+int
+fla_obj_cache_init(struct flexalloc *fs)
+{
+  fs->obj_caches = calloc(fs->geo.npools, sizeof(struct fla_obj_cache *));
+  if (FLA_ERR(!fs->obj_caches, "calloc()"))
+    return -ENOMEM;
+
+  return 0;
+}
+
+void
+fla_obj_cache_fini(struct flexalloc *fs)
+{
+  if (!fs->obj_caches)
+    return;
+
+  for (uint32_t i = 0; i < fs->geo.npools; i++)
+    free(fs->obj_caches[i]);
+
+  free(fs->obj_caches);
+  fs->obj_caches = NULL;
+}
+
+// cache of the pool, NULL if the pool objects are not cached
+static struct fla_obj_cache *
+fla_obj_cache_lookup(struct flexalloc *fs, uint32_t pool_ndx, bool alloc)
+{
+  struct fla_pool_entry const *pool_entry;
+
+  // one cache per pool would serialize the threads of a thread safe handle
+  if (!fs->obj_caches || fs->locks || pool_ndx >= fs->geo.npools)
+    return NULL;
+
+  if (fs->obj_caches[pool_ndx] || !alloc)
+    return fs->obj_caches[pool_ndx];
+
+  // striped objects span several slab entries
+  pool_entry = &fs->pools.entries[pool_ndx];
+  if (fs->pools.entrie_funcs[pool_ndx].fla_pool_num_fla_objs(pool_entry) != 1)
+    return NULL;
+
+  fs->obj_caches[pool_ndx] = calloc(1, sizeof(struct fla_obj_cache));
+  FLA_ERR(!fs->obj_caches[pool_ndx], "calloc()");
+
+  return fs->obj_caches[pool_ndx];
+}
+
+// return the `nobjs` oldest cached objects to their slabs
+static int
+fla_obj_cache_release(struct flexalloc *fs, struct fla_obj_cache *cache, uint32_t nobjs)
+{
+  int err;
+  uint32_t i = 0;
+
+  for (; i < nobjs; i++)
+  {
+    err = fla_slab_obj_release(fs, &cache->objs[i], 1);
+    if (FLA_ERR(err, "fla_slab_obj_release()"))
+      break;
+  }
+
+  cache->nobjs -= i;
+  memmove(cache->objs, cache->objs + i, sizeof(struct fla_object) * cache->nobjs);
+
+  return i == nobjs ? 0 : err;
+}
+
+int
+fla_obj_cache_get(struct flexalloc *fs, struct fla_pool const *pool_handle,
+                  struct fla_object *obj)
+{
+  struct fla_obj_cache *cache = fla_obj_cache_lookup(fs, pool_handle->ndx, true);
+  struct fla_object tmp;
+  int err;
+
+  if (!cache)
+    return FLA_OBJ_CACHE_BYPASS;
+
+  if (!cache->nobjs)
+  {
+    err = fla_slab_objs_reserve(fs, pool_handle, cache->objs, FLA_OBJ_CACHE_BATCH,
+                                &cache->nobjs);
+    if (err)
+      return err;
+
+    // hand the batch out lowest entry first, as the slab path would
+    for (uint32_t i = 0, j = cache->nobjs - 1; i < j; i++, j--)
+    {
+      tmp = cache->objs[i];
+      cache->objs[i] = cache->objs[j];
+      cache->objs[j] = tmp;
+    }
+  }
+
+  *obj = cache->objs[--cache->nobjs];
+  fs->pools.usage[pool_handle->ndx].nobjs_used++;
+
+  return 0;
+}
+
+int
+fla_obj_cache_put(struct flexalloc *fs, struct fla_pool const *pool_handle,
+                  struct fla_object const *obj)
+{
+  struct fla_obj_cache *cache = fla_obj_cache_lookup(fs, pool_handle->ndx, true);
+  int err;
+
+  if (!cache)
+    return FLA_OBJ_CACHE_BYPASS;
+
+  if (cache->nobjs == FLA_OBJ_CACHE_NOBJS)
+  {
+    err = fla_obj_cache_release(fs, cache, FLA_OBJ_CACHE_BATCH);
+    if (FLA_ERR(err, "fla_obj_cache_release()"))
+      return err;
+  }
+
+  cache->objs[cache->nobjs++] = *obj;
+  fs->pools.usage[pool_handle->ndx].nobjs_used--;
+
+  return 0;
+}
+
+int
+fla_obj_cache_drain(struct flexalloc *fs, uint32_t pool_ndx)
+{
+  struct fla_obj_cache *cache = fla_obj_cache_lookup(fs, pool_ndx, false);
+  int err;
+
+  if (!cache)
+    return 0;
+
+  err = fla_obj_cache_release(fs, cache, cache->nobjs);
+  if (err)
+    return err;
+
+  // the pool entry may be reused by a pool which is not cached
+  free(cache);
+  fs->obj_caches[pool_ndx] = NULL;
+
+  return 0;
+}
+
+int
+fla_obj_cache_drain_all(struct flexalloc *fs)
+{
+  int err = 0, ret;
+
+  if (!fs->obj_caches)
+    return 0;
+
+  for (uint32_t i = 0; i < fs->geo.npools; i++)
+  {
+    ret = fla_obj_cache_drain(fs, i);
+    if (FLA_ERR(ret, "fla_obj_cache_drain()"))
+      err = ret;
+  }
+
+  return err;
+}
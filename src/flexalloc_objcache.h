@@ -0,0 +1,114 @@
+/**
+ * Object ID cache
+ *
+ * Creating an object picks a slab from the pool slab lists, loads the slab
+ * freelist, reserves an entry and moves the slab between the pool lists.
+ * The cache amortizes this by reserving a batch of object IDs from a slab in
+ * one go and handing them out one at a time. Destroyed objects are kept for
+ * reuse while the cache has room. The cached IDs stay reserved in their slab
+ * freelist but are not counted as used in the pool usage.
+ *
+ * There is one cache per pool of the flexalloc handle. Striped pools, whose
+ * objects span several slab entries, bypass the cache. So do handles opened
+ * with FLA_OPEN_THREAD_SAFE, which take slab entries without the pool lock.
+ * Cached IDs go back to their slabs when the cache is drained, which happens
+ * on fla_sync(), on close and before the pool is destroyed, so they are never
+ * persisted as allocated.
+ *
+ * @file flexalloc_objcache.h
+ */
+#ifndef __FLEXALLOC_OBJCACHE_H_
+#define __FLEXALLOC_OBJCACHE_H_
+#include <stdint.h>
+#include "flexalloc_shared.h"
+
+/// Max number of object IDs cached per pool
+#define FLA_OBJ_CACHE_NOBJS 64
+/// Number of object IDs reserved, or released, at a time
+#define FLA_OBJ_CACHE_BATCH (FLA_OBJ_CACHE_NOBJS / 2)
+
+/// Returned when the cache does not serve the pool, the caller takes the slab path
+#define FLA_OBJ_CACHE_BYPASS 6001
+
+struct fla_obj_cache
+{
+  /// Number of cached object IDs
+  uint32_t nobjs;
+  /// Cached object IDs, the most recently cached last
+  struct fla_object objs[FLA_OBJ_CACHE_NOBJS];
+};
+
+/**
+ * @brief Set up the object caches of a flexalloc handle
+ *
+ * The cache of each pool is allocated on first use.
+ *
+ * @param fs flexalloc system handle
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_obj_cache_init(struct flexalloc *fs);
+
+/**
+ * @brief Release the object caches without returning the cached IDs
+ *
+ * Only meant for handles whose metadata is discarded, use
+ * fla_obj_cache_drain_all() first otherwise.
+ *
+ * @param fs flexalloc system handle
+ */
+void
+fla_obj_cache_fini(struct flexalloc *fs);
+
+/**
+ * @brief Take an object from the cache of the pool
+ *
+ * Refills an empty cache with a batch reserved from one slab.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_handle pool to allocate from
+ * @param obj set to the object on success
+ * @return Zero on success, FLA_OBJ_CACHE_BYPASS if the cache does not serve
+ * the pool. Any other value is an error.
+ */
+int
+fla_obj_cache_get(struct flexalloc *fs, struct fla_pool const *pool_handle,
+                  struct fla_object *obj);
+
+/**
+ * @brief Keep a destroyed object in the cache of the pool
+ *
+ * Returns the oldest half of a full cache to the slabs first.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_handle pool the object belongs to
+ * @param obj destroyed object
+ * @return Zero on success, FLA_OBJ_CACHE_BYPASS if the cache does not serve
+ * the pool. Any other value is an error.
+ */
+int
+fla_obj_cache_put(struct flexalloc *fs, struct fla_pool const *pool_handle,
+                  struct fla_object const *obj);
+
+/**
+ * @brief Return the cached objects of a pool to their slabs
+ *
+ * The cache itself is released, it is allocated again on next use.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_ndx index of the pool entry
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_obj_cache_drain(struct flexalloc *fs, uint32_t pool_ndx);
+
+/**
+ * @brief Return the cached objects of every pool to their slabs
+ *
+ * @param fs flexalloc system handle
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_obj_cache_drain_all(struct flexalloc *fs);
+
+#endif // __FLEXALLOC_OBJCACHE_H_
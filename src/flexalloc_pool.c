@@ -1,6 +1,8 @@
 // Copyright (C) 2021 Joel Granados <j.granados@samsung.com>
 #include "flexalloc_pool.h"
 #include "flexalloc_ll.h"
+#include "flexalloc_objcache.h"
+#include "flexalloc_journal.h"
 #include "flexalloc_util.h"
 #include "flexalloc_shared.h"
 
@@ -35,11 +37,17 @@ fla_geo_pool_sgmt_calc(uint32_t npools, uint32_t lb_nbytes,
   geo->entries_nlb = FLA_CEIL_DIV(npools * sizeof(struct fla_pool_entry), lb_nbytes);
 }
 
-void
+int
 fla_mkfs_pool_sgmt_init(struct flexalloc *fs, struct fla_geo *geo)
 {
-  // initialize freelist.
-  fla_flist_init(fs->pools.freelist, geo->npools);
+  void *flist_data = fla_flist_data(fs->pools.freelist);
+  int err;
+
+  // initialize freelist, replacing the handle loaded from the zeroed segment.
+  fla_flist_free(fs->pools.freelist);
+  err = fla_flist_init(flist_data, geo->npools, &fs->pools.freelist);
+  if (FLA_ERR(err, "fla_flist_init()"))
+    return err;
 
   // initialize hash table header
   // this stores the size of the table and the number of elements
@@ -51,6 +59,22 @@ fla_mkfs_pool_sgmt_init(struct flexalloc *fs, struct fla_geo *geo)
 
   // initialize the entries themselves
   memset(fs->pools.entries, 0, (geo->lb_nbytes * geo->pool_sgmt.entries_nlb));
+
+  return 0;
+}
+
+/*
+ * Pool freelist and hash table entries move around on insertion and removal,
+ * both are small and marked dirty as a whole.
+ */
+static void
+fla_pool_sgmt_mark_dirty(struct flexalloc *fs)
+{
+  struct fla_geo_pool_sgmt const *geo = &fs->geo.pool_sgmt;
+
+  fla_md_mark_dirty(fs, fla_flist_data(fs->pools.freelist),
+                    (size_t)geo->freelist_nlb * fs->geo.lb_nbytes);
+  fla_md_mark_dirty(fs, fs->pools.htbl_hdr_buffer, (size_t)geo->htbl_nlb * fs->geo.lb_nbytes);
 }
 
 static uint64_t
@@ -74,6 +98,7 @@ fla_pool_entry_reset_default(struct fla_pool_entry *pool_entry,
                              uint32_t const slab_nobj)
 {
   memcpy(pool_entry->name, arg->name, arg->name_len);
+  pool_entry->name[arg->name_len] = '\0';
   pool_entry->obj_nlb = arg->obj_nlb;
   pool_entry->slab_nobj = slab_nobj;
   pool_entry->empty_slabs = FLA_LINKED_LIST_NULL;
@@ -132,19 +157,24 @@ fla_pool_initialize_entrie_func_(struct fla_pools *pools, const uint32_t ndx)
   return 0;
 }
 
-int
-fla_pool_initialize_entrie_func(const uint32_t ndx, va_list ag)
+static void
+fla_pool_wmark_reset(struct fla_pool_wmark *wmark)
 {
-  struct fla_pools *pools = va_arg(ag, struct fla_pools*);
-  return fla_pool_initialize_entrie_func_(pools, ndx);
+  wmark->low = FLA_POOL_EMPTY_SLABS_LOW;
+  wmark->high = FLA_POOL_EMPTY_SLABS_HIGH;
 }
 
 int
 fla_pool_init(struct flexalloc *fs, struct fla_geo *geo, uint8_t *pool_sgmt_base)
 {
   int ret;
-  uint32_t found = 0;
-  fs->pools.freelist = (freelist_t)(pool_sgmt_base);
+  uint32_t ndx;
+  struct fla_flist_iter it;
+
+  ret = fla_flist_load(pool_sgmt_base, &fs->pools.freelist);
+  if (FLA_ERR(ret, "fla_flist_load()"))
+    return ret;
+
   fs->pools.htbl_hdr_buffer = (struct fla_pool_htbl_header *)
                               (pool_sgmt_base
                                + (geo->lb_nbytes * geo->pool_sgmt.freelist_nlb));
@@ -160,13 +190,265 @@ fla_pool_init(struct flexalloc *fs, struct fla_geo *geo, uint8_t *pool_sgmt_base
                          * (geo->pool_sgmt.freelist_nlb
                             + geo->pool_sgmt.htbl_nlb)));
   fs->pools.entrie_funcs = malloc(sizeof(struct fla_pool_entry_fnc)*geo->npools);
-  if (FLA_ERR(fs->pools.entrie_funcs == NULL, "malloc()"))
+  fs->pools.usage = calloc(geo->npools, sizeof(struct fla_pool_usage));
+  fs->pools.bins = malloc(sizeof(struct fla_pool_bins)*geo->npools);
+  fs->pools.slab_bins = malloc(sizeof(struct fla_slab_bin_link)*geo->nslabs);
+  fs->pools.wmarks = malloc(sizeof(struct fla_pool_wmark)*geo->npools);
+  if (FLA_ERR(fs->pools.entrie_funcs == NULL || fs->pools.usage == NULL
+              || fs->pools.bins == NULL || fs->pools.slab_bins == NULL
+              || fs->pools.wmarks == NULL, "malloc()"))
+  {
+    fla_pool_fini(fs);
     return -ENOMEM;
+  }
 
-  ret = fla_flist_search_wfunc(fs->pools.freelist, FLA_FLIST_SEARCH_EXEC_FIRST,
-                               &found, fla_pool_initialize_entrie_func, &fs->pools);
+  for (ndx = 0; ndx < geo->npools; ++ndx)
+    fla_pool_wmark_reset(&fs->pools.wmarks[ndx]);
 
-  return ret;
+  fla_flist_iter_init(&it, fs->pools.freelist, true);
+  while (fla_flist_iter_next(&it, &ndx))
+  {
+    ret = fla_pool_initialize_entrie_func_(&fs->pools, ndx);
+    if (FLA_ERR(ret, "fla_pool_initialize_entrie_func_()"))
+      return ret;
+  }
+
+  return 0;
+}
+
+void
+fla_pool_fini(struct flexalloc *fs)
+{
+  fla_flist_free(fs->pools.freelist);
+  fs->pools.freelist = NULL;
+  free(fs->pools.entrie_funcs);
+  fs->pools.entrie_funcs = NULL;
+  free(fs->pools.usage);
+  fs->pools.usage = NULL;
+  free(fs->pools.bins);
+  fs->pools.bins = NULL;
+  free(fs->pools.slab_bins);
+  fs->pools.slab_bins = NULL;
+  free(fs->pools.wmarks);
+  fs->pools.wmarks = NULL;
+}
+
+static void
+fla_pool_bins_reset(struct fla_pool_bins *bins)
+{
+  for (uint32_t i = 0 ; i < FLA_POOL_NBINS ; ++i)
+  {
+    bins->heads[i] = FLA_LINKED_LIST_NULL;
+    bins->nslabs[i] = 0;
+  }
+  bins->nslabs_full = 0;
+  bins->nobjs_partial = 0;
+}
+
+static void
+fla_pool_bins_unlink(struct fla_pools *pools, struct fla_pool_bins *bins, uint32_t slab_id)
+{
+  struct fla_slab_bin_link *link = &pools->slab_bins[slab_id];
+
+  if (link->bin == FLA_SLAB_BIN_FULL)
+  {
+    bins->nslabs_full--;
+  }
+  else if (link->bin < FLA_POOL_NBINS)
+  {
+    if (link->prev == FLA_LINKED_LIST_NULL)
+      bins->heads[link->bin] = link->next;
+    else
+      pools->slab_bins[link->prev].next = link->next;
+
+    if (link->next != FLA_LINKED_LIST_NULL)
+      pools->slab_bins[link->next].prev = link->prev;
+
+    bins->nslabs[link->bin]--;
+    bins->nobjs_partial -= link->refcount;
+  }
+
+  link->bin = FLA_SLAB_BIN_NONE;
+  link->prev = link->next = FLA_LINKED_LIST_NULL;
+  link->refcount = 0;
+}
+
+void
+fla_pool_bins_update(struct flexalloc *fs, uint32_t slab_id, uint32_t const *list_head)
+{
+  struct fla_slab_header const *slab = fs->slabs.headers + slab_id;
+  struct fla_slab_bin_link *link = &fs->pools.slab_bins[slab_id];
+  struct fla_pool_entry const *pool_entry;
+  struct fla_pool_bins *bins;
+  uint32_t bin = FLA_SLAB_BIN_NONE;
+
+  if (slab->pool >= fs->geo.npools)
+    return;
+
+  pool_entry = &fs->pools.entries[slab->pool];
+  bins = &fs->pools.bins[slab->pool];
+
+  if (list_head == &pool_entry->partial_slabs)
+    bin = fla_min((uint32_t)((uint64_t)slab->refcount * FLA_POOL_NBINS / pool_entry->slab_nobj),
+                  (uint32_t)(FLA_POOL_NBINS - 1));
+  else if (list_head == &pool_entry->full_slabs)
+    bin = FLA_SLAB_BIN_FULL;
+
+  if (link->bin == bin)
+  {
+    // same bin, only the object count moves
+    if (bin < FLA_POOL_NBINS)
+    {
+      bins->nobjs_partial += slab->refcount;
+      bins->nobjs_partial -= link->refcount;
+      link->refcount = slab->refcount;
+    }
+    return;
+  }
+
+  fla_pool_bins_unlink(&fs->pools, bins, slab_id);
+  link->bin = bin;
+
+  if (bin == FLA_SLAB_BIN_FULL)
+  {
+    bins->nslabs_full++;
+  }
+  else if (bin < FLA_POOL_NBINS)
+  {
+    link->next = bins->heads[bin];
+    if (link->next != FLA_LINKED_LIST_NULL)
+      fs->pools.slab_bins[link->next].prev = slab_id;
+    bins->heads[bin] = slab_id;
+    bins->nslabs[bin]++;
+    link->refcount = slab->refcount;
+    bins->nobjs_partial += slab->refcount;
+  }
+}
+
+static uint32_t
+fla_pool_nslabs_empty(struct flexalloc const *fs, uint32_t pool_ndx)
+{
+  struct fla_pool_bins const *bins = &fs->pools.bins[pool_ndx];
+  uint32_t nslabs = fs->pools.usage[pool_ndx].nslabs - bins->nslabs_full;
+
+  for (uint32_t i = 0 ; i < FLA_POOL_NBINS ; ++i)
+    nslabs -= bins->nslabs[i];
+
+  return nslabs;
+}
+
+int
+fla_pool_empty_slabs_trim(struct flexalloc *fs, uint32_t pool_ndx, uint32_t nkeep)
+{
+  int err = 0, ret;
+  struct fla_pool_entry *pool_entry = &fs->pools.entries[pool_ndx];
+  struct fla_slab_header *slab;
+  uint32_t nempty = fla_pool_nslabs_empty(fs, pool_ndx);
+
+  for (; nempty > nkeep && pool_entry->empty_slabs != FLA_LINKED_LIST_NULL; --nempty)
+  {
+    slab = fla_slab_header_ptr(pool_entry->empty_slabs, fs);
+    if ((err = FLA_ERR(!slab, "fla_slab_header_ptr()")))
+      break;
+
+    err = fla_hdll_remove(fs, slab, &pool_entry->empty_slabs);
+    if (FLA_ERR(err, "fla_hdll_remove()"))
+      break;
+
+    fla_fs_lock(fs);
+    err = fla_release_slab(fs, slab);
+    fla_fs_unlock(fs);
+    if (FLA_ERR(err, "fla_release_slab()"))
+    {
+      ret = fla_hdll_prepend(fs, slab, &pool_entry->empty_slabs);
+      FLA_ERR(ret, "fla_hdll_prepend()");
+      break;
+    }
+  }
+
+  return err;
+}
+
+int
+fla_pool_wmark_check(struct flexalloc *fs, uint32_t pool_ndx)
+{
+  struct fla_pool_wmark const *wmark = &fs->pools.wmarks[pool_ndx];
+
+  if (fla_pool_nslabs_empty(fs, pool_ndx) <= wmark->high)
+    return 0;
+
+  return fla_pool_empty_slabs_trim(fs, pool_ndx, wmark->low);
+}
+
+uint32_t
+fla_pool_bins_fullest(struct flexalloc const *fs, uint32_t pool_ndx)
+{
+  struct fla_pool_bins const *bins = &fs->pools.bins[pool_ndx];
+
+  for (uint32_t i = FLA_POOL_NBINS ; i > 0 ; --i)
+  {
+    if (bins->heads[i - 1] != FLA_LINKED_LIST_NULL)
+      return bins->heads[i - 1];
+  }
+
+  return FLA_LINKED_LIST_NULL;
+}
+
+int
+fla_pool_usage_init(struct flexalloc *fs)
+{
+  int err = 0;
+  struct fla_slab_header * curr_slab;
+  struct fla_pool_entry * pool_entry;
+  struct fla_pool_usage * usage;
+  uint32_t * slab_heads[3];
+  uint32_t tmp;
+
+  for (uint32_t nslab = 0 ; nslab < fs->geo.nslabs ; ++nslab)
+  {
+    fs->pools.slab_bins[nslab].bin = FLA_SLAB_BIN_NONE;
+    fs->pools.slab_bins[nslab].prev = FLA_LINKED_LIST_NULL;
+    fs->pools.slab_bins[nslab].next = FLA_LINKED_LIST_NULL;
+    fs->pools.slab_bins[nslab].refcount = 0;
+  }
+
+  for (uint32_t npool = 0 ; npool < fs->geo.npools ; ++npool)
+  {
+    pool_entry = &fs->pools.entries[npool];
+    usage = &fs->pools.usage[npool];
+    memset(usage, 0, sizeof(struct fla_pool_usage));
+    fla_pool_bins_reset(&fs->pools.bins[npool]);
+
+    if(pool_entry->obj_nlb == 0 && pool_entry->slab_nobj == 0)
+      continue; //as this pool has not been initialized
+
+    slab_heads[0] = &pool_entry->empty_slabs;
+    slab_heads[1] = &pool_entry->full_slabs;
+    slab_heads[2] = &pool_entry->partial_slabs;
+    for(size_t i = 0 ; i < 3 ; ++i)
+    {
+      tmp = *slab_heads[i];
+      for(uint32_t j = 0 ; j < fs->geo.nslabs && tmp != FLA_LINKED_LIST_NULL; ++j)
+      {
+        curr_slab = fla_slab_header_ptr(tmp, fs);
+        if((err = FLA_ERR(!curr_slab, "fla_slab_header_ptr()")))
+          return err;
+
+        // slabs acquired before the pool was recorded in the header point at pool 0
+        if (curr_slab->pool != npool)
+        {
+          curr_slab->pool = npool;
+          fla_md_mark_dirty(fs, curr_slab, sizeof(struct fla_slab_header));
+        }
+        usage->nslabs++;
+        usage->nobjs_used += curr_slab->refcount;
+        fla_pool_bins_update(fs, tmp, slab_heads[i]);
+        tmp = curr_slab->next;
+      }
+    }
+  }
+
+  return err;
 }
 
 void
@@ -214,8 +496,9 @@ fla_print_pool_entries(struct flexalloc *fs)
   }
 }
 
-int
-fla_base_pool_open(struct flexalloc *fs, const char *name, struct fla_pool **handle)
+// caller holds the fs lock
+static int
+fla_pool_lookup(struct flexalloc *fs, const char *name, struct fla_pool **handle)
 {
   struct fla_htbl_entry *htbl_entry;
 
@@ -232,6 +515,24 @@ fla_base_pool_open(struct flexalloc *fs, const char *name, struct fla_pool **han
   return 0;
 }
 
+int
+fla_pool_range_check_ndx(struct flexalloc const *fs, uint32_t ndx)
+{
+  return ndx >= fs->geo.npools;
+}
+
+int
+fla_base_pool_open(struct flexalloc *fs, const char *name, struct fla_pool **handle)
+{
+  int err;
+
+  fla_fs_lock(fs);
+  err = fla_pool_lookup(fs, name, handle);
+  fla_fs_unlock(fs);
+
+  return err;
+}
+
 int
 fla_pool_release_all_slabs(struct flexalloc *fs, struct fla_pool_entry * pool_entry)
 {
@@ -260,8 +561,10 @@ fla_base_pool_create(struct flexalloc *fs, struct fla_pool_create_arg const *arg
   int entry_ndx = 0;
   uint32_t slab_nobj;
 
+  fla_fs_lock(fs);
+
   // Return pool if it exists
-  err = fla_base_pool_open(fs, arg->name, handle);
+  err = fla_pool_lookup(fs, arg->name, handle);
   if(!err)
   {
     pool_entry = &fs->pools.entries[(*handle)->ndx];
@@ -270,7 +573,7 @@ fla_base_pool_create(struct flexalloc *fs, struct fla_pool_create_arg const *arg
       err = -EINVAL;
       goto free_handle;
     }
-    return 0;
+    goto exit;
   }
 
   if ((err = FLA_ERR(arg->name_len >= FLA_NAME_SIZE_POOL, "pool name too long")))
@@ -306,11 +609,17 @@ fla_base_pool_create(struct flexalloc *fs, struct fla_pool_create_arg const *arg
     goto free_freelist_entry;
 
   pool_func->fla_pool_entry_reset(pool_entry, arg, slab_nobj);
+  fla_md_mark_dirty(fs, pool_entry, sizeof(struct fla_pool_entry));
+  fla_pool_sgmt_mark_dirty(fs);
+  fla_pool_bins_reset(&fs->pools.bins[entry_ndx]);
+  fla_pool_wmark_reset(&fs->pools.wmarks[entry_ndx]);
+  fla_jnl_log(fs, FLA_JNL_POOL_CREATE, entry_ndx, 0, pool_entry, sizeof(*pool_entry));
 
   (*handle)->ndx = entry_ndx;
   (*handle)->h2 = FLA_HTBL_H2(arg->name);
+  fla_fs_unlock(fs);
 
-  return 0;
+  return fla_jnl_commit(fs);
 
 free_freelist_entry:
   fla_flist_entries_free(fs->pools.freelist, entry_ndx, 1);
@@ -319,22 +628,82 @@ free_handle:
   free(*handle);
 
 exit:
+  fla_fs_unlock(fs);
   return err;
 }
 
+int
+fla_pool_entry_restore(struct flexalloc *fs, uint32_t ndx, struct fla_pool_entry const *entry)
+{
+  struct fla_pool_entry *pool_entry = &fs->pools.entries[ndx];
+  int err;
+
+  // the slab lists are laid out again once the whole journal is replayed
+  *pool_entry = *entry;
+  pool_entry->name[FLA_NAME_SIZE_POOL - 1] = '\0';
+  pool_entry->empty_slabs = FLA_LINKED_LIST_NULL;
+  pool_entry->full_slabs = FLA_LINKED_LIST_NULL;
+  pool_entry->partial_slabs = FLA_LINKED_LIST_NULL;
+  fla_md_mark_dirty(fs, pool_entry, sizeof(struct fla_pool_entry));
+
+  err = fla_flist_run_take(fs->pools.freelist, ndx, 1);
+  if (FLA_ERR(err, "fla_flist_run_take()"))
+    return err;
+
+  err = htbl_insert(&fs->pools.htbl, pool_entry->name, ndx);
+  if (FLA_ERR(err, "htbl_insert()"))
+    return err;
+  fla_pool_sgmt_mark_dirty(fs);
+
+  err = fla_pool_initialize_entrie_func_(&fs->pools, ndx);
+  if (FLA_ERR(err, "fla_pool_initialize_entrie_func_()"))
+    return err;
+
+  fla_pool_bins_reset(&fs->pools.bins[ndx]);
+  fla_pool_wmark_reset(&fs->pools.wmarks[ndx]);
+  return 0;
+}
+
+int
+fla_pool_entry_drop(struct flexalloc *fs, uint32_t ndx, struct fla_pool_entry const *entry)
+{
+  struct fla_htbl_entry *htbl_entry;
+  char name[FLA_NAME_SIZE_POOL];
+  int err;
+
+  // the entry may hold a later pool by now, remove the name the pool had
+  memcpy(name, entry->name, FLA_NAME_SIZE_POOL);
+  name[FLA_NAME_SIZE_POOL - 1] = '\0';
+  htbl_entry = htbl_lookup(&fs->pools.htbl, name);
+  if (htbl_entry && htbl_entry->val == ndx)
+    htbl_remove(&fs->pools.htbl, name);
+
+  err = fla_flist_entries_free(fs->pools.freelist, ndx, 1);
+  if (FLA_ERR(err, "fla_flist_entries_free()"))
+    return err;
+
+  fla_pool_sgmt_mark_dirty(fs);
+  return 0;
+}
+
 int
 fla_base_pool_destroy(struct flexalloc *fs, struct fla_pool * handle)
 {
   struct fla_pool_entry *pool_entry;
   struct fla_htbl_entry *htbl_entry;
+  uint32_t ndx = handle->ndx;
   int err = 0;
-  if ((err = FLA_ERR(handle->ndx > fs->super->npools, "invalid pool id, out of range")))
+  if ((err = FLA_ERR(fla_pool_range_check_ndx(fs, ndx), "invalid pool id, out of range")))
     goto exit;
 
+  // the handle is freed on success
+  fla_pool_lock(fs, ndx);
+  fla_fs_lock(fs);
+
   pool_entry = &fs->pools.entries[handle->ndx];
   htbl_entry = htbl_lookup(&fs->pools.htbl, pool_entry->name);
   if ((err = FLA_ERR(!htbl_entry, "failed to find pool entry in hash table")))
-    goto exit;
+    goto unlock;
 
   /*
    * Name given by pool entry pointed to by handle->ndx resolves to a different
@@ -344,16 +713,20 @@ fla_base_pool_destroy(struct flexalloc *fs, struct fla_pool * handle)
    */
   if ((err = FLA_ERR(htbl_entry->h2 != handle->h2,
                      "stale/invalid pool handle - resolved to an unused/differently named pool")))
-    goto exit;
+    goto unlock;
 
   if ((err = FLA_ERR(htbl_entry->val != handle->ndx,
                      "stale/invalid pool handle - corresponding hash table entry points elsewhere")))
-    goto exit;
+    goto unlock;
+
 
+  err = fla_obj_cache_drain(fs, handle->ndx);
+  if(FLA_ERR(err, "fla_obj_cache_drain()"))
+    goto unlock;
 
   err = fla_pool_release_all_slabs(fs, pool_entry);
   if(FLA_ERR(err, "fla_pool_release_all_slabs()"))
-    goto exit;
+    goto unlock;
 
   err = fla_flist_entries_free(fs->pools.freelist, handle->ndx, 1);
   if (FLA_ERR(err,
@@ -364,15 +737,23 @@ fla_base_pool_destroy(struct flexalloc *fs, struct fla_pool * handle)
      * the range of pools as specified in the super block, but that the freelist
      * somehow has fewer entries anyway (inconsistency).
      */
-    goto exit;
+    goto unlock;
 
   // remove hash table entry, note the freelist entry is the canonical entry.
   htbl_remove(&fs->pools.htbl, pool_entry->name);
+  fla_pool_sgmt_mark_dirty(fs);
+  fla_jnl_log(fs, FLA_JNL_POOL_DESTROY, ndx, 0, pool_entry, sizeof(*pool_entry));
 
   free(handle);
 
   // TODO: release slabs controlled by pool
 
+unlock:
+  fla_fs_unlock(fs);
+  fla_pool_unlock(fs, ndx);
+
+  if (!err)
+    err = fla_jnl_commit(fs);
 exit:
   return err;
 }
@@ -395,6 +776,11 @@ fla_base_pool_set_root_object(struct flexalloc const * const fs,
   struct fla_object *pool_root;
   int ret = 0;
 
+  if (FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx), "invalid pool id, out of range"))
+    return -EINVAL;
+
+  fla_pool_lock(fs, pool_handle->ndx);
+
   // Lookup pool entry and check if root is already set
   pool_root = fla_pool_lookup_root_object(fs, pool_handle);
   if ((*(uint64_t *)pool_root != FLA_ROOT_OBJ_NONE) && !(act & ROOT_OBJ_SET_FORCE))
@@ -409,8 +795,14 @@ fla_base_pool_set_root_object(struct flexalloc const * const fs,
     *pool_root = *obj;
   else
     *(uint64_t *)pool_root = FLA_ROOT_OBJ_NONE;
+  fla_md_mark_dirty(fs, pool_root, sizeof(uint64_t));
+  fla_jnl_log(fs, FLA_JNL_POOL_ROOT, pool_handle->ndx, 0, pool_root, sizeof(uint64_t));
+  fla_pool_unlock(fs, pool_handle->ndx);
+
+  return fla_jnl_commit(fs);
 
 out:
+  fla_pool_unlock(fs, pool_handle->ndx);
   return ret;
 }
 
@@ -422,6 +814,11 @@ fla_base_pool_get_root_object(struct flexalloc const * const fs,
   struct fla_object *pool_root;
   int ret = 0;
 
+  if (FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx), "invalid pool id, out of range"))
+    return -EINVAL;
+
+  fla_pool_lock(fs, pool_handle->ndx);
+
   // Lookup pool entry and check if it is not set
   pool_root = fla_pool_lookup_root_object(fs, pool_handle);
   if (*(uint64_t *)pool_root == FLA_ROOT_OBJ_NONE)
@@ -434,10 +831,129 @@ fla_base_pool_get_root_object(struct flexalloc const * const fs,
   *obj = *pool_root;
 
 out:
+  fla_pool_unlock(fs, pool_handle->ndx);
   return ret;
 
 }
 
+int
+fla_pool_usage(struct flexalloc const * const fs, struct fla_pool const *pool_handle,
+               struct fla_pool_usage *usage)
+{
+  struct fla_pool_entry const * pool_entry;
+
+  if (FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx), "invalid pool id, out of range"))
+    return -EINVAL;
+
+  fla_pool_lock(fs, pool_handle->ndx);
+  pool_entry = &fs->pools.entries[pool_handle->ndx];
+  *usage = fs->pools.usage[pool_handle->ndx];
+  usage->nobjs = (uint64_t)usage->nslabs * pool_entry->slab_nobj;
+  fla_pool_unlock(fs, pool_handle->ndx);
+
+  return 0;
+}
+
+int
+fla_pool_frag(struct flexalloc const * const fs, struct fla_pool const *pool_handle,
+              struct fla_pool_frag *frag)
+{
+  struct fla_pool_entry const * pool_entry;
+  struct fla_pool_bins const * bins;
+
+  if (FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx), "invalid pool id, out of range"))
+    return -EINVAL;
+
+  memset(frag, 0, sizeof(struct fla_pool_frag));
+
+  fla_pool_lock(fs, pool_handle->ndx);
+  pool_entry = &fs->pools.entries[pool_handle->ndx];
+  bins = &fs->pools.bins[pool_handle->ndx];
+  for (uint32_t i = 0 ; i < FLA_POOL_NBINS ; ++i)
+  {
+    frag->nslabs_bin[i] = bins->nslabs[i];
+    frag->nslabs_partial += bins->nslabs[i];
+  }
+  frag->nslabs_full = bins->nslabs_full;
+  frag->nslabs_empty = fs->pools.usage[pool_handle->ndx].nslabs
+                       - frag->nslabs_full - frag->nslabs_partial;
+  frag->nobjs_partial = bins->nobjs_partial;
+  if (pool_entry->slab_nobj)
+    frag->nslabs_reclaimable = frag->nslabs_partial
+                               - FLA_CEIL_DIV(frag->nobjs_partial, pool_entry->slab_nobj);
+  fla_pool_unlock(fs, pool_handle->ndx);
+
+  return 0;
+}
+
+int
+fla_pool_set_wmark(struct flexalloc *fs, struct fla_pool const *pool_handle,
+                   uint32_t low, uint32_t high)
+{
+  int err;
+
+  if (FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx), "invalid pool id, out of range"))
+    return -EINVAL;
+
+  if (FLA_ERR(low > high, "low watermark above high watermark"))
+    return -EINVAL;
+
+  fla_pool_lock(fs, pool_handle->ndx);
+  fs->pools.wmarks[pool_handle->ndx].low = low;
+  fs->pools.wmarks[pool_handle->ndx].high = high;
+  err = fla_pool_wmark_check(fs, pool_handle->ndx);
+  FLA_ERR(err, "fla_pool_wmark_check()");
+  fla_pool_unlock(fs, pool_handle->ndx);
+
+  return err;
+}
+
+int
+fla_pool_trim(struct flexalloc *fs, struct fla_pool const *pool_handle, uint32_t nkeep)
+{
+  int err;
+
+  if (FLA_ERR(fla_pool_range_check_ndx(fs, pool_handle->ndx), "invalid pool id, out of range"))
+    return -EINVAL;
+
+  fla_pool_lock(fs, pool_handle->ndx);
+  err = fla_pool_empty_slabs_trim(fs, pool_handle->ndx, nkeep);
+  FLA_ERR(err, "fla_pool_empty_slabs_trim()");
+  fla_pool_unlock(fs, pool_handle->ndx);
+
+  return err;
+}
+
+int
+fla_usage(struct flexalloc const * const fs, struct fla_usage *usage)
+{
+  struct fla_pool_usage const * pool_usage;
+
+  memset(usage, 0, sizeof(struct fla_usage));
+  usage->npools = fs->geo.npools;
+  usage->nslabs = fs->geo.nslabs;
+
+  fla_fs_lock(fs);
+  usage->npools_used = fla_flist_num_reserved(fs->pools.freelist);
+  usage->nslabs_free = *fs->slabs.fslab_num;
+  fla_fs_unlock(fs);
+
+  // unused pools hold no slabs and contribute nothing
+  for (uint32_t npool = 0 ; npool < fs->geo.npools ; ++npool)
+  {
+    fla_pool_lock(fs, npool);
+    pool_usage = &fs->pools.usage[npool];
+    if (pool_usage->nslabs)
+    {
+      usage->nobjs_used += pool_usage->nobjs_used;
+      usage->nlb_used += pool_usage->nobjs_used * fs->pools.entries[npool].obj_nlb;
+    }
+    fla_pool_unlock(fs, npool);
+  }
+
+  return 0;
+}
+
 uint32_t
 fla_pool_obj_nlb(struct flexalloc const * const fs, struct fla_pool const *pool_handle)
 {
@@ -81,6 +81,49 @@ struct fla_pool_entry
   //       name when we need to.
 };
 
+/// slab is on none of the occupancy bins, it is empty or not held by a pool
+#define FLA_SLAB_BIN_NONE UINT32_MAX
+/// slab is full, counted by its pool but kept off the occupancy bins
+#define FLA_SLAB_BIN_FULL (UINT32_MAX - 1)
+
+/// in-memory occupancy bin membership of a slab
+struct fla_slab_bin_link
+{
+  uint32_t prev;
+  uint32_t next;
+  /// bin of the slab, FLA_SLAB_BIN_NONE or FLA_SLAB_BIN_FULL outside the bins
+  uint32_t bin;
+  /// slab refcount accounted in the pool bins
+  uint32_t refcount;
+};
+
+/// in-memory occupancy bins of the partial slabs of a pool
+struct fla_pool_bins
+{
+  /// head slab ID of each bin, the fullest slabs are in the last bin
+  uint32_t heads[FLA_POOL_NBINS];
+  /// number of slabs in each bin
+  uint32_t nslabs[FLA_POOL_NBINS];
+  /// number of full slabs
+  uint32_t nslabs_full;
+  /// number of objects held by the slabs of all bins
+  uint64_t nobjs_partial;
+};
+
+/// default number of empty slabs a pool keeps when trimmed automatically
+#define FLA_POOL_EMPTY_SLABS_LOW 1
+/// default number of empty slabs above which a pool is trimmed automatically
+#define FLA_POOL_EMPTY_SLABS_HIGH 4
+
+/// in-memory empty slab watermarks of a pool
+struct fla_pool_wmark
+{
+  /// empty slabs kept when trimming above the high watermark
+  uint32_t low;
+  /// empty slabs above which the pool returns its empty slabs to the device
+  uint32_t high;
+};
+
 struct fla_pool_entry_fnc
 {
   uint64_t (*get_slab_elba)(struct fla_pool_entry const * pool_entry,
@@ -98,15 +141,98 @@ fla_geo_pool_sgmt_calc(uint32_t npools, uint32_t lb_nbytes,
 
 struct fla_geo;
 
-void
+int
 fla_mkfs_pool_sgmt_init(struct flexalloc *fs, struct fla_geo *geo);
 
 int
 fla_pool_init(struct flexalloc *fs, struct fla_geo *geo, uint8_t *pool_sgmt_base);
 
+/**
+ * @brief Release the in-memory pool state set up by fla_pool_init()
+ *
+ * @param fs flexalloc system handle
+ */
+void
+fla_pool_fini(struct flexalloc *fs);
+
+/**
+ * @brief Count the slabs and objects of every pool from the slab headers
+ *
+ * Walks the slab lists of the pools once, the counts are kept up to date
+ * from then on by slab acquisition and release and object creation and
+ * destruction. Requires the slab segment to be set up.
+ *
+ * @param fs flexalloc system handle
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_pool_usage_init(struct flexalloc *fs);
+
+/**
+ * @brief Move a slab to the occupancy bin matching its refcount
+ *
+ * Called whenever the refcount of a slab changed, with the pool slab list the
+ * slab sits on now. Slabs off the partial list leave the bins.
+ *
+ * @param fs flexalloc system handle
+ * @param slab_id ID of the slab
+ * @param list_head head of the pool slab list holding the slab, NULL if none
+ */
+void
+fla_pool_bins_update(struct flexalloc *fs, uint32_t slab_id, uint32_t const *list_head);
+
+/**
+ * @brief Return the fullest partial slab of a pool
+ *
+ * @param fs flexalloc system handle
+ * @param pool_ndx index of the pool entry
+ * @return slab ID, FLA_LINKED_LIST_NULL if the pool has no partial slab
+ */
+uint32_t
+fla_pool_bins_fullest(struct flexalloc const *fs, uint32_t pool_ndx);
+
+/**
+ * @brief Return empty slabs of a pool to the device wide free slab list
+ *
+ * The caller holds the pool lock, the fs lock is taken while releasing.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_ndx index of the pool entry
+ * @param nkeep number of empty slabs to keep in the pool
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_pool_empty_slabs_trim(struct flexalloc *fs, uint32_t pool_ndx, uint32_t nkeep);
+
+/**
+ * @brief Trim the empty slabs of a pool down to its low watermark
+ *
+ * Does nothing unless the pool holds more empty slabs than its high
+ * watermark. The caller holds the pool lock and not the fs lock.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_ndx index of the pool entry
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_pool_wmark_check(struct flexalloc *fs, uint32_t pool_ndx);
+
 void
 fla_print_pool_entries(struct flexalloc *fs);
 
+/**
+ * @brief Check a pool index against the pools of the handle
+ *
+ * Every call taking a pool handle checks it before it indexes the pool
+ * entries or takes the pool lock.
+ *
+ * @param fs flexalloc system handle
+ * @param ndx pool index, as found in a pool handle
+ * @return Zero if the index is in range, non zero otherwise
+ */
+int
+fla_pool_range_check_ndx(struct flexalloc const *fs, uint32_t ndx);
+
 int
 fla_base_pool_open(struct flexalloc *fs, const char *name, struct fla_pool **handle);
 
@@ -120,6 +246,34 @@ fla_base_pool_create(struct flexalloc *fs, struct fla_pool_create_arg const *,
 int
 fla_base_pool_destroy(struct flexalloc *fs, struct fla_pool * handle);
 
+/**
+ * @brief Set up a pool entry as logged by the journal
+ *
+ * Reserves the entry and points the pool name at it, the slab lists of the
+ * entry are left empty until fla_slabs_rebuild(). Used by journal replay.
+ *
+ * @param fs flexalloc system handle
+ * @param ndx index of the pool entry
+ * @param entry pool entry as it was created
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_pool_entry_restore(struct flexalloc *fs, uint32_t ndx, struct fla_pool_entry const *entry);
+
+/**
+ * @brief Release a pool entry as logged by the journal
+ *
+ * Frees the entry and removes the pool name unless it already names another
+ * entry. Used by journal replay.
+ *
+ * @param fs flexalloc system handle
+ * @param ndx index of the pool entry
+ * @param entry pool entry as it was destroyed
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_pool_entry_drop(struct flexalloc *fs, uint32_t ndx, struct fla_pool_entry const *entry);
+
 int
 fla_base_pool_set_root_object(struct flexalloc const * const fs,
                               struct fla_pool const * pool_handle,
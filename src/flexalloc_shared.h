@@ -1,6 +1,7 @@
 #ifndef FLEXALLOC_SHARED_H_
 #define FLEXALLOC_SHARED_H_
 #include <stdint.h>
+#include <stdbool.h>
 #include <libxnvme.h>
 
 #ifdef __cplusplus
@@ -15,16 +16,59 @@ struct flexalloc;
 struct fla_pool;
 struct flexalloc;
 
+/// flexalloc I/O engine profile
+///
+/// Describes how the data device is driven. The profile is applied on top of
+/// the xnvme open options and every queue flexalloc creates on the device,
+/// synchronous pipelining, striped, batched and asynchronous I/O alike,
+/// submits and reaps according to it.
+struct fla_io_profile
+{
+  /// xnvme async backend, e.g. "io_uring", "io_uring_cmd" or "libaio". NULL keeps the default
+  char const *backend;
+  /// Number of commands each queue holds, rounded up to a power of 2. Zero keeps the default
+  uint32_t qdepth;
+  /// Reap completions by polling the device instead of waiting for an interrupt
+  bool poll_io;
+  /// Let a kernel thread poll the submission queue
+  bool poll_sq;
+  /// Poll from the CPU given in cpu, otherwise the backend places its polling
+  bool pin_cpu;
+  /// CPU the backend polls from, only used with pin_cpu
+  uint32_t cpu;
+};
+
 /// flexalloc open options
 ///
 /// Minimally the dev_uri needs to be set
 /// If the md_dev is set than flexalloc md will be stored on this device
 /// The xnvme open options are optionally set at open time as well
+/// The io_profile, when set, overrides the matching xnvme open options
+/// The flags are a combination of fla_open_flags
+/// A checkpoint interval or dirty threshold starts a thread writing the
+/// metadata in the background, which needs FLA_OPEN_THREAD_SAFE
 struct fla_open_opts
 {
   char const * dev_uri;
   char const *md_dev_uri;
   struct xnvme_opts *opts;
+  struct fla_io_profile const *io_profile;
+  uint64_t flags;
+  /// write the metadata at least every so many milliseconds, 0 to not
+  uint32_t ckpt_interval_ms;
+  /// write the metadata once this many bytes of it changed, 0 to not
+  uint64_t ckpt_dirty_nbytes;
+};
+
+enum fla_open_flags
+{
+  /// Allow concurrent calls on the handle from several threads.
+  ///
+  /// Pool and object calls serialize per pool, only acquiring and releasing
+  /// slabs takes a handle wide lock. Synchronous object I/O takes no lock.
+  /// The asynchronous object calls share one queue per handle and still have
+  /// to be serialized by the application.
+  FLA_OPEN_THREAD_SAFE = 1 << 0,
 };
 
 /// flexalloc object handle
@@ -60,6 +104,61 @@ struct fla_pool
   uint32_t ndx;
 };
 
+/// pool utilization
+///
+/// The counts are maintained as slabs and objects come and go, querying
+/// them does not visit the slabs of the pool.
+struct fla_pool_usage
+{
+  /// Number of slabs held by the pool
+  uint32_t nslabs;
+  /// Number of objects the slabs of the pool fit
+  uint64_t nobjs;
+  /// Number of objects allocated, a striped object counts its stripes
+  uint64_t nobjs_used;
+};
+
+/// Number of occupancy bins the partial slabs of a pool are sorted into
+#define FLA_POOL_NBINS 4
+
+/// pool fragmentation
+///
+/// Partial slabs are binned by how full they are, bin i holding the slabs
+/// between i/FLA_POOL_NBINS and (i+1)/FLA_POOL_NBINS full. Objects are
+/// allocated from the fullest partial slab so the emptier ones can drain.
+struct fla_pool_frag
+{
+  /// Number of slabs of the pool without objects
+  uint32_t nslabs_empty;
+  /// Number of slabs of the pool without room for another object
+  uint32_t nslabs_full;
+  /// Number of slabs of the pool with objects and room for more
+  uint32_t nslabs_partial;
+  /// Number of partial slabs in each occupancy bin
+  uint32_t nslabs_bin[FLA_POOL_NBINS];
+  /// Number of objects held by the partial slabs
+  uint64_t nobjs_partial;
+  /// Number of partial slabs that would be left empty if their objects were packed
+  uint32_t nslabs_reclaimable;
+};
+
+/// device utilization
+struct fla_usage
+{
+  /// Number of pool entries
+  uint32_t npools;
+  /// Number of pools created
+  uint32_t npools_used;
+  /// Number of slabs
+  uint32_t nslabs;
+  /// Number of slabs not held by any pool
+  uint32_t nslabs_free;
+  /// Number of objects allocated across all pools
+  uint64_t nobjs_used;
+  /// Number of logical blocks taken by the allocated objects
+  uint64_t nlb_used;
+};
+
 typedef enum
 {
   ROOT_OBJ_SET_DEF = 0,
@@ -88,6 +187,10 @@ struct fla_fns
   int (*object_open)(struct flexalloc *fs, struct fla_pool *pool, struct fla_object *object);
   int (*object_create)(struct flexalloc *fs, struct fla_pool *pool, struct fla_object *object);
   int (*object_destroy)(struct flexalloc *fs, struct fla_pool *pool, struct fla_object *object);
+  int (*object_create_n)(struct flexalloc *fs, struct fla_pool *pool, struct fla_object *objects,
+                         uint32_t nobjects);
+  int (*object_destroy_n)(struct flexalloc *fs, struct fla_pool *pool, struct fla_object *objects,
+                          uint32_t nobjects);
   int (*pool_set_root_object)(struct flexalloc const * const fs, struct fla_pool const * pool,
                               struct fla_object const *object, fla_root_object_set_action act);
   int (*pool_get_root_object)(struct flexalloc const * const fs, struct fla_pool const * pool,
@@ -6,6 +6,7 @@
 #include "flexalloc.h"
 #include "flexalloc_mm.h"
 #include "flexalloc_xnvme_env.h"
+#include "flexalloc_bufpool.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -53,6 +54,14 @@ fla_slab_cache_init(struct flexalloc *fs, struct fla_slab_flist_cache *cache)
   // zero out memory, effectively sets all cache entries to FLA_SLAB_CACHE_ELEM_STALE
   memset(cache->_head, 0, fs->super->nslabs * sizeof(struct fla_slab_flist_cache_elem));
 
+  cache->_dirty = calloc(FLA_CEIL_DIV(fs->super->nslabs, 64), sizeof(uint64_t));
+  if (FLA_ERR(!cache->_dirty, "calloc() - failed to allocate slab flist dirty bitmap"))
+  {
+    free(cache->_head);
+    cache->_head = NULL;
+    return -ENOMEM;
+  }
+
   return 0;
 }
 
@@ -71,11 +80,25 @@ fla_slab_cache_free(struct fla_slab_flist_cache *cache)
     if (!e->freelist)
       continue;
 
-    fla_xne_free_buf(cache->_fs->dev.dev, e->freelist);
+    fla_bufpool_free(cache->_fs->bufpool, fla_flist_data(e->freelist));
+    fla_flist_free(e->freelist);
   }
 
   free(cache->_head);
   cache->_head = NULL;
+  free(cache->_dirty);
+  cache->_dirty = NULL;
+}
+
+/*
+ * Mark the entry dirty and record the slab in the dirty bitmap. The state is
+ * set first, a flush which takes the bit clears the state before writing.
+ */
+static void
+cache_elem_mark_dirty(struct fla_slab_flist_cache *cache, uint32_t slab_id)
+{
+  __atomic_store_n(&cache->_head[slab_id].state, FLA_SLAB_CACHE_ELEM_DIRTY, __ATOMIC_RELEASE);
+  __atomic_or_fetch(&cache->_dirty[slab_id / 64], 1ULL << (slab_id % 64), __ATOMIC_RELEASE);
 }
 
 // init entry, should be done when the slab is being acquired by a pool
@@ -85,27 +108,31 @@ fla_slab_cache_elem_init(struct fla_slab_flist_cache *cache, uint32_t slab_id,
 {
   struct fla_slab_flist_cache_elem *e;
   int err = 0;
-  freelist_t flist_buf;
+  void *flist_buf;
 
   e = &cache->_head[slab_id];
   if (e->state != FLA_SLAB_CACHE_ELEM_STALE)
     // do not attempt to initialize an already initialized cache entry
     return FLA_SLAB_CACHE_INVALID_STATE;
 
-  flist_buf = fla_xne_alloc_buf(
-                cache->_fs->dev.dev,
+  flist_buf = fla_bufpool_alloc(
+                cache->_fs->bufpool,
                 cache_flist_size(cache, flist_len));
 
   if (FLA_ERR(!flist_buf,
-              "fla_xne_alloc_buf() - failed to allocate slab flist IO-buffer"))
+              "fla_bufpool_alloc() - failed to allocate slab flist IO-buffer"))
   {
     err = -ENOMEM;
     goto exit;
   }
 
-  fla_flist_init(flist_buf, flist_len);
-  e->freelist = flist_buf;
-  e->state = FLA_SLAB_CACHE_ELEM_DIRTY;
+  err = fla_flist_init(flist_buf, flist_len, &e->freelist);
+  if (FLA_ERR(err, "fla_flist_init()"))
+  {
+    fla_bufpool_free(cache->_fs->bufpool, flist_buf);
+    goto exit;
+  }
+  cache_elem_mark_dirty(cache, slab_id);
 
 exit:
   return err;
@@ -116,7 +143,7 @@ fla_slab_cache_elem_load(struct fla_slab_flist_cache *cache, uint32_t slab_id,
                          uint32_t flist_len)
 {
   struct fla_slab_flist_cache_elem *e = &cache->_head[slab_id];
-  freelist_t flist_buf;
+  void *flist_buf;
   int err = 0;
   uint64_t slba;
   size_t flist_nlb;
@@ -129,9 +156,9 @@ fla_slab_cache_elem_load(struct fla_slab_flist_cache *cache, uint32_t slab_id,
   if (e->state != FLA_SLAB_CACHE_ELEM_STALE)
     return FLA_SLAB_CACHE_INVALID_STATE;
 
-  flist_buf = fla_xne_alloc_buf( cache->_fs->dev.dev, cache_flist_size(cache, flist_len));
+  flist_buf = fla_bufpool_alloc(cache->_fs->bufpool, cache_flist_size(cache, flist_len));
   if (FLA_ERR(!flist_buf,
-              "fla_xne_alloc_buf() - failed to allocate slab flist IO-buffer"))
+              "fla_bufpool_alloc() - failed to allocate slab flist IO-buffer"))
   {
     err = -ENOMEM;
     goto exit;
@@ -143,6 +170,7 @@ fla_slab_cache_elem_load(struct fla_slab_flist_cache *cache, uint32_t slab_id,
     if (flist_nlb > 1)
     {
       FLA_ERR_PRINTF("MD DEV AND FLIST NLB:%lu > 1, FIX ME", flist_nlb);
+      err = -ENOTSUP;
       goto free_io_buffer;
     }
   }
@@ -165,21 +193,24 @@ fla_slab_cache_elem_load(struct fla_slab_flist_cache *cache, uint32_t slab_id,
     goto free_io_buffer;
 
   // sanity-check - the caller should know the freelist length
-  err = fla_flist_len(flist_buf) != flist_len;
+  err = *(uint32_t *)flist_buf != flist_len;
   if (err)
   {
     FLA_ERR_PRINTF("error - expected freelist of length '%"PRIu32"', but entry reports '%"PRIu32"'",
-                   flist_len, fla_flist_len(flist_buf));
+                   flist_len, *(uint32_t *)flist_buf);
     goto free_io_buffer;
   }
 
-  e->freelist = flist_buf;
+  err = fla_flist_load(flist_buf, &e->freelist);
+  if (FLA_ERR(err, "fla_flist_load()"))
+    goto free_io_buffer;
+
   e->state = FLA_SLAB_CACHE_ELEM_CLEAN;
 
   return 0; // success
 
 free_io_buffer:
-  fla_xne_free_buf(cache->_fs->dev.dev, flist_buf);
+  fla_bufpool_free(cache->_fs->bufpool, flist_buf);
 exit:
   return err;
 }
@@ -189,6 +220,7 @@ fla_slab_cache_elem_flush(struct fla_slab_flist_cache *cache, uint32_t slab_id)
 {
   int err = 0;
   struct fla_slab_flist_cache_elem *e;
+  enum fla_slab_flist_elem_state state;
   uint64_t slba;
   size_t flist_nlb;
   struct xnvme_dev *md_dev = cache->_fs->dev.dev;
@@ -197,7 +229,15 @@ fla_slab_cache_elem_flush(struct fla_slab_flist_cache *cache, uint32_t slab_id)
     md_dev = cache->_fs->dev.md_dev;
 
   e = &cache->_head[slab_id];
-  if (e->state != FLA_SLAB_CACHE_ELEM_DIRTY)
+  state = FLA_SLAB_CACHE_ELEM_DIRTY;
+
+  /*
+   * Mark the entry clean before writing it out. Changes made concurrently by
+   * the atomic object calls mark it dirty again and go out with the next
+   * flush if the write misses them.
+   */
+  if (!__atomic_compare_exchange_n(&e->state, &state, FLA_SLAB_CACHE_ELEM_CLEAN, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
     return 0;
 
   flist_nlb = fla_slab_cache_flist_nlb(cache->_fs, fla_flist_len(e->freelist));
@@ -208,14 +248,16 @@ fla_slab_cache_elem_flush(struct fla_slab_flist_cache *cache, uint32_t slab_id)
   if ((err = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
     goto exit;
 
-  struct fla_xne_io xne_io = {.dev = md_dev, .buf = e->freelist, .lba_range = &range, .fla_dp = &(cache->_fs->fla_dp)};
+  struct fla_xne_io xne_io = {.dev = md_dev, .buf = fla_flist_data(e->freelist), .lba_range = &range, .fla_dp = &(cache->_fs->fla_dp)};
 
   err = fla_xne_sync_seq_w_xneio(&xne_io);
   if(FLA_ERR(err, "fla_xne_sync_seq_w_xneio()"))
     goto exit;
 
-  e->state = FLA_SLAB_CACHE_ELEM_CLEAN;
+  return 0;
+
 exit:
+  cache_elem_mark_dirty(cache, slab_id);
   return err;
 }
 
@@ -226,7 +268,8 @@ fla_slab_cache_elem_drop(struct fla_slab_flist_cache *cache, uint32_t slab_id)
   e->state = FLA_SLAB_CACHE_ELEM_STALE;
   if (e->freelist)
   {
-    fla_xne_free_buf(cache->_fs->dev.dev, e->freelist);
+    fla_bufpool_free(cache->_fs->bufpool, fla_flist_data(e->freelist));
+    fla_flist_free(e->freelist);
     e->freelist = NULL;
   }
 }
@@ -238,10 +281,13 @@ fla_slab_cache_obj_alloc(struct fla_slab_flist_cache *cache, uint32_t slab_id,
   struct fla_slab_flist_cache_elem *e = &cache->_head[slab_id];
   int err, entry_ndx;
 
-  if (e->state == FLA_SLAB_CACHE_ELEM_STALE)
+  if (__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) == FLA_SLAB_CACHE_ELEM_STALE)
     return FLA_SLAB_CACHE_INVALID_STATE;
 
-  entry_ndx = fla_flist_entries_alloc(e->freelist, num_objs);
+  if (cache->_fs->locks && num_objs == 1)
+    entry_ndx = fla_flist_entry_alloc_atomic(e->freelist);
+  else
+    entry_ndx = fla_flist_entries_alloc(e->freelist, num_objs);
   if ((err = FLA_ERR(entry_ndx < 0,
                      "fla_flist_entry_alloc() - failed to allocate an object in freelist")))
     return err;
@@ -249,7 +295,7 @@ fla_slab_cache_obj_alloc(struct fla_slab_flist_cache *cache, uint32_t slab_id,
   obj_id->slab_id = slab_id;
   obj_id->entry_ndx = entry_ndx;
 
-  e->state = FLA_SLAB_CACHE_ELEM_DIRTY;
+  cache_elem_mark_dirty(cache, slab_id);
   return 0; // success
 }
 
@@ -260,33 +306,247 @@ fla_slab_cache_obj_free(struct fla_slab_flist_cache *cache,
   struct fla_slab_flist_cache_elem *e = &cache->_head[obj_id->slab_id];
   int err;
 
-  if (e->state == FLA_SLAB_CACHE_ELEM_STALE)
+  if (__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) == FLA_SLAB_CACHE_ELEM_STALE)
     return FLA_SLAB_CACHE_INVALID_STATE;
 
-  err = fla_flist_entries_free(e->freelist, obj_id->entry_ndx, num_objs);
+  if (cache->_fs->locks && num_objs == 1)
+    err = fla_flist_entry_free_atomic(e->freelist, obj_id->entry_ndx);
+  else
+    err = fla_flist_entries_free(e->freelist, obj_id->entry_ndx, num_objs);
   if (FLA_ERR(err, "fla_flist_entries_free() - failed to free object in freelist"))
     goto exit;
 
-  e->state = FLA_SLAB_CACHE_ELEM_DIRTY;
+  cache_elem_mark_dirty(cache, obj_id->slab_id);
 
 exit:
   return err;
 }
 
 int
-fla_slab_cache_flush(struct fla_slab_flist_cache *cache)
+fla_slab_cache_obj_restore(struct fla_slab_flist_cache *cache,
+                           struct fla_object const * obj_id, uint32_t num_objs, bool reserved)
 {
-  uint32_t slab_id = 0;
+  struct fla_slab_flist_cache_elem *e = &cache->_head[obj_id->slab_id];
+  int err;
+
+  if (e->state == FLA_SLAB_CACHE_ELEM_STALE)
+    return FLA_SLAB_CACHE_INVALID_STATE;
+
+  if (reserved)
+    err = fla_flist_run_take(e->freelist, obj_id->entry_ndx, num_objs);
+  else
+    err = fla_flist_run_free(e->freelist, obj_id->entry_ndx, num_objs);
+  if (FLA_ERR(err, "fla_flist_run_take/free() - object outside of the freelist"))
+    return err;
+
+  cache_elem_mark_dirty(cache, obj_id->slab_id);
+  return 0;
+}
+
+static void
+cache_snap_io_cb(int err, void *cb_arg)
+{
+  struct fla_slab_cache_snap_io *io = cb_arg;
+
+  io->err = err;
+}
+
+/*
+ * Only slabs in the dirty bitmap are visited, so the cost of a flush follows
+ * the number of changed freelists rather than the number of slabs.
+ */
+int
+fla_slab_cache_snapshot(struct fla_slab_flist_cache *cache, bool copy,
+                        struct fla_slab_cache_snap *snap)
+{
+  struct flexalloc *fs = cache->_fs;
+  struct fla_slab_flist_cache_elem *e;
+  struct fla_slab_cache_snap_io *io;
+  enum fla_slab_flist_elem_state state;
+  uint32_t nwords, nios = 0, slab_id;
+  uint64_t *taken, word;
   int err = 0;
 
+  memset(snap, 0, sizeof(*snap));
+  snap->copy = copy;
+
   if (cache->_head == NULL)
     return 0;
 
-  for (; slab_id < cache->_fs->geo.nslabs; slab_id++)
+  nwords = FLA_CEIL_DIV(fs->geo.nslabs, 64);
+  taken = calloc(nwords, sizeof(uint64_t));
+  if (FLA_ERR(!taken, "calloc()"))
+    return -ENOMEM;
+
+  for (uint32_t i = 0; i < nwords; i++)
+  {
+    if (__atomic_load_n(&cache->_dirty[i], __ATOMIC_RELAXED))
+      taken[i] = __atomic_exchange_n(&cache->_dirty[i], 0, __ATOMIC_ACQ_REL);
+    nios += __builtin_popcountll(taken[i]);
+  }
+
+  if (!nios)
+    goto free_taken;
+
+  snap->ios = calloc(nios, sizeof(struct fla_slab_cache_snap_io));
+  if (FLA_ERR(!snap->ios, "calloc()"))
+  {
+    err = -ENOMEM;
+    goto restore_taken;
+  }
+
+  for (uint32_t i = 0; i < nwords; i++)
   {
-    if (fla_slab_cache_elem_flush(cache, slab_id))
-      err++;
+    for (word = taken[i]; word; word &= word - 1)
+    {
+      slab_id = i * 64 + __builtin_ctzll(word);
+      e = &cache->_head[slab_id];
+      state = FLA_SLAB_CACHE_ELEM_DIRTY;
+
+      // Mark the entry clean before taking it, see fla_slab_cache_elem_flush()
+      if (!__atomic_compare_exchange_n(&e->state, &state, FLA_SLAB_CACHE_ELEM_CLEAN, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        continue;
+
+      io = &snap->ios[snap->nios++];
+      io->slab_id = slab_id;
+      io->nlb = fla_slab_cache_flist_nlb(fs, fla_flist_len(e->freelist));
+      io->buf = fla_flist_data(e->freelist);
+      if (!copy)
+        continue;
+
+      // the entry may be changed again as soon as the locks are dropped
+      io->buf = fla_bufpool_alloc(fs->bufpool, (size_t)io->nlb * fs->geo.lb_nbytes);
+      if (FLA_ERR(!io->buf, "fla_bufpool_alloc()"))
+      {
+        io->err = -ENOMEM;
+        continue;
+      }
+      memcpy(io->buf, fla_flist_data(e->freelist), (size_t)io->nlb * fs->geo.lb_nbytes);
+    }
   }
 
+  free(taken);
+  return 0;
+
+restore_taken:
+  for (uint32_t i = 0; i < nwords; i++)
+    __atomic_or_fetch(&cache->_dirty[i], taken[i], __ATOMIC_RELEASE);
+free_taken:
+  free(taken);
   return err;
 }
+
+/*
+ * The writes of the snapshot go out together on one queue and are waited for
+ * once.
+ */
+int
+fla_slab_cache_snap_write(struct fla_slab_flist_cache *cache, struct fla_slab_cache_snap *snap)
+{
+  struct flexalloc *fs = cache->_fs;
+  struct xnvme_dev *md_dev = fs->dev.md_dev ? fs->dev.md_dev : fs->dev.dev;
+  struct fla_slab_cache_snap_io *io;
+  struct fla_xne_queue *q = NULL;
+  struct xnvme_lba_range range;
+  struct fla_xne_io xne_io;
+  enum fla_slab_flist_elem_state state;
+  uint32_t nfailed = 0;
+  bool leak = false;
+  int err, ret;
+
+  if (!snap->nios)
+    goto free_ios;
+
+  if (md_dev == fs->dev.dev)
+    err = fla_xne_queue_lease(fs->qpool, fs->qpool->depth, &q);
+  else
+    err = fla_xne_queue_init(md_dev, FLA_XNE_QUEUE_DEPTH, &q);
+  if (FLA_ERR(err, "failed to get a queue for the slab freelists"))
+  {
+    for (uint32_t i = 0; i < snap->nios; i++)
+      snap->ios[i].err = err;
+    goto mark_failed;
+  }
+
+  for (uint32_t i = 0; i < snap->nios; i++)
+  {
+    io = &snap->ios[i];
+    if (io->err)
+      continue;
+
+    range = fla_xne_lba_range_from_slba_naddrs(md_dev,
+            cache_entry_lb_slba(cache, io->slab_id, io->nlb), io->nlb);
+    ret = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()");
+    if (!ret)
+    {
+      memset(&xne_io, 0, sizeof(xne_io));
+      xne_io.io_type = FLA_IO_MD_WRITE;
+      xne_io.dev = md_dev;
+      xne_io.buf = io->buf;
+      xne_io.lba_range = &range;
+      xne_io.fla_dp = &fs->fla_dp;
+
+      ret = fla_xne_async_seq_xneio(q, &xne_io, cache_snap_io_cb, io);
+      FLA_ERR(ret, "fla_xne_async_seq_xneio()");
+    }
+
+    // Submission errors are reported like failed writes
+    if (ret)
+      io->err = ret;
+  }
+
+  ret = fla_xne_queue_drain(q);
+  if (FLA_ERR(ret < 0, "fla_xne_queue_drain()"))
+  {
+    // completions may still arrive, leave every entry of the batch dirty
+    for (uint32_t i = 0; i < snap->nios; i++)
+      snap->ios[i].err = ret;
+
+    // Terminating the queue reaps or cancels the commands in flight. Should that
+    // fail too, the device may still use ios and the copies, so they are leaked.
+    ret = fla_xne_queue_term(q);
+    leak = FLA_ERR(ret, "fla_xne_queue_term()") != 0;
+  }
+  else if (md_dev == fs->dev.dev)
+    fla_xne_queue_release(fs->qpool, q);
+  else
+    fla_xne_queue_term(q);
+
+mark_failed:
+  for (uint32_t i = 0; i < snap->nios; i++)
+  {
+    io = &snap->ios[i];
+    if (snap->copy && io->buf && !leak)
+      fla_bufpool_free(fs->bufpool, io->buf);
+    if (!io->err)
+      continue;
+
+    // an entry changed or dropped since the snapshot is dirty or gone already
+    state = FLA_SLAB_CACHE_ELEM_CLEAN;
+    if (__atomic_compare_exchange_n(&cache->_head[io->slab_id].state, &state,
+                                    FLA_SLAB_CACHE_ELEM_DIRTY, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      cache_elem_mark_dirty(cache, io->slab_id);
+    nfailed++;
+  }
+
+free_ios:
+  if (!leak)
+    free(snap->ios);
+  snap->ios = NULL;
+  snap->nios = 0;
+  return nfailed;
+}
+
+int
+fla_slab_cache_flush(struct fla_slab_flist_cache *cache)
+{
+  struct fla_slab_cache_snap snap;
+  int err;
+
+  err = fla_slab_cache_snapshot(cache, false, &snap);
+  if (FLA_ERR(err, "fla_slab_cache_snapshot()"))
+    return 1;
+
+  return fla_slab_cache_snap_write(cache, &snap);
+}
@@ -39,7 +39,7 @@ enum fla_slab_flist_elem_state
 
 struct fla_slab_flist_cache_elem
 {
-  /// Pointer to a IO-buffer containing the slab freelist, if initialized.
+  /// Freelist over an IO-buffer containing the slab freelist, if initialized.
   freelist_t freelist;
   /// Track the cache entry state. Will initially be stale until the entry
   /// is either initialized from scratch when a pool acquires the slab or
@@ -171,6 +171,10 @@ fla_slab_cache_elem_drop(struct fla_slab_flist_cache *cache, uint32_t slab_id);
  * Allocates an object from the slab by finding and reserving an entry from
  * the freelist.
  *
+ * On handles opened with FLA_OPEN_THREAD_SAFE single entries are taken with
+ * an atomic compare and swap on the freelist word, so several threads may
+ * allocate from, and free to, the same slab without a lock.
+ *
  * @param cache slab freelist cache
  * @param slab_id id of the slab to reserve an entry from
  * @param obj_id pointer to a object id struct - to be populated if operation is successful
@@ -189,7 +193,8 @@ fla_slab_cache_obj_alloc(struct fla_slab_flist_cache *cache, uint32_t slab_id,
  * Release object entry reservation.
  *
  * Call to release a reserved object by marking the freelist entry as available.
- * This should be done when an object is discarded.
+ * This should be done when an object is discarded. Single entries are freed
+ * atomically on thread safe handles, see fla_slab_cache_obj_alloc().
  *
  * @param cache slab freelist cache
  * @param obj_id object id, uniquely identifying the object and its parent slab
@@ -201,9 +206,84 @@ int
 fla_slab_cache_obj_free(struct fla_slab_flist_cache *cache,
                         struct fla_object * obj_id, uint32_t strp_nobjs);
 
+/**
+ * Set the freelist entries of an object to a known state.
+ *
+ * Used when replaying the journal, where an object is known to have been
+ * reserved or released regardless of the state of the freelist on disk.
+ * Taking reserved or freeing free entries is fine.
+ *
+ * @param cache slab freelist cache
+ * @param obj_id object id, uniquely identifying the object and its parent slab
+ * @param strp_nobjs Number of objects to stripe accross
+ * @param reserved whether the object entries are taken or free
+ *
+ * @return On success 0. FLA_SLAB_CACHE_INVALID_STATE if the cache entry is not
+ * initialized, other non-zero values if the object is outside of the slab.
+ */
+int
+fla_slab_cache_obj_restore(struct fla_slab_flist_cache *cache,
+                           struct fla_object const * obj_id, uint32_t strp_nobjs, bool reserved);
+
+/// Freelist taken by fla_slab_cache_snapshot()
+struct fla_slab_cache_snap_io
+{
+  uint32_t slab_id;
+  /// blocks of the freelist
+  uint32_t nlb;
+  /// freelist data, or a copy of it
+  void *buf;
+  int err;
+};
+
+/// Dirty freelists taken from a cache, to be written by fla_slab_cache_snap_write()
+struct fla_slab_cache_snap
+{
+  struct fla_slab_cache_snap_io *ios;
+  uint32_t nios;
+  /// the buffers are copies allocated from the buffer pool
+  bool copy;
+};
+
+/**
+ * Take the dirty cache entries for writing.
+ *
+ * Entries are found through the dirty bitmap of the cache rather than by
+ * scanning every slab, and are marked clean. With copy set their freelists
+ * are copied, so the entries may change while the snapshot is written and
+ * the caller may drop its locks in between. Otherwise the freelists are
+ * written in place.
+ *
+ * @param cache slab freelist cache
+ * @param copy whether to copy the freelists
+ * @param snap set to the entries taken
+ * @return On success 0. On error non-zero, with every entry left dirty.
+ */
+int
+fla_slab_cache_snapshot(struct fla_slab_flist_cache *cache, bool copy,
+                        struct fla_slab_cache_snap *snap);
+
+/**
+ * Write the freelists of a snapshot.
+ *
+ * The freelists are written as one batch of asynchronous writes. Entries
+ * which fail to be written are marked dirty again, unless they changed since.
+ * The snapshot is released.
+ *
+ * @param cache slab freelist cache
+ * @param snap snapshot taken by fla_slab_cache_snapshot()
+ * @return On success 0, On error, the number of entries which could not be
+ * written.
+ */
+int
+fla_slab_cache_snap_write(struct fla_slab_flist_cache *cache, struct fla_slab_cache_snap *snap);
+
 /**
  * Flush all dirty cache entries to disk.
  *
+ * Takes a snapshot of the dirty entries without copying and writes it, see
+ * fla_slab_cache_snapshot().
+ *
  * @param cache slab freelist cache
  * @return On success 0, On error, the number of dirty cache entries which could
  * not be flushed to disk.
@@ -99,6 +99,11 @@ fla_err_errno_fl(const int condition, const char * message, const char * f,
       __typeof__ (b) _b = (b); \
     _a < _b ? _a : _b; })
 
+#define fla_max(a, b) \
+  ({ __typeof__ (a) _a = (a); \
+      __typeof__ (b) _b = (b); \
+    _a > _b ? _a : _b; })
+
 #if FLA_VERBOSITY > 0
 #define FLA_VBS_PRINTF(f, ...) fprintf(stderr, f, __VA_ARGS__);
 #else
@@ -13,7 +13,9 @@
 
 #include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include "flexalloc_xnvme_env.h"
+#include "flexalloc_shared.h"
 #include "flexalloc_util.h"
 #include "flexalloc_dp_fdp.h"
 
@@ -147,30 +149,253 @@ exit:
   return err;
 }
 
-struct fla_async_cb_args
+/*
+ * Queues inherit the completion model the device was opened with so that every
+ * queue on a handle, whichever path creates it, honours the I/O profile.
+ */
+static int
+fla_xne_queue_opts(struct xnvme_dev *dev)
 {
-  uint32_t ecount;
-  uint32_t completed;
-  uint32_t submitted;
-};
+  struct xnvme_opts const *opts = xnvme_dev_get_opts(dev);
+  int qopts = 0;
+
+  if (!opts)
+    return 0;
+
+  if (opts->poll_io)
+    qopts |= XNVME_QUEUE_IOPOLL;
+  if (opts->poll_sq)
+    qopts |= XNVME_QUEUE_SQPOLL;
+
+  return qopts;
+}
+
+int
+fla_xne_queue_init(struct xnvme_dev *dev, uint32_t depth, struct fla_xne_queue **q)
+{
+  int err;
+
+  *q = malloc(sizeof(struct fla_xne_queue));
+  if ((err = FLA_ERR_ERRNO(!(*q), "malloc()")))
+    goto exit;
+  memset(*q, 0, sizeof(struct fla_xne_queue));
+
+  err = xnvme_queue_init(dev, depth, fla_xne_queue_opts(dev), &(*q)->queue);
+  if (FLA_ERR(err, "xnvme_queue_init()"))
+    goto free_q;
+
+  (*q)->depth = depth;
+  return 0;
+
+free_q:
+  free(*q);
+  *q = NULL;
+exit:
+  return err;
+}
+
+int
+fla_xne_queue_poke(struct fla_xne_queue *q, uint32_t max)
+{
+  uint64_t ncompleted = q->ncompleted;
+  int ret;
+
+  ret = xnvme_queue_poke(q->queue, max);
+  if (FLA_ERR(ret < 0, "xnvme_queue_poke()"))
+    return ret;
+
+  return q->ncompleted - ncompleted;
+}
+
+int
+fla_xne_queue_drain(struct fla_xne_queue *q)
+{
+  uint64_t ncompleted = q->ncompleted;
+  int ret;
+
+  while (q->noutstanding)
+  {
+    ret = xnvme_queue_poke(q->queue, 0);
+    if (FLA_ERR(ret < 0, "xnvme_queue_poke()"))
+      return ret;
+  }
+
+  return q->ncompleted - ncompleted;
+}
+
+int
+fla_xne_queue_term(struct fla_xne_queue *q)
+{
+  int err;
+
+  if (!q)
+    return 0;
+
+  err = fla_xne_queue_drain(q);
+  FLA_ERR(err < 0, "fla_xne_queue_drain()");
+
+  err = xnvme_queue_term(q->queue);
+  FLA_ERR(err, "xnvme_queue_term()");
+
+  free(q);
+  return err;
+}
+
+static uint32_t
+fla_xne_queue_depth(uint32_t min_depth)
+{
+  uint32_t depth = 1;
+
+  while (depth < min_depth)
+    depth <<= 1;
+
+  return depth;
+}
+
+int
+fla_xne_queue_pool_init(struct xnvme_dev *dev, uint32_t depth,
+                        struct fla_xne_queue_pool **qpool)
+{
+  int err;
+
+  *qpool = malloc(sizeof(struct fla_xne_queue_pool));
+  if ((err = FLA_ERR_ERRNO(!(*qpool), "malloc()")))
+    goto exit;
+  memset(*qpool, 0, sizeof(struct fla_xne_queue_pool));
+
+  err = pthread_mutex_init(&(*qpool)->lock, NULL);
+  if (FLA_ERR(err, "pthread_mutex_init()"))
+    goto free_qpool;
+
+  (*qpool)->dev = dev;
+  (*qpool)->depth = fla_xne_queue_depth(depth);
+
+  err = fla_xne_queue_init(dev, (*qpool)->depth, &(*qpool)->idle[0]);
+  if (FLA_ERR(err, "fla_xne_queue_init()"))
+    goto destroy_lock;
+  (*qpool)->nidle = 1;
+
+  return 0;
+
+destroy_lock:
+  pthread_mutex_destroy(&(*qpool)->lock);
+free_qpool:
+  free(*qpool);
+  *qpool = NULL;
+exit:
+  return err;
+}
+
+void
+fla_xne_queue_pool_term(struct fla_xne_queue_pool *qpool)
+{
+  if (!qpool)
+    return;
+
+  for (uint32_t i = 0; i < qpool->nidle; ++i)
+    fla_xne_queue_term(qpool->idle[i]);
+
+  pthread_mutex_destroy(&qpool->lock);
+  free(qpool);
+}
+
+int
+fla_xne_queue_lease(struct fla_xne_queue_pool *qpool, uint32_t min_depth,
+                    struct fla_xne_queue **q)
+{
+  int err;
+
+  *q = NULL;
+  pthread_mutex_lock(&qpool->lock);
+  for (uint32_t i = qpool->nidle; i > 0; --i)
+  {
+    if (qpool->idle[i - 1]->depth >= min_depth)
+    {
+      *q = qpool->idle[i - 1];
+      qpool->idle[i - 1] = qpool->idle[--qpool->nidle];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&qpool->lock);
+
+  if (*q)
+    return 0;
+
+  err = fla_xne_queue_init(qpool->dev, min_depth > qpool->depth
+                           ? fla_xne_queue_depth(min_depth) : qpool->depth, q);
+  FLA_ERR(err, "fla_xne_queue_init()");
+
+  return err;
+}
+
+void
+fla_xne_queue_release(struct fla_xne_queue_pool *qpool, struct fla_xne_queue *q)
+{
+  int ret;
+
+  // A queue with commands still in flight holds their contexts, never pool it
+  ret = xnvme_queue_drain(q->queue);
+  if (FLA_ERR(ret < 0, "xnvme_queue_drain()"))
+  {
+    fla_xne_queue_term(q);
+    return;
+  }
+
+  pthread_mutex_lock(&qpool->lock);
+  if (qpool->nidle < FLA_XNE_QUEUE_POOL_MAX)
+  {
+    qpool->idle[qpool->nidle++] = q;
+    q = NULL;
+  }
+  pthread_mutex_unlock(&qpool->lock);
+
+  if (q)
+    fla_xne_queue_term(q);
+}
+
+/*
+ * Lease a queue from the pool of xne_io or create a private one when the
+ * caller has no pool.
+ */
+static int
+fla_xne_io_queue_get(struct fla_xne_io const *xne_io, uint32_t min_depth,
+                     struct fla_xne_queue **q)
+{
+  if (xne_io->qpool)
+    return fla_xne_queue_lease(xne_io->qpool, min_depth, q);
+
+  return fla_xne_queue_init(xne_io->dev, fla_xne_queue_depth(min_depth), q);
+}
+
+static int
+fla_xne_io_queue_put(struct fla_xne_io const *xne_io, struct fla_xne_queue *q)
+{
+  if (xne_io->qpool)
+  {
+    fla_xne_queue_release(xne_io->qpool, q);
+    return 0;
+  }
+
+  return fla_xne_queue_term(q);
+}
 
 struct fla_async_strp_cb_args_common
 {
   uint32_t nsid;
   void * buf;
   struct fla_strp_params *sp;
+  /// Number of commands that completed with an error
+  uint32_t ecount;
 };
 
-struct fla_async_strp_cb_args
+/// Bookkeeping of one member object of a striped transfer
+struct fla_async_strp_member
 {
-  uint64_t slba;
-  uint16_t nlbs;
-  uint64_t sbuf_nbytes;
-  struct fla_async_cb_args cb_args;
+  /// Number of commands in flight to this member object
+  uint32_t noutstanding;
   struct fla_async_strp_cb_args_common * cmn_args;
 };
 
-
 /*
  * We can represent a zero start address by chunks in the following manner:
  * A = ((N*chunks) + left_over). N being the max number of chunks that can fit in A and
@@ -195,216 +420,198 @@ calc_strp_obj_slba(uint64_t const xfer_snbytes, struct fla_strp_params const * c
          / sp->dev_lba_nbytes;
 }
 
-static uint16_t
-calc_strp_obj_next_nbls(uint64_t sbuf_nbytes,
-                        struct fla_async_strp_cb_args_common const * const cmd_args)
-{
-  uint64_t nbytes_to_xfer = cmd_args->sp->xfer_nbytes - sbuf_nbytes;
-  return (fla_min(cmd_args->sp->strp_chunk_nbytes,
-                  nbytes_to_xfer) / cmd_args->sp->dev_lba_nbytes) - 1;
-}
-
-static uint16_t
-calc_strp_obj_first_nlbs(uint64_t const xfer_snbytes,
-                         struct fla_async_strp_cb_args_common const * const cmn_args)
-{
-  return (fla_min(cmn_args->sp->xfer_nbytes,
-                  cmn_args->sp->strp_chunk_nbytes - (xfer_snbytes % cmn_args->sp->strp_chunk_nbytes))
-          / cmn_args->sp->dev_lba_nbytes) - 1;
-}
-
+/*
+ * Number of bytes from buffer offset sbuf_nbytes to the end of its stripe chunk.
+ * Only the first chunk can start in the middle and only the last one can be cut
+ * short by the end of the transfer.
+ */
 static uint64_t
-calc_strp_obj_next_sbuf_nbytes(uint64_t const curr_sbuf_nbytes, uint32_t const xfered_nbls,
-                               struct fla_async_strp_cb_args_common const * const cmn_args)
+calc_strp_chunk_nbytes(uint64_t const sbuf_nbytes, struct fla_strp_params const * const sp)
 {
-  return curr_sbuf_nbytes
-         // adjust for the already tranfered bytes
-         + ((xfered_nbls + 1) * cmn_args->sp->dev_lba_nbytes)
-
-         // In order to "wrap around" to the next strp_nbytes on the device we need to
-         // have transfered one strp_chunk_nbytes for each of the other non-striped
-         // objects (not counting the current one)
-         + (cmn_args->sp->strp_chunk_nbytes * (cmn_args->sp->strp_nobjs - 1));
+  uint64_t chunk_offset = (sp->xfer_snbytes + sbuf_nbytes) % sp->strp_chunk_nbytes;
+  return fla_min(sp->strp_chunk_nbytes - chunk_offset, sp->xfer_nbytes - sbuf_nbytes);
 }
 
 /*
- * This callback is a little tricky and deserves a little comment. It is designed
- * to only tranfer data within a non-striped object. We can have a maximum of strp_nobjs of
- * these callbacks going on in parallel. Here we advance two pointers: 1. the starting logical
- * block addres (slba) and 2. the transfer buffer offset. Every time we advance the slba by
- * one strp_nbytes we need to move the buffer by strp_nbytes * (strp_nobjs-1) in order to keep
- * with the striping order. We stop when we have moved the buffer offset too far that it
- * goes over the original xfer_nbytes. We also need to make sure that we don't transfer too
- * many lbs and so we can our transfer to the xfer_nbytes.
+ * Chunks are laid out round robin over the member objects, so the member holding
+ * buffer offset sbuf_nbytes follows from the chunk index within the striped object.
  */
+static uint32_t
+calc_strp_chunk_member(uint64_t const sbuf_nbytes, struct fla_strp_params const * const sp)
+{
+  return ((sp->xfer_snbytes + sbuf_nbytes) / sp->strp_chunk_nbytes) % sp->strp_nobjs;
+}
+
 static void
 fla_async_strp_cb(struct xnvme_cmd_ctx * ctx, void * cb_arg)
 {
   int err;
-  struct fla_async_strp_cb_args *cb_args = cb_arg;
-  cb_args->cb_args.completed++;
+  struct fla_async_strp_member *member = cb_arg;
 
   if (xnvme_cmd_ctx_cpl_status(ctx))
   {
     xnvme_cmd_ctx_pr(ctx, XNVME_PR_DEF);
-    cb_args->cb_args.ecount++;
-  }
-
-  cb_args->sbuf_nbytes = calc_strp_obj_next_sbuf_nbytes(cb_args->sbuf_nbytes, cb_args->nlbs,
-                         cb_args->cmn_args);
-
-  if(cb_args->sbuf_nbytes < cb_args->cmn_args->sp->xfer_nbytes)
-  {
-    cb_args->slba += cb_args->nlbs + 1;
-    cb_args->nlbs = calc_strp_obj_next_nbls(cb_args->sbuf_nbytes, cb_args->cmn_args);
-
-    err = cb_args->cmn_args->sp->write
-          ? xnvme_nvm_write(ctx, cb_args->cmn_args->nsid, cb_args->slba, cb_args->nlbs,
-                            cb_args->cmn_args->buf + cb_args->sbuf_nbytes, NULL)
-          : xnvme_nvm_read(ctx, cb_args->cmn_args->nsid, cb_args->slba, cb_args->nlbs,
-                           cb_args->cmn_args->buf + cb_args->sbuf_nbytes, NULL);
-
-    switch (err)
-    {
-    case 0:
-      cb_args->cb_args.submitted +=1;
-      break;
-
-    case -EBUSY:
-    case -EAGAIN:
-    default:
-      FLA_ERR(1, cb_args->cmn_args->sp->write ? "xnvme_nvm_write error" : "xnvme_nvm_read error");
-      goto error;
-    }
+    member->cmn_args->ecount++;
   }
-  else
-  {
+  member->noutstanding--;
 
-error:
-    err = xnvme_queue_put_cmd_ctx(ctx->async.queue, ctx);
-    FLA_ERR_ERRNO(err, "xnvme_queue_put_cmd_ctx");
-  }
+  err = xnvme_queue_put_cmd_ctx(ctx->async.queue, ctx);
+  FLA_ERR_ERRNO(err, "xnvme_queue_put_cmd_ctx");
 }
 
+/*
+ * Chunks are submitted in buffer order, which keeps the commands of every member
+ * object in ascending lba order. Up to strp_depth chunks can be in flight per
+ * member; when the member of the next chunk is at its limit we reap completions
+ * until one of its commands finishes. Zoned members are written at the write
+ * pointer and only get one command in flight for writes.
+ */
 int
 fla_xne_async_strp_seq_xneio(struct fla_xne_io *xne_io)
 {
   int err = 0, ret;
-  struct xnvme_queue * queue = NULL;
-  struct fla_async_strp_cb_args *cb_arg;
+  struct fla_strp_params *sp = xne_io->strp_params;
+  struct fla_xne_queue * q = NULL;
+  struct fla_async_strp_member *members, *member;
   struct xnvme_cmd_ctx *ctx;
-  struct fla_async_strp_cb_args cb_args [512] = {0};
+  uint32_t strp_depth;
+  uint64_t slba, nbytes;
   struct fla_async_strp_cb_args_common cmn_args =
   {
     .nsid = xnvme_dev_get_nsid(xne_io->dev),
     .buf = (char *)xne_io->buf,
-    .sp = xne_io->strp_params,
+    .sp = sp,
   };
 
-  if ((err = FLA_ERR(xne_io->strp_params->xfer_nbytes % xne_io->strp_params->dev_lba_nbytes
-                     || xne_io->strp_params->xfer_snbytes % xne_io->strp_params->dev_lba_nbytes,
+  if ((err = FLA_ERR(sp->xfer_nbytes % sp->dev_lba_nbytes
+                     || sp->xfer_snbytes % sp->dev_lba_nbytes,
                      "Transfer bytes (%"PRIu64") and start offset (%"PRIu64") " \
                      "must be aligned to block size (%"PRIu32")",
-                     xne_io->strp_params->xfer_nbytes, xne_io->strp_params->xfer_snbytes,
-                     xne_io->strp_params->dev_lba_nbytes)))
+                     sp->xfer_nbytes, sp->xfer_snbytes, sp->dev_lba_nbytes)))
     goto exit;
 
-  /*
-   * 2 multiplier comes as a consequence when doing e.g. submission-upon-completion,
-   * the queue is filled up consuming all entries. Then when processing a completion,
-   * then the queue is not decremented until that completion-processing is done.
-   * Thus you need more space in the queue, you then need a double amount size the
-   * queue-size must be a power-of-2.
-   */
-  err = xnvme_queue_init(xne_io->dev, xne_io->strp_params->strp_nobjs * 2, 0, &queue);
-  if (FLA_ERR(err, "xnvme_queue_init"))
+  strp_depth = sp->strp_depth ? sp->strp_depth : 1;
+  if (sp->write && fla_xne_dev_type(xne_io->dev) == XNVME_GEO_ZONED)
+    strp_depth = 1;
+
+  members = calloc(sp->strp_nobjs, sizeof(*members));
+  if((err = FLA_ERR_ERRNO(!members, "calloc()")))
     goto exit;
 
-  uint64_t sbuf_nbytes = 0;
-  for(uint32_t i = 0 ;
-      i < xne_io->strp_params->strp_nobjs && sbuf_nbytes < xne_io->strp_params->xfer_nbytes;
-      ++i)
+  for(uint32_t i = 0 ; i < sp->strp_nobjs; ++i)
+    members[i].cmn_args = &cmn_args;
+
+  err = fla_xne_io_queue_get(xne_io, sp->strp_nobjs * strp_depth, &q);
+  if (FLA_ERR(err, "fla_xne_io_queue_get()"))
+    goto free_members;
+
+  for(uint64_t sbuf_nbytes = 0; sbuf_nbytes < sp->xfer_nbytes; sbuf_nbytes += nbytes)
   {
-    ctx = xnvme_queue_get_cmd_ctx(queue);
-    if((err = FLA_ERR_ERRNO(!ctx, "xnvme_queue_get_cmd_ctx")))
-      goto close_queue;
+    member = &members[calc_strp_chunk_member(sbuf_nbytes, sp)];
+    nbytes = calc_strp_chunk_nbytes(sbuf_nbytes, sp);
+    slba = calc_strp_obj_slba(sbuf_nbytes + sp->xfer_snbytes, sp)
+           + (sp->strp_obj_start_nbytes / sp->dev_lba_nbytes);
+
+    while (member->noutstanding >= strp_depth || !(ctx = xnvme_queue_get_cmd_ctx(q->queue)))
+    {
+      ret = xnvme_queue_poke(q->queue, 0);
+      if((err = FLA_ERR_ERRNO(ret < 0, "xnvme_queue_poke")))
+        goto drain_queue;
+    }
 
     if (xne_io->prep_ctx)
     {
       err = xne_io->prep_ctx(xne_io, ctx);
       if(FLA_ERR(err, "prep_ctx()"))
-        goto close_queue;
+        goto put_ctx;
     }
 
-    uint16_t curr_nlbs = calc_strp_obj_first_nlbs(sbuf_nbytes + xne_io->strp_params->xfer_snbytes,
-                         &cmn_args);
-    cb_arg = &cb_args[i];
-    cb_arg->cmn_args = &cmn_args;
-    cb_arg->nlbs = curr_nlbs;
-    cb_arg->slba = calc_strp_obj_slba(sbuf_nbytes + xne_io->strp_params->xfer_snbytes,
-                                      xne_io->strp_params)
-                   + (xne_io->strp_params->strp_obj_start_nbytes/xne_io->strp_params->dev_lba_nbytes);
-    cb_arg->sbuf_nbytes = sbuf_nbytes;
-
-    xnvme_cmd_ctx_set_cb(ctx, fla_async_strp_cb, cb_arg);
+    xnvme_cmd_ctx_set_cb(ctx, fla_async_strp_cb, member);
 
 submit:
-    err = xne_io->strp_params->write
-          ? xnvme_nvm_write(ctx, cb_arg->cmn_args->nsid, cb_arg->slba, cb_arg->nlbs,
-                            cb_arg->cmn_args->buf + cb_arg->sbuf_nbytes, NULL)
-          : xnvme_nvm_read(ctx, cb_arg->cmn_args->nsid, cb_arg->slba, cb_arg->nlbs,
-                           cb_arg->cmn_args->buf + cb_arg->sbuf_nbytes, NULL);
+    err = sp->write
+          ? xnvme_nvm_write(ctx, cmn_args.nsid, slba, (nbytes / sp->dev_lba_nbytes) - 1,
+                            cmn_args.buf + sbuf_nbytes, NULL)
+          : xnvme_nvm_read(ctx, cmn_args.nsid, slba, (nbytes / sp->dev_lba_nbytes) - 1,
+                           cmn_args.buf + sbuf_nbytes, NULL);
 
     switch (err)
     {
     case 0:
-      cb_arg->cb_args.submitted +=1;
+      member->noutstanding++;
       break;
 
     case -EBUSY:
     case -EAGAIN:
-      ret = xnvme_queue_poke(queue, 0);
+      ret = xnvme_queue_poke(q->queue, 0);
       if((err = FLA_ERR_ERRNO(ret < 0, "xnvme_queue_poke")))
-        goto close_queue;
+        goto put_ctx;
 
       goto submit;
 
     default:
       FLA_ERR(1, "Async submission error\n");
-      goto close_queue;
+      goto put_ctx;
     }
-
-    sbuf_nbytes += (curr_nlbs + 1) * xne_io->strp_params->dev_lba_nbytes;
   }
 
-close_queue:
-  ret = xnvme_queue_drain(queue);
-  if((err = FLA_ERR(ret < 0, "xnvme_queue_drain")))
-    goto exit;
+  goto drain_queue;
 
-  if (queue)
-  {
-    err = xnvme_queue_term(queue);
-    if(FLA_ERR(err, "xnvme_queue_term"))
-      goto exit;
-  }
+put_ctx:
+  ret = xnvme_queue_put_cmd_ctx(q->queue, ctx);
+  FLA_ERR_ERRNO(ret, "xnvme_queue_put_cmd_ctx");
 
-  for(uint32_t i = 0 ; i < xne_io->strp_params->strp_nobjs; ++i)
-  {
-    cb_arg = &cb_args[i];
-    if ((err = FLA_ERR(cb_args->cb_args.ecount, "fla_xne_async_strp_seq_xneio")))
-      goto exit;
-  }
+drain_queue:
+  ret = xnvme_queue_drain(q->queue);
+  if(FLA_ERR(ret < 0, "xnvme_queue_drain") && !err)
+    err = ret;
+
+  ret = fla_xne_io_queue_put(xne_io, q);
+  if(FLA_ERR(ret, "fla_xne_io_queue_put()") && !err)
+    err = ret;
+
+  if (!err)
+    err = FLA_ERR(cmn_args.ecount, "fla_xne_async_strp_seq_xneio");
+
+free_members:
+  free(members);
 
 exit:
   return err;
 }
 
+static int
+fla_xne_pipe_seq_leased(struct fla_xne_io *xne_io, bool write);
+
+/*
+ * Transfers that need more than one MDTS sized command are pipelined through
+ * an asynchronous queue instead of waiting on every command. Zoned writes must
+ * reach the device in order and are left alone.
+ */
+static bool
+fla_xne_seq_pipelined(struct fla_xne_io const *xne_io, bool write)
+{
+#ifdef FLA_XNVME_IGNORE_MDTS
+  return false;
+#else
+  return FLEXALLOC_XNVME_PIPE_WINDOW > 1
+         && xne_io->lba_range->naddrs > fla_xne_calc_mdts_naddrs(xne_io->dev)
+         && !(write && fla_xne_dev_type(xne_io->dev) == XNVME_GEO_ZONED);
+#endif //FLA_XNVME_IGNORE_MDTS
+}
+
 int
 fla_xne_sync_seq_w_xneio(struct fla_xne_io *xne_io)
 {
   int err;
 
+  if (fla_xne_seq_pipelined(xne_io, true))
+  {
+    err = fla_xne_pipe_seq_leased(xne_io, true);
+    FLA_ERR(err, "fla_xne_pipe_seq_leased()");
+    return err;
+  }
+
   struct xnvme_cmd_ctx ctx = xnvme_cmd_ctx_from_dev(xne_io->dev);
   if (xne_io->prep_ctx)
   {
@@ -474,12 +681,356 @@ fla_xne_sync_seq_r_xneio(struct fla_xne_io *xne_io)
 {
   int err;
 
+  if (fla_xne_seq_pipelined(xne_io, false))
+  {
+    // Reads never carried placement information, keep it that way
+    struct fla_xne_io r_xne_io = *xne_io;
+    r_xne_io.prep_ctx = NULL;
+
+    err = fla_xne_pipe_seq_leased(&r_xne_io, false);
+    FLA_ERR(err, "fla_xne_pipe_seq_leased()");
+    return err;
+  }
+
   err = fla_xne_sync_seq_r(xne_io->lba_range, xne_io->dev, xne_io->buf);
   FLA_ERR(err, "fla_xne_sync_seq_w()");
 
   return err;
 }
 
+struct fla_xne_async_xfer
+{
+  struct fla_xne_queue *q;
+  fla_xne_async_cb cb;
+  void *cb_arg;
+  /// Number of commands submitted and not yet completed
+  uint32_t ncmds;
+  /// First error seen in any of the commands
+  int err;
+  /// Set while commands are still being submitted
+  bool submitting;
+};
+
+static void
+fla_xne_async_xfer_end(struct fla_xne_async_xfer *xfer)
+{
+  struct fla_xne_queue *q = xfer->q;
+
+  q->noutstanding--;
+  if (xfer->cb)
+  {
+    q->ncompleted++;
+    xfer->cb(xfer->err, xfer->cb_arg);
+  }
+  free(xfer);
+}
+
+static void
+fla_xne_async_xfer_cb(struct xnvme_cmd_ctx *ctx, void *cb_arg)
+{
+  struct fla_xne_async_xfer *xfer = cb_arg;
+
+  if (xnvme_cmd_ctx_cpl_status(ctx))
+  {
+    xnvme_cmd_ctx_pr(ctx, XNVME_PR_DEF);
+    if (!xfer->err)
+      xfer->err = -EIO;
+  }
+
+  xnvme_queue_put_cmd_ctx(ctx->async.queue, ctx);
+
+  xfer->ncmds--;
+  if (!xfer->ncmds && !xfer->submitting)
+    fla_xne_async_xfer_end(xfer);
+}
+
+static bool
+fla_xne_io_is_write(struct fla_xne_io const *xne_io)
+{
+  return xne_io->io_type == FLA_IO_DATA_WRITE || xne_io->io_type == FLA_IO_MD_WRITE;
+}
+
+/*
+ * Submit a sequential transfer as MDTS sized commands keeping at most window
+ * of them in flight. Completions are reaped here whenever the window or the
+ * queue is full, so the callback can run before this function returns. On
+ * error the commands already submitted are reaped before returning.
+ */
+static int
+fla_xne_async_seq_submit(struct fla_xne_queue *q, struct fla_xne_io *xne_io, bool write,
+                         uint32_t window, fla_xne_async_cb cb, void *cb_arg)
+{
+  int err = 0, ret;
+  uint32_t nsid, nlb, mdts_naddrs;
+  char *buf = xne_io->buf;
+  struct xnvme_lba_range const *lba_range = xne_io->lba_range;
+  struct xnvme_cmd_ctx *ctx;
+  struct fla_xne_async_xfer *xfer;
+
+  xfer = malloc(sizeof(struct fla_xne_async_xfer));
+  if ((err = FLA_ERR_ERRNO(!xfer, "malloc()")))
+    goto exit;
+
+  xfer->q = q;
+  xfer->cb = cb;
+  xfer->cb_arg = cb_arg;
+  xfer->ncmds = 0;
+  xfer->err = 0;
+  xfer->submitting = true;
+  q->noutstanding++;
+
+  // Zone writes must arrive in write pointer order
+  if (write && fla_xne_dev_type(xne_io->dev) == XNVME_GEO_ZONED)
+    window = 1;
+
+  nsid = xnvme_dev_get_nsid(xne_io->dev);
+#ifdef FLA_XNVME_IGNORE_MDTS
+  mdts_naddrs = lba_range->naddrs;
+#else
+  mdts_naddrs = fla_xne_calc_mdts_naddrs(xne_io->dev);
+#endif //FLA_XNVME_IGNORE_MDTS
+
+  for(uint64_t slba = lba_range->slba; slba <= lba_range->elba; slba += nlb + 1)
+  {
+    /* mdts_naddrs -1 because it is not a zero based value */
+    nlb = XNVME_MIN(lba_range->elba - slba, mdts_naddrs - 1);
+
+    // Window or queue is full, make room by reaping completions
+    while (xfer->ncmds >= window || !(ctx = xnvme_queue_get_cmd_ctx(q->queue)))
+    {
+      err = xnvme_queue_poke(q->queue, 0);
+      if (FLA_ERR(err < 0, "xnvme_queue_poke()"))
+        goto abort;
+    }
+
+    if (xne_io->prep_ctx)
+    {
+      err = xne_io->prep_ctx(xne_io, ctx);
+      if (FLA_ERR(err, "prep_ctx()"))
+        goto put_ctx;
+    }
+
+    xnvme_cmd_ctx_set_cb(ctx, fla_xne_async_xfer_cb, xfer);
+
+submit:
+    err = write
+          ? xnvme_nvm_write(ctx, nsid, slba, nlb, buf, NULL)
+          : xnvme_nvm_read(ctx, nsid, slba, nlb, buf, NULL);
+
+    switch (err)
+    {
+    case 0:
+      xfer->ncmds++;
+      break;
+
+    case -EBUSY:
+    case -EAGAIN:
+      err = xnvme_queue_poke(q->queue, 0);
+      if (FLA_ERR(err < 0, "xnvme_queue_poke()"))
+        goto put_ctx;
+
+      goto submit;
+
+    default:
+      FLA_ERR(err, write ? "xnvme_nvm_write()" : "xnvme_nvm_read()");
+      goto put_ctx;
+    }
+
+    buf += (nlb + 1) * xnvme_dev_get_geo(xne_io->dev)->lba_nbytes;
+  }
+
+  xfer->submitting = false;
+  if (!xfer->ncmds)
+    fla_xne_async_xfer_end(xfer);
+
+  return 0;
+
+put_ctx:
+  xnvme_queue_put_cmd_ctx(q->queue, ctx);
+abort:
+  // The caller gets the error and may free buf, so wait out the commands in flight
+  xfer->cb = NULL;
+  while (xfer->ncmds)
+  {
+    ret = xnvme_queue_poke(q->queue, 0);
+    if (FLA_ERR(ret < 0, "xnvme_queue_poke()"))
+      break;
+  }
+  xfer->submitting = false;
+  if (!xfer->ncmds)
+    fla_xne_async_xfer_end(xfer);
+exit:
+  return err;
+}
+
+int
+fla_xne_async_seq_xneio(struct fla_xne_queue *q, struct fla_xne_io *xne_io,
+                        fla_xne_async_cb cb, void *cb_arg)
+{
+  return fla_xne_async_seq_submit(q, xne_io, fla_xne_io_is_write(xne_io), q->depth, cb, cb_arg);
+}
+
+struct fla_xne_pipe_status
+{
+  /// First error reported by any of the transfers
+  int err;
+  /// Number of submitted transfers that have not called back
+  uint32_t npending;
+};
+
+static void
+fla_xne_pipe_cb(int err, void *cb_arg)
+{
+  struct fla_xne_pipe_status *status = cb_arg;
+  if (!status->err)
+    status->err = err;
+  status->npending--;
+}
+
+/*
+ * Reap completions until every transfer accounted in status has called back.
+ * status usually lives on the caller's stack, so on error the queue is drained
+ * before returning.
+ */
+static int
+fla_xne_pipe_wait(struct fla_xne_queue *q, struct fla_xne_pipe_status *status)
+{
+  int err;
+
+  while (status->npending)
+  {
+    err = xnvme_queue_poke(q->queue, 0);
+    if (FLA_ERR(err < 0, "xnvme_queue_poke()"))
+    {
+      xnvme_queue_drain(q->queue);
+      return err;
+    }
+  }
+
+  return 0;
+}
+
+static int
+fla_xne_pipe_seq(struct fla_xne_queue *q, struct fla_xne_io *xne_io, bool write,
+                 uint32_t window)
+{
+  int err;
+  struct fla_xne_pipe_status status = {.err = 0, .npending = 1};
+
+  err = fla_xne_async_seq_submit(q, xne_io, write, window, fla_xne_pipe_cb, &status);
+  if (FLA_ERR(err, "fla_xne_async_seq_submit()"))
+    return err;
+
+  err = fla_xne_pipe_wait(q, &status);
+  if (FLA_ERR(err, "fla_xne_pipe_wait()"))
+    return err;
+
+  return status.err;
+}
+
+int
+fla_xne_pipe_seq_xneio(struct fla_xne_queue *q, struct fla_xne_io *xne_io, uint32_t window)
+{
+  return fla_xne_pipe_seq(q, xne_io, fla_xne_io_is_write(xne_io), fla_min(window, q->depth));
+}
+
+static int
+fla_xne_pipe_seq_leased(struct fla_xne_io *xne_io, bool write)
+{
+  int err, ret;
+  struct fla_xne_queue *q;
+
+  err = fla_xne_io_queue_get(xne_io, FLEXALLOC_XNVME_PIPE_WINDOW, &q);
+  if (FLA_ERR(err, "fla_xne_io_queue_get()"))
+    return err;
+
+  err = fla_xne_pipe_seq(q, xne_io, write, FLEXALLOC_XNVME_PIPE_WINDOW);
+  FLA_ERR(err, "fla_xne_pipe_seq()");
+
+  ret = fla_xne_io_queue_put(xne_io, q);
+  if (FLA_ERR(ret, "fla_xne_io_queue_put()") && !err)
+    err = ret;
+
+  return err;
+}
+
+int
+fla_xne_sync_seqv_xneio(struct fla_xne_io *xne_io, struct iovec const *iov, int iovcnt)
+{
+  int err, ret;
+  bool write = fla_xne_io_is_write(xne_io);
+  uint32_t lba_nbytes = xnvme_dev_get_geo(xne_io->dev)->lba_nbytes;
+  uint64_t slba = xne_io->lba_range->slba;
+  struct fla_xne_queue *q;
+  struct fla_xne_pipe_status status = {0};
+  struct xnvme_lba_range lba_range;
+  struct fla_xne_io iov_io = *xne_io;
+
+  for (int i = 0; i < iovcnt; ++i)
+  {
+    if ((err = FLA_ERR(iov[i].iov_len % lba_nbytes,
+                       "iovec %d length (%zu) must be aligned to block size (%"PRIu32")",
+                       i, iov[i].iov_len, lba_nbytes)))
+      return err;
+    slba += iov[i].iov_len / lba_nbytes;
+  }
+
+  if ((err = FLA_ERR(slba != xne_io->lba_range->elba + 1,
+                     "iovec lengths do not add up to the lba range")))
+    return err;
+
+  err = fla_xne_io_queue_get(xne_io, FLEXALLOC_XNVME_PIPE_WINDOW, &q);
+  if (FLA_ERR(err, "fla_xne_io_queue_get()"))
+    return err;
+
+  // Zero length elements never call back, account the others as they go out
+  iov_io.lba_range = &lba_range;
+  slba = xne_io->lba_range->slba;
+  for (int i = 0; i < iovcnt; slba += iov[i].iov_len / lba_nbytes, ++i)
+  {
+    if (!iov[i].iov_len)
+      continue;
+
+    // Zone writes must arrive in write pointer order, one element at a time
+    if (write && fla_xne_dev_type(xne_io->dev) == XNVME_GEO_ZONED)
+    {
+      err = fla_xne_pipe_wait(q, &status);
+      if (FLA_ERR(err, "fla_xne_pipe_wait()"))
+        goto put_queue;
+    }
+
+    lba_range = fla_xne_lba_range_from_slba_naddrs(xne_io->dev, slba,
+                iov[i].iov_len / lba_nbytes);
+    if ((err = FLA_ERR(lba_range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
+      goto wait;
+
+    iov_io.buf = iov[i].iov_base;
+    status.npending++;
+    err = fla_xne_async_seq_submit(q, &iov_io, write, FLEXALLOC_XNVME_PIPE_WINDOW,
+                                   fla_xne_pipe_cb, &status);
+    if (FLA_ERR(err, "fla_xne_async_seq_submit()"))
+    {
+      status.npending--;
+      goto wait;
+    }
+  }
+
+wait:
+  ret = fla_xne_pipe_wait(q, &status);
+  if (FLA_ERR(ret, "fla_xne_pipe_wait()") && !err)
+    err = ret;
+
+  if (!err)
+    err = status.err;
+
+put_queue:
+  ret = fla_xne_io_queue_put(xne_io, q);
+  if (FLA_ERR(ret, "fla_xne_io_queue_put()") && !err)
+    err = ret;
+
+  return err;
+}
+
 void *
 fla_xne_alloc_buf(const struct xnvme_dev *dev, size_t nbytes)
 {
@@ -564,6 +1115,33 @@ fla_xne_dev_open(const char *dev_uri, struct xnvme_opts *opts, struct xnvme_dev
   return err;
 }
 
+int
+fla_xne_dev_open_profile(const char *dev_uri, struct xnvme_opts const *opts,
+                         struct fla_io_profile const *profile, struct xnvme_dev **dev)
+{
+  struct xnvme_opts xopts;
+
+  if (opts)
+    xopts = *opts;
+  else
+  {
+    xopts = xnvme_opts_default();
+    xopts.direct = 1;
+  }
+
+  if (profile)
+  {
+    if (profile->backend)
+      xopts.async = profile->backend;
+    xopts.poll_io = profile->poll_io;
+    xopts.poll_sq = profile->poll_sq;
+    if (profile->pin_cpu)
+      xopts.main_core = profile->cpu;
+  }
+
+  return fla_xne_dev_open(dev_uri, &xopts, dev);
+}
+
 void
 fla_xne_dev_close(struct xnvme_dev *dev)
 {
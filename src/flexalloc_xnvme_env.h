@@ -7,10 +7,14 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <sys/uio.h>
 #include <libxnvme.h>
 #include <libxnvme_lba.h>
 #include <libxnvme_nvm.h>
 
+struct fla_io_profile;
+
 struct fla_strp_params
 {
   /// Num of objects to stripe across
@@ -19,6 +23,9 @@ struct fla_strp_params
   /// Number of bytes of each stripe chunk
   uint32_t strp_chunk_nbytes;
 
+  /// Max number of chunks in flight to each member object, zero is taken as 1
+  uint32_t strp_depth;
+
   /// Number of lbs in a non-striped object
   uint64_t faobj_nlbs;
 
@@ -62,10 +69,64 @@ struct fla_xne_io
   };
   struct fla_pool const * pool_handle;
   struct fla_object const * obj_handle;
+  /// Queues to lease from for asynchronous transfers, NULL creates one per call
+  struct fla_xne_queue_pool * qpool;
 
   int (*prep_ctx)(struct fla_xne_io *xne_io, struct xnvme_cmd_ctx *ctx);
 };
 
+/// Default number of commands an asynchronous queue can hold, must be a power of 2
+#define FLA_XNE_QUEUE_DEPTH 64
+
+/// Max number of MDTS sized commands in flight for one synchronous transfer
+#ifndef FLEXALLOC_XNVME_PIPE_WINDOW
+#define FLEXALLOC_XNVME_PIPE_WINDOW 16
+#endif
+
+/// Default number of stripe chunks in flight to each member object of a striped transfer
+#ifndef FLEXALLOC_XNVME_STRP_DEPTH
+#define FLEXALLOC_XNVME_STRP_DEPTH 4
+#endif
+
+/**
+ * @brief Completion callback of an asynchronous transfer
+ *
+ * @param err Zero on success, non-zero if any command of the transfer failed
+ * @param cb_arg Argument given when the transfer was submitted
+ */
+typedef void (*fla_xne_async_cb)(int err, void *cb_arg);
+
+/// Long lived asynchronous queue
+struct fla_xne_queue
+{
+  /// xnvme queue commands are submitted to
+  struct xnvme_queue *queue;
+  /// Number of commands the queue can hold
+  uint32_t depth;
+  /// Number of transfers submitted and not yet completed
+  uint32_t noutstanding;
+  /// Number of transfers completed since the queue was created
+  uint64_t ncompleted;
+};
+
+/// Max number of idle queues kept by a queue pool
+#define FLA_XNE_QUEUE_POOL_MAX 16
+
+/// Asynchronous queues kept open for the lifetime of a flexalloc handle
+struct fla_xne_queue_pool
+{
+  /// xnvme device the queues submit to
+  struct xnvme_dev *dev;
+  /// Protects idle and nidle
+  pthread_mutex_t lock;
+  /// Queues ready to be leased
+  struct fla_xne_queue *idle[FLA_XNE_QUEUE_POOL_MAX];
+  /// Number of entries in idle
+  uint32_t nidle;
+  /// Smallest depth of the queues created by the pool
+  uint32_t depth;
+};
+
 struct xnvme_lba_range
 fla_xne_lba_range_from_offset_nbytes(struct xnvme_dev *dev, uint64_t offset, uint64_t nbytes);
 
@@ -81,7 +142,9 @@ fla_xne_sync_seq_w_xneio(struct fla_xne_io *xne_io);
 /**
  * @brief asynchronous stripped sequential write
  *
- * @param xne_io contains dev, slba, naddrs and buf
+ * Keeps up to strp_params->strp_depth chunks in flight to each member object.
+ *
+ * @param xne_io contains dev, strp_params and buf
  * @return Zero on success. non-zero on error.
  */
 int
@@ -96,6 +159,148 @@ fla_xne_async_strp_seq_xneio(struct fla_xne_io *xne_io);
 int
 fla_xne_sync_seq_r_xneio(struct fla_xne_io *xne_io);
 
+/**
+ * @brief Create an asynchronous queue
+ *
+ * @param dev xnvme device the queue submits to
+ * @param depth Number of commands the queue can hold, must be a power of 2
+ * @param q Allocated queue on success
+ *
+ * The queue polls for completions and submissions when the device was
+ * opened with poll_io and poll_sq respectively.
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_xne_queue_init(struct xnvme_dev *dev, uint32_t depth, struct fla_xne_queue **q);
+
+/**
+ * @brief Wait for all outstanding transfers and free the queue
+ *
+ * @param q queue to terminate, NULL is ignored
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_xne_queue_term(struct fla_xne_queue *q);
+
+/**
+ * @brief Create a queue pool holding one ready queue
+ *
+ * @param dev xnvme device the queues submit to
+ * @param depth Smallest depth of the queues in the pool, rounded up to a power of 2
+ * @param qpool Allocated pool on success
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_xne_queue_pool_init(struct xnvme_dev *dev, uint32_t depth,
+                        struct fla_xne_queue_pool **qpool);
+
+/**
+ * @brief Terminate all idle queues and free the pool
+ *
+ * All leased queues must have been released.
+ *
+ * @param qpool pool to free, NULL is ignored
+ */
+void
+fla_xne_queue_pool_term(struct fla_xne_queue_pool *qpool);
+
+/**
+ * @brief Lease a queue for exclusive use
+ *
+ * An idle queue holding at least min_depth commands is reused, otherwise a new
+ * one is created.
+ *
+ * @param qpool pool to lease from
+ * @param min_depth Min number of commands the queue must hold
+ * @param q Leased queue on success
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_xne_queue_lease(struct fla_xne_queue_pool *qpool, uint32_t min_depth,
+                    struct fla_xne_queue **q);
+
+/**
+ * @brief Return a leased queue to the pool
+ *
+ * Outstanding transfers on the queue are drained first. The queue is
+ * terminated if draining fails or if the pool already holds
+ * FLA_XNE_QUEUE_POOL_MAX idle queues.
+ *
+ * @param qpool pool the queue was leased from
+ * @param q queue to release
+ */
+void
+fla_xne_queue_release(struct fla_xne_queue_pool *qpool, struct fla_xne_queue *q);
+
+/**
+ * @brief Reap completions from the queue
+ *
+ * Completion callbacks of finished transfers are called from within this function.
+ *
+ * @param q queue to reap completions from
+ * @param max Max number of commands to reap, zero reaps all that are available
+ * @return Number of transfers completed. negative errno on error.
+ */
+int
+fla_xne_queue_poke(struct fla_xne_queue *q, uint32_t max);
+
+/**
+ * @brief Reap completions until no transfers are outstanding
+ *
+ * @param q queue to drain
+ * @return Number of transfers completed. negative errno on error.
+ */
+int
+fla_xne_queue_drain(struct fla_xne_queue *q);
+
+/**
+ * @brief Asynchronous sequential read or write
+ *
+ * The transfer is split in MDTS sized commands and xne_io->prep_ctx is called
+ * for each of them before submission. cb is called once, when all commands
+ * have completed. The direction is taken from xne_io->io_type.
+ *
+ * @param q queue to submit to
+ * @param xne_io contains dev, lba_range and buf. Not referenced after return.
+ * @param cb Completion callback
+ * @param cb_arg Argument passed to cb
+ * @return Zero on success. non-zero on error, in which case cb is never called.
+ */
+int
+fla_xne_async_seq_xneio(struct fla_xne_queue *q, struct fla_xne_io *xne_io,
+                        fla_xne_async_cb cb, void *cb_arg);
+
+/**
+ * @brief Pipelined sequential read or write
+ *
+ * Sends the MDTS sized commands of one transfer through q keeping at most
+ * window of them in flight and waits for all of them. The direction is taken
+ * from xne_io->io_type.
+ *
+ * @param q queue to submit to
+ * @param xne_io contains dev, lba_range and buf
+ * @param window Max number of commands in flight, capped at the queue depth
+ * @return Zero if every command succeeded. non-zero on error.
+ */
+int
+fla_xne_pipe_seq_xneio(struct fla_xne_queue *q, struct fla_xne_io *xne_io, uint32_t window);
+
+/**
+ * @brief Pipelined sequential read or write of a scatter gather list
+ *
+ * The lba range of xne_io is transferred to or from the iovec elements in
+ * order, each element going out as its own MDTS sized commands on a single
+ * queue. The direction is taken from xne_io->io_type and xne_io->buf is
+ * ignored.
+ *
+ * @param xne_io contains dev and lba_range
+ * @param iov Buffers allocated with fla_xne_alloc_buf, lengths aligned to the block size
+ * @param iovcnt Number of elements in iov
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_xne_sync_seqv_xneio(struct fla_xne_io *xne_io, struct iovec const *iov, int iovcnt);
+
 /**
  * @brief Allocate a buffer with xnvme allocate
  *
@@ -145,6 +350,22 @@ fla_xne_dev_mdts_nbytes(const struct xnvme_dev *dev);
 int
 fla_xne_dev_open(const char *dev_uri, struct xnvme_opts *opts, struct xnvme_dev **dev);
 
+/**
+ * @brief Open a device driven according to an I/O engine profile
+ *
+ * The profile is applied on top of the open options. Queues created on the
+ * device afterwards pick up its completion polling and SQPOLL settings.
+ *
+ * @param dev_uri Device to open
+ * @param opts xnvme open options, NULL uses the defaults with direct I/O
+ * @param profile I/O engine profile, NULL opens with opts unchanged
+ * @param dev Opened device on success
+ * @return Zero on success. non-zero on error.
+ */
+int
+fla_xne_dev_open_profile(const char *dev_uri, struct xnvme_opts const *opts,
+                         struct fla_io_profile const *profile, struct xnvme_dev **dev);
+
 void
 fla_xne_dev_close(struct xnvme_dev *dev);
 
@@ -3,6 +3,7 @@
 
 #include "libflexalloc.h"
 #include "flexalloc_xnvme_env.h"
+#include "flexalloc_bufpool.h"
 #include "flexalloc.h"
 
 int
@@ -62,16 +63,36 @@ fla_object_destroy(struct flexalloc *fs, struct fla_pool * pool,
   return fs->fns.object_destroy(fs, pool, object);
 }
 
+int
+fla_object_create_n(struct flexalloc * fs, struct fla_pool * pool,
+                    struct fla_object * objects, uint32_t nobjects)
+{
+  return fs->fns.object_create_n(fs, pool, objects, nobjects);
+}
+
+int
+fla_object_destroy_n(struct flexalloc * fs, struct fla_pool * pool,
+                     struct fla_object * objects, uint32_t nobjects)
+{
+  return fs->fns.object_destroy_n(fs, pool, objects, nobjects);
+}
+
 void *
 fla_buf_alloc(struct flexalloc const *fs, size_t nbytes)
 {
+  if (fs->bufpool)
+    return fla_bufpool_alloc(fs->bufpool, nbytes);
+
   return fla_xne_alloc_buf(fs->dev.dev, nbytes);
 }
 
 void
 fla_buf_free(struct flexalloc const * fs, void *buf)
 {
-  fla_xne_free_buf(fs->dev.dev, buf);
+  if (fs->bufpool)
+    fla_bufpool_free(fs->bufpool, buf);
+  else
+    fla_xne_free_buf(fs->dev.dev, buf);
 }
 
 int
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 #include "flexalloc_shared.h"
 
 #ifdef __cplusplus
@@ -164,6 +165,40 @@ int
 fla_object_destroy(struct flexalloc *fs, struct fla_pool * pool,
                    struct fla_object * object);
 
+/**
+ * @brief Create several objects in one go
+ *
+ * Takes the objects from one slab at a time, moving each slab between the
+ * pool slab lists once instead of once per object. Either all objects are
+ * created or none are.
+ *
+ * @param fs flexalloc system handle
+ * @param pool Pool that will contain the objects
+ * @param objects Array of nobjects object handles to initialize
+ * @param nobjects Number of objects to create
+ * @return 0 on success. non zero otherwise
+ */
+int
+fla_object_create_n(struct flexalloc * fs, struct fla_pool * pool,
+                    struct fla_object * objects, uint32_t nobjects);
+
+/**
+ * @brief Destroy several objects in one go
+ *
+ * Consecutive objects of the same slab are returned to it together, as
+ * fla_object_create_n() hands them out. All objects are destroyed even if
+ * one of them fails.
+ *
+ * @param fs flexalloc system handle
+ * @param pool Pool containing the objects
+ * @param objects Array of nobjects objects to destroy
+ * @param nobjects Number of objects to destroy
+ * @return Zero on success. non zero if any object could not be destroyed
+ */
+int
+fla_object_destroy_n(struct flexalloc * fs, struct fla_pool * pool,
+                     struct fla_object * objects, uint32_t nobjects);
+
 /**
  * @brief Seal a flexalloc object
  *
@@ -246,6 +281,181 @@ fla_object_unaligned_write(struct flexalloc * fs,
                            struct fla_object const * object, void const * buf, size_t offset,
                            size_t len);
 
+/**
+ * @brief Same as fla_object_read but offset and len can be unaligned values
+ *
+ * The block aligned middle of the range is read directly into buf. Partial
+ * head and tail blocks are read into a bounce buffer in the same batch and
+ * copied from there.
+ *
+ * @param fs flexalloc system handle
+ * @param pool Handle to the pool containing the obj
+ * @param object Read from this object
+ * @param buf Read into this buffer, allocated with fla_buf_alloc
+ * @param offset Number of bytes from beginning of object
+ * @param len Number of bytes to read
+ * @return Zero on success. non zero otherwise
+ */
+int
+fla_object_unaligned_read(struct flexalloc * fs,
+                          struct fla_pool const * pool,
+                          struct fla_object const * object, void * buf, size_t offset,
+                          size_t len);
+
+/**
+ * @brief Read into the buffers of a scatter gather list
+ *
+ * Same constraints as fla_object_read. The object is read from offset into
+ * the iovec elements in order, for a total of the sum of their lengths.
+ *
+ * @param fs flexalloc system handle
+ * @param pool Handle to the pool containing the obj
+ * @param object Read from this object
+ * @param iov Buffers allocated with fla_buf_alloc, each length a multiple of the block size
+ * @param iovcnt Number of elements in iov
+ * @param offset Number of bytes from beginning of object where the read begins.
+ * @return Zero on success. non zero otherwise
+ */
+int
+fla_object_readv(struct flexalloc const * fs, struct fla_pool const * pool,
+                 struct fla_object const * object, struct iovec const * iov, int iovcnt,
+                 size_t offset);
+
+/**
+ * @brief Write the buffers of a scatter gather list
+ *
+ * Same constraints as fla_object_write. The iovec elements are written in
+ * order starting at offset, without first copying them into one buffer.
+ *
+ * @param fs flexalloc system handle
+ * @param pool Handle to the pool containing the obj
+ * @param object Write to this object
+ * @param iov Buffers allocated with fla_buf_alloc, each length a multiple of the block size
+ * @param iovcnt Number of elements in iov
+ * @param offset Number of bytes from the beginning of the object where the write begins
+ * @return Zero on success. non zero otherwise
+ */
+int
+fla_object_writev(struct flexalloc * fs, struct fla_pool const * pool,
+                  struct fla_object const * object, struct iovec const * iov, int iovcnt,
+                  size_t offset);
+
+/**
+ * @brief Completion callback of an asynchronous object read or write
+ *
+ * @param err Zero if the transfer succeeded, non zero otherwise
+ * @param cb_arg Argument given when the transfer was submitted
+ */
+typedef void (*fla_object_io_cb)(int err, void *cb_arg);
+
+/**
+ * @brief Submit a read of len bytes into buf without waiting for it
+ *
+ * Same constraints as fla_object_read. The transfer is queued on a queue
+ * owned by fs and cb is called once all of it has completed. Completions
+ * are reaped with fla_object_io_poll or fla_object_io_drain. buf must stay
+ * valid until cb is called.
+ *
+ * @param fs flexalloc system handle
+ * @param pool Handle to the pool containing the obj
+ * @param object Read from this object
+ * @param buf Read into this buffer
+ * @param offset Number of bytes from beginning of object where the read begins.
+ * @param len Number of bytes to read
+ * @param cb Completion callback
+ * @param cb_arg Argument passed to cb
+ * @return Zero on success. non zero otherwise, in which case cb is never called
+ */
+int
+fla_object_read_async(struct flexalloc * fs, struct fla_pool const * pool,
+                      struct fla_object const * object, void * buf, size_t offset, size_t len,
+                      fla_object_io_cb cb, void *cb_arg);
+
+/**
+ * @brief Submit a write of len bytes from buf without waiting for it
+ *
+ * Same constraints as fla_object_write. See fla_object_read_async for how
+ * completions are delivered.
+ *
+ * @param fs flexalloc system handle
+ * @param pool Handle to the pool containing the obj
+ * @param object Write to this object
+ * @param buf Write from this buffer
+ * @param offset Number of bytes from the beginning of the object where the write begins
+ * @param len Number of bytes to write
+ * @param cb Completion callback
+ * @param cb_arg Argument passed to cb
+ * @return Zero on success. non zero otherwise, in which case cb is never called
+ */
+int
+fla_object_write_async(struct flexalloc * fs, struct fla_pool const * pool,
+                       struct fla_object const * object, void const * buf, size_t offset,
+                       size_t len, fla_object_io_cb cb, void *cb_arg);
+
+/// Direction of a batched object transfer
+enum fla_object_io_dir
+{
+  FLA_OBJECT_IO_READ = 0,
+  FLA_OBJECT_IO_WRITE,
+};
+
+/// One transfer of a batch submitted with fla_object_io_batch
+struct fla_object_io_desc
+{
+  /// Handle to the pool containing object
+  struct fla_pool const * pool;
+  /// Read from or write to this object
+  struct fla_object const * object;
+  /// Number of bytes from the beginning of the object where the transfer begins
+  size_t offset;
+  /// Number of bytes to transfer
+  size_t len;
+  /// Buffer allocated with fla_buf_alloc
+  void * buf;
+  enum fla_object_io_dir dir;
+  /// Set by fla_object_io_batch, zero if this transfer succeeded
+  int status;
+};
+
+/**
+ * @brief Read and write many objects at once
+ *
+ * Each descriptor has the same constraints as fla_object_read and
+ * fla_object_write. The descriptors are sent in device order through one
+ * asynchronous queue. Descriptors that continue each other both on the device
+ * and in memory, within the same slab, are merged into one transfer. Returns
+ * once every transfer has completed. Descriptors are not ordered against each
+ * other, so a batch must not read and write the same blocks.
+ *
+ * @param fs flexalloc system handle
+ * @param descs Transfers to do, status of each is set on return
+ * @param ndescs Number of elements in descs
+ * @return Zero if every transfer succeeded. The first non zero status otherwise
+ */
+int
+fla_object_io_batch(struct flexalloc * fs, struct fla_object_io_desc * descs, uint32_t ndescs);
+
+/**
+ * @brief Reap completed asynchronous object transfers
+ *
+ * Callbacks of the completed transfers are called before returning.
+ *
+ * @param fs flexalloc system handle
+ * @param max Max number of device commands to reap, zero reaps all available
+ * @return Number of transfers completed, negative value on error
+ */
+int
+fla_object_io_poll(struct flexalloc * fs, uint32_t max);
+
+/**
+ * @brief Wait for all submitted asynchronous object transfers
+ *
+ * @param fs flexalloc system handle
+ * @return Number of transfers completed, negative value on error
+ */
+int
+fla_object_io_drain(struct flexalloc * fs);
+
 /**
  * @brief Associate object with pool
  *
@@ -282,6 +492,81 @@ fla_pool_get_root_object(struct flexalloc const * const fs,
 uint32_t
 fla_pool_obj_nlb(struct flexalloc const *const fs, struct fla_pool const *pool_handle);
 
+/**
+ * @brief Return the slab and object counts of the pool
+ *
+ * The counts are maintained incrementally, this does not visit the slabs.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_handle flexalloc pool handle
+ * @param usage set to the utilization of the pool on success
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_pool_usage(struct flexalloc const *const fs, struct fla_pool const *pool_handle,
+               struct fla_pool_usage *usage);
+
+/**
+ * @brief Return the fragmentation of the pool
+ *
+ * The counts are maintained with the occupancy bins of the pool, this does
+ * not visit the slabs.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_handle flexalloc pool handle
+ * @param frag set to the fragmentation of the pool on success
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_pool_frag(struct flexalloc const *const fs, struct fla_pool const *pool_handle,
+              struct fla_pool_frag *frag);
+
+/**
+ * @brief Set the empty slab watermarks of the pool
+ *
+ * A pool holding more than `high` empty slabs after objects were destroyed
+ * returns empty slabs to the device until `low` are left, making the space
+ * available to the other pools. The pool is trimmed right away if it holds
+ * more than `high` empty slabs already. Watermarks are not persisted, pools
+ * start out with a low watermark of 1 and a high watermark of 4.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_handle flexalloc pool handle
+ * @param low number of empty slabs kept when trimming
+ * @param high number of empty slabs above which the pool is trimmed, UINT32_MAX never trims
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_pool_set_wmark(struct flexalloc *fs, struct fla_pool const *pool_handle,
+                   uint32_t low, uint32_t high);
+
+/**
+ * @brief Return the empty slabs of the pool to the device
+ *
+ * Releases empty slabs of the pool until at most `nkeep` are left, whatever
+ * its watermarks. The objects of the pool are left alone.
+ *
+ * @param fs flexalloc system handle
+ * @param pool_handle flexalloc pool handle
+ * @param nkeep number of empty slabs to keep in the pool
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_pool_trim(struct flexalloc *fs, struct fla_pool const *pool_handle, uint32_t nkeep);
+
+/**
+ * @brief Return the utilization of the device
+ *
+ * Sums the maintained counts of the pools, the cost is linear in the number
+ * of pools rather than in the number of objects.
+ *
+ * @param fs flexalloc system handle
+ * @param usage set to the utilization of the device on success
+ * @return Zero on success, non zero otherwise
+ */
+int
+fla_usage(struct flexalloc const *const fs, struct fla_usage *usage);
+
 #ifdef __cplusplus
 }
 #endif
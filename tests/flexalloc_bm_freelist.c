@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <libxnvme.h>
+#include "flexalloc_bits.h"
+#include "flexalloc_freelist.h"
+#include "flexalloc_freelist_kern.h"
+#include "flexalloc_util.h"
+
+/*
+ * Compares the freelist kernels against the 32-bit word loops the freelist
+ * used before, on a list of 1M entries:
+ * - counting free entries, as done when a freelist is loaded
+ * - finding the first word with a free entry in a full list
+ * - allocating and freeing one entry in a 90% full list
+ */
+
+#define BM_FLIST_LEN (1u << 20)
+#define BM_NITER_COUNT 200
+#define BM_NITER_ALLOC 2000
+
+static char const * const bm_isa_names[] =
+{
+  [FLA_FLIST_KERN_SCALAR] = "scalar",
+  [FLA_FLIST_KERN_AVX2] = "avx2",
+  [FLA_FLIST_KERN_AVX512] = "avx512",
+};
+
+static uint32_t
+legacy_num_reserved(uint32_t const *flist)
+{
+  uint32_t const *ptr = flist + 1;
+  uint32_t const *end = ptr + FLA_FREELIST_U32_ELEMS(*flist);
+  uint32_t free_entries = 0;
+
+  for (; ptr != end; ptr++)
+    free_entries += count_set_bits(*ptr);
+
+  return *flist - free_entries;
+}
+
+static uint32_t
+legacy_find(uint32_t const *flist)
+{
+  uint32_t elems = FLA_FREELIST_U32_ELEMS(*flist);
+
+  for (uint32_t i = 0; i < elems; i++)
+  {
+    if (flist[1 + i] != 0)
+      return i;
+  }
+  return elems;
+}
+
+static int
+legacy_entry_alloc(uint32_t *flist)
+{
+  uint32_t elems = FLA_FREELIST_U32_ELEMS(*flist);
+  uint32_t *elem, wndx;
+
+  for (uint32_t i = 0; i < elems; i++)
+  {
+    elem = &flist[1 + i];
+    if (*elem == 0)
+      continue;
+
+    wndx = *elem & (- *elem);
+    *elem &= ~wndx;
+    return i * sizeof(uint32_t) * 8 + ntz(wndx);
+  }
+  return -1;
+}
+
+static void
+legacy_entry_free(uint32_t *flist, uint32_t ndx)
+{
+  flist[1 + ndx / 32] |= 1u << (ndx % 32);
+}
+
+static double
+bm_usecs(struct xnvme_timer *timer, uint32_t niter)
+{
+  return xnvme_timer_elapsed_secs(timer) * 1000000 / niter;
+}
+
+int
+main(int argc, char ** argv)
+{
+  int err, ret;
+  uint32_t nwords = FLA_FREELIST_U32_ELEMS(BM_FLIST_LEN), nreserved = 0;
+  uint32_t *words;
+  uint64_t sink = 0;
+  freelist_t flist;
+  struct xnvme_timer timer;
+
+  err = fla_flist_new(BM_FLIST_LEN, &flist);
+  if (FLA_ERR(err, "fla_flist_new()"))
+    goto exit;
+  words = fla_flist_data(flist);
+
+  fprintf(stdout, "freelist of %"PRIu32" entries\n", BM_FLIST_LEN);
+
+  // every entry reserved
+  for (uint32_t i = 0; i < BM_FLIST_LEN; i++)
+    fla_flist_entries_alloc(flist, 1);
+
+  xnvme_timer_start(&timer);
+  for (int i = 0; i < BM_NITER_COUNT; ++i)
+    sink += legacy_num_reserved(words);
+  xnvme_timer_stop(&timer);
+  fprintf(stdout, "popcount     %-8s : %10.2f usec\n", "legacy",
+          bm_usecs(&timer, BM_NITER_COUNT));
+
+  xnvme_timer_start(&timer);
+  for (int i = 0; i < BM_NITER_COUNT; ++i)
+    sink += legacy_find(words);
+  xnvme_timer_stop(&timer);
+  fprintf(stdout, "find         %-8s : %10.2f usec\n", "legacy",
+          bm_usecs(&timer, BM_NITER_COUNT));
+
+  for (int isa = FLA_FLIST_KERN_SCALAR; isa <= FLA_FLIST_KERN_AVX512; isa++)
+  {
+    if (fla_flist_kern_select(isa))
+    {
+      fprintf(stdout, "%-8s not supported\n", bm_isa_names[isa]);
+      continue;
+    }
+
+    xnvme_timer_start(&timer);
+    for (int i = 0; i < BM_NITER_COUNT; ++i)
+      sink += fla_flist_kern_popcount(words + 1, nwords);
+    xnvme_timer_stop(&timer);
+    fprintf(stdout, "popcount     %-8s : %10.2f usec\n", bm_isa_names[isa],
+            bm_usecs(&timer, BM_NITER_COUNT));
+
+    xnvme_timer_start(&timer);
+    for (int i = 0; i < BM_NITER_COUNT; ++i)
+      sink += fla_flist_kern_find(words + 1, 0, nwords, 0);
+    xnvme_timer_stop(&timer);
+    fprintf(stdout, "find         %-8s : %10.2f usec\n", bm_isa_names[isa],
+            bm_usecs(&timer, BM_NITER_COUNT));
+  }
+
+  // free the last 10% of the list
+  for (uint32_t i = BM_FLIST_LEN - BM_FLIST_LEN / 10; i < BM_FLIST_LEN; i++)
+    fla_flist_entry_free(flist, i);
+
+  nreserved = fla_flist_num_reserved(flist);
+
+  xnvme_timer_start(&timer);
+  for (int i = 0; i < BM_NITER_ALLOC; ++i)
+  {
+    ret = legacy_entry_alloc(words);
+    legacy_entry_free(words, ret);
+  }
+  xnvme_timer_stop(&timer);
+  fprintf(stdout, "alloc/free   %-8s : %10.2f usec\n", "legacy",
+          bm_usecs(&timer, BM_NITER_ALLOC));
+
+  xnvme_timer_start(&timer);
+  for (int i = 0; i < BM_NITER_ALLOC; ++i)
+  {
+    ret = fla_flist_entries_alloc(flist, 1);
+    fla_flist_entry_free(flist, ret);
+  }
+  xnvme_timer_stop(&timer);
+  fprintf(stdout, "alloc/free   %-8s : %10.2f usec\n", "summary",
+          bm_usecs(&timer, BM_NITER_ALLOC));
+
+  err = FLA_ERR(fla_flist_num_reserved(flist) != nreserved, "freelist changed by alloc/free");
+
+  // keep the compiler from discarding the measured loops
+  fprintf(stdout, "(checksum %"PRIu64")\n", sink);
+
+  fla_flist_free(flist);
+
+exit:
+  return err != 0;
+}
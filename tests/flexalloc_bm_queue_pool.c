@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdio.h>
+#include "flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_xnvme_env.h"
+
+/*
+ * Compares the cost of one small asynchronous read when every I/O creates and
+ * terminates its own queue, as the striped path used to do, against leasing
+ * the queue from a pool.
+ */
+
+#define BM_NITER 2000
+#define BM_QDEPTH 8
+
+static int
+bm_queue_init(struct fla_xne_io *xne_io, double *usecs)
+{
+  int err = 0;
+  struct fla_xne_queue *q;
+  struct xnvme_timer timer;
+
+  xnvme_timer_start(&timer);
+  for (int i = 0; i < BM_NITER; ++i)
+  {
+    err = fla_xne_queue_init(xne_io->dev, BM_QDEPTH, &q);
+    if (FLA_ERR(err, "fla_xne_queue_init()"))
+      return err;
+
+    err = fla_xne_pipe_seq_xneio(q, xne_io, 1);
+    FLA_ERR(err, "fla_xne_pipe_seq_xneio()");
+
+    err |= fla_xne_queue_term(q);
+    if (err)
+      return err;
+  }
+  xnvme_timer_stop(&timer);
+
+  *usecs = xnvme_timer_elapsed_secs(&timer) * 1000000 / BM_NITER;
+  return err;
+}
+
+static int
+bm_queue_lease(struct fla_xne_io *xne_io, double *usecs)
+{
+  int err = 0;
+  struct fla_xne_queue *q;
+  struct fla_xne_queue_pool *qpool;
+  struct xnvme_timer timer;
+
+  err = fla_xne_queue_pool_init(xne_io->dev, BM_QDEPTH, &qpool);
+  if (FLA_ERR(err, "fla_xne_queue_pool_init()"))
+    return err;
+
+  xnvme_timer_start(&timer);
+  for (int i = 0; i < BM_NITER; ++i)
+  {
+    err = fla_xne_queue_lease(qpool, BM_QDEPTH, &q);
+    if (FLA_ERR(err, "fla_xne_queue_lease()"))
+      goto term_qpool;
+
+    err = fla_xne_pipe_seq_xneio(q, xne_io, 1);
+    fla_xne_queue_release(qpool, q);
+    if (FLA_ERR(err, "fla_xne_pipe_seq_xneio()"))
+      goto term_qpool;
+  }
+  xnvme_timer_stop(&timer);
+
+  *usecs = xnvme_timer_elapsed_secs(&timer) * 1000000 / BM_NITER;
+
+term_qpool:
+  fla_xne_queue_pool_term(qpool);
+  return err;
+}
+
+int
+main(int argc, char ** argv)
+{
+  int err, ret, blk_size = 512, blk_num = 64;
+  double init_usecs, lease_usecs;
+  struct fla_ut_lpbk * lpbk;
+  struct xnvme_dev * xnvme_dev;
+  char * buf;
+
+  err = fla_ut_lpbk_dev_alloc(blk_size, blk_num, &lpbk);
+  if(FLA_ERR(err, "fla_ut_lpbk_dev_alloc()"))
+    goto exit;
+
+  err = fla_xne_dev_open(lpbk->dev_name, NULL, &xnvme_dev);
+  if(FLA_ERR(err, "fla_xne_dev_open()"))
+    goto loop_free;
+
+  buf = fla_xne_alloc_buf(xnvme_dev, blk_size);
+  if((err = FLA_ERR(!buf, "fla_xne_alloc_buf()")))
+    goto close_dev;
+
+  struct xnvme_lba_range range = fla_xne_lba_range_from_slba_naddrs(xnvme_dev, 0, 1);
+  if((err = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
+    goto free_buf;
+
+  struct fla_xne_io xne_io =
+  {
+    .io_type = FLA_IO_DATA_READ,
+    .dev = xnvme_dev,
+    .buf = buf,
+    .lba_range = &range,
+  };
+
+  err = bm_queue_init(&xne_io, &init_usecs);
+  if(FLA_ERR(err, "bm_queue_init()"))
+    goto free_buf;
+
+  err = bm_queue_lease(&xne_io, &lease_usecs);
+  if(FLA_ERR(err, "bm_queue_lease()"))
+    goto free_buf;
+
+  fprintf(stdout, "queue init per I/O  : %10.2f usec\n", init_usecs);
+  fprintf(stdout, "queue lease per I/O : %10.2f usec\n", lease_usecs);
+
+free_buf:
+  fla_xne_free_buf(xnvme_dev, buf);
+
+close_dev:
+  xnvme_dev_close(xnvme_dev);
+
+loop_free:
+  ret = fla_ut_lpbk_dev_free(lpbk);
+  if(FLA_ERR(ret, "fla_ut_lpbk_dev_free()") && !err)
+    err = ret;
+
+exit:
+  return err != 0;
+}
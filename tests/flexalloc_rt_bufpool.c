@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_xnvme_env.h"
+#include "flexalloc_bufpool.h"
+
+#define NTHREADS 4
+#define NITER 1000
+#define NHELD 8
+
+struct thread_args
+{
+  struct fla_bufpool *pool;
+  char tag;
+  int err;
+};
+
+static int
+test_size_classes(struct fla_bufpool *pool)
+{
+  int err = 0;
+  size_t sizes[] = {1, 512, 4096, 4097, 512 * 1024, 512 * 1024 + 1};
+  void *bufs[sizeof(sizes) / sizeof(sizes[0])];
+  void *buf;
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    bufs[i] = fla_bufpool_alloc(pool, sizes[i]);
+    if ((err = FLA_ERR(!bufs[i], "fla_bufpool_alloc()")))
+      return err;
+
+    memset(bufs[i], (int)i, sizes[i]);
+  }
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+  {
+    err = FLA_ASSERTF(fla_ut_count_char_in_buf((char)i, bufs[i], sizes[i]) == (int)sizes[i],
+                      "Buffer %zu of %zu bytes overlaps another one", i, sizes[i]);
+    if (FLA_ERR(err, "FLA_ASSERT()"))
+      return err;
+  }
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    fla_bufpool_free(pool, bufs[i]);
+
+  // The last freed buffer of a class is handed out first
+  buf = fla_bufpool_alloc(pool, 4096);
+  err = FLA_ASSERT(buf == bufs[2], "Freed buffer was not reused");
+  fla_bufpool_free(pool, buf);
+
+  return err;
+}
+
+static void *
+thread_fn(void *arg)
+{
+  struct thread_args *args = arg;
+  void *held[NHELD] = {0};
+  size_t nbytes;
+
+  for (int i = 0; i < NITER && !args->err; ++i)
+  {
+    int slot = i % NHELD;
+    nbytes = 4096 << (i % 3);
+
+    if (held[slot])
+    {
+      args->err = FLA_ASSERT(fla_ut_count_char_in_buf(args->tag, held[slot], 4096) == 4096,
+                             "Held buffer was modified by another thread");
+      fla_bufpool_free(args->pool, held[slot]);
+    }
+
+    held[slot] = fla_bufpool_alloc(args->pool, nbytes);
+    if ((args->err = FLA_ERR(!held[slot], "fla_bufpool_alloc()")))
+      break;
+    memset(held[slot], args->tag, nbytes);
+  }
+
+  for (int i = 0; i < NHELD; ++i)
+    fla_bufpool_free(args->pool, held[i]);
+
+  return NULL;
+}
+
+static int
+test_threads(struct fla_bufpool *pool)
+{
+  int err = 0;
+  pthread_t threads[NTHREADS];
+  struct thread_args args[NTHREADS];
+
+  for (int i = 0; i < NTHREADS; ++i)
+  {
+    args[i] = (struct thread_args){.pool = pool, .tag = 'a' + i, .err = 0};
+    err = pthread_create(&threads[i], NULL, thread_fn, &args[i]);
+    if (FLA_ERR(err, "pthread_create()"))
+    {
+      for (int j = 0; j < i; ++j)
+        pthread_join(threads[j], NULL);
+      return err;
+    }
+  }
+
+  for (int i = 0; i < NTHREADS; ++i)
+  {
+    pthread_join(threads[i], NULL);
+    err |= args[i].err;
+  }
+
+  return err;
+}
+
+int
+main(int argc, char ** argv)
+{
+  int err, ret, blk_size = 512, blk_num = 8;
+  struct fla_ut_lpbk * lpbk;
+  struct xnvme_dev * xnvme_dev;
+  struct fla_bufpool * pool;
+
+  err = fla_ut_lpbk_dev_alloc(blk_size, blk_num, &lpbk);
+  if(FLA_ERR(err, "fla_ut_lpbk_dev_alloc()"))
+    goto exit;
+
+  err = fla_xne_dev_open(lpbk->dev_name, NULL, &xnvme_dev);
+  if(FLA_ERR(err, "fla_xne_dev_open()"))
+    goto loop_free;
+
+  err = fla_bufpool_init(xnvme_dev, &pool);
+  if(FLA_ERR(err, "fla_bufpool_init()"))
+    goto close_dev;
+
+  err = test_size_classes(pool);
+  if(FLA_ERR(err, "test_size_classes()"))
+    goto term_pool;
+
+  err = test_threads(pool);
+  if(FLA_ERR(err, "test_threads()"))
+    goto term_pool;
+
+term_pool:
+  fla_bufpool_term(pool);
+
+close_dev:
+  xnvme_dev_close(xnvme_dev);
+
+loop_free:
+  ret = fla_ut_lpbk_dev_free(lpbk);
+  if(FLA_ERR(ret, "fla_ut_lpbk_dev_free()") && !err)
+    err = ret;
+
+exit:
+  return err != 0;
+}
@@ -0,0 +1,339 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tests/flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_mm.h"
+#include "flexalloc_slabcache.h"
+#include "libflexalloc.h"
+
+/*
+ * Open with a background checkpointer and check that changes are written
+ * without calling fla_sync(), so that they survive closing without a flush.
+ * A checkpointer on a handle which is not thread safe is refused.
+ *
+ * Then trim a slab from one pool and reuse it in another while checkpoints
+ * run. Without an md device the freelist of the first pool, if copied by a
+ * checkpoint, must not be written over the data of the second.
+ */
+
+#define CKPT_INTERVAL_MS 10
+#define CKPT_WAIT_MS 5000
+#define REUSE_NROUNDS 32
+
+static uint32_t
+count_dirty(struct flexalloc *fs)
+{
+  return fla_ut_md_ndirty(fs) + fla_ut_slabs_ndirty(fs);
+}
+
+static int
+wait_clean(struct flexalloc *fs)
+{
+  for (uint32_t ms = 0; ms < CKPT_WAIT_MS; ms += CKPT_INTERVAL_MS)
+  {
+    if (!count_dirty(fs))
+      return 0;
+    usleep(CKPT_INTERVAL_MS * 1000);
+  }
+
+  return FLA_ASSERTF(0, "%"PRIu32" blocks still dirty after %d ms", count_dirty(fs),
+                     CKPT_WAIT_MS);
+}
+
+struct flush_arg
+{
+  struct flexalloc *fs;
+  int err;
+};
+
+static void *
+flush_thread(void *varg)
+{
+  struct flush_arg *arg = varg;
+
+  arg->err = fla_flush(arg->fs);
+  return NULL;
+}
+
+/*
+ * Objects of pool a take a block, so its freelist spans the last blocks of a
+ * slab. The single object of pool b spans all but the last block of a slab,
+ * and is written where the freelist of pool a was. Pool b holds every other
+ * slab, so the two pools take turns on the last free one.
+ */
+static int
+check_slab_reuse(struct fla_ut_dev *dev)
+{
+  int err, ret;
+  char *names[2] = {"pool_a", "pool_b"};
+  uint32_t slab_nlb = 16 * dev->lb_nbytes, flist_nlb, nfill = 0;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pools[2] = {NULL, NULL};
+  struct fla_object obj, *fill = NULL;
+  struct fla_open_opts open_opts = {0};
+  struct flush_arg flush_arg;
+  pthread_t thread;
+  size_t off;
+  char *buf = NULL;
+
+  // an md device keeps the freelists out of the slabs, and needs them in one block
+  if (dev->_md_dev_uri || dev->nblocks < 3 * (uint64_t)slab_nlb)
+    return 0;
+
+  err = fla_ut_fs_create(slab_nlb, 2, dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    return err;
+
+  err = fla_close(fs);
+  fs = NULL;
+  if (FLA_ERR(err, "fla_close()"))
+    return err;
+
+  open_opts.dev_uri = dev->_dev_uri;
+  open_opts.md_dev_uri = dev->_md_dev_uri;
+  open_opts.flags = FLA_OPEN_THREAD_SAFE;
+  open_opts.ckpt_interval_ms = CKPT_INTERVAL_MS;
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open()"))
+    return err;
+
+  for (uint32_t i = 0; i < 2; ++i)
+  {
+    struct fla_pool_create_arg pool_arg =
+    {
+      .flags = 0,
+      .name = names[i],
+      .name_len = strlen(names[i]),
+      .obj_nlb = i ? slab_nlb - 1 : 1
+    };
+
+    err = fla_pool_create(fs, &pool_arg, &pools[i]);
+    if (FLA_ERR(err, "fla_pool_create()"))
+      goto close;
+  }
+
+  flist_nlb = fla_slab_cache_flist_nlb(fs, fs->pools.entries[pools[0]->ndx].slab_nobj);
+  err = FLA_ASSERTF(flist_nlb > 1, "Freelist of pool a takes %"PRIu32" block, expected more",
+                    flist_nlb);
+  if (err)
+    goto close;
+  off = (size_t)(slab_nlb - flist_nlb) * dev->lb_nbytes;
+
+  fill = malloc(fs->geo.nslabs * sizeof(*fill));
+  buf = fla_buf_alloc(fs, dev->lb_nbytes);
+  if ((err = FLA_ERR(!fill || !buf, "failed to allocate buffers")))
+    goto close;
+
+  for (; nfill < fs->geo.nslabs - 1; ++nfill)
+  {
+    err = fla_object_create(fs, pools[1], &fill[nfill]);
+    if (FLA_ERR(err, "fla_object_create()"))
+      goto destroy_fill;
+  }
+
+  for (uint32_t round = 0; round < REUSE_NROUNDS; ++round)
+  {
+    err = fla_object_create(fs, pools[0], &obj);
+    if (FLA_ERR(err, "fla_object_create() - pool a"))
+      break;
+
+    // leaves the freelist of pool a dirty for the flush
+    err = fla_object_destroy(fs, pools[0], &obj);
+    if (FLA_ERR(err, "fla_object_destroy() - pool a"))
+      break;
+
+    flush_arg.fs = fs;
+    flush_arg.err = 0;
+    err = pthread_create(&thread, NULL, flush_thread, &flush_arg);
+    if (FLA_ERR(err, "pthread_create()"))
+      break;
+
+    err = fla_pool_trim(fs, pools[0], 0);
+    FLA_ERR(err, "fla_pool_trim() - pool a");
+
+    if (!err)
+    {
+      err = fla_object_create(fs, pools[1], &obj);
+      FLA_ERR(err, "fla_object_create() - pool b");
+    }
+
+    if (!err)
+    {
+      memset(buf, round + 1, dev->lb_nbytes);
+      err = fla_object_write(fs, pools[1], &obj, buf, off, dev->lb_nbytes);
+      FLA_ERR(err, "fla_object_write()");
+    }
+
+    pthread_join(thread, NULL);
+    if (err || FLA_ERR((err = flush_arg.err), "fla_flush()"))
+      break;
+
+    memset(buf, 0, dev->lb_nbytes);
+    err = fla_object_read(fs, pools[1], &obj, buf, off, dev->lb_nbytes);
+    if (FLA_ERR(err, "fla_object_read()"))
+      break;
+
+    for (uint32_t i = 0; i < dev->lb_nbytes && !err; ++i)
+      err = FLA_ASSERTF(buf[i] == (char)(round + 1),
+                        "Round %"PRIu32": byte %"PRIu32" of the reused slab overwritten", round, i);
+    if (err)
+      break;
+
+    err = fla_object_destroy(fs, pools[1], &obj);
+    if (FLA_ERR(err, "fla_object_destroy() - pool b"))
+      break;
+
+    err = fla_pool_trim(fs, pools[1], 0);
+    if (FLA_ERR(err, "fla_pool_trim() - pool b"))
+      break;
+  }
+
+destroy_fill:
+  ret = fla_object_destroy_n(fs, pools[1], fill, nfill);
+  if (FLA_ERR(ret, "fla_object_destroy_n()"))
+    err = ret;
+
+close:
+  for (uint32_t i = 0; i < 2; ++i)
+  {
+    if (pools[i])
+    {
+      ret = fla_pool_destroy(fs, pools[i]);
+      if (FLA_ERR(ret, "fla_pool_destroy()"))
+      {
+        err = ret;
+        free(pools[i]);
+      }
+    }
+  }
+  if (buf)
+    fla_buf_free(fs, buf);
+  free(fill);
+  ret = fla_ut_fs_teardown(fs);
+  if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+    err = ret;
+  return err;
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char *pool_handle_name = "mypool";
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle = NULL;
+  struct fla_object obj;
+  struct fla_pool_usage usage;
+  struct fla_open_opts open_opts = {0};
+
+  err = fla_ut_dev_init(40000, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+    err = fla_ut_fs_create(dev.nsect_zn, 1, &dev, &fs);
+  else
+    err = fla_ut_fs_create(1000, 1, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  err = fla_close(fs);
+  fs = NULL;
+  if (FLA_ERR(err, "fla_close()"))
+    goto teardown_ut_dev;
+
+  open_opts.dev_uri = dev._dev_uri;
+  open_opts.md_dev_uri = dev._md_dev_uri;
+  open_opts.ckpt_interval_ms = CKPT_INTERVAL_MS;
+  err = FLA_ASSERT(fla_open(&open_opts, &fs) == -EINVAL,
+                   "Checkpointer accepted on a handle which is not thread safe");
+  if (err)
+    goto teardown_ut_fs;
+
+  open_opts.flags = FLA_OPEN_THREAD_SAFE;
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open()"))
+    goto teardown_ut_dev;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = dev._is_zns ? dev.nsect_zn : 1
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  err = fla_object_create(fs, pool_handle, &obj);
+  if (FLA_ERR(err, "fla_object_create()"))
+    goto teardown_ut_fs;
+
+  err = wait_clean(fs);
+  if (FLA_ERR(err, "wait_clean()"))
+    goto teardown_ut_fs;
+
+  fla_close_noflush(fs);
+  fs = NULL;
+
+  open_opts.ckpt_interval_ms = 0;
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open() - failed to re-open device"))
+    goto teardown_ut_fs;
+
+  err = fla_pool_usage(fs, pool_handle, &usage);
+  if (FLA_ERR(err, "fla_pool_usage()"))
+    goto teardown_ut_fs;
+
+  err = FLA_ASSERTF(usage.nslabs == 1 && usage.nobjs_used == 1,
+                    "Expected 1 slab and 1 object after re-open, got %"PRIu32" and %"PRIu64,
+                    usage.nslabs, usage.nobjs_used);
+  if (err)
+    goto teardown_ut_fs;
+
+  err = fla_object_destroy(fs, pool_handle, &obj);
+  if (FLA_ERR(err, "fla_object_destroy()"))
+    goto teardown_ut_fs;
+
+  err = fla_pool_destroy(fs, pool_handle);
+  pool_handle = NULL;
+  if (FLA_ERR(err, "fla_pool_destroy()"))
+    goto teardown_ut_fs;
+
+  // one object per zone, a slab is not shared by pools of different objects
+  if (dev._is_zns)
+    goto teardown_ut_fs;
+
+  // the check formats the device anew
+  err = fla_close(fs);
+  fs = NULL;
+  if (FLA_ERR(err, "fla_close()"))
+    goto teardown_ut_dev;
+
+  err = check_slab_reuse(&dev);
+  FLA_ERR(err, "check_slab_reuse()");
+
+teardown_ut_fs:
+  free(pool_handle);
+  if (fs)
+  {
+    ret = fla_ut_fs_teardown(fs);
+    if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+      err = ret;
+  }
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+    err = ret;
+
+exit:
+  return err;
+}
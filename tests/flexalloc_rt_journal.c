@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_mm.h"
+#include "libflexalloc.h"
+
+/*
+ * Format with a journal, change pools and objects and close without a flush
+ * as if crashing. Check that re-opening replays the changes, and that the
+ * entries of the surviving objects are not handed out again.
+ */
+
+#define NOBJS 10
+#define NDESTROY 3
+
+static int
+reopen(struct fla_ut_dev *dev, struct flexalloc **fs)
+{
+  struct fla_open_opts open_opts = {0};
+
+  fla_close_noflush(*fs);
+  *fs = NULL;
+
+  open_opts.dev_uri = dev->_dev_uri;
+  open_opts.md_dev_uri = dev->_md_dev_uri;
+  return fla_open(&open_opts, fs);
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char *pool_handle_name = "mypool";
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle = NULL;
+  struct fla_object objs[NOBJS], obj, root;
+  struct fla_pool_usage pool_usage;
+  struct fla_usage usage;
+  struct fla_mkfs_p mkfs_params = {0};
+  struct fla_open_opts open_opts = {0};
+  uint32_t nslabs_free, nkeep = NOBJS - NDESTROY;
+
+  err = fla_ut_dev_init(40000, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    // one object per zone, the journal itself is covered by the md device
+    err = FLA_TEST_SKIP_RETCODE;
+    goto teardown_ut_dev;
+  }
+
+  mkfs_params.open_opts.dev_uri = dev._dev_uri;
+  mkfs_params.open_opts.md_dev_uri = dev._md_dev_uri;
+  mkfs_params.slab_nlb = 1000;
+  mkfs_params.npools = 1;
+
+  // a journal leaving no room for a slab must not wrap the geometry around
+  mkfs_params.jnl_nlb = UINT32_MAX;
+  ret = fla_mkfs(&mkfs_params);
+  err = FLA_ASSERT(ret != 0, "fla_mkfs() accepted a journal larger than the device");
+  if (err)
+    goto teardown_ut_dev;
+
+  mkfs_params.jnl_nlb = 64;
+
+  if (dev._md_dev_uri)
+  {
+    // one object per block needs a freelist of two blocks, which replay cannot load
+    mkfs_params.slab_nlb = dev.lb_nbytes * 8;
+    ret = fla_mkfs(&mkfs_params);
+    err = FLA_ASSERT(ret != 0, "fla_mkfs() accepted a journal with multi block freelists");
+    if (err)
+      goto teardown_ut_dev;
+    mkfs_params.slab_nlb = 1000;
+  }
+
+  err = fla_mkfs(&mkfs_params);
+  if (FLA_ERR(err, "fla_mkfs()"))
+    goto teardown_ut_dev;
+
+  open_opts.dev_uri = dev._dev_uri;
+  open_opts.md_dev_uri = dev._md_dev_uri;
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open()"))
+    goto teardown_ut_dev;
+
+  err = fla_usage(fs, &usage);
+  if (FLA_ERR(err, "fla_usage()"))
+    goto teardown_ut_fs;
+  nslabs_free = usage.nslabs_free;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = 1
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  err = fla_object_create_n(fs, pool_handle, objs, NOBJS);
+  if (FLA_ERR(err, "fla_object_create_n()"))
+    goto teardown_ut_fs;
+
+  for (uint32_t i = nkeep; i < NOBJS; ++i)
+  {
+    err = fla_object_destroy(fs, pool_handle, &objs[i]);
+    if (FLA_ERR(err, "fla_object_destroy()"))
+      goto teardown_ut_fs;
+  }
+
+  err = fla_pool_set_root_object(fs, pool_handle, &objs[0], ROOT_OBJ_SET_DEF);
+  if (FLA_ERR(err, "fla_pool_set_root_object()"))
+    goto teardown_ut_fs;
+
+  // nothing but the journal went to disk since mkfs
+  err = reopen(&dev, &fs);
+  if (FLA_ERR(err, "reopen()"))
+    goto teardown_ut_fs;
+
+  free(pool_handle);
+  pool_handle = NULL;
+  err = fla_pool_open(fs, pool_handle_name, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_open() - pool lost on re-open"))
+    goto teardown_ut_fs;
+
+  err = fla_pool_usage(fs, pool_handle, &pool_usage);
+  if (FLA_ERR(err, "fla_pool_usage()"))
+    goto teardown_ut_fs;
+
+  err = FLA_ASSERTF(pool_usage.nslabs == 1 && pool_usage.nobjs_used == nkeep,
+                    "Expected 1 slab and %"PRIu32" objects after replay, got %"PRIu32" and %"PRIu64,
+                    nkeep, pool_usage.nslabs, pool_usage.nobjs_used);
+  if (err)
+    goto teardown_ut_fs;
+
+  err = fla_pool_get_root_object(fs, pool_handle, &root);
+  if (FLA_ERR(err, "fla_pool_get_root_object()"))
+    goto teardown_ut_fs;
+
+  err = FLA_ASSERT(root.slab_id == objs[0].slab_id && root.entry_ndx == objs[0].entry_ndx,
+                   "Root object not replayed");
+  if (err)
+    goto teardown_ut_fs;
+
+  err = fla_object_create(fs, pool_handle, &obj);
+  if (FLA_ERR(err, "fla_object_create()"))
+    goto teardown_ut_fs;
+
+  for (uint32_t i = 0; i < nkeep; ++i)
+  {
+    err |= FLA_ASSERTF(obj.slab_id != objs[i].slab_id || obj.entry_ndx != objs[i].entry_ndx,
+                       "Entry %"PRIu32" of a replayed object handed out again", obj.entry_ndx);
+  }
+  if (err)
+    goto teardown_ut_fs;
+
+  objs[nkeep] = obj;
+  err = fla_object_destroy_n(fs, pool_handle, objs, nkeep + 1);
+  if (FLA_ERR(err, "fla_object_destroy_n()"))
+    goto teardown_ut_fs;
+
+  err = fla_pool_destroy(fs, pool_handle);
+  pool_handle = NULL;
+  if (FLA_ERR(err, "fla_pool_destroy()"))
+    goto teardown_ut_fs;
+
+  err = reopen(&dev, &fs);
+  if (FLA_ERR(err, "reopen()"))
+    goto teardown_ut_fs;
+
+  err = FLA_ASSERT(fla_pool_open(fs, pool_handle_name, &pool_handle) != 0,
+                   "Destroyed pool found after replay");
+  if (err)
+    goto teardown_ut_fs;
+
+  err = fla_usage(fs, &usage);
+  if (FLA_ERR(err, "fla_usage()"))
+    goto teardown_ut_fs;
+
+  err = FLA_ASSERTF(usage.nslabs_free == nslabs_free,
+                    "Expected %"PRIu32" free slabs after replay, got %"PRIu32,
+                    nslabs_free, usage.nslabs_free);
+
+teardown_ut_fs:
+  free(pool_handle);
+  if (fs)
+  {
+    ret = fla_ut_fs_teardown(fs);
+    if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+      err = ret;
+  }
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+    err = ret;
+
+exit:
+  return err;
+}
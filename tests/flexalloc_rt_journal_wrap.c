@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_mm.h"
+#include "libflexalloc.h"
+
+/*
+ * Format with a small journal and commit past its end without a checkpoint,
+ * so that a commit which does not fit at the end goes to the block after the
+ * super. Close without a flush and check that replay follows the commits
+ * around the journal.
+ *
+ * With JNL_NLB blocks, every commit below but the batch takes one block:
+ * the pool and NFIRST objects take blocks 1 to 5 and a flush checkpoints
+ * them, which moves the start to block 6. One object goes to block 6, the
+ * batch of two blocks does not fit in block 7 and goes to blocks 1 and 2, and
+ * the last destroy to block 3.
+ */
+
+#define JNL_NLB 8
+#define NFIRST 4
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char *pool_handle_name = "mypool";
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle = NULL;
+  struct fla_object *objs = NULL;
+  struct fla_pool_usage pool_usage;
+  struct fla_mkfs_p mkfs_params = {0};
+  struct fla_open_opts open_opts = {0};
+  uint32_t nbatch, nobjs = 0;
+  uint64_t refcount;
+
+  err = fla_ut_dev_init(40000, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    // one object per zone, the journal itself is covered by the md device
+    err = FLA_TEST_SKIP_RETCODE;
+    goto teardown_ut_dev;
+  }
+
+  mkfs_params.open_opts.dev_uri = dev._dev_uri;
+  mkfs_params.open_opts.md_dev_uri = dev._md_dev_uri;
+  mkfs_params.slab_nlb = 1000;
+  mkfs_params.npools = 1;
+  mkfs_params.jnl_nlb = JNL_NLB;
+  err = fla_mkfs(&mkfs_params);
+  if (FLA_ERR(err, "fla_mkfs()"))
+    goto teardown_ut_dev;
+
+  open_opts.dev_uri = dev._dev_uri;
+  open_opts.md_dev_uri = dev._md_dev_uri;
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open()"))
+    goto teardown_ut_dev;
+
+  // a record of this many objects spills into a second block
+  nbatch = fs->dev.lb_nbytes / sizeof(struct fla_object);
+  objs = malloc((NFIRST + 1 + nbatch) * sizeof(struct fla_object));
+  if ((err = FLA_ERR(!objs, "malloc()")))
+    goto teardown_ut_fs;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = 1
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  for (; nobjs < NFIRST; ++nobjs)
+  {
+    err = fla_object_create(fs, pool_handle, &objs[nobjs]);
+    if (FLA_ERR(err, "fla_object_create()"))
+      goto teardown_ut_fs;
+  }
+
+  // with a journal fla_sync() only commits, checkpoint to move the start
+  err = fla_flush(fs);
+  if (FLA_ERR(err, "fla_flush()"))
+    goto teardown_ut_fs;
+
+  err = fla_object_create(fs, pool_handle, &objs[nobjs++]);
+  if (FLA_ERR(err, "fla_object_create()"))
+    goto teardown_ut_fs;
+
+  err = fla_object_create_n(fs, pool_handle, &objs[nobjs], nbatch);
+  if (FLA_ERR(err, "fla_object_create_n()"))
+    goto teardown_ut_fs;
+  nobjs += nbatch;
+
+  err = fla_object_destroy(fs, pool_handle, &objs[--nobjs]);
+  if (FLA_ERR(err, "fla_object_destroy()"))
+    goto teardown_ut_fs;
+
+  fla_close_noflush(fs);
+  fs = NULL;
+
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open() - failed to re-open device"))
+    goto teardown_ut_fs;
+
+  free(pool_handle);
+  pool_handle = NULL;
+  err = fla_pool_open(fs, pool_handle_name, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_open() - pool lost on re-open"))
+    goto teardown_ut_fs;
+
+  err = fla_pool_usage(fs, pool_handle, &pool_usage);
+  if (FLA_ERR(err, "fla_pool_usage()"))
+    goto teardown_ut_fs;
+
+  err = FLA_ASSERTF(pool_usage.nobjs_used == nobjs,
+                    "Expected %"PRIu32" objects after replay, got %"PRIu64,
+                    nobjs, pool_usage.nobjs_used);
+  if (err)
+    goto teardown_ut_fs;
+
+  err = fla_ut_pool_slabs_check(fs, pool_handle, &refcount);
+  if (FLA_ERR(err, "fla_ut_pool_slabs_check()"))
+    goto teardown_ut_fs;
+
+  err = FLA_ASSERTF(refcount == nobjs,
+                    "Slabs hold %"PRIu64" objects after replay, expected %"PRIu32,
+                    refcount, nobjs);
+  if (err)
+    goto teardown_ut_fs;
+
+  err = fla_object_destroy_n(fs, pool_handle, objs, nobjs);
+  if (FLA_ERR(err, "fla_object_destroy_n()"))
+    goto teardown_ut_fs;
+
+  err = fla_pool_destroy(fs, pool_handle);
+  pool_handle = NULL;
+  FLA_ERR(err, "fla_pool_destroy()");
+
+teardown_ut_fs:
+  free(objs);
+  free(pool_handle);
+  if (fs)
+  {
+    ret = fla_ut_fs_teardown(fs);
+    if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+      err = ret;
+  }
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+    err = ret;
+
+exit:
+  return err;
+}
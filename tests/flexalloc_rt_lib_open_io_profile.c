@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libflexalloc.h"
+#include "flexalloc.h"
+#include "flexalloc_mm.h"
+#include "flexalloc_util.h"
+#include "flexalloc_xnvme_env.h"
+#include "tests/flexalloc_tests_common.h"
+
+/*
+ * Open with an I/O profile asking for a queue depth which is not a power of 2
+ * and push more asynchronous transfers through the handle than the queue holds.
+ */
+
+#define PROFILE_QDEPTH 6
+#define NOBJS (4 * PROFILE_QDEPTH)
+
+struct io_status
+{
+  int err;
+  int ncalls;
+};
+
+static void
+io_cb(int err, void *cb_arg)
+{
+  struct io_status *status = cb_arg;
+  status->err = err;
+  status->ncalls++;
+}
+
+static int
+check_status(struct io_status *status, uint32_t nstatus)
+{
+  int err = 0;
+
+  for (uint32_t i = 0; i < nstatus; ++i)
+  {
+    err |= FLA_ASSERTF(status[i].ncalls == 1, "Callback %"PRIu32" called %d times",
+                       i, status[i].ncalls);
+    err |= FLA_ASSERTF(status[i].err == 0, "Transfer %"PRIu32" failed with %d",
+                       i, status[i].err);
+  }
+
+  return err;
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char *pool_handle_name = "mypool", *write_buf, *read_buf;
+  size_t obj_nbytes;
+  struct fla_ut_lpbk *lpbk;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle;
+  struct fla_object objs[NOBJS];
+  struct io_status status[NOBJS];
+  struct fla_mkfs_p mkfs_params = {0};
+  struct fla_open_opts open_opts = {0};
+  struct fla_io_profile io_profile = {.qdepth = PROFILE_QDEPTH};
+  uint32_t nobjs = 0, lb_nbytes = 512, obj_nlb = 4;
+
+  err = fla_ut_lpbk_dev_alloc(lb_nbytes, 8192, &lpbk);
+  if (FLA_ERR(err, "fla_ut_lpbk_dev_alloc()"))
+    goto exit;
+
+  mkfs_params.open_opts.dev_uri = lpbk->dev_name;
+  mkfs_params.slab_nlb = 1024;
+  mkfs_params.npools = 1;
+  err = fla_mkfs(&mkfs_params);
+  if (FLA_ERR(err, "fla_mkfs()"))
+    goto teardown_lpbk;
+
+  open_opts.dev_uri = lpbk->dev_name;
+  open_opts.io_profile = &io_profile;
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open()"))
+    goto teardown_lpbk;
+
+  err = FLA_ASSERTF(fs->qpool->depth == 8, "Queue depth %"PRIu32", expected 8",
+                    fs->qpool->depth);
+  if (FLA_ERR(err, "FLA_ASSERT()"))
+    goto close_fs;
+
+  obj_nbytes = obj_nlb * lb_nbytes;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = obj_nlb
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto close_fs;
+
+  for (nobjs = 0; nobjs < NOBJS; ++nobjs)
+  {
+    err = fla_object_create(fs, pool_handle, &objs[nobjs]);
+    if (FLA_ERR(err, "fla_object_create()"))
+      goto release_objects;
+  }
+
+  write_buf = fla_buf_alloc(fs, obj_nbytes * NOBJS);
+  if ((err = FLA_ERR(!write_buf, "fla_buf_alloc()")))
+    goto release_objects;
+
+  read_buf = fla_buf_alloc(fs, obj_nbytes * NOBJS);
+  if ((err = FLA_ERR(!read_buf, "fla_buf_alloc()")))
+    goto free_write_buffer;
+
+  fla_t_fill_buf_random(write_buf, obj_nbytes * NOBJS);
+  memset(read_buf, 0, obj_nbytes * NOBJS);
+
+  memset(status, 0, sizeof(status));
+  for (uint32_t i = 0; i < NOBJS; ++i)
+  {
+    err = fla_object_write_async(fs, pool_handle, &objs[i], write_buf + i * obj_nbytes, 0,
+                                 obj_nbytes, io_cb, &status[i]);
+    if (FLA_ERR(err, "fla_object_write_async()"))
+      goto free_read_buffer;
+  }
+
+  ret = fla_object_io_drain(fs);
+  if ((err = FLA_ERR(ret < 0, "fla_object_io_drain()")))
+    goto free_read_buffer;
+
+  err = check_status(status, NOBJS);
+  if (FLA_ERR(err, "check_status() - writes"))
+    goto free_read_buffer;
+
+  memset(status, 0, sizeof(status));
+  for (uint32_t i = 0; i < NOBJS; ++i)
+  {
+    err = fla_object_read_async(fs, pool_handle, &objs[i], read_buf + i * obj_nbytes, 0,
+                                obj_nbytes, io_cb, &status[i]);
+    if (FLA_ERR(err, "fla_object_read_async()"))
+      goto free_read_buffer;
+  }
+
+  ret = fla_object_io_drain(fs);
+  if ((err = FLA_ERR(ret < 0, "fla_object_io_drain()")))
+    goto free_read_buffer;
+
+  err = check_status(status, NOBJS);
+  if (FLA_ERR(err, "check_status() - reads"))
+    goto free_read_buffer;
+
+  err = memcmp(write_buf, read_buf, obj_nbytes * NOBJS);
+  FLA_ERR(err, "memcmp() - failed to read back the written values");
+
+free_read_buffer:
+  fla_buf_free(fs, read_buf);
+
+free_write_buffer:
+  fla_buf_free(fs, write_buf);
+
+release_objects:
+  for (uint32_t i = 0; i < nobjs; ++i)
+  {
+    ret = fla_object_destroy(fs, pool_handle, &objs[i]);
+    if (FLA_ERR(ret, "fla_object_destroy()"))
+      err = ret;
+  }
+
+  ret = fla_pool_destroy(fs, pool_handle);
+  if (FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+close_fs:
+  ret = fla_close(fs);
+  if (FLA_ERR(ret, "fla_close()"))
+    err = ret;
+
+teardown_lpbk:
+  ret = fla_ut_lpbk_dev_free(lpbk);
+  if (FLA_ERR(ret, "fla_ut_lpbk_dev_free()"))
+    err = ret;
+
+exit:
+  return err;
+}
@@ -0,0 +1,282 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libflexalloc.h"
+#include "flexalloc.h"
+#include "flexalloc_util.h"
+#include "tests/flexalloc_tests_common.h"
+
+/*
+ * Open the handle thread safe and let several threads create, write, read
+ * back and destroy objects at the same time, each in a pool of its own and
+ * all of them in one shared pool. The shared pool spans several slabs, so the
+ * threads also race for acquiring slabs.
+ */
+
+#define NTHREADS 4
+#define NOBJS_OWN 64
+#define NOBJS_SHARED 300
+
+struct thread_arg
+{
+  struct flexalloc *fs;
+  struct fla_pool *own_pool;
+  struct fla_pool *shared_pool;
+  struct fla_object own_objs[NOBJS_OWN];
+  struct fla_object shared_objs[NOBJS_SHARED];
+  uint32_t tid;
+  int err;
+};
+
+static void *
+create_objects(void *varg)
+{
+  struct thread_arg *arg = varg;
+  uint32_t lb_nbytes = fla_fs_lb_nbytes(arg->fs);
+  char *w_buf, *r_buf;
+
+  w_buf = fla_buf_alloc(arg->fs, lb_nbytes);
+  r_buf = fla_buf_alloc(arg->fs, lb_nbytes);
+  if ((arg->err = FLA_ERR(!w_buf || !r_buf, "fla_buf_alloc()")))
+    goto free_bufs;
+
+  for (uint32_t i = 0; i < NOBJS_SHARED; ++i)
+  {
+    arg->err = fla_object_create(arg->fs, arg->shared_pool, &arg->shared_objs[i]);
+    if (FLA_ERR(arg->err, "fla_object_create() - shared pool"))
+      goto free_bufs;
+
+    if (i >= NOBJS_OWN)
+      continue;
+
+    arg->err = fla_object_create(arg->fs, arg->own_pool, &arg->own_objs[i]);
+    if (FLA_ERR(arg->err, "fla_object_create() - own pool"))
+      goto free_bufs;
+
+    memset(w_buf, 'a' + arg->tid, lb_nbytes);
+    memcpy(w_buf, &i, sizeof(i));
+    arg->err = fla_object_write(arg->fs, arg->own_pool, &arg->own_objs[i], w_buf, 0, lb_nbytes);
+    if (FLA_ERR(arg->err, "fla_object_write()"))
+      goto free_bufs;
+
+    arg->err = fla_object_read(arg->fs, arg->own_pool, &arg->own_objs[i], r_buf, 0, lb_nbytes);
+    if (FLA_ERR(arg->err, "fla_object_read()"))
+      goto free_bufs;
+
+    arg->err = FLA_ASSERTF(!memcmp(w_buf, r_buf, lb_nbytes),
+                           "Thread %"PRIu32" read back other data from object %"PRIu32,
+                           arg->tid, i);
+    if (arg->err)
+      goto free_bufs;
+  }
+
+free_bufs:
+  fla_buf_free(arg->fs, w_buf);
+  fla_buf_free(arg->fs, r_buf);
+  return NULL;
+}
+
+static void *
+destroy_objects(void *varg)
+{
+  struct thread_arg *arg = varg;
+  int ret;
+
+  for (uint32_t i = 0; i < NOBJS_SHARED; ++i)
+  {
+    ret = fla_object_destroy(arg->fs, arg->shared_pool, &arg->shared_objs[i]);
+    if (FLA_ERR(ret, "fla_object_destroy() - shared pool"))
+      arg->err = ret;
+
+    if (i >= NOBJS_OWN)
+      continue;
+
+    ret = fla_object_destroy(arg->fs, arg->own_pool, &arg->own_objs[i]);
+    if (FLA_ERR(ret, "fla_object_destroy() - own pool"))
+      arg->err = ret;
+  }
+
+  return NULL;
+}
+
+static int
+run_threads(struct thread_arg *args, void *(*fn)(void *))
+{
+  pthread_t threads[NTHREADS];
+  int err = 0;
+  uint32_t nthreads = 0;
+
+  for (; nthreads < NTHREADS; ++nthreads)
+  {
+    err = pthread_create(&threads[nthreads], NULL, fn, &args[nthreads]);
+    if (FLA_ERR(err, "pthread_create()"))
+      break;
+  }
+
+  for (uint32_t i = 0; i < nthreads; ++i)
+  {
+    pthread_join(threads[i], NULL);
+    if (FLA_ERR(args[i].err, "thread failed"))
+      err = args[i].err;
+  }
+
+  return err;
+}
+
+static int
+check_shared_unique(struct thread_arg const *args)
+{
+  struct fla_object objs[NTHREADS * NOBJS_SHARED];
+
+  for (uint32_t t = 0; t < NTHREADS; ++t)
+    memcpy(&objs[t * NOBJS_SHARED], args[t].shared_objs, sizeof(args[t].shared_objs));
+
+  return fla_ut_objs_check_unique(objs, NTHREADS * NOBJS_SHARED);
+}
+
+static int
+check_usage(struct flexalloc *fs, struct thread_arg const *args, uint32_t own, uint32_t shared)
+{
+  struct fla_pool_usage usage;
+  int err;
+
+  err = fla_pool_usage(fs, args[0].shared_pool, &usage);
+  if (FLA_ERR(err, "fla_pool_usage()"))
+    return err;
+
+  err = FLA_ASSERTF(usage.nobjs_used == shared, "Shared pool counts %"PRIu64" objects",
+                    usage.nobjs_used);
+  if (err)
+    return err;
+
+  for (uint32_t t = 0; t < NTHREADS; ++t)
+  {
+    err = fla_pool_usage(fs, args[t].own_pool, &usage);
+    if (FLA_ERR(err, "fla_pool_usage()"))
+      return err;
+
+    err = FLA_ASSERTF(usage.nobjs_used == own, "Pool of thread %"PRIu32" counts %"PRIu64" objects",
+                      t, usage.nobjs_used);
+    if (err)
+      return err;
+  }
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char pool_name[32];
+  struct fla_ut_lpbk *lpbk;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *shared_pool = NULL;
+  struct fla_mkfs_p mkfs_params = {0};
+  struct fla_open_opts open_opts = {0};
+  struct thread_arg *args;
+  uint32_t npools = 0;
+
+  args = calloc(NTHREADS, sizeof(struct thread_arg));
+  if ((err = FLA_ERR(!args, "calloc()")))
+    goto exit;
+
+  err = fla_ut_lpbk_dev_alloc(512, 32768, &lpbk);
+  if (FLA_ERR(err, "fla_ut_lpbk_dev_alloc()"))
+    goto free_args;
+
+  mkfs_params.open_opts.dev_uri = lpbk->dev_name;
+  mkfs_params.slab_nlb = 512;
+  mkfs_params.npools = NTHREADS + 1;
+  err = fla_mkfs(&mkfs_params);
+  if (FLA_ERR(err, "fla_mkfs()"))
+    goto teardown_lpbk;
+
+  open_opts.dev_uri = lpbk->dev_name;
+  open_opts.flags = FLA_OPEN_THREAD_SAFE;
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open()"))
+    goto teardown_lpbk;
+
+  err = FLA_ASSERT(fs->locks != NULL, "Handle opened without locks");
+  if (err)
+    goto close_fs;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = "shared",
+    .name_len = strlen("shared"),
+    .obj_nlb = 1
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &shared_pool);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto close_fs;
+
+  for (; npools < NTHREADS; ++npools)
+  {
+    snprintf(pool_name, sizeof(pool_name), "thread%"PRIu32, npools);
+    pool_arg.name = pool_name;
+    pool_arg.name_len = strlen(pool_name);
+    err = fla_pool_create(fs, &pool_arg, &args[npools].own_pool);
+    if (FLA_ERR(err, "fla_pool_create()"))
+      goto destroy_pools;
+
+    args[npools].fs = fs;
+    args[npools].shared_pool = shared_pool;
+    args[npools].tid = npools;
+  }
+
+  err = run_threads(args, create_objects);
+  if (FLA_ERR(err, "run_threads() - create"))
+    goto destroy_pools;
+
+  err = check_shared_unique(args);
+  if (FLA_ERR(err, "check_shared_unique()"))
+    goto destroy_objects;
+
+  err = check_usage(fs, args, NOBJS_OWN, NTHREADS * NOBJS_SHARED);
+  if (FLA_ERR(err, "check_usage() - after create"))
+    goto destroy_objects;
+
+destroy_objects:
+  ret = run_threads(args, destroy_objects);
+  if (FLA_ERR(ret, "run_threads() - destroy"))
+  {
+    err = ret;
+    goto destroy_pools;
+  }
+
+  ret = check_usage(fs, args, 0, 0);
+  if (FLA_ERR(ret, "check_usage() - after destroy"))
+    err = ret;
+
+destroy_pools:
+  for (uint32_t i = 0; i < npools; ++i)
+  {
+    ret = fla_pool_destroy(fs, args[i].own_pool);
+    if (FLA_ERR(ret, "fla_pool_destroy()"))
+      err = ret;
+  }
+
+  ret = fla_pool_destroy(fs, shared_pool);
+  if (FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+close_fs:
+  ret = fla_close(fs);
+  if (FLA_ERR(ret, "fla_close()"))
+    err = ret;
+
+teardown_lpbk:
+  ret = fla_ut_lpbk_dev_free(lpbk);
+  if (FLA_ERR(ret, "fla_ut_lpbk_dev_free()"))
+    err = ret;
+
+free_args:
+  free(args);
+
+exit:
+  return err;
+}
@@ -0,0 +1,210 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libflexalloc.h"
+#include "flexalloc.h"
+#include "flexalloc_mm.h"
+#include "flexalloc_util.h"
+#include "tests/flexalloc_tests_common.h"
+
+/*
+ * Let many threads of a thread safe handle create and destroy objects in one
+ * pool, in random amounts and in random order. Slab entries are taken and
+ * returned without the pool lock there, so check afterwards that every slab
+ * freelist holds exactly as many entries as the slab counts objects.
+ */
+
+#define NTHREADS 8
+#define NROUNDS 200
+#define MAX_OBJS 48
+
+struct thread_arg
+{
+  struct flexalloc *fs;
+  struct fla_pool *pool;
+  struct fla_object objs[MAX_OBJS];
+  uint32_t nobjs;
+  unsigned int seed;
+  int err;
+};
+
+static void *
+churn_objects(void *varg)
+{
+  struct thread_arg *arg = varg;
+  struct fla_object tmp;
+  uint32_t n, j;
+
+  for (uint32_t round = 0; round < NROUNDS; ++round)
+  {
+    n = rand_r(&arg->seed) % (MAX_OBJS - arg->nobjs + 1);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+      arg->err = fla_object_create(arg->fs, arg->pool, &arg->objs[arg->nobjs]);
+      if (FLA_ERR(arg->err, "fla_object_create()"))
+        return NULL;
+      arg->nobjs++;
+    }
+
+    n = rand_r(&arg->seed) % (arg->nobjs + 1);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+      j = rand_r(&arg->seed) % arg->nobjs;
+      arg->err = fla_object_destroy(arg->fs, arg->pool, &arg->objs[j]);
+      if (FLA_ERR(arg->err, "fla_object_destroy()"))
+        return NULL;
+
+      tmp = arg->objs[--arg->nobjs];
+      arg->objs[j] = tmp;
+    }
+  }
+
+  return NULL;
+}
+
+static int
+check_unique(struct thread_arg const *args)
+{
+  struct fla_object objs[NTHREADS * MAX_OBJS];
+  uint32_t nobjs = 0;
+
+  for (uint32_t t = 0; t < NTHREADS; ++t)
+  {
+    memcpy(&objs[nobjs], args[t].objs, args[t].nobjs * sizeof(*objs));
+    nobjs += args[t].nobjs;
+  }
+
+  return fla_ut_objs_check_unique(objs, nobjs);
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  struct fla_ut_lpbk *lpbk;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool = NULL;
+  struct fla_mkfs_p mkfs_params = {0};
+  struct fla_open_opts open_opts = {0};
+  struct fla_pool_usage usage;
+  struct thread_arg *args;
+  pthread_t threads[NTHREADS];
+  uint32_t nthreads = 0;
+  uint64_t nobjs, nlive = 0;
+
+  args = calloc(NTHREADS, sizeof(struct thread_arg));
+  if ((err = FLA_ERR(!args, "calloc()")))
+    goto exit;
+
+  err = fla_ut_lpbk_dev_alloc(512, 32768, &lpbk);
+  if (FLA_ERR(err, "fla_ut_lpbk_dev_alloc()"))
+    goto free_args;
+
+  // small slabs, so the threads also race for acquiring slabs
+  mkfs_params.open_opts.dev_uri = lpbk->dev_name;
+  mkfs_params.slab_nlb = 64;
+  mkfs_params.npools = 1;
+  err = fla_mkfs(&mkfs_params);
+  if (FLA_ERR(err, "fla_mkfs()"))
+    goto teardown_lpbk;
+
+  open_opts.dev_uri = lpbk->dev_name;
+  open_opts.flags = FLA_OPEN_THREAD_SAFE;
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open()"))
+    goto teardown_lpbk;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = "stress",
+    .name_len = strlen("stress"),
+    .obj_nlb = 1
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto close_fs;
+
+  for (; nthreads < NTHREADS; ++nthreads)
+  {
+    args[nthreads].fs = fs;
+    args[nthreads].pool = pool;
+    args[nthreads].seed = 1 + nthreads;
+    err = pthread_create(&threads[nthreads], NULL, churn_objects, &args[nthreads]);
+    if (FLA_ERR(err, "pthread_create()"))
+      break;
+  }
+
+  for (uint32_t i = 0; i < nthreads; ++i)
+  {
+    pthread_join(threads[i], NULL);
+    if (FLA_ERR(args[i].err, "thread failed"))
+      err = args[i].err;
+    nlive += args[i].nobjs;
+  }
+  if (err)
+    goto destroy_objects;
+
+  err = check_unique(args);
+  if (FLA_ERR(err, "check_unique()"))
+    goto destroy_objects;
+
+  err = fla_ut_pool_slabs_check(fs, pool, &nobjs);
+  if (FLA_ERR(err, "fla_ut_pool_slabs_check()"))
+    goto destroy_objects;
+
+  err = fla_pool_usage(fs, pool, &usage);
+  if (FLA_ERR(err, "fla_pool_usage()"))
+    goto destroy_objects;
+
+  err = FLA_ASSERTF(nobjs == nlive && usage.nobjs_used == nlive,
+                    "Threads hold %"PRIu64" objects, slabs count %"PRIu64", pool usage %"PRIu64,
+                    nlive, nobjs, usage.nobjs_used);
+  FLA_ERR(err, "FLA_ASSERT()");
+
+destroy_objects:
+  for (uint32_t t = 0; t < nthreads; ++t)
+  {
+    for (uint32_t i = 0; i < args[t].nobjs; ++i)
+    {
+      ret = fla_object_destroy(fs, pool, &args[t].objs[i]);
+      if (FLA_ERR(ret, "fla_object_destroy()"))
+        err = ret;
+    }
+  }
+  if (err)
+    goto destroy_pool;
+
+  err = fla_sync(fs);
+  if (FLA_ERR(err, "fla_sync()"))
+    goto destroy_pool;
+
+  err = fla_ut_pool_slabs_check(fs, pool, &nobjs);
+  if (FLA_ERR(err, "fla_ut_pool_slabs_check() - after destroy"))
+    goto destroy_pool;
+
+  err = FLA_ASSERTF(nobjs == 0, "Slabs count %"PRIu64" objects after destroy", nobjs);
+  FLA_ERR(err, "FLA_ASSERT()");
+
+destroy_pool:
+  ret = fla_pool_destroy(fs, pool);
+  if (FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+close_fs:
+  ret = fla_close(fs);
+  if (FLA_ERR(ret, "fla_close()"))
+    err = ret;
+
+teardown_lpbk:
+  ret = fla_ut_lpbk_dev_free(lpbk);
+  if (FLA_ERR(ret, "fla_ut_lpbk_dev_free()"))
+    err = ret;
+
+free_args:
+  free(args);
+
+exit:
+  return err;
+}
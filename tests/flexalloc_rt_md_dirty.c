@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_mm.h"
+#include "libflexalloc.h"
+
+/*
+ * Check that a flush leaves no metadata block or slab freelist dirty, that
+ * creating an object dirties only a few blocks and the freelist of its slab,
+ * and that the change survives a re-open although only those were written.
+ */
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char *pool_handle_name = "mypool";
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle = NULL;
+  struct fla_object obj;
+  struct fla_pool_usage usage;
+  struct fla_open_opts open_opts = {0};
+  uint32_t ndirty;
+
+  err = fla_ut_dev_init(40000, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+    err = fla_ut_fs_create(dev.nsect_zn, 1, &dev, &fs);
+  else
+    err = fla_ut_fs_create(1000, 1, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = dev._is_zns ? dev.nsect_zn : 1
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  err = fla_sync(fs);
+  if (FLA_ERR(err, "fla_sync()"))
+    goto teardown_ut_fs;
+
+  err = FLA_ASSERTF(fla_ut_md_ndirty(fs) == 0, "%"PRIu32" blocks left dirty by fla_sync()",
+                    fla_ut_md_ndirty(fs));
+  err |= FLA_ASSERTF(fla_ut_slabs_ndirty(fs) == 0,
+                     "%"PRIu32" slab freelists left dirty by fla_sync()", fla_ut_slabs_ndirty(fs));
+  if (err)
+    goto teardown_ut_fs;
+
+  err = fla_object_create(fs, pool_handle, &obj);
+  if (FLA_ERR(err, "fla_object_create()"))
+    goto teardown_ut_fs;
+
+  // a slab header, the free slab list and the pool entry at most
+  ndirty = fla_ut_md_ndirty(fs);
+  err = FLA_ASSERTF(ndirty > 0 && ndirty <= 4, "Creating an object dirtied %"PRIu32" blocks",
+                    ndirty);
+  err |= FLA_ASSERTF(fla_ut_slabs_ndirty(fs) == 1,
+                     "Creating an object dirtied %"PRIu32" slab freelists",
+                     fla_ut_slabs_ndirty(fs));
+  if (err)
+    goto teardown_ut_fs;
+
+  err = fla_close(fs);
+  fs = NULL;
+  if (FLA_ERR(err, "fla_close()"))
+    goto teardown_ut_dev;
+
+  open_opts.dev_uri = dev._dev_uri;
+  open_opts.md_dev_uri = dev._md_dev_uri;
+  err = fla_open(&open_opts, &fs);
+  if (FLA_ERR(err, "fla_open() - failed to re-open device"))
+    goto teardown_ut_dev;
+
+  err = fla_pool_usage(fs, pool_handle, &usage);
+  if (FLA_ERR(err, "fla_pool_usage()"))
+    goto teardown_ut_fs;
+
+  err = FLA_ASSERTF(usage.nslabs == 1 && usage.nobjs_used == 1,
+                    "Expected 1 slab and 1 object after re-open, got %"PRIu32" and %"PRIu64,
+                    usage.nslabs, usage.nobjs_used);
+  if (err)
+    goto teardown_ut_fs;
+
+  err = fla_object_destroy(fs, pool_handle, &obj);
+  if (FLA_ERR(err, "fla_object_destroy()"))
+    goto teardown_ut_fs;
+
+  err = fla_pool_destroy(fs, pool_handle);
+  pool_handle = NULL;
+  FLA_ERR(err, "fla_pool_destroy()");
+
+teardown_ut_fs:
+  free(pool_handle);
+  if (fs)
+  {
+    ret = fla_ut_fs_teardown(fs);
+    if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+      err = ret;
+  }
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+    err = ret;
+
+exit:
+  return err;
+}
@@ -16,6 +16,8 @@ struct test_vals
 };
 
 static int test_objects(struct test_vals * test_vals);
+static int test_usage(struct flexalloc *fs, struct fla_pool *pool_handle,
+                      struct test_vals const * test_vals, uint64_t nobjs_used);
 #define FLA_UT_OBJECT_NUMBER_OF_TESTS 2
 
 int
@@ -89,6 +91,10 @@ test_objects(struct test_vals * test_vals)
       goto release_pool;
   }
 
+  err = test_usage(fs, pool_handle, test_vals, test_vals->dev_nobj);
+  if(FLA_ERR(err, "test_usage()"))
+    goto release_pool;
+
   // Make sure we cannot allocate more
   /*err = fla_object_create(fs, pool_handle, &obj);
   if(FLA_ASSERTF(err != 0, "Allocated past the max value %d\n", test_vals->dev_nobj))
@@ -103,6 +109,10 @@ test_objects(struct test_vals * test_vals)
       goto release_pool;
   }
 
+  err = test_usage(fs, pool_handle, test_vals, 0);
+  if(FLA_ERR(err, "test_usage()"))
+    goto release_pool;
+
 release_pool:
   ret = fla_pool_destroy(fs, pool_handle);
   if(FLA_ERR(ret, "fla_pool_destroy()"))
@@ -124,3 +134,40 @@ free_objs:
 exit:
   return err;
 }
+
+static int
+test_usage(struct flexalloc *fs, struct fla_pool *pool_handle,
+           struct test_vals const * test_vals, uint64_t nobjs_used)
+{
+  int err;
+  struct fla_pool_usage pool_usage;
+  struct fla_usage usage;
+
+  err = fla_pool_usage(fs, pool_handle, &pool_usage);
+  if(FLA_ERR(err, "fla_pool_usage()"))
+    return err;
+
+  err = fla_usage(fs, &usage);
+  if(FLA_ERR(err, "fla_usage()"))
+    return err;
+
+  err |= FLA_ASSERTF(pool_usage.nobjs_used == nobjs_used,
+                     "Pool counts %"PRIu64" objects, expected %"PRIu64,
+                     pool_usage.nobjs_used, nobjs_used);
+  err |= FLA_ASSERTF(pool_usage.nobjs >= pool_usage.nobjs_used,
+                     "Pool counts %"PRIu64" objects in %"PRIu64" slots",
+                     pool_usage.nobjs_used, pool_usage.nobjs);
+  err |= FLA_ASSERTF(usage.nslabs - usage.nslabs_free == pool_usage.nslabs,
+                     "Device counts %"PRIu32" slabs in use, the pool %"PRIu32,
+                     usage.nslabs - usage.nslabs_free, pool_usage.nslabs);
+  err |= FLA_ASSERTF(usage.npools == test_vals->npools && usage.npools_used == 1,
+                     "Device counts %"PRIu32" of %"PRIu32" pools used",
+                     usage.npools_used, usage.npools);
+  err |= FLA_ASSERTF(usage.nobjs_used == nobjs_used,
+                     "Device counts %"PRIu64" objects, expected %"PRIu64,
+                     usage.nobjs_used, nobjs_used);
+  err |= FLA_ASSERTF(usage.nlb_used == nobjs_used * test_vals->obj_nlb,
+                     "Device counts %"PRIu64" blocks used", usage.nlb_used);
+
+  return err;
+}
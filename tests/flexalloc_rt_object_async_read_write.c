@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libflexalloc.h"
+#include "flexalloc.h"
+#include "flexalloc_util.h"
+#include "tests/flexalloc_tests_common.h"
+
+#define NOBJS 16
+
+struct test_vals
+{
+  uint64_t blk_num;
+  uint32_t npools;
+  uint32_t slab_nlb;
+  uint32_t obj_nlb;
+};
+
+struct io_status
+{
+  int err;
+  int ncalls;
+};
+
+static void
+io_cb(int err, void *cb_arg)
+{
+  struct io_status *status = cb_arg;
+  status->err = err;
+  status->ncalls++;
+}
+
+static int
+check_status(struct io_status *status, uint32_t nstatus)
+{
+  int err = 0;
+
+  for (uint32_t i = 0; i < nstatus; ++i)
+  {
+    err |= FLA_ASSERTF(status[i].ncalls == 1, "Callback %"PRIu32" called %d times",
+                       i, status[i].ncalls);
+    err |= FLA_ASSERTF(status[i].err == 0, "Transfer %"PRIu32" failed with %d",
+                       i, status[i].err);
+  }
+
+  return err;
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char * pool_handle_name, *write_buf, *read_buf;
+  size_t obj_nbytes;
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle;
+  struct fla_object objs[NOBJS];
+  struct io_status status[NOBJS];
+  uint32_t nobjs = 0;
+  struct test_vals test_vals
+      = {.blk_num = 40000, .slab_nlb = 4000, .npools = 1, .obj_nlb = 8};
+
+  pool_handle_name = "mypool";
+
+  err = fla_ut_dev_init(test_vals.blk_num, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    test_vals.slab_nlb = dev.nsect_zn * NOBJS;
+    test_vals.obj_nlb = dev.nsect_zn;
+  }
+
+  err = fla_ut_fs_create(test_vals.slab_nlb, test_vals.npools, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  obj_nbytes = test_vals.obj_nlb * dev.lb_nbytes;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = test_vals.obj_nlb
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if(FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  for (nobjs = 0; nobjs < NOBJS; ++nobjs)
+  {
+    err = fla_object_create(fs, pool_handle, &objs[nobjs]);
+    if(FLA_ERR(err, "fla_object_create()"))
+      goto release_objects;
+  }
+
+  write_buf = fla_buf_alloc(fs, obj_nbytes * NOBJS);
+  if((err = FLA_ERR(!write_buf, "fla_buf_alloc()")))
+    goto release_objects;
+
+  read_buf = fla_buf_alloc(fs, obj_nbytes * NOBJS);
+  if((err = FLA_ERR(!read_buf, "fla_buf_alloc()")))
+    goto free_write_buffer;
+
+  fla_t_fill_buf_random(write_buf, obj_nbytes * NOBJS);
+  memset(read_buf, 0, obj_nbytes * NOBJS);
+
+  // Submit all writes before reaping any of them
+  memset(status, 0, sizeof(status));
+  for (uint32_t i = 0; i < NOBJS; ++i)
+  {
+    err = fla_object_write_async(fs, pool_handle, &objs[i], write_buf + i * obj_nbytes, 0,
+                                 obj_nbytes, io_cb, &status[i]);
+    if(FLA_ERR(err, "fla_object_write_async()"))
+      goto free_read_buffer;
+  }
+
+  ret = fla_object_io_drain(fs);
+  if((err = FLA_ERR(ret < 0, "fla_object_io_drain()")))
+    goto free_read_buffer;
+
+  err = check_status(status, NOBJS);
+  if(FLA_ERR(err, "check_status() - writes"))
+    goto free_read_buffer;
+
+  memset(status, 0, sizeof(status));
+  for (uint32_t i = 0; i < NOBJS; ++i)
+  {
+    err = fla_object_read_async(fs, pool_handle, &objs[i], read_buf + i * obj_nbytes, 0,
+                                obj_nbytes, io_cb, &status[i]);
+    if(FLA_ERR(err, "fla_object_read_async()"))
+      goto free_read_buffer;
+  }
+
+  // Reap completions in batches until every read has called back
+  for (int ncompleted = 0; ncompleted < NOBJS; ncompleted += ret)
+  {
+    ret = fla_object_io_poll(fs, 4);
+    if((err = FLA_ERR(ret < 0, "fla_object_io_poll()")))
+      goto free_read_buffer;
+  }
+
+  err = check_status(status, NOBJS);
+  if(FLA_ERR(err, "check_status() - reads"))
+    goto free_read_buffer;
+
+  err = memcmp(write_buf, read_buf, obj_nbytes * NOBJS);
+  if(FLA_ERR(err, "memcmp() - failed to read back the written values"))
+    goto free_read_buffer;
+
+  // Bounds are checked at submission, the callback must not be called
+  memset(status, 0, sizeof(status));
+  ret = fla_object_read_async(fs, pool_handle, &objs[0], read_buf, dev.lb_nbytes,
+                              obj_nbytes, io_cb, &status[0]);
+  if((err = FLA_ASSERT(ret != 0, "Read outside of object was submitted")))
+    goto free_read_buffer;
+
+  ret = fla_object_io_drain(fs);
+  if((err = FLA_ERR(ret < 0, "fla_object_io_drain()")))
+    goto free_read_buffer;
+
+  err = FLA_ASSERT(status[0].ncalls == 0, "Callback called for rejected read");
+
+free_read_buffer:
+  fla_buf_free(fs, read_buf);
+
+free_write_buffer:
+  fla_buf_free(fs, write_buf);
+
+release_objects:
+  for (uint32_t i = 0; i < nobjs; ++i)
+  {
+    ret = fla_object_destroy(fs, pool_handle, &objs[i]);
+    if(FLA_ERR(ret, "fla_object_destroy()"))
+      err = ret;
+  }
+
+  ret = fla_pool_destroy(fs, pool_handle);
+  if(FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+teardown_ut_fs:
+  ret = fla_ut_fs_teardown(fs);
+  if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+  {
+    err = ret;
+  }
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+  {
+    err = ret;
+  }
+
+exit:
+  return err;
+}
@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <string.h>
+#include "tests/flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_mm.h"
+#include "flexalloc_objcache.h"
+#include "libflexalloc.h"
+
+/*
+ * Create and destroy more objects than the object cache holds, twice over,
+ * and check that no object is handed out twice and that the cached objects
+ * are back in their slabs once the handle is synced.
+ */
+
+#define NOBJS (3 * FLA_OBJ_CACHE_NOBJS)
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char *pool_handle_name = "mypool";
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle;
+  struct fla_object objs[NOBJS];
+  struct fla_pool_usage usage;
+  uint32_t nobjs = 0, slab_nlb = 4000, obj_nlb = 1;
+  uint64_t refcount;
+
+  err = fla_ut_dev_init(40000, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    // one object per zone, too many zones needed to get past the cache
+    err = FLA_TEST_SKIP_RETCODE;
+    goto teardown_ut_dev;
+  }
+
+  err = fla_ut_fs_create(slab_nlb, 1, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = obj_nlb
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  for (int round = 0; round < 2; ++round)
+  {
+    for (nobjs = 0; nobjs < NOBJS; ++nobjs)
+    {
+      err = fla_object_create(fs, pool_handle, &objs[nobjs]);
+      if (FLA_ERR(err, "fla_object_create()"))
+        goto release_objects;
+    }
+
+    err = fla_ut_objs_check_unique(objs, NOBJS);
+    if (FLA_ERR(err, "fla_ut_objs_check_unique()"))
+      goto release_objects;
+
+    err = fla_pool_usage(fs, pool_handle, &usage);
+    if (FLA_ERR(err, "fla_pool_usage()"))
+      goto release_objects;
+
+    err = FLA_ASSERTF(usage.nobjs_used == NOBJS, "Pool counts %"PRIu64" objects",
+                      usage.nobjs_used);
+    if (FLA_ERR(err, "FLA_ASSERT()"))
+      goto release_objects;
+
+    // destroy the second half first, the cache overflows in the middle of it
+    for (uint32_t i = NOBJS; i > 0; --i)
+    {
+      err = fla_object_destroy(fs, pool_handle, &objs[(i + NOBJS / 2) % NOBJS]);
+      if (FLA_ERR(err, "fla_object_destroy()"))
+        goto release_pool;
+    }
+    nobjs = 0;
+  }
+
+  err = fla_sync(fs);
+  if (FLA_ERR(err, "fla_sync()"))
+    goto release_pool;
+
+  err = fla_ut_pool_slabs_check(fs, pool_handle, &refcount);
+  if (FLA_ERR(err, "fla_ut_pool_slabs_check()"))
+    goto release_pool;
+
+  err = FLA_ASSERTF(refcount == 0, "Slabs hold %"PRIu64" objects after sync", refcount);
+  FLA_ERR(err, "FLA_ASSERT()");
+  goto release_pool;
+
+release_objects:
+  for (uint32_t i = 0; i < nobjs; ++i)
+  {
+    ret = fla_object_destroy(fs, pool_handle, &objs[i]);
+    if (FLA_ERR(ret, "fla_object_destroy()"))
+      err = ret;
+  }
+
+release_pool:
+  ret = fla_pool_destroy(fs, pool_handle);
+  if (FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+teardown_ut_fs:
+  ret = fla_ut_fs_teardown(fs);
+  if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+    err = ret;
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+    err = ret;
+
+exit:
+  return err;
+}
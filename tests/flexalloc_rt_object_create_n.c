@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_mm.h"
+#include "libflexalloc.h"
+
+/*
+ * Create objects in batches spanning several slabs and destroy them in
+ * batches again, checking that no object is handed out twice and that the
+ * slab counts match the slab freelists all along.
+ */
+
+// check the slab refcounts against their freelists and the pool usage
+static int
+check_slabs(struct flexalloc *fs, struct fla_pool *pool_handle, uint64_t nobjs)
+{
+  struct fla_pool_usage usage;
+  uint64_t refcount;
+  int err;
+
+  err = fla_ut_pool_slabs_check(fs, pool_handle, &refcount);
+  if (FLA_ERR(err, "fla_ut_pool_slabs_check()"))
+    return err;
+
+  err = fla_pool_usage(fs, pool_handle, &usage);
+  if (FLA_ERR(err, "fla_pool_usage()"))
+    return err;
+
+  return FLA_ASSERTF(refcount == nobjs && usage.nobjs_used == nobjs,
+                     "Expected %"PRIu64" objects, slabs count %"PRIu64", pool usage %"PRIu64,
+                     nobjs, refcount, usage.nobjs_used);
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char *pool_handle_name = "mypool";
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle;
+  struct fla_object *objs;
+  uint32_t slab_nlb = 1000, obj_nlb = 1, nobjs, nhalf;
+
+  err = fla_ut_dev_init(40000, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    // one object per zone, too many zones needed to span several slabs
+    err = FLA_TEST_SKIP_RETCODE;
+    goto teardown_ut_dev;
+  }
+
+  err = fla_ut_fs_create(slab_nlb, 1, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = obj_nlb
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  // two and a half slabs worth of objects
+  nobjs = fs->pools.entries[pool_handle->ndx].slab_nobj * 5 / 2;
+  nhalf = nobjs / 2;
+  objs = calloc(nobjs, sizeof(struct fla_object));
+  if ((err = FLA_ERR(!objs, "calloc()")))
+    goto release_pool;
+
+  err = fla_object_create_n(fs, pool_handle, objs, nhalf);
+  if (FLA_ERR(err, "fla_object_create_n()"))
+    goto free_objs;
+
+  // starts in the partial slab left by the first batch
+  err = fla_object_create_n(fs, pool_handle, objs + nhalf, nobjs - nhalf);
+  if (FLA_ERR(err, "fla_object_create_n()"))
+    goto release_first;
+
+  err = fla_ut_objs_check_unique(objs, nobjs);
+  if (FLA_ERR(err, "fla_ut_objs_check_unique()"))
+    goto release_all;
+
+  err = check_slabs(fs, pool_handle, nobjs);
+  if (FLA_ERR(err, "check_slabs() - after create"))
+    goto release_all;
+
+  // destroy the second half first
+  err = fla_object_destroy_n(fs, pool_handle, objs + nhalf, nobjs - nhalf);
+  if (FLA_ERR(err, "fla_object_destroy_n()"))
+    goto release_first;
+
+  err = check_slabs(fs, pool_handle, nhalf);
+  if (FLA_ERR(err, "check_slabs() - after destroying half"))
+    goto release_first;
+
+  err = fla_object_destroy_n(fs, pool_handle, objs, nhalf);
+  if (FLA_ERR(err, "fla_object_destroy_n()"))
+    goto free_objs;
+
+  err = fla_sync(fs);
+  if (FLA_ERR(err, "fla_sync()"))
+    goto free_objs;
+
+  err = check_slabs(fs, pool_handle, 0);
+  FLA_ERR(err, "check_slabs() - after destroy");
+  goto free_objs;
+
+release_all:
+  ret = fla_object_destroy_n(fs, pool_handle, objs + nhalf, nobjs - nhalf);
+  if (FLA_ERR(ret, "fla_object_destroy_n()"))
+    err = ret;
+
+release_first:
+  ret = fla_object_destroy_n(fs, pool_handle, objs, nhalf);
+  if (FLA_ERR(ret, "fla_object_destroy_n()"))
+    err = ret;
+
+free_objs:
+  free(objs);
+
+release_pool:
+  ret = fla_pool_destroy(fs, pool_handle);
+  if (FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+teardown_ut_fs:
+  ret = fla_ut_fs_teardown(fs);
+  if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+    err = ret;
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+    err = ret;
+
+exit:
+  return err;
+}
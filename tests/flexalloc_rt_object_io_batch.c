@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libflexalloc.h"
+#include "flexalloc.h"
+#include "flexalloc_util.h"
+#include "tests/flexalloc_tests_common.h"
+
+#define NOBJS 8
+
+struct test_vals
+{
+  uint64_t blk_num;
+  uint32_t npools;
+  uint32_t slab_nlb;
+  uint32_t obj_nlb;
+};
+
+static int
+check_status(struct fla_object_io_desc *descs, uint32_t ndescs)
+{
+  int err = 0;
+
+  for (uint32_t i = 0; i < ndescs; ++i)
+    err |= FLA_ASSERTF(descs[i].status == 0, "Descriptor %"PRIu32" failed with %d",
+                       i, descs[i].status);
+
+  return err;
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char * pool_handle_name, *write_buf, *read_bufs[NOBJS] = {0};
+  size_t obj_nbytes;
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle;
+  struct fla_object objs[NOBJS];
+  struct fla_object_io_desc descs[NOBJS + 1];
+  uint32_t nobjs = 0;
+  struct test_vals test_vals
+      = {.blk_num = 40000, .slab_nlb = 4000, .npools = 1, .obj_nlb = 8};
+
+  pool_handle_name = "mypool";
+
+  err = fla_ut_dev_init(test_vals.blk_num, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    test_vals.slab_nlb = dev.nsect_zn * NOBJS;
+    test_vals.obj_nlb = dev.nsect_zn;
+  }
+
+  err = fla_ut_fs_create(test_vals.slab_nlb, test_vals.npools, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  obj_nbytes = test_vals.obj_nlb * dev.lb_nbytes;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = test_vals.obj_nlb
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if(FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  for (nobjs = 0; nobjs < NOBJS; ++nobjs)
+  {
+    err = fla_object_create(fs, pool_handle, &objs[nobjs]);
+    if(FLA_ERR(err, "fla_object_create()"))
+      goto release_objects;
+  }
+
+  write_buf = fla_buf_alloc(fs, obj_nbytes * NOBJS);
+  if((err = FLA_ERR(!write_buf, "fla_buf_alloc()")))
+    goto release_objects;
+
+  for (uint32_t i = 0; i < NOBJS; ++i)
+  {
+    read_bufs[i] = fla_buf_alloc(fs, obj_nbytes);
+    if((err = FLA_ERR(!read_bufs[i], "fla_buf_alloc()")))
+      goto free_buffers;
+    memset(read_bufs[i], 0, obj_nbytes);
+  }
+
+  fla_t_fill_buf_random(write_buf, obj_nbytes * NOBJS);
+
+  // Objects of one slab out of order, backed by one buffer so they can be merged
+  for (uint32_t i = 0; i < NOBJS; ++i)
+  {
+    uint32_t obj_ndx = NOBJS - 1 - i;
+    descs[i] = (struct fla_object_io_desc)
+    {
+      .pool = pool_handle, .object = &objs[obj_ndx], .offset = 0, .len = obj_nbytes,
+      .buf = write_buf + obj_ndx * obj_nbytes, .dir = FLA_OBJECT_IO_WRITE, .status = -1
+    };
+  }
+
+  err = fla_object_io_batch(fs, descs, NOBJS);
+  if(FLA_ERR(err, "fla_object_io_batch() - writes"))
+    goto free_buffers;
+
+  err = check_status(descs, NOBJS);
+  if(FLA_ERR(err, "check_status() - writes"))
+    goto free_buffers;
+
+  // Separate buffers, plus one read past the end of its object
+  for (uint32_t i = 0; i < NOBJS; ++i)
+  {
+    descs[i] = (struct fla_object_io_desc)
+    {
+      .pool = pool_handle, .object = &objs[i], .offset = 0, .len = obj_nbytes,
+      .buf = read_bufs[i], .dir = FLA_OBJECT_IO_READ, .status = -1
+    };
+  }
+  descs[NOBJS] = descs[0];
+  descs[NOBJS].offset = dev.lb_nbytes;
+
+  ret = fla_object_io_batch(fs, descs, NOBJS + 1);
+  if((err = FLA_ASSERT(ret != 0, "Batch with a read outside of an object succeeded")))
+    goto free_buffers;
+
+  err = FLA_ASSERT(descs[NOBJS].status != 0, "Read outside of an object has a zero status");
+  if(FLA_ERR(err, "FLA_ASSERT()"))
+    goto free_buffers;
+
+  err = check_status(descs, NOBJS);
+  if(FLA_ERR(err, "check_status() - reads"))
+    goto free_buffers;
+
+  for (uint32_t i = 0; i < NOBJS; ++i)
+  {
+    err = memcmp(write_buf + i * obj_nbytes, read_bufs[i], obj_nbytes);
+    if(FLA_ERR(err, "memcmp() - failed to read back the written values"))
+      goto free_buffers;
+  }
+
+free_buffers:
+  for (uint32_t i = 0; i < NOBJS; ++i)
+  {
+    if (read_bufs[i])
+      fla_buf_free(fs, read_bufs[i]);
+  }
+  fla_buf_free(fs, write_buf);
+
+release_objects:
+  for (uint32_t i = 0; i < nobjs; ++i)
+  {
+    ret = fla_object_destroy(fs, pool_handle, &objs[i]);
+    if(FLA_ERR(ret, "fla_object_destroy()"))
+      err = ret;
+  }
+
+  ret = fla_pool_destroy(fs, pool_handle);
+  if(FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+teardown_ut_fs:
+  ret = fla_ut_fs_teardown(fs);
+  if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+  {
+    err = ret;
+  }
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+  {
+    err = ret;
+  }
+
+exit:
+  return err;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "libflexalloc.h"
+#include "flexalloc.h"
+#include "flexalloc_util.h"
+#include "tests/flexalloc_tests_common.h"
+
+#define NIOV 3
+
+struct test_vals
+{
+  uint64_t blk_num;
+  uint32_t npools;
+  uint32_t slab_nlb;
+  uint32_t obj_nlb;
+};
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char * pool_handle_name, *obj_buf, *read_buf;
+  size_t obj_nbytes, lb_nbytes;
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle;
+  struct fla_object obj;
+  struct iovec iov[NIOV] = {0};
+  struct test_vals test_vals
+      = {.blk_num = 40000, .slab_nlb = 4000, .npools = 1, .obj_nlb = 8};
+
+  pool_handle_name = "mypool";
+
+  err = fla_ut_dev_init(test_vals.blk_num, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    test_vals.slab_nlb = dev.nsect_zn;
+    test_vals.obj_nlb = dev.nsect_zn;
+  }
+
+  err = fla_ut_fs_create(test_vals.slab_nlb, test_vals.npools, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  lb_nbytes = dev.lb_nbytes;
+  obj_nbytes = test_vals.obj_nlb * lb_nbytes;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = test_vals.obj_nlb
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if(FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  err = fla_object_create(fs, pool_handle, &obj);
+  if(FLA_ERR(err, "fla_object_create()"))
+    goto destroy_pool;
+
+  // Header and footer of one block around a data region, each in its own buffer
+  iov[0].iov_len = lb_nbytes;
+  iov[1].iov_len = obj_nbytes - 2 * lb_nbytes;
+  iov[2].iov_len = lb_nbytes;
+  for (int i = 0; i < NIOV; ++i)
+  {
+    iov[i].iov_base = fla_buf_alloc(fs, iov[i].iov_len);
+    if((err = FLA_ERR(!iov[i].iov_base, "fla_buf_alloc()")))
+      goto free_iov;
+    fla_t_fill_buf_random(iov[i].iov_base, iov[i].iov_len);
+  }
+
+  obj_buf = fla_buf_alloc(fs, obj_nbytes);
+  if((err = FLA_ERR(!obj_buf, "fla_buf_alloc()")))
+    goto free_iov;
+
+  read_buf = fla_buf_alloc(fs, obj_nbytes);
+  if((err = FLA_ERR(!read_buf, "fla_buf_alloc()")))
+    goto free_obj_buf;
+
+  for (int i = 0, off = 0; i < NIOV; off += iov[i].iov_len, ++i)
+    memcpy(obj_buf + off, iov[i].iov_base, iov[i].iov_len);
+
+  err = fla_object_writev(fs, pool_handle, &obj, iov, NIOV, 0);
+  if(FLA_ERR(err, "fla_object_writev()"))
+    goto free_read_buf;
+
+  memset(read_buf, 0, obj_nbytes);
+  err = fla_object_read(fs, pool_handle, &obj, read_buf, 0, obj_nbytes);
+  if(FLA_ERR(err, "fla_object_read()"))
+    goto free_read_buf;
+
+  err = memcmp(obj_buf, read_buf, obj_nbytes);
+  if(FLA_ERR(err, "memcmp() - gathered write differs from the source buffers"))
+    goto free_read_buf;
+
+  // Scatter the object back into the same buffers
+  for (int i = 0; i < NIOV; ++i)
+    memset(iov[i].iov_base, 0, iov[i].iov_len);
+
+  err = fla_object_readv(fs, pool_handle, &obj, iov, NIOV, 0);
+  if(FLA_ERR(err, "fla_object_readv()"))
+    goto free_read_buf;
+
+  for (int i = 0, off = 0; i < NIOV; off += iov[i].iov_len, ++i)
+  {
+    err = memcmp(obj_buf + off, iov[i].iov_base, iov[i].iov_len);
+    if(FLA_ERR(err, "memcmp() - scattered read differs from the object"))
+      goto free_read_buf;
+  }
+
+  // Same bounds as fla_object_write, the gathered length must fit in the object
+  ret = fla_object_writev(fs, pool_handle, &obj, iov, NIOV, lb_nbytes);
+  err = FLA_ASSERT(ret != 0, "Write outside of an object was accepted");
+
+free_read_buf:
+  fla_buf_free(fs, read_buf);
+
+free_obj_buf:
+  fla_buf_free(fs, obj_buf);
+
+free_iov:
+  for (int i = 0; i < NIOV; ++i)
+  {
+    if (iov[i].iov_base)
+      fla_buf_free(fs, iov[i].iov_base);
+  }
+
+  ret = fla_object_destroy(fs, pool_handle, &obj);
+  if(FLA_ERR(ret, "fla_object_destroy()"))
+    err = ret;
+
+destroy_pool:
+  ret = fla_pool_destroy(fs, pool_handle);
+  if(FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+teardown_ut_fs:
+  ret = fla_ut_fs_teardown(fs);
+  if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+  {
+    err = ret;
+  }
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+  {
+    err = ret;
+  }
+
+exit:
+  return err;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libflexalloc.h"
+#include "flexalloc.h"
+#include "flexalloc_util.h"
+#include "tests/flexalloc_tests_common.h"
+
+struct test_vals
+{
+  uint64_t blk_num;
+  uint32_t npools;
+  uint32_t slab_nlb;
+  uint32_t obj_nlb;
+};
+
+/// Read range, in blocks plus a byte adjustment, relative to the object start
+struct unaligned_read_vals
+{
+  uint32_t s_blk;
+  int32_t s_adj;
+  uint32_t e_blk;
+  int32_t e_adj;
+};
+
+static struct unaligned_read_vals reads[] =
+{
+  // within one block
+  {.s_blk = 1, .s_adj = 10, .e_blk = 1, .e_adj = 20},
+  // partial head only
+  {.s_blk = 0, .s_adj = 7, .e_blk = 3, .e_adj = 0},
+  // partial tail only
+  {.s_blk = 2, .s_adj = 0, .e_blk = 4, .e_adj = 1},
+  // partial head and tail in neighbouring blocks
+  {.s_blk = 1, .s_adj = 100, .e_blk = 2, .e_adj = 3},
+  // partial head and tail around an aligned middle
+  {.s_blk = 0, .s_adj = 1, .e_blk = 7, .e_adj = -1},
+  // fully aligned
+  {.s_blk = 2, .s_adj = 0, .e_blk = 6, .e_adj = 0},
+};
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char * pool_handle_name, *obj_buf, *read_buf, *dst;
+  size_t obj_nbytes, offset, len;
+  uint32_t lb_nbytes;
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle;
+  struct fla_object obj;
+  struct test_vals test_vals
+      = {.blk_num = 40000, .slab_nlb = 4000, .npools = 1, .obj_nlb = 8};
+
+  pool_handle_name = "mypool";
+
+  err = fla_ut_dev_init(test_vals.blk_num, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    test_vals.slab_nlb = dev.nsect_zn;
+    test_vals.obj_nlb = dev.nsect_zn;
+  }
+
+  err = fla_ut_fs_create(test_vals.slab_nlb, test_vals.npools, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  lb_nbytes = dev.lb_nbytes;
+  obj_nbytes = test_vals.obj_nlb * lb_nbytes;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = test_vals.obj_nlb
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if(FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  err = fla_object_create(fs, pool_handle, &obj);
+  if(FLA_ERR(err, "fla_object_create()"))
+    goto destroy_pool;
+
+  obj_buf = fla_buf_alloc(fs, obj_nbytes);
+  if((err = FLA_ERR(!obj_buf, "fla_buf_alloc()")))
+    goto destroy_object;
+
+  // one spare byte to read at an address which is not block aligned
+  read_buf = fla_buf_alloc(fs, obj_nbytes + 1);
+  if((err = FLA_ERR(!read_buf, "fla_buf_alloc()")))
+    goto free_obj_buf;
+
+  fla_t_fill_buf_random(obj_buf, obj_nbytes);
+  err = fla_object_write(fs, pool_handle, &obj, obj_buf, 0, obj_nbytes);
+  if(FLA_ERR(err, "fla_object_write()"))
+    goto free_read_buf;
+
+  for (size_t i = 0; i < 2 * sizeof(reads) / sizeof(reads[0]); ++i)
+  {
+    offset = reads[i / 2].s_blk * lb_nbytes + reads[i / 2].s_adj;
+    len = reads[i / 2].e_blk * lb_nbytes + reads[i / 2].e_adj - offset;
+    dst = read_buf + i % 2;
+
+    memset(read_buf, 0, obj_nbytes + 1);
+    err = fla_object_unaligned_read(fs, pool_handle, &obj, dst, offset, len);
+    if(FLA_ERR(err, "fla_object_unaligned_read()"))
+      goto free_read_buf;
+
+    err = memcmp(dst, obj_buf + offset, len);
+    if(FLA_ERR(err, "memcmp() - unaligned read differs from the object"))
+      goto free_read_buf;
+
+    // Nothing past len may be touched
+    err = FLA_ASSERTF(fla_ut_count_char_in_buf(0, dst + len, obj_nbytes - len)
+                      == obj_nbytes - len, "Read %zu wrote past the requested length", i);
+    if(FLA_ERR(err, "FLA_ASSERT()"))
+      goto free_read_buf;
+  }
+
+  ret = fla_object_unaligned_read(fs, pool_handle, &obj, read_buf, obj_nbytes - 1, 2);
+  err = FLA_ASSERT(ret != 0, "Read outside of an object succeeded");
+
+free_read_buf:
+  fla_buf_free(fs, read_buf);
+
+free_obj_buf:
+  fla_buf_free(fs, obj_buf);
+
+destroy_object:
+  ret = fla_object_destroy(fs, pool_handle, &obj);
+  if(FLA_ERR(ret, "fla_object_destroy()"))
+    err = ret;
+
+destroy_pool:
+  ret = fla_pool_destroy(fs, pool_handle);
+  if(FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+teardown_ut_fs:
+  ret = fla_ut_fs_teardown(fs);
+  if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+  {
+    err = ret;
+  }
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+  {
+    err = ret;
+  }
+
+exit:
+  return err;
+}
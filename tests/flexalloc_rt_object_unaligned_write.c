@@ -34,6 +34,7 @@ struct unaligned_test_vals
 int test_unaligned_write(struct fs_test_vals const * fs_tv,
                          struct unaligned_test_vals const * u_tv);
 int test_unaligned_writes(struct fs_test_vals const * fs_tv);
+int test_unaligned_write_direct(struct fs_test_vals const * fs_tv);
 
 int
 main(int argc, char **argv)
@@ -86,6 +87,10 @@ main(int argc, char **argv)
   if(FLA_ERR(err, "test_unaligned_write()"))
     goto release_object;
 
+  err = test_unaligned_write_direct(&fs_vals);
+  if(FLA_ERR(err, "test_unaligned_write_direct()"))
+    goto release_object;
+
 release_object:
   ret = fla_object_destroy(fs_vals.fs, fs_vals.pool_handle, &fs_vals.object_handle);
   if(FLA_ERR(ret, "fla_object_destroy()"))
@@ -183,7 +188,7 @@ free_w_buf:
   free(w_buf);
 
 free_a_buf:
-  free(a_buf);
+  fla_buf_free(fs_tv->fs, a_buf);
 
 exit:
   return err;
@@ -227,3 +232,62 @@ exit:
 }
 
 
+
+/*
+ * Source buffer placed so the block aligned interior of the write sits at an
+ * aligned address, which lets it go to the device without a bounce.
+ */
+int
+test_unaligned_write_direct(struct fs_test_vals const * fs_tv)
+{
+  int err = 0;
+  size_t lb_nbytes = fs_tv->fs->dev.lb_nbytes, w_offset = lb_nbytes / 2, w_len = 3 * lb_nbytes;
+  size_t buf_len = 5 * lb_nbytes;
+  char * w_buf, * r_buf, * expected;
+
+  w_buf = fla_buf_alloc(fs_tv->fs, buf_len);
+  if((err = FLA_ERR(!w_buf, "fla_buf_alloc()")))
+    goto exit;
+
+  r_buf = fla_buf_alloc(fs_tv->fs, buf_len);
+  if((err = FLA_ERR(!r_buf, "fla_buf_alloc()")))
+    goto free_w_buf;
+
+  expected = malloc(buf_len);
+  if((err = FLA_ERR(!expected, "malloc()")))
+    goto free_r_buf;
+
+  fla_t_fill_buf_random(expected, buf_len);
+  memcpy(w_buf, expected, buf_len);
+  err = fla_object_write(fs_tv->fs, fs_tv->pool_handle, &fs_tv->object_handle, w_buf, 0,
+                         buf_len);
+  if(FLA_ERR(err, "fla_object_write()"))
+    goto free_expected;
+
+  fla_t_fill_buf_random(w_buf, buf_len);
+  memcpy(expected + w_offset, w_buf + w_offset, w_len);
+  err = fla_object_unaligned_write(fs_tv->fs, fs_tv->pool_handle, &fs_tv->object_handle,
+                                   w_buf + w_offset, w_offset, w_len);
+  if(FLA_ERR(err, "fla_object_unaligned_write()"))
+    goto free_expected;
+
+  err = fla_object_read(fs_tv->fs, fs_tv->pool_handle, &fs_tv->object_handle, r_buf, 0,
+                        buf_len);
+  if(FLA_ERR(err, "fla_object_read()"))
+    goto free_expected;
+
+  err = memcmp(r_buf, expected, buf_len);
+  FLA_ERR(err, "memcmp() - failed to read back the written value");
+
+free_expected:
+  free(expected);
+
+free_r_buf:
+  fla_buf_free(fs_tv->fs, r_buf);
+
+free_w_buf:
+  fla_buf_free(fs_tv->fs, w_buf);
+
+exit:
+  return err;
+}
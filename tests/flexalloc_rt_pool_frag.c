@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_mm.h"
+#include "libflexalloc.h"
+
+/*
+ * Leave one slab nearly empty and one nearly full, check the fragmentation
+ * of the pool and that the next object comes from the fuller slab.
+ */
+
+static int
+check_frag(struct flexalloc *fs, struct fla_pool *pool_handle, uint32_t nfull,
+           uint32_t nkeep_a, uint32_t nkeep_b)
+{
+  struct fla_pool_frag frag;
+  uint32_t slab_nobj = fs->pools.entries[pool_handle->ndx].slab_nobj;
+  uint32_t bin_a = nkeep_a * FLA_POOL_NBINS / slab_nobj;
+  uint32_t bin_b = nkeep_b * FLA_POOL_NBINS / slab_nobj;
+  uint64_t nobjs = nkeep_a + nkeep_b;
+  int err;
+
+  err = fla_pool_frag(fs, pool_handle, &frag);
+  if (FLA_ERR(err, "fla_pool_frag()"))
+    return err;
+
+  err |= FLA_ASSERTF(frag.nslabs_full == nfull, "Expected %"PRIu32" full slabs, got %"PRIu32,
+                     nfull, frag.nslabs_full);
+  err |= FLA_ASSERTF(frag.nslabs_partial == 2, "Expected 2 partial slabs, got %"PRIu32,
+                     frag.nslabs_partial);
+  err |= FLA_ASSERTF(frag.nslabs_empty == 0, "Expected no empty slab, got %"PRIu32,
+                     frag.nslabs_empty);
+  err |= FLA_ASSERTF(frag.nslabs_bin[bin_a] >= 1 && frag.nslabs_bin[bin_b] >= 1,
+                     "Partial slabs missing from bins %"PRIu32" and %"PRIu32, bin_a, bin_b);
+  err |= FLA_ASSERTF(frag.nobjs_partial == nobjs, "Expected %"PRIu64" objects, got %"PRIu64,
+                     nobjs, frag.nobjs_partial);
+  err |= FLA_ASSERTF(frag.nslabs_reclaimable == 2 - FLA_CEIL_DIV(nobjs, slab_nobj),
+                     "Unexpected number of reclaimable slabs %"PRIu32, frag.nslabs_reclaimable);
+  return err;
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char *pool_handle_name = "mypool";
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle;
+  struct fla_object *objs, obj;
+  uint32_t slab_nlb = 1000, obj_nlb = 1, slab_nobj, nkeep_a, nkeep_b;
+
+  err = fla_ut_dev_init(40000, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    // one object per zone, too many zones needed to span several slabs
+    err = FLA_TEST_SKIP_RETCODE;
+    goto teardown_ut_dev;
+  }
+
+  err = fla_ut_fs_create(slab_nlb, 1, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = obj_nlb
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  // three full slabs, objects of a slab next to each other
+  slab_nobj = fs->pools.entries[pool_handle->ndx].slab_nobj;
+  nkeep_a = slab_nobj / 8;
+  nkeep_b = slab_nobj - nkeep_a;
+  objs = calloc(slab_nobj * 3, sizeof(struct fla_object));
+  if ((err = FLA_ERR(!objs, "calloc()")))
+    goto release_pool;
+
+  err = fla_object_create_n(fs, pool_handle, objs, slab_nobj * 3);
+  if (FLA_ERR(err, "fla_object_create_n()"))
+    goto free_objs;
+
+  // leave the first slab nearly empty and the second nearly full
+  err = fla_object_destroy_n(fs, pool_handle, objs + nkeep_a, slab_nobj - nkeep_a);
+  if (FLA_ERR(err, "fla_object_destroy_n()"))
+    goto release_all;
+
+  err = fla_object_destroy_n(fs, pool_handle, objs + slab_nobj + nkeep_b, slab_nobj - nkeep_b);
+  if (FLA_ERR(err, "fla_object_destroy_n()"))
+    goto release_a;
+
+  err = check_frag(fs, pool_handle, 1, nkeep_a, nkeep_b);
+  if (FLA_ERR(err, "check_frag()"))
+    goto release_b;
+
+  err = fla_object_create_n(fs, pool_handle, &obj, 1);
+  if (FLA_ERR(err, "fla_object_create_n()"))
+    goto release_b;
+
+  err = FLA_ASSERTF(obj.slab_id == objs[slab_nobj].slab_id,
+                    "Object taken from slab %"PRIu32", expected the fuller slab %"PRIu32,
+                    obj.slab_id, objs[slab_nobj].slab_id);
+
+  ret = fla_object_destroy_n(fs, pool_handle, &obj, 1);
+  if (FLA_ERR(ret, "fla_object_destroy_n()"))
+    err = ret;
+
+release_b:
+  ret = fla_object_destroy_n(fs, pool_handle, objs + slab_nobj, nkeep_b);
+  if (FLA_ERR(ret, "fla_object_destroy_n()"))
+    err = ret;
+
+  ret = fla_object_destroy_n(fs, pool_handle, objs + slab_nobj * 2, slab_nobj);
+  if (FLA_ERR(ret, "fla_object_destroy_n()"))
+    err = ret;
+
+release_a:
+  ret = fla_object_destroy_n(fs, pool_handle, objs, nkeep_a);
+  if (FLA_ERR(ret, "fla_object_destroy_n()"))
+    err = ret;
+  goto free_objs;
+
+release_all:
+  ret = fla_object_destroy_n(fs, pool_handle, objs, slab_nobj * 3);
+  if (FLA_ERR(ret, "fla_object_destroy_n()"))
+    err = ret;
+
+free_objs:
+  free(objs);
+
+release_pool:
+  ret = fla_pool_destroy(fs, pool_handle);
+  if (FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+teardown_ut_fs:
+  ret = fla_ut_fs_teardown(fs);
+  if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+    err = ret;
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+    err = ret;
+
+exit:
+  return err;
+}
@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/flexalloc_tests_common.h"
+#include "flexalloc_util.h"
+#include "flexalloc_mm.h"
+#include "libflexalloc.h"
+
+/*
+ * Empty several slabs of a pool and check that the pool gives back the
+ * empty slabs above its high watermark, and the rest on fla_pool_trim().
+ */
+
+static int
+check_slabs(struct flexalloc *fs, struct fla_pool *pool_handle, uint32_t nslabs_pool,
+            uint32_t nslabs_empty, uint32_t nslabs_free)
+{
+  struct fla_pool_usage pool_usage;
+  struct fla_pool_frag frag;
+  struct fla_usage usage;
+  int err;
+
+  err = fla_pool_usage(fs, pool_handle, &pool_usage);
+  if (FLA_ERR(err, "fla_pool_usage()"))
+    return err;
+
+  err = fla_pool_frag(fs, pool_handle, &frag);
+  if (FLA_ERR(err, "fla_pool_frag()"))
+    return err;
+
+  err = fla_usage(fs, &usage);
+  if (FLA_ERR(err, "fla_usage()"))
+    return err;
+
+  err |= FLA_ASSERTF(pool_usage.nslabs == nslabs_pool, "Expected %"PRIu32" slabs in the pool, got %"PRIu32,
+                     nslabs_pool, pool_usage.nslabs);
+  err |= FLA_ASSERTF(frag.nslabs_empty == nslabs_empty, "Expected %"PRIu32" empty slabs, got %"PRIu32,
+                     nslabs_empty, frag.nslabs_empty);
+  err |= FLA_ASSERTF(usage.nslabs_free == nslabs_free, "Expected %"PRIu32" free slabs, got %"PRIu32,
+                     nslabs_free, usage.nslabs_free);
+  return err;
+}
+
+int
+main(int argc, char **argv)
+{
+  int err, ret;
+  char *pool_handle_name = "mypool";
+  struct fla_ut_dev dev;
+  struct flexalloc *fs = NULL;
+  struct fla_pool *pool_handle;
+  struct fla_object *objs;
+  struct fla_usage usage;
+  uint32_t slab_nlb = 1000, obj_nlb = 1, nslabs = 4, low = 1, high = 2, nobjs, nslabs_free;
+
+  err = fla_ut_dev_init(40000, &dev);
+  if (FLA_ERR(err, "fla_ut_dev_init()"))
+    goto exit;
+
+  if (dev._is_zns)
+  {
+    // one object per zone, too many zones needed to span several slabs
+    err = FLA_TEST_SKIP_RETCODE;
+    goto teardown_ut_dev;
+  }
+
+  err = fla_ut_fs_create(slab_nlb, 1, &dev, &fs);
+  if (FLA_ERR(err, "fla_ut_fs_create()"))
+    goto teardown_ut_dev;
+
+  err = fla_usage(fs, &usage);
+  if (FLA_ERR(err, "fla_usage()"))
+    goto teardown_ut_fs;
+  nslabs_free = usage.nslabs_free;
+
+  struct fla_pool_create_arg pool_arg =
+  {
+    .flags = 0,
+    .name = pool_handle_name,
+    .name_len = strlen(pool_handle_name),
+    .obj_nlb = obj_nlb
+  };
+
+  err = fla_pool_create(fs, &pool_arg, &pool_handle);
+  if (FLA_ERR(err, "fla_pool_create()"))
+    goto teardown_ut_fs;
+
+  err = fla_pool_set_wmark(fs, pool_handle, low, high);
+  if (FLA_ERR(err, "fla_pool_set_wmark()"))
+    goto release_pool;
+
+  nobjs = fs->pools.entries[pool_handle->ndx].slab_nobj * nslabs;
+  objs = calloc(nobjs, sizeof(struct fla_object));
+  if ((err = FLA_ERR(!objs, "calloc()")))
+    goto release_pool;
+
+  err = fla_object_create_n(fs, pool_handle, objs, nobjs);
+  if (FLA_ERR(err, "fla_object_create_n()"))
+    goto free_objs;
+
+  err = check_slabs(fs, pool_handle, nslabs, 0, nslabs_free - nslabs);
+  if (FLA_ERR(err, "check_slabs() - after create"))
+    goto release_objs;
+
+  // all slabs empty, above the high watermark the pool keeps the low watermark
+  err = fla_object_destroy_n(fs, pool_handle, objs, nobjs);
+  if (FLA_ERR(err, "fla_object_destroy_n()"))
+    goto free_objs;
+
+  err = check_slabs(fs, pool_handle, low, low, nslabs_free - low);
+  if (FLA_ERR(err, "check_slabs() - after destroy"))
+    goto free_objs;
+
+  err = fla_pool_trim(fs, pool_handle, 0);
+  if (FLA_ERR(err, "fla_pool_trim()"))
+    goto free_objs;
+
+  err = check_slabs(fs, pool_handle, 0, 0, nslabs_free);
+  FLA_ERR(err, "check_slabs() - after trim");
+  goto free_objs;
+
+release_objs:
+  ret = fla_object_destroy_n(fs, pool_handle, objs, nobjs);
+  if (FLA_ERR(ret, "fla_object_destroy_n()"))
+    err = ret;
+
+free_objs:
+  free(objs);
+
+release_pool:
+  ret = fla_pool_destroy(fs, pool_handle);
+  if (FLA_ERR(ret, "fla_pool_destroy()"))
+    err = ret;
+
+teardown_ut_fs:
+  ret = fla_ut_fs_teardown(fs);
+  if (FLA_ERR(ret, "fla_ut_fs_teardown()"))
+    err = ret;
+
+teardown_ut_dev:
+  ret = fla_ut_dev_teardown(&dev);
+  if (FLA_ERR(ret, "fla_ut_dev_teardown()"))
+    err = ret;
+
+exit:
+  return err;
+}
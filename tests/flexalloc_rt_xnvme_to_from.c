@@ -13,6 +13,8 @@ int test_to_stg(const int buf_size, const int blk_num, const int blk_size,
 int test_from_stg(const int buf_size, const int blk_num, const int blk_size,
                   struct fla_ut_lpbk * lpbk, struct xnvme_dev * xnvme_dev, char * buf);
 
+int test_pipe_to_from_stg(const int blk_size, const uint32_t mdts_nbytes);
+
 int
 main(int argc, char ** argv)
 {
@@ -54,6 +56,12 @@ main(int argc, char ** argv)
     goto free_buf;
   }
 
+  ret = test_pipe_to_from_stg(blk_size, fla_xne_dev_mdts_nbytes(xnvme_dev));
+  if(FLA_ERR(ret, "test_pipe_to_from_stg()"))
+  {
+    goto free_buf;
+  }
+
 free_buf:
   fla_xne_free_buf(xnvme_dev, buf);
 
@@ -164,3 +172,101 @@ exit:
   return ret;
 }
 
+/*
+ * Transfers spanning several MDTS sized commands go through the pipelined
+ * engine. Write and read back 4 MDTS worth of data plus one block, both with
+ * the synchronous calls and through an explicit queue with a small window.
+ */
+int
+test_pipe_to_from_stg(const int blk_size, const uint32_t mdts_nbytes)
+{
+  int ret = 0, err;
+  int blk_num = (4 * mdts_nbytes / blk_size) + 1;
+  size_t buf_size = (size_t)blk_num * blk_size;
+  struct fla_ut_lpbk * lpbk;
+  struct xnvme_dev * xnvme_dev;
+  struct fla_xne_queue * q;
+  char * w_buf, * r_buf;
+
+  ret = fla_ut_lpbk_dev_alloc(blk_size, blk_num, &lpbk);
+  if(FLA_ERR(ret, "fla_ut_lpbk_dev_alloc()"))
+    goto exit;
+
+  ret = fla_xne_dev_open(lpbk->dev_name, NULL, &xnvme_dev);
+  if(FLA_ERR(ret, "fla_xne_dev_open()"))
+    goto loop_free;
+
+  w_buf = fla_xne_alloc_buf(xnvme_dev, buf_size);
+  if((ret = FLA_ERR(!w_buf, "fla_xne_alloc_buf()")))
+    goto close_dev;
+
+  r_buf = fla_xne_alloc_buf(xnvme_dev, buf_size);
+  if((ret = FLA_ERR(!r_buf, "fla_xne_alloc_buf()")))
+    goto free_w_buf;
+
+  struct xnvme_lba_range range = fla_xne_lba_range_from_slba_naddrs(xnvme_dev, 0, blk_num);
+  if((ret = FLA_ERR(range.attr.is_valid != 1, "fla_xne_lba_range_from_slba_naddrs()")))
+    goto free_r_buf;
+
+  struct fla_xne_io xne_io = {.dev = xnvme_dev, .lba_range = &range, .fla_dp = NULL};
+
+  fla_t_fill_buf_random(w_buf, buf_size);
+  memset(r_buf, 0, buf_size);
+
+  xne_io.buf = w_buf;
+  ret = fla_xne_sync_seq_w_xneio(&xne_io);
+  if(FLA_ERR(ret, "fla_xne_sync_seq_w_xneio()"))
+    goto free_r_buf;
+
+  xne_io.buf = r_buf;
+  ret = fla_xne_sync_seq_r_xneio(&xne_io);
+  if(FLA_ERR(ret, "fla_xne_sync_seq_r_xneio()"))
+    goto free_r_buf;
+
+  ret = FLA_ASSERT(memcmp(w_buf, r_buf, buf_size) == 0, "Synchronous pipelined read back differs");
+  if(FLA_ERR(ret, "FLA_ASSERT()"))
+    goto free_r_buf;
+
+  ret = fla_xne_queue_init(xnvme_dev, 2, &q);
+  if(FLA_ERR(ret, "fla_xne_queue_init()"))
+    goto free_r_buf;
+
+  fla_t_fill_buf_random(w_buf, buf_size);
+  memset(r_buf, 0, buf_size);
+
+  xne_io.io_type = FLA_IO_DATA_WRITE;
+  xne_io.buf = w_buf;
+  ret = fla_xne_pipe_seq_xneio(q, &xne_io, 2);
+  if(FLA_ERR(ret, "fla_xne_pipe_seq_xneio()"))
+    goto term_queue;
+
+  xne_io.io_type = FLA_IO_DATA_READ;
+  xne_io.buf = r_buf;
+  ret = fla_xne_pipe_seq_xneio(q, &xne_io, 2);
+  if(FLA_ERR(ret, "fla_xne_pipe_seq_xneio()"))
+    goto term_queue;
+
+  ret = FLA_ASSERT(memcmp(w_buf, r_buf, buf_size) == 0, "Windowed pipelined read back differs");
+
+term_queue:
+  err = fla_xne_queue_term(q);
+  if(FLA_ERR(err, "fla_xne_queue_term()") && !ret)
+    ret = err;
+
+free_r_buf:
+  fla_xne_free_buf(xnvme_dev, r_buf);
+
+free_w_buf:
+  fla_xne_free_buf(xnvme_dev, w_buf);
+
+close_dev:
+  xnvme_dev_close(xnvme_dev);
+
+loop_free:
+  err = fla_ut_lpbk_dev_free(lpbk);
+  if(FLA_ERR(err, "fla_ut_lpbk_dev_free()") && !ret)
+    ret = err;
+
+exit:
+  return ret;
+}
@@ -8,6 +8,9 @@
 #include "flexalloc_xnvme_env.h"
 #include "flexalloc_util.h"
 #include "libflexalloc.h"
+#include "flexalloc_ll.h"
+#include "flexalloc_freelist.h"
+#include "flexalloc_slabcache.h"
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -704,3 +707,94 @@ fla_t_fill_buf_random(char * buf, const size_t size)
   }
   *(buf + size) = '\0';
 }
+
+int
+fla_ut_pool_slabs_check(struct flexalloc *fs, struct fla_pool const *pool_handle,
+                        uint64_t *nobjs)
+{
+  struct fla_pool_entry *pool_entry = &fs->pools.entries[pool_handle->ndx];
+  uint32_t heads[3] = {pool_entry->empty_slabs, pool_entry->full_slabs, pool_entry->partial_slabs};
+  struct fla_slab_header *slab;
+  uint32_t nreserved;
+  int err;
+
+  *nobjs = 0;
+  for (size_t i = 0; i < 3; ++i)
+  {
+    for (uint32_t id = heads[i]; id != FLA_LINKED_LIST_NULL; id = slab->next)
+    {
+      slab = fla_slab_header_ptr(id, fs);
+      nreserved = fla_flist_num_reserved(fs->slab_cache._head[id].freelist);
+
+      err = FLA_ASSERTF(nreserved == slab->refcount,
+                        "Slab %"PRIu32" counts %"PRIu32" objects, its freelist %"PRIu32,
+                        id, slab->refcount, nreserved);
+      if (err)
+        return err;
+
+      *nobjs += slab->refcount;
+    }
+  }
+  return 0;
+}
+
+static int
+fla_ut_obj_cmp(const void *a, const void *b)
+{
+  struct fla_object const *x = a, *y = b;
+
+  if (x->slab_id != y->slab_id)
+    return x->slab_id < y->slab_id ? -1 : 1;
+  if (x->entry_ndx != y->entry_ndx)
+    return x->entry_ndx < y->entry_ndx ? -1 : 1;
+  return 0;
+}
+
+int
+fla_ut_objs_check_unique(struct fla_object const *objs, uint32_t nobjs)
+{
+  struct fla_object *sorted;
+  int err = 0;
+
+  if (!nobjs)
+    return 0;
+
+  // sort a copy, duplicates end up next to each other
+  sorted = malloc(nobjs * sizeof(*sorted));
+  if (FLA_ERR(!sorted, "malloc()"))
+    return -ENOMEM;
+  memcpy(sorted, objs, nobjs * sizeof(*sorted));
+  qsort(sorted, nobjs, sizeof(*sorted), fla_ut_obj_cmp);
+
+  for (uint32_t i = 1; i < nobjs && !err; ++i)
+  {
+    err = FLA_ASSERTF(fla_ut_obj_cmp(&sorted[i - 1], &sorted[i]) != 0,
+                      "Object %"PRIu32" of slab %"PRIu32" is held twice",
+                      sorted[i].entry_ndx, sorted[i].slab_id);
+  }
+
+  free(sorted);
+  return err;
+}
+
+uint32_t
+fla_ut_md_ndirty(struct flexalloc *fs)
+{
+  uint32_t ndirty = 0;
+
+  for (uint32_t i = 0; i < FLA_CEIL_DIV(fla_geo_nblocks(&fs->geo), 64); ++i)
+    ndirty += __builtin_popcountll(__atomic_load_n(&fs->md_dirty[i], __ATOMIC_RELAXED));
+
+  return ndirty;
+}
+
+uint32_t
+fla_ut_slabs_ndirty(struct flexalloc *fs)
+{
+  uint32_t ndirty = 0;
+
+  for (uint32_t i = 0; i < FLA_CEIL_DIV(fs->geo.nslabs, 64); ++i)
+    ndirty += __builtin_popcountll(__atomic_load_n(&fs->slab_cache._dirty[i], __ATOMIC_RELAXED));
+
+  return ndirty;
+}
@@ -139,6 +139,48 @@ fla_ut_lpbk_offs_blk_fill(struct fla_ut_lpbk * lpbk);
 void
 fla_t_fill_buf_random(char * buf, const size_t size);
 
+/**
+ * Walk the slabs of a pool and check their refcounts against their freelists.
+ *
+ * @param fs flexalloc handle
+ * @param pool_handle pool whose empty, full and partial slabs are walked
+ * @param nobjs set to the sum of the slab refcounts
+ * @return 0 on success, != 0 if a slab refcount differs from its freelist.
+ */
+int
+fla_ut_pool_slabs_check(struct flexalloc *fs, struct fla_pool const *pool_handle,
+                        uint64_t *nobjs);
+
+/**
+ * Check that no object appears twice in a set of objects.
+ *
+ * @param objs objects to check, left as they are
+ * @param nobjs number of objects in objs
+ * @return 0 on success, != 0 if two objects name the same slab entry.
+ */
+int
+fla_ut_objs_check_unique(struct fla_object const *objs, uint32_t nobjs);
+
+/**
+ * Count the metadata blocks of a handle marked dirty.
+ *
+ * Safe to call while a checkpoint thread clears the marks.
+ *
+ * @param fs flexalloc handle
+ * @return number of dirty blocks of the metadata buffer
+ */
+uint32_t
+fla_ut_md_ndirty(struct flexalloc *fs);
+
+/**
+ * Count the slab freelists of a handle marked dirty.
+ *
+ * @param fs flexalloc handle
+ * @return number of slabs whose freelist awaits a flush
+ */
+uint32_t
+fla_ut_slabs_ndirty(struct flexalloc *fs);
+
 /**
  * Assert functions for the testing frame work
  */
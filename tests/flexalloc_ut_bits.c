@@ -20,6 +20,21 @@ test_ntz()
   return err;
 }
 
+int
+test_ntz64()
+{
+  int err = 0;
+  err |= FLA_ASSERT(ntz64(0) == 64, "expected ntz64(0) == 64");
+
+  err |= FLA_ASSERT(ntz64(~0ull) == 0, "expected ntz64(~0) == 0");
+
+  err |= FLA_ASSERT(ntz64(256) == 8, "expected ntz64(256) == 8");
+
+  err |= FLA_ASSERT(ntz64(1ull << 40) == 40, "expected ntz64(1 << 40) == 40");
+
+  return err;
+}
+
 #define ASSERT_SET_BITS(val, num_set)             \
   FLA_ASSERTF(count_set_bits(val) == num_set, "%u should have %u set bits", val, num_set)
 
@@ -52,6 +67,7 @@ main(int argc, char **argv)
   int err = 0;
 
   err |= RUN_TEST(test_ntz);
+  err |= RUN_TEST(test_ntz64);
   err |= RUN_TEST(test_count_set_bits);
 
   return err;
@@ -1,16 +1,18 @@
 // Copyright (C) 2021 Jesper Devantier <j.devantier@samsung.com>
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <errno.h>
 #include <string.h>
 #include "flexalloc_freelist.h"
+#include "flexalloc_freelist_kern.h"
 #include "flexalloc_bits.h"
 #include "flexalloc_util.h"
 #include "flexalloc_tests_common.h"
 
-#define FLIST_ENTRY(f, n) &(f)[1 + n]
+#define FLIST_ENTRY(f, n) &(f)->words[1 + n]
 
 #define ASSERT_FLIST_LEN(flist, len)            \
   FLA_ASSERTF(fla_flist_len(flist) == len, "got: %"PRIu32, fla_flist_len(flist))
@@ -71,14 +73,20 @@ binval(const char *bstring)
 void
 _print_flist(freelist_t flist)
 {
-  uint32_t elems = FLA_FREELIST_U32_ELEMS(*flist);
+  uint32_t elems = FLA_FREELIST_U32_ELEMS(fla_flist_len(flist));
   for (uint32_t i = 0; i < elems; i++)
   {
     fprintf(stdout, "   elem %2d: ", i);
-    print_binary(sizeof(uint32_t), &flist[1 + i]);
+    print_binary(sizeof(uint32_t), FLIST_ENTRY(flist, i));
   }
 }
 
+static int
+__flist_bit_free(freelist_t flist, uint32_t ndx)
+{
+  return (*FLIST_ENTRY(flist, ndx / 32) >> (ndx % 32)) & 1U;
+}
+
 int
 test_byte_val()
 {
@@ -122,7 +130,7 @@ test_flist_init_helper(uint32_t len, uint32_t last_word)
 exit:
   if (err && f)
     _print_flist(f);
-  if (f) free(f);
+  fla_flist_free(f);
   return err;
 }
 
@@ -186,8 +194,8 @@ test_flist_reset(uint32_t len)
     goto exit;
 
 exit:
-  if (f1) free(f1);
-  if (f2) free(f2);
+  fla_flist_free(f1);
+  fla_flist_free(f2);
   return err;
 }
 
@@ -227,7 +235,7 @@ test_flist_37_alloc_free_max()
   FLA_ASSERTF(*FLIST_ENTRY(f, 0) == 3, "got: %"PRIu32, *FLIST_ENTRY(f, 0));
 
 exit:
-  if (f) free(f);
+  fla_flist_free(f);
   return err;
 }
 
@@ -278,10 +286,554 @@ test_alloc_free_deep()
   err |= FLA_ASSERT(fla_flist_entries_alloc(f, 1) == 7, "unexpected alloc");
 
 exit:
-  if (f) free(f);
+  fla_flist_free(f);
+  return err;
+}
+
+/*
+ * Allocation in a list spanning several top level summary words must return
+ * the lowest free entry, wherever the freed entries are.
+ */
+int
+test_flist_summary(uint32_t len)
+{
+  int err = 0, ret;
+  uint32_t holes[] = {len - 1, 0, 4095, 4096, 131071, 131072, len / 2};
+  uint32_t nholes = sizeof(holes) / sizeof(holes[0]);
+  uint32_t expected;
+  freelist_t f = NULL;
+
+  if ((err = FLA_ASSERT(!fla_flist_new(len, &f), "failed to create freelist")))
+    return err;
+
+  for (uint32_t i = 0; i < len; i++)
+  {
+    if ((err = FLA_ASSERTF(fla_flist_entries_alloc(f, 1) == i, "alloc failed for i=%u", i)))
+      goto exit;
+  }
+
+  if ((err = FLA_ASSERT(fla_flist_entries_alloc(f, 1) == -1, "expected failure to allocate")))
+    goto exit;
+
+  for (uint32_t i = 0; i < nholes; i++)
+    err |= FLA_ASSERT(fla_flist_entry_free(f, holes[i]) == 0, "expected free to work");
+
+  err |= FLA_ASSERT(fla_flist_entry_free(f, len) == -1, "expected free past the end to fail");
+  err |= FLA_ASSERTF(fla_flist_num_reserved(f) == len - nholes, "got: %"PRIu32,
+                     fla_flist_num_reserved(f));
+  if (err)
+    goto exit;
+
+  // holes come back lowest index first
+  for (uint32_t i = 0; i < nholes; i++)
+  {
+    expected = UINT32_MAX;
+    for (uint32_t j = 0; j < nholes; j++)
+    {
+      if (holes[j] < expected)
+        expected = holes[j];
+    }
+
+    ret = fla_flist_entries_alloc(f, 1);
+    if ((err = FLA_ASSERTF(ret == expected, "expected %"PRIu32", got %d", expected, ret)))
+      goto exit;
+
+    for (uint32_t j = 0; j < nholes; j++)
+    {
+      if (holes[j] == expected)
+        holes[j] = UINT32_MAX;
+    }
+  }
+
+  err = FLA_ASSERT(fla_flist_entries_alloc(f, 1) == -1, "expected failure to allocate");
+
+exit:
+  fla_flist_free(f);
+  return err;
+}
+
+/*
+ * The summary is not stored with the freelist. Loading a freelist from a
+ * copy of its buffer must rebuild it from the freelist words.
+ */
+int
+test_flist_load(uint32_t len)
+{
+  int err = 0;
+  freelist_t f = NULL, loaded = NULL;
+  void *buf = NULL;
+
+  if ((err = FLA_ASSERT(!fla_flist_new(len, &f), "failed to create freelist")))
+    return err;
+
+  for (uint32_t i = 0; i < len - 2; i++)
+    fla_flist_entries_alloc(f, 1);
+  fla_flist_entry_free(f, 33);
+
+  buf = malloc(fla_flist_size(len));
+  if ((err = FLA_ASSERT(buf != NULL, "malloc()")))
+    goto exit;
+  memcpy(buf, fla_flist_data(f), fla_flist_size(len));
+
+  if ((err = FLA_ASSERT(!fla_flist_load(buf, &loaded), "failed to load freelist")))
+    goto exit;
+
+  if ((err = ASSERT_FLIST_LEN(loaded, len)))
+    goto exit;
+
+  if ((err = FLA_ASSERT(flist_eql(f, loaded), "expected freelists to be equal")))
+    goto exit;
+
+  err |= FLA_ASSERT(fla_flist_entries_alloc(loaded, 1) == 33, "unexpected alloc");
+  err |= FLA_ASSERT(fla_flist_entries_alloc(loaded, 1) == len - 2, "unexpected alloc");
+  err |= FLA_ASSERT(fla_flist_entries_alloc(loaded, 1) == len - 1, "unexpected alloc");
+  err |= FLA_ASSERT(fla_flist_entries_alloc(loaded, 1) == -1, "expected failure to allocate");
+
+  // re-initializing the buffer frees every entry again
+  fla_flist_free(loaded);
+  loaded = NULL;
+  if ((err |= FLA_ASSERT(!fla_flist_init(buf, len, &loaded), "failed to init freelist")))
+    goto exit;
+
+  err |= FLA_ASSERT(fla_flist_num_reserved(loaded) == 0, "expected an empty freelist");
+  err |= FLA_ASSERT(fla_flist_entries_alloc(loaded, 1) == 0, "unexpected alloc");
+
+exit:
+  fla_flist_free(loaded);
+  free(buf);
+  fla_flist_free(f);
+  return err;
+}
+
+// lowest run of num free entries in the shadow copy, -1 if there is none
+static int
+shadow_run_find(char const *shadow, uint32_t len, uint32_t num)
+{
+  uint32_t run = 0;
+
+  for (uint32_t i = 0; i < len; i++)
+  {
+    run = shadow[i] ? run + 1 : 0;
+    if (run == num)
+      return i + 1 - num;
+  }
+  return -1;
+}
+
+/*
+ * Allocate and free runs of random lengths and check every allocation against
+ * a lowest-fit search over a byte-per-entry shadow of the freelist.
+ */
+int
+test_flist_run_random(uint32_t len, uint32_t niter)
+{
+  int err = 0, ndx, expected;
+  uint32_t num, nfree = len;
+  char *shadow = malloc(len);
+  freelist_t f = NULL;
+
+  if ((err = FLA_ASSERT(shadow != NULL, "malloc()")))
+    return err;
+  memset(shadow, 1, len);
+
+  if ((err = FLA_ASSERT(!fla_flist_new(len, &f), "failed to create freelist")))
+    goto exit;
+
+  srand(len);
+  for (uint32_t i = 0; i < niter; i++)
+  {
+    num = 1 + rand() % (rand() % 4 ? 8 : 100);
+
+    if (rand() % 3)
+    {
+      expected = shadow_run_find(shadow, len, num);
+      ndx = fla_flist_run_alloc(f, num);
+      if ((err = FLA_ASSERTF(ndx == expected, "run of %"PRIu32": expected %d, got %d",
+                             num, expected, ndx)))
+        goto exit;
+
+      if (ndx >= 0)
+      {
+        memset(shadow + ndx, 0, num);
+        nfree -= num;
+      }
+    }
+    else
+    {
+      ndx = rand() % len;
+      if (ndx + num > len)
+        num = len - ndx;
+
+      if ((err = FLA_ASSERT(fla_flist_run_free(f, ndx, num) == 0, "expected free to work")))
+        goto exit;
+
+      for (uint32_t j = ndx; j < ndx + num; j++)
+        nfree += !shadow[j];
+      memset(shadow + ndx, 1, num);
+    }
+
+    if ((err = FLA_ASSERTF(fla_flist_num_free(f) == nfree,
+                           "expected %"PRIu32" free entries, got %"PRIu32,
+                           nfree, fla_flist_num_free(f))))
+      goto exit;
+  }
+
+  for (uint32_t i = 0; i < len; i++)
+  {
+    if ((err = FLA_ASSERTF(__flist_bit_free(f, i) == shadow[i],
+                           "entry %"PRIu32" differs from the shadow", i)))
+      goto exit;
+  }
+
+exit:
+  fla_flist_free(f);
+  free(shadow);
+  return err;
+}
+
+int
+test_flist_run()
+{
+  int err = 0;
+  freelist_t f = NULL;
+
+  if ((err = FLA_ASSERT(!fla_flist_new(200, &f), "failed to create freelist")))
+    return err;
+
+  // runs crossing word boundaries
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 30) == 0, "unexpected alloc");
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 5) == 30, "unexpected alloc");
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 70) == 35, "unexpected alloc");
+  err |= ASSERT_WORD(f, 0, 0);
+  err |= ASSERT_WORD(f, 1, 0);
+  err |= ASSERT_WORD(f, 2, 0);
+  err |= ASSERT_WORD(f, 3, UINT32_MAX << 9);
+
+  // a hole too small is skipped
+  err |= FLA_ASSERT(fla_flist_run_free(f, 10, 4) == 0, "expected free to work");
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 5) == 105, "unexpected alloc");
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 4) == 10, "unexpected alloc");
+
+  // masked free spanning full words
+  err |= FLA_ASSERT(fla_flist_run_free(f, 20, 80) == 0, "expected free to work");
+  err |= ASSERT_WORD(f, 0, binval("1111 1111 1111 0000 0000 0000 0000 0000"));
+  err |= ASSERT_WORD(f, 1, UINT32_MAX);
+  err |= ASSERT_WORD(f, 2, UINT32_MAX);
+  // 96..99 freed, 100..113 still taken
+  err |= ASSERT_WORD(f, 3, ((UINT32_MAX << 14) | binval("1111")));
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 80) == 20, "unexpected alloc");
+
+  // out of bounds and oversized runs
+  err |= FLA_ASSERT(fla_flist_run_free(f, 190, 11) == -1, "expected free past the end to fail");
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 201) == -1, "expected oversized run to fail");
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 0) == -1, "expected empty run to fail");
+
+  // the last run may end at the last entry, but not past it
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 90) == 110, "unexpected alloc");
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, 1) == -1, "expected failure to allocate");
+
+  if (err)
+    _print_flist(f);
+
+  fla_flist_free(f);
+  return err;
+}
+
+/*
+ * The free count must follow single and run allocations, idempotent frees,
+ * resets and loads.
+ */
+int
+test_flist_count(uint32_t len)
+{
+  int err = 0;
+  freelist_t f = NULL, loaded = NULL;
+
+  if ((err = FLA_ASSERT(!fla_flist_new(len, &f), "failed to create freelist")))
+    return err;
+
+  err |= FLA_ASSERT(fla_flist_num_free(f) == len, "expected every entry free");
+  err |= FLA_ASSERT(fla_flist_num_reserved(f) == 0, "expected no entry reserved");
+
+  err |= FLA_ASSERT(fla_flist_entries_alloc(f, 1) == 0, "unexpected alloc");
+  err |= FLA_ASSERT(fla_flist_entries_alloc(f, 40) == 1, "unexpected alloc");
+  err |= FLA_ASSERT(fla_flist_num_reserved(f) == 41, "expected 41 reserved");
+
+  // freeing free entries leaves the count alone
+  err |= FLA_ASSERT(!fla_flist_entry_free(f, 0), "expected free to work");
+  err |= FLA_ASSERT(!fla_flist_entry_free(f, 0), "expected free to work");
+  err |= FLA_ASSERT(!fla_flist_entries_free(f, 30, 20), "expected free to work");
+  err |= FLA_ASSERT(!fla_flist_entries_free(f, 30, 20), "expected free to work");
+  err |= FLA_ASSERT(fla_flist_num_reserved(f) == 29, "expected 29 reserved");
+
+  // failed calls leave the count alone
+  err |= FLA_ASSERT(fla_flist_entry_free(f, len) == -1, "expected free past the end to fail");
+  err |= FLA_ASSERT(fla_flist_run_alloc(f, len) == -1, "expected oversized run to fail");
+  err |= FLA_ASSERT(fla_flist_num_reserved(f) == 29, "expected 29 reserved");
+
+  err |= FLA_ASSERT(!fla_flist_load(fla_flist_data(f), &loaded), "failed to load freelist");
+  if (!err)
+    err |= FLA_ASSERT(fla_flist_num_free(loaded) == fla_flist_num_free(f),
+                      "expected the loaded freelist to count the same");
+
+  fla_flist_reset(f);
+  err |= FLA_ASSERT(fla_flist_num_free(f) == len, "expected every entry free after reset");
+
+  fla_flist_free(loaded);
+  fla_flist_free(f);
+  return err;
+}
+
+/*
+ * The iterator must visit exactly the reserved, or the free, entries in
+ * index order and never the padding bits past the end of the list.
+ */
+int
+test_flist_iter(uint32_t len)
+{
+  int err = 0;
+  uint32_t ndx, expected, nvisited, batch[7], nbatch;
+  freelist_t f = NULL;
+  struct fla_flist_iter it;
+
+  if ((err = FLA_ASSERT(!fla_flist_new(len, &f), "failed to create freelist")))
+    return err;
+
+  srand(len);
+  for (uint32_t i = 0; i < len / 2; i++)
+    fla_flist_entries_alloc(f, 1 + rand() % 3);
+  for (uint32_t i = 0; i < len / 4; i++)
+    fla_flist_entry_free(f, rand() % len);
+
+  for (int reserved = 0; reserved < 2; reserved++)
+  {
+    expected = 0;
+    nvisited = 0;
+    fla_flist_iter_init(&it, f, reserved);
+    while (fla_flist_iter_next(&it, &ndx))
+    {
+      while (expected < len && __flist_bit_free(f, expected) == reserved)
+        expected++;
+
+      if ((err = FLA_ASSERTF(ndx == expected, "visited %"PRIu32", expected %"PRIu32,
+                             ndx, expected)))
+        goto exit;
+
+      expected++;
+      nvisited++;
+    }
+
+    expected = reserved ? fla_flist_num_reserved(f) : fla_flist_num_free(f);
+    if ((err = FLA_ASSERTF(nvisited == expected, "visited %"PRIu32" entries, expected %"PRIu32,
+                           nvisited, expected)))
+      goto exit;
+
+    // the batches must add up to the same walk
+    ndx = 0;
+    fla_flist_iter_init(&it, f, reserved);
+    while ((nbatch = fla_flist_iter_batch(&it, batch, 7)))
+    {
+      for (uint32_t i = 0; i < nbatch; i++)
+        err |= FLA_ASSERTF(__flist_bit_free(f, batch[i]) != reserved,
+                           "batch returned entry %"PRIu32, batch[i]);
+      ndx += nbatch;
+    }
+
+    if ((err |= FLA_ASSERTF(ndx == nvisited, "batches returned %"PRIu32" entries, expected %"PRIu32,
+                            ndx, nvisited)))
+      goto exit;
+  }
+
+exit:
+  fla_flist_free(f);
+  return err;
+}
+
+struct flist_atomic_arg
+{
+  freelist_t flist;
+  /// one byte per entry, set while a thread holds the entry
+  uint8_t *owned;
+  /// entries not reserved by any thread
+  int32_t *avail;
+  uint32_t niter;
+  uint32_t seed;
+  int err;
+};
+
+static void *
+flist_atomic_worker(void *varg)
+{
+  struct flist_atomic_arg *arg = varg;
+  uint32_t held[16], nheld, seed = arg->seed;
+  int32_t avail;
+  int ndx;
+
+  for (uint32_t i = 0; i < arg->niter && !arg->err; i++)
+  {
+    nheld = 1 + rand_r(&seed) % 16;
+    for (uint32_t j = 0; j < nheld; j++)
+    {
+      // reserve an entry by count first, the allocation may then not fail
+      avail = __atomic_load_n(arg->avail, __ATOMIC_SEQ_CST);
+      do
+      {
+        if (!avail)
+          break;
+      }
+      while (!__atomic_compare_exchange_n(arg->avail, &avail, avail - 1, false,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+      if (!avail)
+      {
+        nheld = j;
+        break;
+      }
+
+      ndx = fla_flist_entry_alloc_atomic(arg->flist);
+      if ((arg->err = FLA_ASSERT(ndx >= 0, "reserved allocation failed")))
+        return NULL;
+
+      if ((arg->err = FLA_ASSERTF(!__atomic_exchange_n(&arg->owned[ndx], 1, __ATOMIC_SEQ_CST),
+                                  "entry %d handed out twice", ndx)))
+        return NULL;
+
+      held[j] = ndx;
+    }
+
+    for (uint32_t j = 0; j < nheld; j++)
+    {
+      __atomic_store_n(&arg->owned[held[j]], 0, __ATOMIC_SEQ_CST);
+      arg->err |= FLA_ASSERT(!fla_flist_entry_free_atomic(arg->flist, held[j]), "free failed");
+      __atomic_fetch_add(arg->avail, 1, __ATOMIC_SEQ_CST);
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Threads allocating and freeing with the atomic calls must never share an
+ * entry, and once they are done the list, its count and its summary must be
+ * back to a fully free list.
+ */
+int
+test_flist_atomic(uint32_t len, uint32_t nthreads, uint32_t niter)
+{
+  int err = 0;
+  int32_t avail = len;
+  freelist_t f = NULL;
+  pthread_t threads[8];
+  struct flist_atomic_arg args[8];
+  uint8_t *owned = calloc(len, 1);
+  uint32_t w, s, last, nwords = FLA_FREELIST_U32_ELEMS(len);
+
+  if ((err = FLA_ASSERT(owned != NULL, "calloc()")))
+    return err;
+
+  if ((err = FLA_ASSERT(!fla_flist_new(len, &f), "failed to create freelist")))
+    goto free_owned;
+
+  for (uint32_t i = 0; i < nthreads; i++)
+  {
+    args[i] = (struct flist_atomic_arg)
+    {
+      .flist = f, .owned = owned, .avail = &avail, .niter = niter, .seed = i + 1
+    };
+    if ((err = FLA_ASSERT(!pthread_create(&threads[i], NULL, flist_atomic_worker, &args[i]),
+                          "pthread_create()")))
+    {
+      nthreads = i;
+      break;
+    }
+  }
+
+  for (uint32_t i = 0; i < nthreads; i++)
+  {
+    pthread_join(threads[i], NULL);
+    err |= args[i].err;
+  }
+  if (err)
+    goto exit;
+
+  err |= FLA_ASSERTF(fla_flist_num_free(f) == len, "got: %"PRIu32, fla_flist_num_free(f));
+  for (w = 0; w < nwords; w++)
+  {
+    last = w + 1 < nwords || len % 32 == 0 ? UINT32_MAX : ~0u >> (32 - len % 32);
+    err |= ASSERT_WORD(f, w, last);
+    s = w / 64;
+    err |= FLA_ASSERTF((f->summary[s] >> (w % 64)) & 1, "summary bit of word %"PRIu32" clear", w);
+    err |= FLA_ASSERTF((f->top[s / 64] >> (s % 64)) & 1, "top bit of summary %"PRIu32" clear", s);
+  }
+
+  // and the list must still allocate in order
+  for (uint32_t i = 0; i < len && !err; i++)
+    err |= FLA_ASSERTF(fla_flist_entries_alloc(f, 1) == i, "alloc failed for i=%u", i);
+
+exit:
+  fla_flist_free(f);
+free_owned:
+  free(owned);
   return err;
 }
 
+/*
+ * Every kernel implementation the CPU supports must agree with a plain loop
+ * over the words, including for ranges not a multiple of the vector width.
+ */
+int
+test_flist_kern()
+{
+  int err = 0;
+  uint32_t nwords = 1000, nset, expected;
+  uint32_t *words = malloc(sizeof(uint32_t) * (nwords + 1));
+  uint32_t skips[] = {0, UINT32_MAX};
+
+  if ((err = FLA_ASSERT(words != NULL, "malloc()")))
+    return err;
+
+  for (int isa = FLA_FLIST_KERN_SCALAR; isa <= FLA_FLIST_KERN_AVX512; isa++)
+  {
+    if (fla_flist_kern_select(isa))
+      continue;
+
+    // offset by one word, as freelist words follow the length
+    for (uint32_t i = 1; i <= nwords; i++)
+      words[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    for (uint32_t len = 0; len <= nwords; len += 37)
+    {
+      nset = 0;
+      for (uint32_t i = 0; i < len; i++)
+        nset += count_set_bits(words[1 + i]);
+
+      err |= FLA_ASSERTF(fla_flist_kern_popcount(words + 1, len) == nset,
+                         "isa %d, popcount of %"PRIu32" words", isa, len);
+    }
+
+    for (uint32_t s = 0; s < 2; s++)
+    {
+      for (uint32_t i = 1; i <= nwords; i++)
+        words[i] = skips[s];
+
+      for (uint32_t pos = 0; pos < nwords; pos += 13)
+      {
+        words[1 + pos] = skips[s] ^ (1u << (pos % 32));
+        for (uint32_t from = 0; from <= pos + 1; from += 1 + from / 2)
+        {
+          expected = from <= pos ? pos : nwords;
+          err |= FLA_ASSERTF(fla_flist_kern_find(words + 1, from, nwords, skips[s]) == expected,
+                             "isa %d, find from %"PRIu32" with word %"PRIu32" set", isa, from, pos);
+        }
+        words[1 + pos] = skips[s];
+      }
+    }
+
+    err |= test_flist_summary(200000);
+    err |= test_flist_load(70000);
+  }
+
+  free(words);
+  return err;
+}
 
 int
 main(int argc, char **argv)
@@ -308,5 +860,27 @@ main(int argc, char **argv)
   err |= test_flist_reset(32);
   err |= test_flist_reset(33);
 
+  err |= test_flist_summary(200000);
+  err |= test_flist_summary(64 * 64 * 32 * 3);
+  err |= test_flist_load(37);
+  err |= test_flist_load(70000);
+
+  err |= test_flist_run();
+  err |= test_flist_run_random(1000, 20000);
+  err |= test_flist_run_random(70000, 5000);
+
+  err |= test_flist_count(100);
+  err |= test_flist_count(70000);
+
+  err |= test_flist_iter(1);
+  err |= test_flist_iter(32);
+  err |= test_flist_iter(37);
+  err |= test_flist_iter(70000);
+
+  err |= test_flist_kern();
+
+  err |= test_flist_atomic(40, 8, 20000);
+  err |= test_flist_atomic(70000, 8, 2000);
+
   return err;
 }